@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <cstring>
@@ -32,6 +33,8 @@
 #include <daw/daw_string_view.h>
 #include <daw/iterator/daw_iterator.h>
 
+#include "crypto_telemetry.h"
+
 namespace daw {
 	namespace crypto {
 		namespace aes {
@@ -48,6 +51,15 @@ namespace daw {
 				                                    AES128_NUM_ROUNDS::value + 1u )>;
 
 				using AES128_KEY_SIZE = std::integral_constant<uint8_t, 16u>;
+
+				/// @brief What the modes built on the AES-NI helpers report to
+				/// telemetry
+				constexpr telemetry_backend_t const aes_telemetry_backend =
+#if defined( __AES__ )
+				  telemetry_backend_t::aesni;
+#else
+				  telemetry_backend_t::scalar;
+#endif
 			} // namespace impl
 
 			using cipher_t = std::array<uint8_t, 16>;
@@ -133,6 +145,19 @@ namespace daw {
 					}
 				}
 
+				/// @brief Add a round key from the key schedule, which is stored a
+				/// column at a time, to the row ordered state
+				constexpr void
+				aes_add_schedule_round_key( daw::span<uint8_t> state,
+				                            daw::span<uint8_t const> key ) noexcept {
+					for( uint_fast8_t r = 0; r < AES_COLUMN_SIZE::value; ++r ) {
+						for( uint_fast8_t c = 0; c < AES_NUM_COLUMNS::value; ++c ) {
+							state[r * AES_COLUMN_SIZE::value + c] ^=
+							  key[c * AES_NUM_COLUMNS::value + r];
+						}
+					}
+				}
+
 				constexpr void aes_shift_rows( daw::span<uint8_t> block ) noexcept {
 					// Rotate each item left by n for each row
 					for( int_fast8_t n = 1; n < AES_NUM_COLUMNS::value; ++n ) {
@@ -280,17 +305,16 @@ namespace daw {
 					                msg[3], msg[7],  msg[11], msg[15]};
 				}
 
-				/// @brief Encrypt a block of uint8_t's.
+				/// @brief Encrypt a block of uint8_t's with an expanded key
 				constexpr cipher_t
-				aes_encrypt_128_block( daw::span<uint8_t const> input,
-				                       daw::span<uint8_t const> key ) noexcept {
-
-					auto const key_sched = impl::aes128_key_schedule( key );
+				aes_encrypt_128_block(
+				  daw::span<uint8_t const> input,
+				  aes128_key_schedule_t const &key_sched ) noexcept {
 					auto result = convert_state( input );
 					auto state = make_span( result );
 
 					auto key_round = make_span( key_sched );
-					impl::aes_add_round_key( state, key_round );
+					impl::aes_add_schedule_round_key( state, key_round );
 
 					for( uint_fast8_t round = 1; round < AES128_NUM_ROUNDS::value;
 					     ++round ) {
@@ -299,32 +323,37 @@ namespace daw {
 						impl::aes_mix_columns( state );
 
 						key_round.remove_prefix( AES_BLOCK_SIZE::value );
-						impl::aes_add_round_key( state, key_round );
+						impl::aes_add_schedule_round_key( state, key_round );
 					}
 					impl::aes_sub_bytes( state );
 					impl::aes_shift_rows( state );
 
 					key_round.remove_prefix( AES_BLOCK_SIZE::value );
-					impl::aes_add_round_key( state, key_round );
+					impl::aes_add_schedule_round_key( state, key_round );
 
-					return result;
-					// return convert_state( make_span( result ) );
+					return convert_state( make_span( result ) );
 				}
 
+				/// @brief Encrypt a block of uint8_t's.
 				constexpr cipher_t
-				aes_decrypt_128_block( daw::span<uint8_t const> input,
+				aes_encrypt_128_block( daw::span<uint8_t const> input,
 				                       daw::span<uint8_t const> key ) noexcept {
+					return aes_encrypt_128_block( input,
+					                              impl::aes128_key_schedule( key ) );
+				}
 
-					auto const key_sched = impl::aes128_key_schedule( key );
-					cipher_t result{0};
-					daw::algorithm::copy( input.cbegin( ), input.cend( ),
-					                      result.begin( ) );
+				/// @brief Decrypt a block of uint8_t's with an expanded key
+				constexpr cipher_t
+				aes_decrypt_128_block(
+				  daw::span<uint8_t const> input,
+				  aes128_key_schedule_t const &key_sched ) noexcept {
+					auto result = convert_state( input );
 					auto state = make_span( result );
 
 					auto key_round = daw::make_span(
 					  key_sched, AES128_NUM_ROUNDS::value * AES_BLOCK_SIZE::value,
 					  AES_BLOCK_SIZE::value );
-					impl::aes_add_round_key( state, key_round );
+					impl::aes_add_schedule_round_key( state, key_round );
 
 					impl::aes_shift_rows_inv( state );
 					impl::aes_sbox_inv_apply_block( state );
@@ -333,21 +362,26 @@ namespace daw {
 					     --round ) {
 						key_round = daw::make_span(
 						  key_sched, round * AES_BLOCK_SIZE::value, AES_BLOCK_SIZE::value );
-						impl::aes_add_round_key( state, key_round );
+						impl::aes_add_schedule_round_key( state, key_round );
 
 						impl::aes_mix_columns_inv( state );
 						impl::aes_shift_rows_inv( state );
 						impl::aes_sbox_inv_apply_block( state );
 					}
 
-					key_round =
-					  daw::make_span( key_sched, 0, AES_BLOCK_SIZE::value );
-					impl::aes_add_round_key( state, key_round );
+					key_round = daw::make_span( key_sched, 0, AES_BLOCK_SIZE::value );
+					impl::aes_add_schedule_round_key( state, key_round );
 
-					// return result;
 					return convert_state( make_span( result ) );
 				}
 
+				constexpr cipher_t
+				aes_decrypt_128_block( daw::span<uint8_t const> input,
+				                       daw::span<uint8_t const> key ) noexcept {
+					return aes_decrypt_128_block( input,
+					                              impl::aes128_key_schedule( key ) );
+				}
+
 				constexpr void
 				aes_encrypt_128_block( daw::span<uint8_t const> input,
 				                       daw::span<uint8_t const> key,
@@ -357,17 +391,133 @@ namespace daw {
 					daw::algorithm::copy( tmp.cbegin( ), tmp.cend( ), cipher.begin( ) );
 				}
 
+				/// @brief Walks a list of fragments as one stream, a block at a time
+				template<typename T>
+				class fragment_cursor_t {
+					daw::span<daw::span<T> const> m_fragments;
+					size_t m_index = 0;
+					T *m_pos = nullptr;
+					size_t m_size = 0;
+
+					constexpr void skip_empty( ) noexcept {
+						while( m_size == 0 && m_index < m_fragments.size( ) ) {
+							m_pos = m_fragments[m_index].data( );
+							m_size = m_fragments[m_index].size( );
+							++m_index;
+						}
+					}
+
+				public:
+					explicit constexpr fragment_cursor_t(
+					  daw::span<daw::span<T> const> fragments ) noexcept
+					  : m_fragments( fragments ) {
+						skip_empty( );
+					}
+
+					constexpr bool empty( ) const noexcept {
+						return m_size == 0;
+					}
+
+					/// @brief The next block in place when the current fragment holds
+					/// all of it, otherwise a null pointer
+					constexpr T *contiguous_block( ) noexcept {
+						if( m_size < AES_BLOCK_SIZE::value ) {
+							return nullptr;
+						}
+						auto result = m_pos;
+						m_pos += AES_BLOCK_SIZE::value;
+						m_size -= AES_BLOCK_SIZE::value;
+						skip_empty( );
+						return result;
+					}
+
+					/// @brief Copy up to a block out of the stream into buffer
+					/// @return the number of bytes copied
+					constexpr size_t gather( cipher_t &buffer ) noexcept {
+						size_t count = 0;
+						while( count < buffer.size( ) && !empty( ) ) {
+							auto const n = std::min( m_size, buffer.size( ) - count );
+							daw::algorithm::copy_n( m_pos, buffer.begin( ) + count, n );
+							count += n;
+							m_pos += n;
+							m_size -= n;
+							skip_empty( );
+						}
+						return count;
+					}
+
+					/// @brief Copy up to a block from buffer into the stream
+					/// @return the number of bytes copied
+					constexpr size_t scatter( cipher_t const &buffer ) noexcept {
+						size_t count = 0;
+						while( count < buffer.size( ) && !empty( ) ) {
+							auto const n = std::min( m_size, buffer.size( ) - count );
+							daw::algorithm::copy_n( buffer.begin( ) + count, m_pos, n );
+							count += n;
+							m_pos += n;
+							m_size -= n;
+							skip_empty( );
+						}
+						return count;
+					}
+				};
 			} // namespace impl
 
+			/// @brief Gather-in/scatter-out form of aes_encrypt_128.  The input
+			/// fragments are encrypted as one stream into the cipher fragments,
+			/// which must together hold the input size rounded up to a whole block.
+			/// A block straddling input fragments is gathered into a local block, and
+			/// blocks are read in place otherwise
+			constexpr void aes_encrypt_128_fragments(
+			  daw::span<daw::span<uint8_t const> const> input,
+			  daw::span<uint8_t const> key,
+			  daw::span<daw::span<uint8_t> const> cipher ) noexcept {
+				auto sample = crypto::impl::telemetry_start( );
+				auto const key_sched = impl::aes128_key_schedule( key );
+				impl::fragment_cursor_t<uint8_t const> in( input );
+				impl::fragment_cursor_t<uint8_t> out( cipher );
+				while( !in.empty( ) && !out.empty( ) ) {
+					cipher_t result{0};
+					if( auto const block = in.contiguous_block( ); block != nullptr ) {
+						result = impl::aes_encrypt_128_block(
+						  daw::span<uint8_t const>( block, impl::AES_BLOCK_SIZE::value ),
+						  key_sched );
+					} else {
+						// The last partial block is zero padded like aes_encrypt_128
+						cipher_t pt_tmp{0};
+						in.gather( pt_tmp );
+						result = impl::aes_encrypt_128_block( daw::make_span( pt_tmp ),
+						                                      key_sched );
+					}
+					if( auto const block = out.contiguous_block( ); block != nullptr ) {
+						daw::algorithm::copy( result.cbegin( ), result.cend( ), block );
+					} else {
+						out.scatter( result );
+					}
+				}
+				if constexpr( telemetry_enabled( ) ) {
+					size_t bytes = 0;
+					for( auto const &fragment : input ) {
+						bytes += fragment.size( );
+					}
+					crypto::impl::telemetry_record( telemetry_op_t::aes128_ecb,
+					                                telemetry_backend_t::scalar, 1,
+					                                bytes, sample );
+				}
+			}
+
 			// cipher must have enough room for round(input.size(
 			// )/AES_BLOCK_SIZE::value) * AES_BLOCK_SIZE::value
 			constexpr void aes_encrypt_128( daw::span<uint8_t const> input,
-			                                daw::span<uint8_t const> key,
+			                                aes128_key_schedule_t const &key_sched,
 			                                daw::span<uint8_t> cipher ) noexcept {
+				auto sample = crypto::impl::telemetry_start( );
+				auto const size = input.size( );
 				size_t const count = input.size( ) / impl::AES_BLOCK_SIZE::value;
 				for( size_t n = 0; n < count; ++n ) {
-					impl::aes_encrypt_128_block(
-					  input.subset( 0, impl::AES_BLOCK_SIZE::value ), key, cipher );
+					auto const tmp = impl::aes_encrypt_128_block(
+					  input.subset( 0, impl::AES_BLOCK_SIZE::value ), key_sched );
+					daw::algorithm::copy( tmp.cbegin( ), tmp.cend( ), cipher.begin( ) );
 					input.remove_prefix( impl::AES_BLOCK_SIZE::value );
 					cipher.remove_prefix( impl::AES_BLOCK_SIZE::value );
 				}
@@ -375,10 +525,51 @@ namespace daw {
 					std::array<uint8_t, impl::AES_BLOCK_SIZE::value> ct_tmp{0};
 					daw::algorithm::copy( input.cbegin( ), input.cend( ),
 					                      ct_tmp.begin( ) );
-					impl::aes_encrypt_128_block( daw::make_span( ct_tmp ), key,
-					                             cipher );
+					auto const tmp =
+					  impl::aes_encrypt_128_block( daw::make_span( ct_tmp ), key_sched );
+					daw::algorithm::copy( tmp.cbegin( ), tmp.cend( ), cipher.begin( ) );
 				}
-			} // namespace aes
+				crypto::impl::telemetry_record( telemetry_op_t::aes128_ecb,
+				                                telemetry_backend_t::scalar, 1, size,
+				                                sample );
+			}
+
+			/// @brief CBC mode encryption of one message.  Like aes_encrypt_128 a
+			/// final partial block is zero padded, so cipher must have room for the
+			/// input size rounded up to a whole block
+			constexpr void
+			aes_encrypt_128_cbc( daw::span<uint8_t const> input,
+			                     aes128_key_schedule_t const &key_sched,
+			                     cipher_t const &iv,
+			                     daw::span<uint8_t> cipher ) noexcept {
+				auto sample = crypto::impl::telemetry_start( );
+				auto const size = input.size( );
+				auto chain = iv;
+				while( !input.empty( ) ) {
+					auto const count =
+					  std::min( input.size( ),
+					            static_cast<size_t>( impl::AES_BLOCK_SIZE::value ) );
+					for( size_t n = 0; n < count; ++n ) {
+						chain[n] ^= input[n];
+					}
+					chain = impl::aes_encrypt_128_block( daw::make_span( chain ),
+					                                     key_sched );
+					daw::algorithm::copy( chain.cbegin( ), chain.cend( ),
+					                      cipher.begin( ) );
+					input.remove_prefix( count );
+					cipher.remove_prefix( impl::AES_BLOCK_SIZE::value );
+				}
+				crypto::impl::telemetry_record( telemetry_op_t::aes128_cbc,
+				                                telemetry_backend_t::scalar, 1, size,
+				                                sample );
+			}
+
+			/// @brief Expands the key once for the whole input
+			constexpr void aes_encrypt_128( daw::span<uint8_t const> input,
+			                                daw::span<uint8_t const> key,
+			                                daw::span<uint8_t> cipher ) noexcept {
+				aes_encrypt_128( input, impl::aes128_key_schedule( key ), cipher );
+			}
 		}   // namespace aes
 	}     // namespace crypto
 } // namespace daw
@@ -0,0 +1,195 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// CBC encryption of many independent messages, each with its own key.  CBC is
+// serial within a message, so a short message keeps one AES unit busy for a
+// single dependent chain of rounds.  Running the rounds of several messages
+// side by side hides the latency of each round
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined( __AES__ )
+#include <wmmintrin.h>
+#endif
+
+#include <daw/daw_span.h>
+
+#include "aes.h"
+
+namespace daw {
+	namespace crypto {
+		namespace aes {
+			/// @brief One message of a batch.  output must have room for the input
+			/// size rounded up to a whole block, a final partial block is zero
+			/// padded
+			struct aes128_cbc_job_t {
+				aes128_key_schedule_t const *key_sched;
+				cipher_t iv;
+				daw::span<uint8_t const> input;
+				daw::span<uint8_t> output;
+			};
+
+			namespace impl {
+				/// @brief Number of messages interleaved by the batch functions
+				constexpr size_t const aes_batch_lanes = 8;
+
+				inline void
+				aes_encrypt_128_cbc_portable( aes128_cbc_job_t const &job ) noexcept {
+					aes_encrypt_128_cbc( job.input, *job.key_sched, job.iv, job.output );
+				}
+
+#if defined( __AES__ )
+				// The lanes are unrolled so the states stay in registers
+				template<size_t Lanes, typename Lane, typename RoundKey,
+				         size_t... Ls>
+				inline void aes_lane_rounds( __m128i ( &state )[Lanes],
+				                             std::array<Lane, Lanes> const &lanes,
+				                             RoundKey const &round_key,
+				                             std::index_sequence<Ls...> ) noexcept {
+					for( size_t round = 1; round < AES128_NUM_ROUNDS::value; ++round ) {
+						( ( state[Ls] = _mm_aesenc_si128(
+						      state[Ls], round_key( lanes[Ls], round ) ) ),
+						  ... );
+					}
+					( ( state[Ls] = _mm_aesenclast_si128(
+					      state[Ls],
+					      round_key( lanes[Ls], AES128_NUM_ROUNDS::value ) ) ),
+					  ... );
+				}
+
+				/// @brief Interleave the rounds of Lanes messages.  When a message
+				/// ends its lane takes the next one, so short and long messages mix
+				/// without idle lanes until the queue runs dry
+				template<size_t Lanes>
+				void aes_encrypt_128_cbc_lanes(
+				  daw::span<aes128_cbc_job_t const> jobs ) noexcept {
+					struct lane_t {
+						aes128_cbc_job_t const *job = nullptr;
+						uint8_t const *round_keys = nullptr;
+						size_t pos = 0;
+						__m128i chain = _mm_setzero_si128( );
+					};
+					// Idle lanes run on this so the round loop has no branches
+					alignas( 16 ) static aes128_key_schedule_t const idle_keys{};
+
+					std::array<lane_t, Lanes> lanes{};
+					size_t next = 0;
+					size_t active = 0;
+					auto const start = [&]( lane_t &lane ) {
+						while( next < jobs.size( ) ) {
+							auto const &job = jobs[next++];
+							if( !job.input.empty( ) ) {
+								lane.job = &job;
+								lane.round_keys = job.key_sched->data( );
+								lane.pos = 0;
+								lane.chain = _mm_loadu_si128(
+								  reinterpret_cast<__m128i const *>( job.iv.data( ) ) );
+								return true;
+							}
+						}
+						lane.job = nullptr;
+						lane.round_keys = idle_keys.data( );
+						return false;
+					};
+					for( auto &lane : lanes ) {
+						active += start( lane ) ? 1 : 0;
+					}
+					auto const round_key = []( lane_t const &lane, size_t round ) {
+						return _mm_loadu_si128( reinterpret_cast<__m128i const *>(
+						  lane.round_keys + round * AES_BLOCK_SIZE::value ) );
+					};
+
+					while( active > 0 ) {
+						__m128i state[Lanes];
+						for( size_t n = 0; n < Lanes; ++n ) {
+							auto &lane = lanes[n];
+							__m128i block = _mm_setzero_si128( );
+							if( lane.job != nullptr ) {
+								auto const remaining = lane.job->input.size( ) - lane.pos;
+								auto const src = lane.job->input.data( ) + lane.pos;
+								if( remaining >= AES_BLOCK_SIZE::value ) {
+									block =
+									  _mm_loadu_si128( reinterpret_cast<__m128i const *>( src ) );
+								} else {
+									alignas( 16 ) std::array<uint8_t, 16> tmp{};
+									std::memcpy( tmp.data( ), src, remaining );
+									block = _mm_load_si128(
+									  reinterpret_cast<__m128i const *>( tmp.data( ) ) );
+								}
+							}
+							state[n] = _mm_xor_si128( _mm_xor_si128( block, lane.chain ),
+							                          round_key( lane, 0 ) );
+						}
+						aes_lane_rounds( state, lanes, round_key,
+						                 std::make_index_sequence<Lanes>{} );
+						for( size_t n = 0; n < Lanes; ++n ) {
+							auto &lane = lanes[n];
+							if( lane.job == nullptr ) {
+								continue;
+							}
+							_mm_storeu_si128( reinterpret_cast<__m128i *>(
+							                    lane.job->output.data( ) + lane.pos ),
+							                  state[n] );
+							lane.chain = state[n];
+							lane.pos += AES_BLOCK_SIZE::value;
+							if( lane.pos >= lane.job->input.size( ) && !start( lane ) ) {
+								--active;
+							}
+						}
+					}
+				}
+#endif
+			} // namespace impl
+
+			/// @brief CBC encrypt every job, each under its own key schedule.  With
+			/// AES-NI up to impl::aes_batch_lanes jobs are in flight at once,
+			/// otherwise they are encrypted one after another with
+			/// aes_encrypt_128_cbc
+			inline void aes_encrypt_128_cbc_batch(
+			  daw::span<aes128_cbc_job_t const> jobs ) noexcept {
+#if defined( __AES__ )
+				auto sample = crypto::impl::telemetry_start( );
+				impl::aes_encrypt_128_cbc_lanes<impl::aes_batch_lanes>( jobs );
+				if constexpr( telemetry_enabled( ) ) {
+					size_t bytes = 0;
+					for( auto const &job : jobs ) {
+						bytes += job.input.size( );
+					}
+					crypto::impl::telemetry_record( telemetry_op_t::aes128_cbc,
+					                                telemetry_backend_t::aesni,
+					                                jobs.size( ), bytes, sample );
+				}
+#else
+				for( auto const &job : jobs ) {
+					impl::aes_encrypt_128_cbc_portable( job );
+				}
+#endif
+			}
+		} // namespace aes
+	}   // namespace crypto
+} // namespace daw
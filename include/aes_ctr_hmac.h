@@ -0,0 +1,310 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// AES-128-CTR with HMAC-SHA256 in encrypt-then-MAC order.  Encrypting and
+// MACing as two passes reads every byte of a large buffer from memory twice.
+// Here the data goes through in tiles small enough to stay in L1: a tile is
+// encrypted and its cipher text is fed to SHA-256 before the next tile is
+// touched
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined( __AES__ )
+#include <wmmintrin.h>
+#endif
+
+#include <daw/daw_span.h>
+
+#include "aes.h"
+#include "aes_ni.h"
+#include "hmac_sha256.h"
+
+namespace daw {
+	namespace crypto {
+		namespace aes {
+			using aes128_ctr_hmac_tag_t = hmac_sha256_tag_t;
+
+			/// @brief What the encrypt-then-MAC tag covers.  cipher_text is the
+			/// stored format, AES-CTR then HMAC-SHA256 over the cipher text alone.
+			/// iv_and_cipher_text also binds the IV, so a changed IV is caught like
+			/// changed cipher text, but its tags differ from the stored format
+			enum class ctr_hmac_mac_t : uint8_t { cipher_text, iv_and_cipher_text };
+
+			namespace impl {
+				/// @brief Bytes encrypted and then MACed at a time.  The plain and
+				/// cipher text of a tile together fit in a 32KB L1 data cache
+				constexpr size_t const ctr_hmac_tile_size = 8192;
+
+				/// @brief Add to the counter block as one 128 bit big endian number
+				/// (SP 800-38A B.1)
+				constexpr void ctr_increment( cipher_t &counter,
+				                              uint64_t count ) noexcept {
+					for( size_t n = counter.size( ); n > 0 && count != 0; --n ) {
+						auto const sum = counter[n - 1] + ( count & 0xFFu );
+						counter[n - 1] = static_cast<uint8_t>( sum );
+						count = ( count >> 8u ) + ( sum >> 8u );
+					}
+				}
+
+#if defined( __AES__ )
+				inline uint64_t load64_be( uint8_t const *p ) noexcept {
+					uint64_t result = 0;
+					std::memcpy( &result, p, sizeof( result ) );
+					return __builtin_bswap64( result );
+				}
+
+				/// @brief XOR blocks whole blocks of in with the key stream starting
+				/// at counter, 8 blocks at a time.  counter is advanced past them
+				inline void ctr_blocks_aesni( aes_round_keys_t const &keys,
+				                              cipher_t &counter, uint8_t const *in,
+				                              uint8_t *out, size_t blocks ) noexcept {
+					auto hi = load64_be( counter.data( ) );
+					auto lo = load64_be( counter.data( ) + 8 );
+					auto const next_counter = [&]( ) {
+						auto const result = _mm_set_epi64x(
+						  static_cast<long long>( __builtin_bswap64( lo ) ),
+						  static_cast<long long>( __builtin_bswap64( hi ) ) );
+						hi += ( ++lo == 0 ) ? 1u : 0u;
+						return result;
+					};
+					auto const crypt = [&]( auto lanes ) {
+						constexpr size_t N = decltype( lanes )::value;
+						__m128i ks[N];
+						for( auto &k : ks ) {
+							k = next_counter( );
+						}
+						aesni_crypt_blocks<true>( ks, keys, std::make_index_sequence<N>{} );
+						for( size_t n = 0; n < N; ++n ) {
+							auto const p = _mm_loadu_si128(
+							  reinterpret_cast<__m128i const *>( in + n * 16u ) );
+							_mm_storeu_si128( reinterpret_cast<__m128i *>( out + n * 16u ),
+							                  _mm_xor_si128( p, ks[n] ) );
+						}
+						in += N * 16u;
+						out += N * 16u;
+					};
+					for( ; blocks >= 8; blocks -= 8 ) {
+						crypt( std::integral_constant<size_t, 8>{} );
+					}
+					for( ; blocks > 0; --blocks ) {
+						crypt( std::integral_constant<size_t, 1>{} );
+					}
+					_mm_storeu_si128( reinterpret_cast<__m128i *>( counter.data( ) ),
+					                  next_counter( ) );
+				}
+#endif
+			} // namespace impl
+
+			/// @brief Streaming AES-128-CTR.  Encryption and decryption are the
+			/// same operation, and the stream may be fed in pieces of any size
+			class aes128_ctr_t {
+#if defined( __AES__ )
+				impl::aes_round_keys_t m_keys;
+#else
+				aes128_key_schedule_t m_sched;
+#endif
+				cipher_t m_counter;
+				cipher_t m_key_stream{};
+				// Bytes of m_key_stream already used
+				size_t m_used = impl::AES_BLOCK_SIZE::value;
+
+				void next_key_stream( ) noexcept {
+#if defined( __AES__ )
+					m_key_stream = m_counter;
+					impl::aesni_crypt_block<true>( m_key_stream, m_keys );
+#else
+					m_key_stream =
+					  impl::aes_encrypt_128_block( daw::make_span( m_counter ), m_sched );
+#endif
+					impl::ctr_increment( m_counter, 1 );
+					m_used = 0;
+				}
+
+				void whole_blocks( uint8_t const *in, uint8_t *out,
+				                   size_t blocks ) noexcept {
+#if defined( __AES__ )
+					impl::ctr_blocks_aesni( m_keys, m_counter, in, out, blocks );
+#else
+					for( size_t b = 0; b < blocks; ++b ) {
+						next_key_stream( );
+						for( size_t n = 0; n < m_key_stream.size( ); ++n ) {
+							out[n] = static_cast<uint8_t>( in[n] ^ m_key_stream[n] );
+						}
+						in += impl::AES_BLOCK_SIZE::value;
+						out += impl::AES_BLOCK_SIZE::value;
+						m_used = impl::AES_BLOCK_SIZE::value;
+					}
+#endif
+				}
+
+			public:
+				/// @param iv the initial counter block
+				aes128_ctr_t( aes128_key_schedule_t const &sched,
+				              cipher_t const &iv ) noexcept
+#if defined( __AES__ )
+				  : m_keys( impl::load_round_keys( sched ) )
+#else
+				  : m_sched( sched )
+#endif
+				  , m_counter( iv ) {
+				}
+
+				/// @brief XOR in with the next in.size( ) bytes of key stream
+				/// @param out at least as long as in, may be the same memory
+				void crypt( daw::span<uint8_t const> in,
+				            daw::span<uint8_t> out ) noexcept {
+					auto sample = crypto::impl::telemetry_start( );
+					auto const *src = in.data( );
+					auto *dst = out.data( );
+					auto size = in.size( );
+					// Finish the block a previous call stopped in
+					while( size > 0 && m_used < m_key_stream.size( ) ) {
+						*dst++ = static_cast<uint8_t>( *src++ ^ m_key_stream[m_used++] );
+						--size;
+					}
+					auto const blocks = size / impl::AES_BLOCK_SIZE::value;
+					whole_blocks( src, dst, blocks );
+					src += blocks * impl::AES_BLOCK_SIZE::value;
+					dst += blocks * impl::AES_BLOCK_SIZE::value;
+					size -= blocks * impl::AES_BLOCK_SIZE::value;
+					if( size > 0 ) {
+						next_key_stream( );
+						while( size > 0 ) {
+							*dst++ = static_cast<uint8_t>( *src++ ^ m_key_stream[m_used++] );
+							--size;
+						}
+					}
+					crypto::impl::telemetry_record( telemetry_op_t::aes128_ctr,
+					                                impl::aes_telemetry_backend, 1,
+					                                in.size( ), sample );
+				}
+			};
+
+			/// @brief One shot AES-128-CTR
+			inline void aes_ctr_128( aes128_key_schedule_t const &sched,
+			                         cipher_t const &iv,
+			                         daw::span<uint8_t const> in,
+			                         daw::span<uint8_t> out ) noexcept {
+				aes128_ctr_t ctr( sched, iv );
+				ctr.crypt( in, out );
+			}
+
+			/// @brief Streaming encrypt-then-MAC with AES-128-CTR and HMAC-SHA256.
+			/// The tag is the one of aes_ctr_128 followed by hmac_sha256 over the
+			/// cipher text, see ctr_hmac_mac_t.  Use one context per message and
+			/// either encrypt_update or decrypt_update, not both
+			class aes128_ctr_hmac_sha256_ctx {
+				aes128_ctr_t m_ctr;
+				hmac_sha256_ctx m_mac;
+
+			public:
+				/// @param enc_key 16 byte AES key
+				/// @param mac_key HMAC key, independent of enc_key
+				/// @param iv initial counter block, never reused under enc_key
+				/// @param covers what the tag is taken over
+				aes128_ctr_hmac_sha256_ctx(
+				  daw::span<uint8_t const> enc_key, daw::span<uint8_t const> mac_key,
+				  cipher_t const &iv,
+				  ctr_hmac_mac_t covers = ctr_hmac_mac_t::cipher_text ) noexcept
+				  : m_ctr( impl::aes128_key_schedule( enc_key ), iv )
+				  , m_mac( mac_key ) {
+
+					if( covers == ctr_hmac_mac_t::iv_and_cipher_text ) {
+						m_mac.update( iv.data( ), iv.size( ) );
+					}
+				}
+
+				/// @param out at least as long as plain, may be the same memory
+				void encrypt_update( daw::span<uint8_t const> plain,
+				                     daw::span<uint8_t> out ) noexcept {
+					for( size_t pos = 0; pos < plain.size( );
+					     pos += impl::ctr_hmac_tile_size ) {
+						auto const size =
+						  std::min( impl::ctr_hmac_tile_size, plain.size( ) - pos );
+						m_ctr.crypt( plain.subset( pos, size ), out.subset( pos, size ) );
+						m_mac.update( out.data( ) + pos, size );
+					}
+				}
+
+				/// @brief Decrypt cipher text while MACing it.  The plain text must
+				/// not be used unless verify( ) succeeds afterwards
+				/// @param out at least as long as cipher, may be the same memory
+				void decrypt_update( daw::span<uint8_t const> cipher,
+				                     daw::span<uint8_t> out ) noexcept {
+					for( size_t pos = 0; pos < cipher.size( );
+					     pos += impl::ctr_hmac_tile_size ) {
+						auto const size =
+						  std::min( impl::ctr_hmac_tile_size, cipher.size( ) - pos );
+						m_mac.update( cipher.data( ) + pos, size );
+						m_ctr.crypt( cipher.subset( pos, size ), out.subset( pos, size ) );
+					}
+				}
+
+				aes128_ctr_hmac_tag_t final( ) noexcept {
+					return m_mac.final( );
+				}
+
+				/// @brief Compare the tag of the cipher text so far in constant time
+				bool verify( aes128_ctr_hmac_tag_t const &tag ) noexcept {
+					return m_mac.verify( tag );
+				}
+			};
+
+			/// @brief Encrypt plain into cipher and return the tag over cipher, and
+			/// iv first when covers asks for it
+			inline aes128_ctr_hmac_tag_t aes128_ctr_hmac_seal(
+			  daw::span<uint8_t const> enc_key, daw::span<uint8_t const> mac_key,
+			  cipher_t const &iv, daw::span<uint8_t const> plain,
+			  daw::span<uint8_t> cipher,
+			  ctr_hmac_mac_t covers = ctr_hmac_mac_t::cipher_text ) noexcept {
+				aes128_ctr_hmac_sha256_ctx ctx( enc_key, mac_key, iv, covers );
+				ctx.encrypt_update( plain, cipher );
+				return ctx.final( );
+			}
+
+			/// @brief Check the tag, made with the same covers, and only if it
+			/// matches decrypt into plain.  Returns false, with plain untouched,
+			/// otherwise
+			inline bool aes128_ctr_hmac_open(
+			  daw::span<uint8_t const> enc_key, daw::span<uint8_t const> mac_key,
+			  cipher_t const &iv, daw::span<uint8_t const> cipher,
+			  aes128_ctr_hmac_tag_t const &tag, daw::span<uint8_t> plain,
+			  ctr_hmac_mac_t covers = ctr_hmac_mac_t::cipher_text ) noexcept {
+				hmac_sha256_ctx mac( mac_key );
+				if( covers == ctr_hmac_mac_t::iv_and_cipher_text ) {
+					mac.update( iv.data( ), iv.size( ) );
+				}
+				mac.update( cipher );
+				if( !mac.verify( tag ) ) {
+					return false;
+				}
+				aes_ctr_128( impl::aes128_key_schedule( enc_key ), iv, cipher, plain );
+				return true;
+			}
+		} // namespace aes
+	}   // namespace crypto
+} // namespace daw
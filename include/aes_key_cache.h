@@ -0,0 +1,383 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Shared cache of expanded AES-128 key schedules keyed by a caller chosen key
+// id.  The cache is a set associative table of seqlock protected slots.
+// Readers take no lock and only write to set the CLOCK reference bit of the
+// slot they hit, writers serialize per stripe of sets and evict with the CLOCK
+// algorithm
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <daw/daw_span.h>
+
+#include "aes.h"
+#include "crypto_config.h"
+
+namespace daw {
+	namespace crypto {
+		namespace aes {
+			/// @brief Counters of a key_schedule_cache.  They are summed from
+			/// relaxed per stripe counters so a snapshot taken while other threads
+			/// use the cache is approximate
+			struct key_schedule_cache_stats_t {
+				uint64_t hits = 0;
+				uint64_t misses = 0;
+				uint64_t evictions = 0;
+
+				double hit_ratio( ) const noexcept {
+					auto const total = hits + misses;
+					return total == 0 ? 0.0
+					                  : static_cast<double>( hits ) /
+					                      static_cast<double>( total );
+				}
+			};
+
+			namespace impl {
+				constexpr uint64_t mix_key_id( uint64_t key_id ) noexcept {
+					key_id ^= key_id >> 33u;
+					key_id *= 0xFF51'AFD7'ED55'8CCDULL;
+					key_id ^= key_id >> 33u;
+					key_id *= 0xC4CE'B9FE'1A85'EC53ULL;
+					return key_id ^ ( key_id >> 33u );
+				}
+
+				constexpr size_t aes128_key_schedule_words =
+				  sizeof( aes128_key_schedule_t ) / sizeof( uint64_t );
+
+				// Every field is an atomic so that the optimistic copy a reader
+				// makes while a writer may be active is well defined.  The sequence
+				// is odd while the slot is being written
+				struct alignas( 64 ) key_schedule_slot_t {
+					std::atomic<uint64_t> sequence{0};
+					std::atomic<uint64_t> key_id{0};
+					std::atomic<bool> occupied{false};
+					std::atomic<bool> referenced{false};
+					std::array<std::atomic<uint64_t>, aes128_key_schedule_words>
+					  words{};
+
+					void load_words( aes128_key_schedule_t &out ) const noexcept {
+						std::array<uint64_t, aes128_key_schedule_words> tmp{};
+						for( size_t n = 0; n < tmp.size( ); ++n ) {
+							tmp[n] = words[n].load( std::memory_order_relaxed );
+						}
+						std::memcpy( out.data( ), tmp.data( ), sizeof( out ) );
+						crypto::impl::secure_wipe( tmp.data( ), sizeof( tmp ) );
+					}
+
+					// Callers hold the stripe lock
+					void store( uint64_t id, bool is_occupied,
+					            aes128_key_schedule_t const *sched ) noexcept {
+						auto const seq = sequence.load( std::memory_order_relaxed );
+						sequence.store( seq + 1, std::memory_order_relaxed );
+						std::atomic_thread_fence( std::memory_order_release );
+						key_id.store( id, std::memory_order_relaxed );
+						occupied.store( is_occupied, std::memory_order_relaxed );
+						referenced.store( false, std::memory_order_relaxed );
+						for( size_t n = 0; n < words.size( ); ++n ) {
+							uint64_t w = 0;
+							if( sched != nullptr ) {
+								std::memcpy( &w, sched->data( ) + n * sizeof( uint64_t ),
+								             sizeof( uint64_t ) );
+							}
+							words[n].store( w, std::memory_order_relaxed );
+						}
+						sequence.store( seq + 2, std::memory_order_release );
+					}
+				};
+
+				// The key ids of a set share a cache line so a lookup only touches the
+				// slot that matches
+				template<size_t Ways>
+				struct alignas( 64 ) key_schedule_set_tags_t {
+					std::array<std::atomic<uint64_t>, Ways> key_ids{};
+				};
+
+				struct alignas( 64 ) key_schedule_cache_counters_t {
+					std::atomic<uint64_t> hits{0};
+					std::atomic<uint64_t> misses{0};
+					std::atomic<uint64_t> evictions{0};
+				};
+
+				struct alignas( 64 ) key_schedule_cache_stripe_t {
+					std::mutex mutex{};
+				};
+
+				inline size_t thread_stripe( size_t stripes ) noexcept {
+					static thread_local size_t const id =
+					  std::hash<std::thread::id>{}( std::this_thread::get_id( ) );
+					return id & ( stripes - 1 );
+				}
+			} // namespace impl
+
+			/// @brief Concurrent cache of expanded AES-128 key schedules for
+			/// services handling many keys.  find( ) and the hit path of get( ) take
+			/// no lock, and their only shared writes are a hit counter stripe and
+			/// the CLOCK reference bit of the slot hit, when not already set.
+			/// Schedules are handed out as copies, so an entry can be
+			/// evicted while a caller still uses it.  Evicted and erased slots are
+			/// overwritten before the cache forgets them, copies handed out are the
+			/// caller's to wipe (see crypto::impl::secure_wipe)
+			class key_schedule_cache {
+				static constexpr size_t const ways = 8;
+				static constexpr size_t const stripes = 64;
+
+				size_t m_set_mask;
+				std::unique_ptr<impl::key_schedule_slot_t[]> m_slots;
+				std::unique_ptr<impl::key_schedule_set_tags_t<ways>[]> m_tags;
+				std::unique_ptr<std::atomic<uint8_t>[]> m_clock_hands;
+				std::array<impl::key_schedule_cache_stripe_t, stripes> m_stripes{};
+				mutable std::array<impl::key_schedule_cache_counters_t, stripes>
+				  m_counters{};
+
+				static size_t set_count( size_t capacity ) noexcept {
+					size_t result = 1;
+					while( result * ways < capacity ) {
+						result <<= 1u;
+					}
+					return result;
+				}
+
+				size_t set_of( uint64_t key_id ) const noexcept {
+					return static_cast<size_t>( impl::mix_key_id( key_id ) ) &
+					       m_set_mask;
+				}
+
+				impl::key_schedule_slot_t *set_slots( size_t set ) const noexcept {
+					return m_slots.get( ) + set * ways;
+				}
+
+				impl::key_schedule_cache_counters_t &counters( ) const noexcept {
+					return m_counters[impl::thread_stripe( stripes )];
+				}
+
+				bool find_in_set( size_t set, uint64_t key_id,
+				                  aes128_key_schedule_t &out ) const noexcept {
+					auto const slots = set_slots( set );
+					auto const &tags = m_tags[set].key_ids;
+					for( size_t n = 0; n < ways; ++n ) {
+						// The tag is a hint, the slot's own key id under its sequence
+						// decides
+						if( tags[n].load( std::memory_order_relaxed ) != key_id ) {
+							continue;
+						}
+						auto &slot = slots[n];
+						while( true ) {
+							auto const seq = slot.sequence.load( std::memory_order_acquire );
+							if( ( seq & 1u ) != 0 ) {
+								std::this_thread::yield( );
+								continue;
+							}
+							bool const match =
+							  slot.occupied.load( std::memory_order_relaxed ) &&
+							  slot.key_id.load( std::memory_order_relaxed ) == key_id;
+							if( match ) {
+								slot.load_words( out );
+							}
+							std::atomic_thread_fence( std::memory_order_acquire );
+							if( slot.sequence.load( std::memory_order_relaxed ) != seq ) {
+								continue;
+							}
+							if( !match ) {
+								break;
+							}
+							// Only write when the bit is clear so hot entries stay shared
+							// in every reader's cache
+							if( !slot.referenced.load( std::memory_order_relaxed ) ) {
+								slot.referenced.store( true, std::memory_order_relaxed );
+							}
+							return true;
+						}
+					}
+					return false;
+				}
+
+				// Callers hold the stripe lock of set
+				void insert_locked( size_t set, uint64_t key_id,
+				                    aes128_key_schedule_t const &sched ) noexcept {
+					auto const slots = set_slots( set );
+					impl::key_schedule_slot_t *victim = nullptr;
+					for( size_t n = 0; n < ways && victim == nullptr; ++n ) {
+						if( !slots[n].occupied.load( std::memory_order_relaxed ) ) {
+							victim = slots + n;
+						}
+					}
+					if( victim == nullptr ) {
+						// CLOCK, give referenced entries a second chance
+						auto hand = m_clock_hands[set].load( std::memory_order_relaxed );
+						while( slots[hand].referenced.load( std::memory_order_relaxed ) ) {
+							slots[hand].referenced.store( false, std::memory_order_relaxed );
+							hand = static_cast<uint8_t>( ( hand + 1u ) % ways );
+						}
+						victim = slots + hand;
+						m_clock_hands[set].store(
+						  static_cast<uint8_t>( ( hand + 1u ) % ways ),
+						  std::memory_order_relaxed );
+						counters( ).evictions.fetch_add( 1, std::memory_order_relaxed );
+					}
+					victim->store( key_id, true, &sched );
+					m_tags[set].key_ids[static_cast<size_t>( victim - slots )].store(
+					  key_id, std::memory_order_relaxed );
+				}
+
+			public:
+				/// @brief A cache holding at least capacity schedules
+				explicit key_schedule_cache( size_t capacity = 4096 )
+				  : m_set_mask( set_count( capacity ) - 1 )
+				  , m_slots( new impl::key_schedule_slot_t[set_count( capacity ) *
+				                                           ways] )
+				  , m_tags(
+				      new impl::key_schedule_set_tags_t<ways>[set_count( capacity )] )
+				  , m_clock_hands(
+				      new std::atomic<uint8_t>[set_count( capacity )]( ) ) {}
+
+				key_schedule_cache( key_schedule_cache const & ) = delete;
+				key_schedule_cache &operator=( key_schedule_cache const & ) = delete;
+
+				~key_schedule_cache( ) {
+					clear( );
+				}
+
+				size_t capacity( ) const noexcept {
+					return ( m_set_mask + 1 ) * ways;
+				}
+
+				/// @brief Copy the cached schedule of key_id into out
+				/// @return false if key_id is not cached
+				bool find( uint64_t key_id, aes128_key_schedule_t &out ) const
+				  noexcept {
+					if( find_in_set( set_of( key_id ), key_id, out ) ) {
+						counters( ).hits.fetch_add( 1, std::memory_order_relaxed );
+						return true;
+					}
+					counters( ).misses.fetch_add( 1, std::memory_order_relaxed );
+					return false;
+				}
+
+				/// @brief The schedule of key_id, expanded from the bytes load_key( )
+				/// returns and cached on a miss.  load_key is only called on a miss
+				/// and must return something convertible to daw::span<uint8_t const>
+				template<typename KeyLoader>
+				aes128_key_schedule_t get( uint64_t key_id, KeyLoader &&load_key ) {
+					aes128_key_schedule_t result{};
+					auto const set = set_of( key_id );
+					if( find_in_set( set, key_id, result ) ) {
+						counters( ).hits.fetch_add( 1, std::memory_order_relaxed );
+						return result;
+					}
+					counters( ).misses.fetch_add( 1, std::memory_order_relaxed );
+					result = impl::aes128_key_schedule( load_key( ) );
+					std::lock_guard<std::mutex> lock( m_stripes[set % stripes].mutex );
+					// Another thread may have inserted it while the key was expanded
+					aes128_key_schedule_t existing{};
+					if( !find_in_set( set, key_id, existing ) ) {
+						insert_locked( set, key_id, result );
+					}
+					crypto::impl::secure_wipe( existing.data( ), existing.size( ) );
+					return result;
+				}
+
+				/// @brief The schedule of key_id, expanded from key on a miss
+				aes128_key_schedule_t get( uint64_t key_id,
+				                           daw::span<uint8_t const> key ) {
+					return get( key_id, [key]( ) { return key; } );
+				}
+
+				/// @brief Add or replace the schedule of key_id, e.g. after a key
+				/// rotation reuses the id
+				void insert( uint64_t key_id, daw::span<uint8_t const> key ) {
+					auto sched = impl::aes128_key_schedule( key );
+					auto const set = set_of( key_id );
+					{
+						std::lock_guard<std::mutex> lock( m_stripes[set % stripes].mutex );
+						auto const slots = set_slots( set );
+						bool replaced = false;
+						for( size_t n = 0; n < ways && !replaced; ++n ) {
+							if( slots[n].occupied.load( std::memory_order_relaxed ) &&
+							    slots[n].key_id.load( std::memory_order_relaxed ) ==
+							      key_id ) {
+								slots[n].store( key_id, true, &sched );
+								replaced = true;
+							}
+						}
+						if( !replaced ) {
+							insert_locked( set, key_id, sched );
+						}
+					}
+					crypto::impl::secure_wipe( sched.data( ), sched.size( ) );
+				}
+
+				/// @brief Remove and wipe the schedule of key_id, e.g. when the key
+				/// is revoked
+				void erase( uint64_t key_id ) noexcept {
+					auto const set = set_of( key_id );
+					std::lock_guard<std::mutex> lock( m_stripes[set % stripes].mutex );
+					auto const slots = set_slots( set );
+					for( size_t n = 0; n < ways; ++n ) {
+						if( slots[n].occupied.load( std::memory_order_relaxed ) &&
+						    slots[n].key_id.load( std::memory_order_relaxed ) == key_id ) {
+							slots[n].store( 0, false, nullptr );
+						}
+					}
+				}
+
+				/// @brief Remove and wipe every schedule
+				void clear( ) noexcept {
+					for( size_t set = 0; set <= m_set_mask; ++set ) {
+						std::lock_guard<std::mutex> lock( m_stripes[set % stripes].mutex );
+						auto const slots = set_slots( set );
+						for( size_t n = 0; n < ways; ++n ) {
+							slots[n].store( 0, false, nullptr );
+						}
+					}
+				}
+
+				key_schedule_cache_stats_t stats( ) const noexcept {
+					key_schedule_cache_stats_t result{};
+					for( auto const &c : m_counters ) {
+						result.hits += c.hits.load( std::memory_order_relaxed );
+						result.misses += c.misses.load( std::memory_order_relaxed );
+						result.evictions += c.evictions.load( std::memory_order_relaxed );
+					}
+					return result;
+				}
+
+				void reset_stats( ) noexcept {
+					for( auto &c : m_counters ) {
+						c.hits.store( 0, std::memory_order_relaxed );
+						c.misses.store( 0, std::memory_order_relaxed );
+						c.evictions.store( 0, std::memory_order_relaxed );
+					}
+				}
+			};
+		} // namespace aes
+	}   // namespace crypto
+} // namespace daw
@@ -0,0 +1,120 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Helpers shared by the AES-NI code paths: the round keys held in registers
+// and a fixed number of independent blocks pushed through the rounds together
+
+#include <array>
+#include <cstdint>
+#include <utility>
+
+#if defined( __AES__ )
+#include <wmmintrin.h>
+#endif
+
+#include "aes.h"
+
+namespace daw {
+	namespace crypto {
+		namespace aes {
+			namespace impl {
+#if defined( __AES__ )
+				/// @brief The expanded key in registers.  A plain array member, as a
+				/// std::array of __m128i drops the type's alignment attribute
+				struct aes_round_keys_t {
+					__m128i keys[AES128_NUM_ROUNDS::value + 1u];
+
+					static constexpr size_t size( ) noexcept {
+						return AES128_NUM_ROUNDS::value + 1u;
+					}
+
+					__m128i &operator[]( size_t n ) noexcept {
+						return keys[n];
+					}
+
+					__m128i const &operator[]( size_t n ) const noexcept {
+						return keys[n];
+					}
+				};
+
+				inline aes_round_keys_t
+				load_round_keys( aes128_key_schedule_t const &sched ) noexcept {
+					aes_round_keys_t result{};
+					for( size_t n = 0; n < result.size( ); ++n ) {
+						result[n] = _mm_loadu_si128( reinterpret_cast<__m128i const *>(
+						  sched.data( ) + n * AES_BLOCK_SIZE::value ) );
+					}
+					return result;
+				}
+
+				/// @brief Round keys for the equivalent inverse cipher used by aesdec
+				inline aes_round_keys_t
+				decrypt_round_keys( aes_round_keys_t const &enc ) noexcept {
+					aes_round_keys_t result{};
+					auto const last = enc.size( ) - 1u;
+					result[0] = enc[last];
+					for( size_t n = 1; n < last; ++n ) {
+						result[n] = _mm_aesimc_si128( enc[last - n] );
+					}
+					result[last] = enc[0];
+					return result;
+				}
+
+				/// @brief Run the rounds over blocks[Ns]..., an array of __m128i
+				template<bool Encrypt, typename Blocks, size_t... Ns>
+				inline void aesni_crypt_blocks( Blocks &blocks,
+				                                aes_round_keys_t const &keys,
+				                                std::index_sequence<Ns...> ) noexcept {
+					( ( blocks[Ns] = _mm_xor_si128( blocks[Ns], keys[0] ) ), ... );
+					for( size_t round = 1; round < AES128_NUM_ROUNDS::value; ++round ) {
+						if constexpr( Encrypt ) {
+							( ( blocks[Ns] = _mm_aesenc_si128( blocks[Ns], keys[round] ) ),
+							  ... );
+						} else {
+							( ( blocks[Ns] = _mm_aesdec_si128( blocks[Ns], keys[round] ) ),
+							  ... );
+						}
+					}
+					auto const &last = keys[AES128_NUM_ROUNDS::value];
+					if constexpr( Encrypt ) {
+						( ( blocks[Ns] = _mm_aesenclast_si128( blocks[Ns], last ) ), ... );
+					} else {
+						( ( blocks[Ns] = _mm_aesdeclast_si128( blocks[Ns], last ) ), ... );
+					}
+				}
+
+				template<bool Encrypt>
+				inline void aesni_crypt_block( cipher_t &block,
+				                               aes_round_keys_t const &keys ) noexcept {
+					__m128i b[1] = {_mm_loadu_si128(
+					  reinterpret_cast<__m128i const *>( block.data( ) ) )};
+					aesni_crypt_blocks<Encrypt>( b, keys, std::make_index_sequence<1>{} );
+					_mm_storeu_si128( reinterpret_cast<__m128i *>( block.data( ) ),
+					                  b[0] );
+				}
+#endif
+			} // namespace impl
+		}   // namespace aes
+	}     // namespace crypto
+} // namespace daw
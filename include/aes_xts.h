@@ -0,0 +1,379 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// XTS-AES-128(IEEE 1619) for data at rest.  Each sector, or data unit, is
+// encrypted independently under a tweak made from its sector number, and a
+// sector that is not a whole number of blocks uses ciphertext stealing.  With
+// AES-NI the blocks of a sector go through the AES unit 8 at a time
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined( __AES__ )
+#include <wmmintrin.h>
+#endif
+
+#include <daw/daw_span.h>
+
+#include "aes.h"
+#include "aes_ni.h"
+
+namespace daw {
+	namespace crypto {
+		namespace aes {
+			namespace impl {
+#if defined( __AES__ )
+				/// @brief Multiply the tweak by x in GF(2^128), the tweak being a
+				/// little endian 128 bit number.  Each 32 bit lane shifts left and the
+				/// bits that fall out move to the next lane, with the top bit folded
+				/// back in as x^7 + x^2 + x + 1
+				inline __m128i xts_mul_alpha( __m128i tweak ) noexcept {
+					auto carry = _mm_srai_epi32( tweak, 31 );
+					carry = _mm_shuffle_epi32( carry, 0x93 );
+					carry = _mm_and_si128( carry, _mm_set_epi32( 1, 1, 1, 0x87 ) );
+					return _mm_xor_si128( _mm_slli_epi32( tweak, 1 ), carry );
+				}
+#endif
+
+				constexpr void xts_mul_alpha( cipher_t &tweak ) noexcept {
+					auto const carry = static_cast<uint8_t>( tweak[15] >> 7u );
+					for( size_t n = tweak.size( ) - 1u; n > 0; --n ) {
+						tweak[n] = static_cast<uint8_t>( ( tweak[n] << 1u ) |
+						                                 ( tweak[n - 1u] >> 7u ) );
+					}
+					tweak[0] = static_cast<uint8_t>( ( tweak[0] << 1u ) ^
+					                                 ( carry != 0 ? 0x87u : 0u ) );
+				}
+			} // namespace impl
+
+			/// @brief XTS-AES-128 key.  The 32 byte XTS key is the data key followed
+			/// by the tweak key
+			class aes128_xts_key_t {
+				aes128_key_schedule_t m_data_sched;
+				aes128_key_schedule_t m_tweak_sched;
+#if defined( __AES__ )
+				impl::aes_round_keys_t m_data_enc;
+				impl::aes_round_keys_t m_data_dec;
+				impl::aes_round_keys_t m_tweak_enc;
+#endif
+
+				static daw::span<uint8_t const> check( daw::span<uint8_t const> key ) {
+					if( key.size( ) != 2u * impl::AES128_KEY_SIZE::value ) {
+						throw std::invalid_argument(
+						  "XTS-AES-128 keys are 32 bytes, data key then tweak key" );
+					}
+					return key;
+				}
+
+			public:
+				explicit aes128_xts_key_t( daw::span<uint8_t const> key )
+				  : m_data_sched( impl::aes128_key_schedule(
+				      check( key ).subset( 0, impl::AES128_KEY_SIZE::value ) ) )
+				  , m_tweak_sched( impl::aes128_key_schedule( key.subset(
+				      impl::AES128_KEY_SIZE::value, impl::AES128_KEY_SIZE::value ) ) )
+#if defined( __AES__ )
+				  , m_data_enc( impl::load_round_keys( m_data_sched ) )
+				  , m_data_dec( impl::decrypt_round_keys( m_data_enc ) )
+				  , m_tweak_enc( impl::load_round_keys( m_tweak_sched ) )
+#endif
+				{
+				}
+
+				aes128_key_schedule_t const &data_schedule( ) const noexcept {
+					return m_data_sched;
+				}
+
+				aes128_key_schedule_t const &tweak_schedule( ) const noexcept {
+					return m_tweak_sched;
+				}
+
+#if defined( __AES__ )
+				template<bool Encrypt>
+				impl::aes_round_keys_t const &data_round_keys( ) const noexcept {
+					if constexpr( Encrypt ) {
+						return m_data_enc;
+					} else {
+						return m_data_dec;
+					}
+				}
+
+				impl::aes_round_keys_t const &tweak_round_keys( ) const noexcept {
+					return m_tweak_enc;
+				}
+#endif
+			};
+
+			namespace impl {
+				template<bool Encrypt>
+				cipher_t xts_crypt_block( aes128_xts_key_t const &key,
+				                          cipher_t block,
+				                          cipher_t const &tweak ) noexcept {
+					for( size_t n = 0; n < block.size( ); ++n ) {
+						block[n] ^= tweak[n];
+					}
+#if defined( __AES__ )
+					aesni_crypt_block<Encrypt>( block, key.data_round_keys<Encrypt>( ) );
+#else
+					if constexpr( Encrypt ) {
+						block = aes_encrypt_128_block( daw::make_span( block ),
+						                               key.data_schedule( ) );
+					} else {
+						block = aes_decrypt_128_block( daw::make_span( block ),
+						                               key.data_schedule( ) );
+					}
+#endif
+					for( size_t n = 0; n < block.size( ); ++n ) {
+						block[n] ^= tweak[n];
+					}
+					return block;
+				}
+
+				inline cipher_t xts_initial_tweak( aes128_xts_key_t const &key,
+				                                   uint64_t sector ) noexcept {
+					cipher_t tweak{};
+					for( size_t n = 0; n < sizeof( sector ); ++n ) {
+						tweak[n] = static_cast<uint8_t>( sector >> ( 8u * n ) );
+					}
+#if defined( __AES__ )
+					aesni_crypt_block<true>( tweak, key.tweak_round_keys( ) );
+					return tweak;
+#else
+					return aes_encrypt_128_block( daw::make_span( tweak ),
+					                              key.tweak_schedule( ) );
+#endif
+				}
+
+#if defined( __AES__ )
+				constexpr size_t const xts_lanes = 8;
+
+				template<bool Encrypt, size_t N>
+				inline __m128i xts_blocks( aes128_xts_key_t const &key, __m128i tweak,
+				                           uint8_t const *in, uint8_t *out ) noexcept {
+					__m128i tweaks[N];
+					__m128i blocks[N];
+					for( size_t n = 0; n < N; ++n ) {
+						tweaks[n] = tweak;
+						tweak = xts_mul_alpha( tweak );
+						blocks[n] = _mm_xor_si128(
+						  _mm_loadu_si128( reinterpret_cast<__m128i const *>(
+						    in + n * AES_BLOCK_SIZE::value ) ),
+						  tweaks[n] );
+					}
+					aesni_crypt_blocks<Encrypt>( blocks, key.data_round_keys<Encrypt>( ),
+					                             std::make_index_sequence<N>{} );
+					for( size_t n = 0; n < N; ++n ) {
+						_mm_storeu_si128(
+						  reinterpret_cast<__m128i *>( out + n * AES_BLOCK_SIZE::value ),
+						  _mm_xor_si128( blocks[n], tweaks[n] ) );
+					}
+					return tweak;
+				}
+#endif
+
+				/// @brief Encrypt or decrypt one sector of at least one block.  in and
+				/// out may be the same buffer
+				template<bool Encrypt>
+				void xts_sector( aes128_xts_key_t const &key, uint64_t sector,
+				                 uint8_t const *in, uint8_t *out,
+				                 size_t size ) noexcept {
+					auto const partial = size % AES_BLOCK_SIZE::value;
+					auto blocks = size / AES_BLOCK_SIZE::value;
+					if( partial != 0 ) {
+						// The last whole block takes part in ciphertext stealing
+						--blocks;
+					}
+					auto tweak = xts_initial_tweak( key, sector );
+#if defined( __AES__ )
+					auto t = _mm_loadu_si128(
+					  reinterpret_cast<__m128i const *>( tweak.data( ) ) );
+					for( ; blocks >= xts_lanes; blocks -= xts_lanes ) {
+						t = xts_blocks<Encrypt, xts_lanes>( key, t, in, out );
+						in += xts_lanes * AES_BLOCK_SIZE::value;
+						out += xts_lanes * AES_BLOCK_SIZE::value;
+					}
+					for( ; blocks > 0; --blocks ) {
+						t = xts_blocks<Encrypt, 1>( key, t, in, out );
+						in += AES_BLOCK_SIZE::value;
+						out += AES_BLOCK_SIZE::value;
+					}
+					_mm_storeu_si128( reinterpret_cast<__m128i *>( tweak.data( ) ), t );
+#else
+					for( ; blocks > 0; --blocks ) {
+						cipher_t block{};
+						std::memcpy( block.data( ), in, block.size( ) );
+						block = xts_crypt_block<Encrypt>( key, block, tweak );
+						std::memcpy( out, block.data( ), block.size( ) );
+						xts_mul_alpha( tweak );
+						in += AES_BLOCK_SIZE::value;
+						out += AES_BLOCK_SIZE::value;
+					}
+#endif
+					if( partial == 0 ) {
+						return;
+					}
+					// Ciphertext stealing.  The last whole block is processed with the
+					// tweak after it on decryption and the one before on encryption
+					auto next_tweak = tweak;
+					xts_mul_alpha( next_tweak );
+					cipher_t block{};
+					std::memcpy( block.data( ), in, block.size( ) );
+					block = xts_crypt_block<Encrypt>( key, block,
+					                                  Encrypt ? tweak : next_tweak );
+					cipher_t stolen = block;
+					std::memcpy( stolen.data( ), in + AES_BLOCK_SIZE::value, partial );
+					std::memcpy( out + AES_BLOCK_SIZE::value, block.data( ), partial );
+					stolen = xts_crypt_block<Encrypt>( key, stolen,
+					                                   Encrypt ? next_tweak : tweak );
+					std::memcpy( out, stolen.data( ), stolen.size( ) );
+				}
+
+				/// @brief Throw std::invalid_argument for sizes XTS cannot process
+				inline void xts_check_sizes( size_t sector_size, size_t input_size,
+				                             size_t output_size ) {
+					if( sector_size < AES_BLOCK_SIZE::value ) {
+						throw std::invalid_argument(
+						  "XTS sectors must be at least one block" );
+					}
+					if( output_size < input_size ) {
+						throw std::invalid_argument( "XTS output is smaller than input" );
+					}
+					if( input_size % sector_size != 0 &&
+					    input_size % sector_size < AES_BLOCK_SIZE::value ) {
+						throw std::invalid_argument(
+						  "The last XTS sector must be at least one block" );
+					}
+				}
+
+				template<bool Encrypt>
+				void xts_sectors( aes128_xts_key_t const &key, uint64_t first_sector,
+				                  size_t sector_size, daw::span<uint8_t const> input,
+				                  daw::span<uint8_t> output, size_t threads ) {
+					xts_check_sizes( sector_size, input.size( ), output.size( ) );
+					if( input.empty( ) ) {
+						return;
+					}
+					auto sample = crypto::impl::telemetry_start( );
+					auto const sectors =
+					  ( input.size( ) + sector_size - 1 ) / sector_size;
+					auto const run = [&]( size_t first, size_t last ) {
+						for( size_t n = first; n < last; ++n ) {
+							auto const offset = n * sector_size;
+							xts_sector<Encrypt>(
+							  key, first_sector + n, input.data( ) + offset,
+							  output.data( ) + offset,
+							  std::min( sector_size, input.size( ) - offset ) );
+						}
+					};
+					// Below a megabyte per thread starting threads costs more than it
+					// saves
+					size_t const min_bytes_per_thread = 1024 * 1024;
+					if( threads == 0 ) {
+						threads = std::max( 1U, std::thread::hardware_concurrency( ) );
+					}
+					threads = std::min(
+					  {threads, sectors,
+					   std::max( static_cast<size_t>( 1 ),
+					             input.size( ) / min_bytes_per_thread )} );
+					auto const record = [&] {
+						crypto::impl::telemetry_record( telemetry_op_t::aes128_xts,
+						                                aes_telemetry_backend, 1,
+						                                input.size( ), sample );
+					};
+					if( threads <= 1 ) {
+						run( 0, sectors );
+						record( );
+						return;
+					}
+					std::vector<std::thread> workers;
+					workers.reserve( threads - 1 );
+					auto const per_thread = sectors / threads;
+					auto const extra = sectors % threads;
+					size_t first = 0;
+					for( size_t t = 0; t < threads; ++t ) {
+						auto const last = first + per_thread + ( t < extra ? 1 : 0 );
+						if( t + 1 == threads ) {
+							run( first, last );
+						} else {
+							workers.emplace_back( run, first, last );
+						}
+						first = last;
+					}
+					for( auto &w : workers ) {
+						w.join( );
+					}
+					record( );
+				}
+			} // namespace impl
+
+			/// @brief Encrypt one sector.  input must be at least one block and
+			/// output at least as large, they may be the same buffer
+			inline void aes_xts_encrypt_128( aes128_xts_key_t const &key,
+			                                 uint64_t sector,
+			                                 daw::span<uint8_t const> input,
+			                                 daw::span<uint8_t> output ) {
+				impl::xts_sectors<true>( key, sector, input.size( ), input, output, 1 );
+			}
+
+			/// @brief Decrypt one sector
+			inline void aes_xts_decrypt_128( aes128_xts_key_t const &key,
+			                                 uint64_t sector,
+			                                 daw::span<uint8_t const> input,
+			                                 daw::span<uint8_t> output ) {
+				impl::xts_sectors<false>( key, sector, input.size( ), input, output,
+				                          1 );
+			}
+
+			/// @brief Encrypt consecutive sectors of sector_size bytes starting at
+			/// first_sector, spread over up to threads threads(0 for one per core).
+			/// The last sector may be shorter but must be at least one block
+			inline void aes_xts_encrypt_128_sectors( aes128_xts_key_t const &key,
+			                                         uint64_t first_sector,
+			                                         size_t sector_size,
+			                                         daw::span<uint8_t const> input,
+			                                         daw::span<uint8_t> output,
+			                                         size_t threads = 0 ) {
+				impl::xts_sectors<true>( key, first_sector, sector_size, input, output,
+				                         threads );
+			}
+
+			/// @brief Decrypt consecutive sectors, the inverse of
+			/// aes_xts_encrypt_128_sectors
+			inline void aes_xts_decrypt_128_sectors( aes128_xts_key_t const &key,
+			                                         uint64_t first_sector,
+			                                         size_t sector_size,
+			                                         daw::span<uint8_t const> input,
+			                                         daw::span<uint8_t> output,
+			                                         size_t threads = 0 ) {
+				impl::xts_sectors<false>( key, first_sector, sector_size, input, output,
+				                          threads );
+			}
+		} // namespace aes
+	}   // namespace crypto
+} // namespace daw
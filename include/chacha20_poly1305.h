@@ -0,0 +1,884 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+// ChaCha20-Poly1305 AEAD(RFC 8439).  It needs nothing but 32 bit adds,
+// rotates and xors, so it stays fast on hosts without AES-NI.  With AVX2 or
+// AVX-512 ChaCha20 runs 8 or 16 blocks side by side and Poly1305 works on 4
+// blocks at a time.  Everything has a scalar path usable in constant
+// expressions
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#endif
+
+#include <daw/daw_span.h>
+
+#include "crypto_config.h"
+
+namespace daw {
+	namespace crypto {
+		using chacha20_key_t = std::array<uint8_t, 32>;
+		using chacha20_nonce_t = std::array<uint8_t, 12>;
+		using poly1305_key_t = std::array<uint8_t, 32>;
+		using poly1305_tag_t = std::array<uint8_t, 16>;
+
+		namespace impl {
+			using chacha20_state_t = std::array<uint32_t, 16>;
+			constexpr size_t const chacha20_block_size = 64;
+			constexpr size_t const poly1305_block_size = 16;
+
+			constexpr uint32_t load32_le( uint8_t const *ptr ) noexcept {
+				return static_cast<uint32_t>( ptr[0] ) |
+				       ( static_cast<uint32_t>( ptr[1] ) << 8u ) |
+				       ( static_cast<uint32_t>( ptr[2] ) << 16u ) |
+				       ( static_cast<uint32_t>( ptr[3] ) << 24u );
+			}
+
+			constexpr void store32_le( uint8_t *ptr, uint32_t value ) noexcept {
+				for( size_t n = 0; n < 4; ++n ) {
+					ptr[n] = static_cast<uint8_t>( value >> ( 8u * n ) );
+				}
+			}
+
+			constexpr uint32_t rotl32( uint32_t value, unsigned bits ) noexcept {
+				return ( value << bits ) | ( value >> ( 32u - bits ) );
+			}
+
+			constexpr chacha20_state_t chacha20_init( chacha20_key_t const &key,
+			                                          chacha20_nonce_t const &nonce,
+			                                          uint32_t counter ) noexcept {
+				chacha20_state_t state = {0x6170'7865, 0x3320'646e, 0x7962'2d32,
+				                          0x6b20'6574};
+				for( size_t n = 0; n < 8; ++n ) {
+					state[4 + n] = load32_le( key.data( ) + 4 * n );
+				}
+				state[12] = counter;
+				for( size_t n = 0; n < 3; ++n ) {
+					state[13 + n] = load32_le( nonce.data( ) + 4 * n );
+				}
+				return state;
+			}
+
+			constexpr void chacha20_quarter_round( chacha20_state_t &x, size_t a,
+			                                       size_t b, size_t c,
+			                                       size_t d ) noexcept {
+				x[a] += x[b];
+				x[d] = rotl32( x[d] ^ x[a], 16 );
+				x[c] += x[d];
+				x[b] = rotl32( x[b] ^ x[c], 12 );
+				x[a] += x[b];
+				x[d] = rotl32( x[d] ^ x[a], 8 );
+				x[c] += x[d];
+				x[b] = rotl32( x[b] ^ x[c], 7 );
+			}
+
+			/// @brief One 64 byte block of key stream for the counter in state[12]
+			constexpr void chacha20_block( chacha20_state_t const &state,
+			                               uint8_t *out ) noexcept {
+				auto x = state;
+				for( size_t n = 0; n < 10; ++n ) {
+					chacha20_quarter_round( x, 0, 4, 8, 12 );
+					chacha20_quarter_round( x, 1, 5, 9, 13 );
+					chacha20_quarter_round( x, 2, 6, 10, 14 );
+					chacha20_quarter_round( x, 3, 7, 11, 15 );
+					chacha20_quarter_round( x, 0, 5, 10, 15 );
+					chacha20_quarter_round( x, 1, 6, 11, 12 );
+					chacha20_quarter_round( x, 2, 7, 8, 13 );
+					chacha20_quarter_round( x, 3, 4, 9, 14 );
+				}
+				for( size_t n = 0; n < x.size( ); ++n ) {
+					store32_le( out + 4 * n, x[n] + state[n] );
+				}
+			}
+
+			/// @brief XOR size bytes with the key stream a block at a time and
+			/// advance the block counter.  in and out may be the same buffer
+			constexpr void chacha20_xor_scalar( chacha20_state_t &state,
+			                                    uint8_t const *in, uint8_t *out,
+			                                    size_t size ) noexcept {
+				std::array<uint8_t, chacha20_block_size> key_stream{};
+				while( size > 0 ) {
+					chacha20_block( state, key_stream.data( ) );
+					++state[12];
+					auto const count = std::min( size, chacha20_block_size );
+					for( size_t n = 0; n < count; ++n ) {
+						out[n] = static_cast<uint8_t>( in[n] ^ key_stream[n] );
+					}
+					in += count;
+					out += count;
+					size -= count;
+				}
+			}
+
+#if defined( __AVX2__ )
+			template<unsigned Bits>
+			inline __m256i rotl32_avx2( __m256i value ) noexcept {
+				if constexpr( Bits == 16 ) {
+					return _mm256_shuffle_epi8(
+					  value, _mm256_setr_epi8( 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14,
+					                           15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 10,
+					                           11, 8, 9, 14, 15, 12, 13 ) );
+				} else if constexpr( Bits == 8 ) {
+					return _mm256_shuffle_epi8(
+					  value, _mm256_setr_epi8( 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15,
+					                           12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6, 11,
+					                           8, 9, 10, 15, 12, 13, 14 ) );
+				} else {
+					return _mm256_or_si256( _mm256_slli_epi32( value, Bits ),
+					                        _mm256_srli_epi32( value, 32 - Bits ) );
+				}
+			}
+
+			inline void chacha20_quarter_round_avx2( __m256i &a, __m256i &b,
+			                                         __m256i &c,
+			                                         __m256i &d ) noexcept {
+				a = _mm256_add_epi32( a, b );
+				d = rotl32_avx2<16>( _mm256_xor_si256( d, a ) );
+				c = _mm256_add_epi32( c, d );
+				b = rotl32_avx2<12>( _mm256_xor_si256( b, c ) );
+				a = _mm256_add_epi32( a, b );
+				d = rotl32_avx2<8>( _mm256_xor_si256( d, a ) );
+				c = _mm256_add_epi32( c, d );
+				b = rotl32_avx2<7>( _mm256_xor_si256( b, c ) );
+			}
+
+			/// @brief 8 blocks(512 bytes) at once.  Lane n of x[i] is word i of
+			/// block n, so the result is transposed back to block order on the way
+			/// out
+			inline void chacha20_xor_avx2( chacha20_state_t &state,
+			                               uint8_t const *in,
+			                               uint8_t *out ) noexcept {
+				__m256i initial[16];
+				for( size_t n = 0; n < 16; ++n ) {
+					initial[n] = _mm256_set1_epi32( static_cast<int>( state[n] ) );
+				}
+				initial[12] = _mm256_add_epi32(
+				  initial[12], _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+				__m256i x[16];
+				std::copy( initial, initial + 16, x );
+				for( size_t n = 0; n < 10; ++n ) {
+					chacha20_quarter_round_avx2( x[0], x[4], x[8], x[12] );
+					chacha20_quarter_round_avx2( x[1], x[5], x[9], x[13] );
+					chacha20_quarter_round_avx2( x[2], x[6], x[10], x[14] );
+					chacha20_quarter_round_avx2( x[3], x[7], x[11], x[15] );
+					chacha20_quarter_round_avx2( x[0], x[5], x[10], x[15] );
+					chacha20_quarter_round_avx2( x[1], x[6], x[11], x[12] );
+					chacha20_quarter_round_avx2( x[2], x[7], x[8], x[13] );
+					chacha20_quarter_round_avx2( x[3], x[4], x[9], x[14] );
+				}
+				for( size_t n = 0; n < 16; ++n ) {
+					x[n] = _mm256_add_epi32( x[n], initial[n] );
+				}
+				// Words 0-7 then 8-15 of every block, an 8x8 transpose each
+				for( size_t half = 0; half < 2; ++half ) {
+					auto const *a = x + 8 * half;
+					auto const t0 = _mm256_unpacklo_epi32( a[0], a[1] );
+					auto const t1 = _mm256_unpackhi_epi32( a[0], a[1] );
+					auto const t2 = _mm256_unpacklo_epi32( a[2], a[3] );
+					auto const t3 = _mm256_unpackhi_epi32( a[2], a[3] );
+					auto const t4 = _mm256_unpacklo_epi32( a[4], a[5] );
+					auto const t5 = _mm256_unpackhi_epi32( a[4], a[5] );
+					auto const t6 = _mm256_unpacklo_epi32( a[6], a[7] );
+					auto const t7 = _mm256_unpackhi_epi32( a[6], a[7] );
+					// u0 holds words 0-3 of blocks 0 and 4, u1 blocks 1 and 5...
+					__m256i const lo[4] = {
+					  _mm256_unpacklo_epi64( t0, t2 ), _mm256_unpackhi_epi64( t0, t2 ),
+					  _mm256_unpacklo_epi64( t1, t3 ), _mm256_unpackhi_epi64( t1, t3 )};
+					__m256i const hi[4] = {
+					  _mm256_unpacklo_epi64( t4, t6 ), _mm256_unpackhi_epi64( t4, t6 ),
+					  _mm256_unpacklo_epi64( t5, t7 ), _mm256_unpackhi_epi64( t5, t7 )};
+					for( size_t b = 0; b < 4; ++b ) {
+						auto const emit = [&]( size_t block, __m256i value ) {
+							auto const offset = block * chacha20_block_size + 32 * half;
+							auto const src = _mm256_loadu_si256(
+							  reinterpret_cast<__m256i const *>( in + offset ) );
+							_mm256_storeu_si256( reinterpret_cast<__m256i *>( out + offset ),
+							                     _mm256_xor_si256( value, src ) );
+						};
+						emit( b, _mm256_permute2x128_si256( lo[b], hi[b], 0x20 ) );
+						emit( b + 4, _mm256_permute2x128_si256( lo[b], hi[b], 0x31 ) );
+					}
+				}
+				state[12] += 8;
+			}
+#endif
+
+#if defined( __AVX512F__ )
+			inline void chacha20_quarter_round_avx512( __m512i &a, __m512i &b,
+			                                           __m512i &c,
+			                                           __m512i &d ) noexcept {
+				a = _mm512_add_epi32( a, b );
+				d = _mm512_rol_epi32( _mm512_xor_si512( d, a ), 16 );
+				c = _mm512_add_epi32( c, d );
+				b = _mm512_rol_epi32( _mm512_xor_si512( b, c ), 12 );
+				a = _mm512_add_epi32( a, b );
+				d = _mm512_rol_epi32( _mm512_xor_si512( d, a ), 8 );
+				c = _mm512_add_epi32( c, d );
+				b = _mm512_rol_epi32( _mm512_xor_si512( b, c ), 7 );
+			}
+
+			/// @brief 16 blocks(1024 bytes) at once, laid out as in
+			/// chacha20_xor_avx2
+			inline void chacha20_xor_avx512( chacha20_state_t &state,
+			                                 uint8_t const *in,
+			                                 uint8_t *out ) noexcept {
+				__m512i initial[16];
+				for( size_t n = 0; n < 16; ++n ) {
+					initial[n] = _mm512_set1_epi32( static_cast<int>( state[n] ) );
+				}
+				initial[12] = _mm512_add_epi32(
+				  initial[12], _mm512_set_epi32( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6,
+				                                 5, 4, 3, 2, 1, 0 ) );
+				__m512i x[16];
+				std::copy( initial, initial + 16, x );
+				for( size_t n = 0; n < 10; ++n ) {
+					chacha20_quarter_round_avx512( x[0], x[4], x[8], x[12] );
+					chacha20_quarter_round_avx512( x[1], x[5], x[9], x[13] );
+					chacha20_quarter_round_avx512( x[2], x[6], x[10], x[14] );
+					chacha20_quarter_round_avx512( x[3], x[7], x[11], x[15] );
+					chacha20_quarter_round_avx512( x[0], x[5], x[10], x[15] );
+					chacha20_quarter_round_avx512( x[1], x[6], x[11], x[12] );
+					chacha20_quarter_round_avx512( x[2], x[7], x[8], x[13] );
+					chacha20_quarter_round_avx512( x[3], x[4], x[9], x[14] );
+				}
+				for( size_t n = 0; n < 16; ++n ) {
+					x[n] = _mm512_add_epi32( x[n], initial[n] );
+				}
+				// A 4x4 transpose within each 128 bit lane gives rows[g][j], whose
+				// lane L is words 4g to 4g+3 of block 4L+j.  A 4x4 transpose of the
+				// lanes then gathers each block
+				__m512i rows[4][4];
+				for( size_t g = 0; g < 4; ++g ) {
+					auto const *a = x + 4 * g;
+					auto const t0 = _mm512_unpacklo_epi32( a[0], a[1] );
+					auto const t1 = _mm512_unpackhi_epi32( a[0], a[1] );
+					auto const t2 = _mm512_unpacklo_epi32( a[2], a[3] );
+					auto const t3 = _mm512_unpackhi_epi32( a[2], a[3] );
+					rows[g][0] = _mm512_unpacklo_epi64( t0, t2 );
+					rows[g][1] = _mm512_unpackhi_epi64( t0, t2 );
+					rows[g][2] = _mm512_unpacklo_epi64( t1, t3 );
+					rows[g][3] = _mm512_unpackhi_epi64( t1, t3 );
+				}
+				auto const emit = [&]( size_t block, __m512i value ) {
+					auto const offset = block * chacha20_block_size;
+					_mm512_storeu_si512(
+					  out + offset,
+					  _mm512_xor_si512( value, _mm512_loadu_si512( in + offset ) ) );
+				};
+				for( size_t j = 0; j < 4; ++j ) {
+					auto const v0 = _mm512_shuffle_i32x4( rows[0][j], rows[1][j], 0x44 );
+					auto const v1 = _mm512_shuffle_i32x4( rows[0][j], rows[1][j], 0xEE );
+					auto const v2 = _mm512_shuffle_i32x4( rows[2][j], rows[3][j], 0x44 );
+					auto const v3 = _mm512_shuffle_i32x4( rows[2][j], rows[3][j], 0xEE );
+					emit( j, _mm512_shuffle_i32x4( v0, v2, 0x88 ) );
+					emit( 4 + j, _mm512_shuffle_i32x4( v0, v2, 0xDD ) );
+					emit( 8 + j, _mm512_shuffle_i32x4( v1, v3, 0x88 ) );
+					emit( 12 + j, _mm512_shuffle_i32x4( v1, v3, 0xDD ) );
+				}
+				state[12] += 16;
+			}
+#endif
+
+			/// @brief XOR size bytes with the key stream and advance the block
+			/// counter past every block used.  in and out may be the same buffer
+			constexpr void chacha20_xor( chacha20_state_t &state, uint8_t const *in,
+			                             uint8_t *out, size_t size ) noexcept {
+				if( !is_constant_evaluated( ) ) {
+#if defined( __AVX512F__ )
+					for( ; size >= 16 * chacha20_block_size;
+					     size -= 16 * chacha20_block_size ) {
+						chacha20_xor_avx512( state, in, out );
+						in += 16 * chacha20_block_size;
+						out += 16 * chacha20_block_size;
+					}
+#endif
+#if defined( __AVX2__ )
+					for( ; size >= 8 * chacha20_block_size;
+					     size -= 8 * chacha20_block_size ) {
+						chacha20_xor_avx2( state, in, out );
+						in += 8 * chacha20_block_size;
+						out += 8 * chacha20_block_size;
+					}
+					if( size > 2 * chacha20_block_size ) {
+						// Cheaper to run 8 blocks and drop some than to do 3 or more
+						// one at a time
+						std::array<uint8_t, 8 * chacha20_block_size> tmp{};
+						std::copy( in, in + size, tmp.data( ) );
+						auto const counter = state[12];
+						chacha20_xor_avx2( state, tmp.data( ), tmp.data( ) );
+						std::copy( tmp.data( ), tmp.data( ) + size, out );
+						state[12] = counter + static_cast<uint32_t>(
+						                        ( size + chacha20_block_size - 1 ) /
+						                        chacha20_block_size );
+						return;
+					}
+#endif
+				}
+				chacha20_xor_scalar( state, in, out, size );
+			}
+
+			/// @brief Poly1305 in radix 2^26, so every product of two limbs fits
+			/// in 64 bits
+			using poly1305_limbs_t = std::array<uint32_t, 5>;
+
+			struct poly1305_state_t {
+				poly1305_limbs_t r{};
+				poly1305_limbs_t h{};
+				std::array<uint32_t, 4> pad{};
+			};
+
+			constexpr uint32_t const poly1305_mask = 0x3ff'ffff;
+
+			/// @brief Carry d down to limbs of 26 bits, folding the part above
+			/// 2^130 back in times 5
+			constexpr poly1305_limbs_t
+			poly1305_carry( std::array<uint64_t, 5> d ) noexcept {
+				poly1305_limbs_t h{};
+				d[1] += d[0] >> 26u;
+				h[0] = static_cast<uint32_t>( d[0] ) & poly1305_mask;
+				d[2] += d[1] >> 26u;
+				h[1] = static_cast<uint32_t>( d[1] ) & poly1305_mask;
+				d[3] += d[2] >> 26u;
+				h[2] = static_cast<uint32_t>( d[2] ) & poly1305_mask;
+				d[4] += d[3] >> 26u;
+				h[3] = static_cast<uint32_t>( d[3] ) & poly1305_mask;
+				auto const c = static_cast<uint32_t>( d[4] >> 26u );
+				h[4] = static_cast<uint32_t>( d[4] ) & poly1305_mask;
+				h[0] += c * 5u;
+				h[1] += h[0] >> 26u;
+				h[0] &= poly1305_mask;
+				return h;
+			}
+
+			/// @brief h = h * r mod 2^130 - 5
+			constexpr void poly1305_mul( poly1305_limbs_t &h,
+			                             poly1305_limbs_t const &r ) noexcept {
+				auto const m = []( uint32_t a, uint32_t b ) {
+					return static_cast<uint64_t>( a ) * b;
+				};
+				auto const s1 = r[1] * 5u;
+				auto const s2 = r[2] * 5u;
+				auto const s3 = r[3] * 5u;
+				auto const s4 = r[4] * 5u;
+				h = poly1305_carry( {
+				  m( h[0], r[0] ) + m( h[1], s4 ) + m( h[2], s3 ) + m( h[3], s2 ) +
+				    m( h[4], s1 ),
+				  m( h[0], r[1] ) + m( h[1], r[0] ) + m( h[2], s4 ) + m( h[3], s3 ) +
+				    m( h[4], s2 ),
+				  m( h[0], r[2] ) + m( h[1], r[1] ) + m( h[2], r[0] ) + m( h[3], s4 ) +
+				    m( h[4], s3 ),
+				  m( h[0], r[3] ) + m( h[1], r[2] ) + m( h[2], r[1] ) +
+				    m( h[3], r[0] ) + m( h[4], s4 ),
+				  m( h[0], r[4] ) + m( h[1], r[3] ) + m( h[2], r[2] ) +
+				    m( h[3], r[1] ) + m( h[4], r[0] )} );
+			}
+
+			/// @brief A 16 byte block as limbs, hibit is the 2^128 bit appended to
+			/// every full block
+			constexpr poly1305_limbs_t poly1305_load( uint8_t const *block,
+			                                          uint32_t hibit ) noexcept {
+				return {load32_le( block ) & poly1305_mask,
+				        ( load32_le( block + 3 ) >> 2u ) & poly1305_mask,
+				        ( load32_le( block + 6 ) >> 4u ) & poly1305_mask,
+				        ( load32_le( block + 9 ) >> 6u ) & poly1305_mask,
+				        ( load32_le( block + 12 ) >> 8u ) | hibit};
+			}
+
+			constexpr uint32_t const poly1305_hibit = 1u << 24u;
+
+			constexpr poly1305_state_t
+			poly1305_init( poly1305_key_t const &key ) noexcept {
+				poly1305_state_t state{};
+				// r is clamped as the spec requires
+				state.r = {load32_le( key.data( ) ) & 0x3ff'ffff,
+				           ( load32_le( key.data( ) + 3 ) >> 2u ) & 0x3ff'ff03,
+				           ( load32_le( key.data( ) + 6 ) >> 4u ) & 0x3ff'c0ff,
+				           ( load32_le( key.data( ) + 9 ) >> 6u ) & 0x3f0'3fff,
+				           ( load32_le( key.data( ) + 12 ) >> 8u ) & 0x00f'ffff};
+				for( size_t n = 0; n < state.pad.size( ); ++n ) {
+					state.pad[n] = load32_le( key.data( ) + 16 + 4 * n );
+				}
+				return state;
+			}
+
+			constexpr void poly1305_blocks_scalar( poly1305_state_t &state,
+			                                       uint8_t const *blocks,
+			                                       size_t count,
+			                                       uint32_t hibit ) noexcept {
+				for( ; count > 0; --count ) {
+					auto const m = poly1305_load( blocks, hibit );
+					for( size_t n = 0; n < m.size( ); ++n ) {
+						state.h[n] += m[n];
+					}
+					poly1305_mul( state.h, state.r );
+					blocks += poly1305_block_size;
+				}
+			}
+
+#if defined( __AVX2__ )
+			/// @brief The 5 limbs of 4 lanes.  A struct rather than a std::array,
+			/// which drops the alignment attribute of __m256i
+			struct poly1305_vec_t {
+				__m256i limbs[5];
+
+				static constexpr size_t size( ) noexcept {
+					return 5;
+				}
+
+				__m256i &operator[]( size_t n ) noexcept {
+					return limbs[n];
+				}
+
+				__m256i const &operator[]( size_t n ) const noexcept {
+					return limbs[n];
+				}
+			};
+
+			inline poly1305_vec_t
+			poly1305_load_avx2( uint8_t const *blocks ) noexcept {
+				alignas( 32 ) std::array<std::array<uint64_t, 4>, 5> limbs{};
+				for( size_t b = 0; b < 4; ++b ) {
+					auto const m =
+					  poly1305_load( blocks + b * poly1305_block_size, poly1305_hibit );
+					for( size_t n = 0; n < m.size( ); ++n ) {
+						limbs[n][b] = m[n];
+					}
+				}
+				poly1305_vec_t result;
+				for( size_t n = 0; n < result.size( ); ++n ) {
+					result[n] = _mm256_load_si256(
+					  reinterpret_cast<__m256i const *>( limbs[n].data( ) ) );
+				}
+				return result;
+			}
+
+			/// @brief h = h * r in each 64 bit lane, as poly1305_mul
+			inline void poly1305_mul_avx2( poly1305_vec_t &h,
+			                               poly1305_vec_t const &r ) noexcept {
+				auto const m = []( __m256i a, __m256i b ) {
+					return _mm256_mul_epu32( a, b );
+				};
+				auto const add = []( auto a, auto... b ) {
+					( ( a = _mm256_add_epi64( a, b ) ), ... );
+					return a;
+				};
+				auto const times5 = [&]( __m256i a ) {
+					return _mm256_add_epi64( a, _mm256_slli_epi64( a, 2 ) );
+				};
+				auto const s1 = times5( r[1] );
+				auto const s2 = times5( r[2] );
+				auto const s3 = times5( r[3] );
+				auto const s4 = times5( r[4] );
+				poly1305_vec_t d = {{
+				  add( m( h[0], r[0] ), m( h[1], s4 ), m( h[2], s3 ), m( h[3], s2 ),
+				       m( h[4], s1 ) ),
+				  add( m( h[0], r[1] ), m( h[1], r[0] ), m( h[2], s4 ), m( h[3], s3 ),
+				       m( h[4], s2 ) ),
+				  add( m( h[0], r[2] ), m( h[1], r[1] ), m( h[2], r[0] ), m( h[3], s4 ),
+				       m( h[4], s3 ) ),
+				  add( m( h[0], r[3] ), m( h[1], r[2] ), m( h[2], r[1] ),
+				       m( h[3], r[0] ), m( h[4], s4 ) ),
+				  add( m( h[0], r[4] ), m( h[1], r[3] ), m( h[2], r[2] ),
+				       m( h[3], r[1] ), m( h[4], r[0] ) )}};
+				auto const mask = _mm256_set1_epi64x( poly1305_mask );
+				for( size_t n = 0; n < 4; ++n ) {
+					d[n + 1] =
+					  _mm256_add_epi64( d[n + 1], _mm256_srli_epi64( d[n], 26 ) );
+					d[n] = _mm256_and_si256( d[n], mask );
+				}
+				auto const c = _mm256_srli_epi64( d[4], 26 );
+				d[4] = _mm256_and_si256( d[4], mask );
+				d[0] = _mm256_add_epi64( d[0], times5( c ) );
+				d[1] = _mm256_add_epi64( d[1], _mm256_srli_epi64( d[0], 26 ) );
+				d[0] = _mm256_and_si256( d[0], mask );
+				h = d;
+			}
+
+			/// @brief 4 interleaved Poly1305 evaluations.  Lane k accumulates
+			/// blocks k, k+4, k+8... times r^4 per step, and the lanes are combined
+			/// by multiplying them by r^4, r^3, r^2 and r.  count is a multiple of
+			/// 4
+			inline void poly1305_blocks_avx2( poly1305_state_t &state,
+			                                  uint8_t const *blocks,
+			                                  size_t count ) noexcept {
+				std::array<poly1305_limbs_t, 4> powers = {state.r, state.r, state.r,
+				                                          state.r};
+				for( size_t n = 1; n < powers.size( ); ++n ) {
+					powers[n] = powers[n - 1];
+					poly1305_mul( powers[n], state.r );
+				}
+				auto const broadcast = [&]( poly1305_limbs_t const &limbs ) {
+					poly1305_vec_t result;
+					for( size_t n = 0; n < result.size( ); ++n ) {
+						result[n] = _mm256_set1_epi64x( limbs[n] );
+					}
+					return result;
+				};
+				auto const r4 = broadcast( powers[3] );
+
+				auto h = poly1305_load_avx2( blocks );
+				h[0] = _mm256_add_epi64(
+				  h[0], _mm256_setr_epi64x( state.h[0], 0, 0, 0 ) );
+				for( size_t n = 1; n < h.size( ); ++n ) {
+					h[n] = _mm256_add_epi64(
+					  h[n], _mm256_setr_epi64x( state.h[n], 0, 0, 0 ) );
+				}
+				for( count -= 4, blocks += 4 * poly1305_block_size; count > 0;
+				     count -= 4, blocks += 4 * poly1305_block_size ) {
+					poly1305_mul_avx2( h, r4 );
+					auto const m = poly1305_load_avx2( blocks );
+					for( size_t n = 0; n < h.size( ); ++n ) {
+						h[n] = _mm256_add_epi64( h[n], m[n] );
+					}
+				}
+				poly1305_vec_t last;
+				for( size_t n = 0; n < last.size( ); ++n ) {
+					last[n] = _mm256_setr_epi64x( powers[3][n], powers[2][n],
+					                              powers[1][n], powers[0][n] );
+				}
+				poly1305_mul_avx2( h, last );
+
+				alignas( 32 ) std::array<uint64_t, 4> lanes{};
+				std::array<uint64_t, 5> sum{};
+				for( size_t n = 0; n < h.size( ); ++n ) {
+					_mm256_store_si256( reinterpret_cast<__m256i *>( lanes.data( ) ),
+					                    h[n] );
+					sum[n] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+				}
+				state.h = poly1305_carry( sum );
+			}
+#endif
+
+			/// @brief Absorb count full blocks
+			constexpr void poly1305_blocks( poly1305_state_t &state,
+			                                uint8_t const *blocks,
+			                                size_t count ) noexcept {
+#if defined( __AVX2__ )
+				// Below this the cost of computing r^2..r^4 is not won back
+				constexpr size_t const min_vector_blocks = 16;
+				if( !is_constant_evaluated( ) && count >= min_vector_blocks ) {
+					auto const vector_blocks = count - count % 4;
+					poly1305_blocks_avx2( state, blocks, vector_blocks );
+					blocks += vector_blocks * poly1305_block_size;
+					count -= vector_blocks;
+				}
+#endif
+				poly1305_blocks_scalar( state, blocks, count, poly1305_hibit );
+			}
+
+			constexpr poly1305_tag_t
+			poly1305_finish( poly1305_state_t const &state ) noexcept {
+				auto h = state.h;
+				// Fully carry h, then subtract p if h >= p without branching
+				for( size_t n = 1; n < h.size( ); ++n ) {
+					h[n] += h[n - 1] >> 26u;
+					h[n - 1] &= poly1305_mask;
+				}
+				h[0] += ( h[4] >> 26u ) * 5u;
+				h[4] &= poly1305_mask;
+				h[1] += h[0] >> 26u;
+				h[0] &= poly1305_mask;
+
+				poly1305_limbs_t g{};
+				uint32_t carry = 5;
+				for( size_t n = 0; n < 4; ++n ) {
+					g[n] = h[n] + carry;
+					carry = g[n] >> 26u;
+					g[n] &= poly1305_mask;
+				}
+				g[4] = h[4] + carry - ( 1u << 26u );
+				// All ones when h + 5 reached 2^130, i.e. h >= p
+				auto const use_g = ( g[4] >> 31u ) - 1u;
+				for( size_t n = 0; n < h.size( ); ++n ) {
+					h[n] = ( h[n] & ~use_g ) | ( g[n] & use_g );
+				}
+
+				std::array<uint32_t, 4> const words = {
+				  h[0] | ( h[1] << 26u ), ( h[1] >> 6u ) | ( h[2] << 20u ),
+				  ( h[2] >> 12u ) | ( h[3] << 14u ), ( h[3] >> 18u ) | ( h[4] << 8u )};
+				poly1305_tag_t tag{};
+				uint64_t sum = 0;
+				for( size_t n = 0; n < words.size( ); ++n ) {
+					sum = ( sum >> 32u ) + words[n] + state.pad[n];
+					store32_le( tag.data( ) + 4 * n, static_cast<uint32_t>( sum ) );
+				}
+				return tag;
+			}
+		} // namespace impl
+
+		/// @brief XOR input with the ChaCha20 key stream starting at block
+		/// counter and write it to output, which must be at least as large.  The
+		/// same call encrypts and decrypts, and input and output may be the same
+		/// buffer
+		constexpr void chacha20_xor( chacha20_key_t const &key,
+		                             chacha20_nonce_t const &nonce,
+		                             uint32_t counter,
+		                             daw::span<uint8_t const> input,
+		                             daw::span<uint8_t> output ) noexcept {
+			auto state = impl::chacha20_init( key, nonce, counter );
+			impl::chacha20_xor( state, input.data( ), output.data( ),
+			                    input.size( ) );
+		}
+
+		/// @brief Streaming Poly1305 one-time authenticator.  A key must never
+		/// be used for more than one message
+		class poly1305_ctx {
+			impl::poly1305_state_t m_state;
+			std::array<uint8_t, impl::poly1305_block_size> m_block;
+			size_t m_block_size;
+
+		public:
+			explicit constexpr poly1305_ctx( poly1305_key_t const &key ) noexcept
+			  : m_state( impl::poly1305_init( key ) )
+			  , m_block{}
+			  , m_block_size( 0 ) {}
+
+			constexpr void update( daw::span<uint8_t const> data ) noexcept {
+				auto ptr = data.data( );
+				auto size = data.size( );
+				if( m_block_size > 0 ) {
+					auto const count =
+					  std::min( size, impl::poly1305_block_size - m_block_size );
+					for( size_t n = 0; n < count; ++n ) {
+						m_block[m_block_size + n] = ptr[n];
+					}
+					m_block_size += count;
+					ptr += count;
+					size -= count;
+					if( m_block_size < impl::poly1305_block_size ) {
+						return;
+					}
+					impl::poly1305_blocks( m_state, m_block.data( ), 1 );
+					m_block_size = 0;
+				}
+				// Whole blocks are read from the caller's buffer
+				auto const blocks = size / impl::poly1305_block_size;
+				impl::poly1305_blocks( m_state, ptr, blocks );
+				ptr += blocks * impl::poly1305_block_size;
+				size -= blocks * impl::poly1305_block_size;
+				for( size_t n = 0; n < size; ++n ) {
+					m_block[n] = ptr[n];
+				}
+				m_block_size = size;
+			}
+
+			/// @brief Bytes buffered towards the next block
+			constexpr size_t pending( ) const noexcept {
+				return m_block_size;
+			}
+
+			constexpr poly1305_tag_t final( ) noexcept {
+				if( m_block_size > 0 ) {
+					// A final partial block gets a 1 appended instead of the 2^128 bit
+					m_block[m_block_size] = 1;
+					for( size_t n = m_block_size + 1; n < m_block.size( ); ++n ) {
+						m_block[n] = 0;
+					}
+					impl::poly1305_blocks_scalar( m_state, m_block.data( ), 1, 0 );
+					m_block_size = 0;
+				}
+				return impl::poly1305_finish( m_state );
+			}
+		};
+
+		namespace impl {
+			constexpr poly1305_key_t
+			aead_poly1305_key( chacha20_key_t const &key,
+			                   chacha20_nonce_t const &nonce ) noexcept {
+				std::array<uint8_t, chacha20_block_size> block{};
+				chacha20_block( chacha20_init( key, nonce, 0 ), block.data( ) );
+				poly1305_key_t result{};
+				for( size_t n = 0; n < result.size( ); ++n ) {
+					result[n] = block[n];
+				}
+				return result;
+			}
+
+			/// @brief Zero pad the MAC input to a multiple of 16 bytes
+			constexpr void aead_pad16( poly1305_ctx &mac ) noexcept {
+				std::array<uint8_t, poly1305_block_size> const zeros{};
+				if( mac.pending( ) != 0 ) {
+					mac.update( daw::span<uint8_t const>(
+					  zeros.data( ), poly1305_block_size - mac.pending( ) ) );
+				}
+			}
+
+			constexpr poly1305_tag_t aead_final( poly1305_ctx &mac,
+			                                     uint64_t aad_size,
+			                                     uint64_t text_size ) noexcept {
+				aead_pad16( mac );
+				std::array<uint8_t, 16> sizes{};
+				for( size_t n = 0; n < 8; ++n ) {
+					sizes[n] = static_cast<uint8_t>( aad_size >> ( 8u * n ) );
+					sizes[8 + n] = static_cast<uint8_t>( text_size >> ( 8u * n ) );
+				}
+				mac.update( daw::span<uint8_t const>( sizes.data( ), sizes.size( ) ) );
+				return mac.final( );
+			}
+		} // namespace impl
+
+		/// @brief Streaming ChaCha20-Poly1305 for one message.  Pass all of the
+		/// associated data to update_aad before the first encrypt or decrypt
+		/// update.  Decrypted output is not authenticated until verify( )
+		/// returns true; use chacha20_poly1305_open to only release verified
+		/// plain text
+		class chacha20_poly1305_ctx {
+			static constexpr size_t const aead_chunk_size = 4096;
+
+			impl::chacha20_state_t m_cipher;
+			std::array<uint8_t, impl::chacha20_block_size> m_key_stream;
+			size_t m_key_stream_pos;
+			poly1305_ctx m_mac;
+			uint64_t m_aad_size;
+			uint64_t m_text_size;
+			bool m_in_text;
+
+			constexpr void start_text( ) noexcept {
+				if( !m_in_text ) {
+					impl::aead_pad16( m_mac );
+					m_in_text = true;
+				}
+			}
+
+			constexpr void crypt( uint8_t const *in, uint8_t *out,
+			                      size_t size ) noexcept {
+				for( ; size > 0 && m_key_stream_pos < m_key_stream.size( ); --size ) {
+					*out++ = static_cast<uint8_t>( *in++ ^
+					                               m_key_stream[m_key_stream_pos++] );
+				}
+				auto const whole = size - size % impl::chacha20_block_size;
+				impl::chacha20_xor( m_cipher, in, out, whole );
+				in += whole;
+				out += whole;
+				size -= whole;
+				if( size > 0 ) {
+					impl::chacha20_block( m_cipher, m_key_stream.data( ) );
+					++m_cipher[12];
+					for( m_key_stream_pos = 0; m_key_stream_pos < size;
+					     ++m_key_stream_pos ) {
+						out[m_key_stream_pos] = static_cast<uint8_t>(
+						  in[m_key_stream_pos] ^ m_key_stream[m_key_stream_pos] );
+					}
+				}
+			}
+
+		public:
+			constexpr chacha20_poly1305_ctx( chacha20_key_t const &key,
+			                                 chacha20_nonce_t const &nonce ) noexcept
+			  : m_cipher( impl::chacha20_init( key, nonce, 1 ) )
+			  , m_key_stream{}
+			  , m_key_stream_pos( impl::chacha20_block_size )
+			  , m_mac( impl::aead_poly1305_key( key, nonce ) )
+			  , m_aad_size( 0 )
+			  , m_text_size( 0 )
+			  , m_in_text( false ) {}
+
+			constexpr void update_aad( daw::span<uint8_t const> aad ) noexcept {
+				m_mac.update( aad );
+				m_aad_size += aad.size( );
+			}
+
+			/// @brief Encrypt the next part of the message.  output must be at
+			/// least as large as input and may be the same buffer
+			constexpr void encrypt_update( daw::span<uint8_t const> input,
+			                               daw::span<uint8_t> output ) noexcept {
+				start_text( );
+				// MAC each piece while it is still in L1
+				for( size_t pos = 0; pos < input.size( ); pos += aead_chunk_size ) {
+					auto const count = std::min( aead_chunk_size, input.size( ) - pos );
+					crypt( input.data( ) + pos, output.data( ) + pos, count );
+					m_mac.update(
+					  daw::span<uint8_t const>( output.data( ) + pos, count ) );
+				}
+				m_text_size += input.size( );
+			}
+
+			/// @brief Decrypt the next part of the message
+			constexpr void decrypt_update( daw::span<uint8_t const> input,
+			                               daw::span<uint8_t> output ) noexcept {
+				start_text( );
+				for( size_t pos = 0; pos < input.size( ); pos += aead_chunk_size ) {
+					auto const count = std::min( aead_chunk_size, input.size( ) - pos );
+					m_mac.update(
+					  daw::span<uint8_t const>( input.data( ) + pos, count ) );
+					crypt( input.data( ) + pos, output.data( ) + pos, count );
+				}
+				m_text_size += input.size( );
+			}
+
+			/// @brief The tag over the associated data and cipher text so far.  The
+			/// context is finished afterwards
+			constexpr poly1305_tag_t final( ) noexcept {
+				start_text( );
+				return impl::aead_final( m_mac, m_aad_size, m_text_size );
+			}
+
+			/// @brief Compare the computed tag with the received one in constant
+			/// time
+			constexpr bool verify( poly1305_tag_t const &tag ) noexcept {
+				return impl::constant_time_equal( final( ), tag );
+			}
+		};
+
+		/// @brief Encrypt plain_text into cipher_text, which must be at least as
+		/// large, and return the tag
+		constexpr poly1305_tag_t
+		chacha20_poly1305_seal( chacha20_key_t const &key,
+		                        chacha20_nonce_t const &nonce,
+		                        daw::span<uint8_t const> aad,
+		                        daw::span<uint8_t const> plain_text,
+		                        daw::span<uint8_t> cipher_text ) noexcept {
+			chacha20_poly1305_ctx ctx( key, nonce );
+			ctx.update_aad( aad );
+			ctx.encrypt_update( plain_text, cipher_text );
+			return ctx.final( );
+		}
+
+		/// @brief Verify the tag and only then decrypt cipher_text into
+		/// plain_text.  Returns false, leaving plain_text untouched, when
+		/// authentication fails
+		constexpr bool
+		chacha20_poly1305_open( chacha20_key_t const &key,
+		                        chacha20_nonce_t const &nonce,
+		                        daw::span<uint8_t const> aad,
+		                        daw::span<uint8_t const> cipher_text,
+		                        poly1305_tag_t const &tag,
+		                        daw::span<uint8_t> plain_text ) noexcept {
+			poly1305_ctx mac( impl::aead_poly1305_key( key, nonce ) );
+			mac.update( aad );
+			impl::aead_pad16( mac );
+			mac.update( cipher_text );
+			if( !impl::constant_time_equal(
+			      impl::aead_final( mac, aad.size( ), cipher_text.size( ) ), tag ) ) {
+				return false;
+			}
+			chacha20_xor( key, nonce, 1, cipher_text, plain_text );
+			return true;
+		}
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,286 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Storage for bulk input and output.  A std::vector zero fills memory that is
+// about to be overwritten, and a large one is spread over 4KB pages that each
+// cost a TLB entry.  crypto_buffer leaves its bytes uninitialized, aligns
+// them to a cache line or more and can back them with 2MB pages, either
+// transparent huge pages or reserved hugetlbfs pages.  POSIX only
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <daw/daw_span.h>
+
+namespace daw {
+	namespace crypto {
+		/// @brief transparent asks for transparent huge pages with madvise,
+		/// hugetlb maps reserved huge pages and falls back to transparent ones
+		/// when none are free
+		enum class huge_pages_t : uint8_t { none, transparent, hugetlb };
+
+		/// @brief Where a crypto_buffer's memory came from
+		enum class buffer_backing_t : uint8_t {
+			empty,
+			heap,
+			pages,
+			transparent_huge_pages,
+			hugetlb
+		};
+
+		struct buffer_options_t {
+			/// @brief A power of 2.  Page size or more, or any huge pages, maps
+			/// the memory rather than taking it from the heap
+			size_t alignment = 64;
+			huge_pages_t huge_pages = huge_pages_t::none;
+			/// @brief Fault every page in up front so the first pass over the
+			/// buffer does not pay for it
+			bool populate = false;
+			/// @brief Zero the bytes.  Mapped memory already reads as zero
+			bool zero = false;
+		};
+
+		namespace impl {
+			constexpr size_t const huge_page_size = 2 * 1024 * 1024;
+
+			inline size_t page_size( ) noexcept {
+				static size_t const result =
+				  static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+				return result;
+			}
+
+			constexpr size_t round_up( size_t size, size_t alignment ) noexcept {
+				return ( size + alignment - 1 ) & ~( alignment - 1 );
+			}
+		} // namespace impl
+
+		/// @brief A move only, fixed size byte buffer that is not initialized
+		/// unless asked to be
+		class crypto_buffer {
+			uint8_t *m_data = nullptr;
+			size_t m_size = 0;
+			// The mapping m_data is in, nullptr when m_data is from the heap
+			void *m_map = nullptr;
+			size_t m_map_size = 0;
+			buffer_backing_t m_backing = buffer_backing_t::empty;
+
+			void release( ) noexcept {
+				if( m_map != nullptr ) {
+					::munmap( m_map, m_map_size );
+				} else {
+					std::free( m_data );
+				}
+				m_data = nullptr;
+				m_size = 0;
+				m_map = nullptr;
+				m_map_size = 0;
+				m_backing = buffer_backing_t::empty;
+			}
+
+			void *map( size_t size, int flags ) noexcept {
+				auto *result = ::mmap( nullptr, size, PROT_READ | PROT_WRITE,
+				                       MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0 );
+				return result == MAP_FAILED ? nullptr : result;
+			}
+
+			/// @brief Map size bytes starting on an alignment boundary.  Extra
+			/// is mapped and the unaligned ends are returned to the kernel
+			bool map_aligned( size_t size, size_t alignment, int flags ) noexcept {
+				auto const total = size + alignment - impl::page_size( );
+				auto *base = static_cast<uint8_t *>( map( total, flags ) );
+				if( base == nullptr ) {
+					return false;
+				}
+				auto const address = reinterpret_cast<uintptr_t>( base );
+				auto *aligned = reinterpret_cast<uint8_t *>(
+				  impl::round_up( address, alignment ) );
+				auto const head = static_cast<size_t>( aligned - base );
+				if( head != 0 ) {
+					::munmap( base, head );
+				}
+				if( auto const tail = total - head - size; tail != 0 ) {
+					::munmap( aligned + size, tail );
+				}
+				m_map = aligned;
+				m_map_size = size;
+				m_data = aligned;
+				return true;
+			}
+
+		public:
+			crypto_buffer( ) noexcept = default;
+
+			/// @brief size uninitialized bytes.  Throws std::bad_alloc when the
+			/// memory cannot be had
+			explicit crypto_buffer( size_t size, buffer_options_t options = {} )
+			  : m_size( size ) {
+				if( size == 0 ) {
+					return;
+				}
+				auto const alignment =
+				  std::max( options.alignment, alignof( std::max_align_t ) );
+				if( ( alignment & ( alignment - 1 ) ) != 0 ) {
+					throw std::bad_alloc( );
+				}
+				int const populate = options.populate ? MAP_POPULATE : 0;
+				if( options.huge_pages == huge_pages_t::hugetlb ) {
+					auto const map_size = impl::round_up( size, impl::huge_page_size );
+					// Huge page mappings are naturally 2MB aligned
+					m_data = static_cast<uint8_t *>(
+					  map( map_size, MAP_HUGETLB | populate ) );
+					if( m_data != nullptr ) {
+						m_map = m_data;
+						m_map_size = map_size;
+						m_backing = buffer_backing_t::hugetlb;
+					}
+				}
+				if( m_data == nullptr && options.huge_pages != huge_pages_t::none ) {
+					auto const map_size = impl::round_up( size, impl::huge_page_size );
+					if( !map_aligned( map_size,
+					                  std::max( alignment, impl::huge_page_size ), 0 ) ) {
+						throw std::bad_alloc( );
+					}
+					// Only advice, the kernel may still use small pages
+					static_cast<void>( ::madvise( m_map, m_map_size, MADV_HUGEPAGE ) );
+					m_backing = buffer_backing_t::transparent_huge_pages;
+					if( options.populate ) {
+						static_cast<void>( ::madvise( m_map, m_map_size, MADV_WILLNEED ) );
+						for( size_t n = 0; n < m_map_size; n += impl::page_size( ) ) {
+							m_data[n] = 0;
+						}
+					}
+				}
+				if( m_data == nullptr && alignment >= impl::page_size( ) ) {
+					if( !map_aligned( impl::round_up( size, impl::page_size( ) ),
+					                  alignment, populate ) ) {
+						throw std::bad_alloc( );
+					}
+					m_backing = buffer_backing_t::pages;
+				}
+				if( m_data == nullptr ) {
+					void *ptr = nullptr;
+					if( ::posix_memalign( &ptr, alignment, size ) != 0 ) {
+						throw std::bad_alloc( );
+					}
+					m_data = static_cast<uint8_t *>( ptr );
+					m_backing = buffer_backing_t::heap;
+					if( options.zero ) {
+						std::memset( m_data, 0, size );
+					} else if( options.populate ) {
+						for( size_t n = 0; n < size; n += impl::page_size( ) ) {
+							m_data[n] = 0;
+						}
+					}
+				}
+			}
+
+			crypto_buffer( crypto_buffer &&other ) noexcept
+			  : m_data( std::exchange( other.m_data, nullptr ) )
+			  , m_size( std::exchange( other.m_size, 0 ) )
+			  , m_map( std::exchange( other.m_map, nullptr ) )
+			  , m_map_size( std::exchange( other.m_map_size, 0 ) )
+			  , m_backing(
+			      std::exchange( other.m_backing, buffer_backing_t::empty ) ) {}
+
+			crypto_buffer &operator=( crypto_buffer &&rhs ) noexcept {
+				if( this != &rhs ) {
+					release( );
+					m_data = std::exchange( rhs.m_data, nullptr );
+					m_size = std::exchange( rhs.m_size, 0 );
+					m_map = std::exchange( rhs.m_map, nullptr );
+					m_map_size = std::exchange( rhs.m_map_size, 0 );
+					m_backing = std::exchange( rhs.m_backing, buffer_backing_t::empty );
+				}
+				return *this;
+			}
+
+			crypto_buffer( crypto_buffer const & ) = delete;
+			crypto_buffer &operator=( crypto_buffer const & ) = delete;
+
+			~crypto_buffer( ) {
+				release( );
+			}
+
+			uint8_t *data( ) noexcept {
+				return m_data;
+			}
+
+			uint8_t const *data( ) const noexcept {
+				return m_data;
+			}
+
+			size_t size( ) const noexcept {
+				return m_size;
+			}
+
+			bool empty( ) const noexcept {
+				return m_size == 0;
+			}
+
+			uint8_t *begin( ) noexcept {
+				return m_data;
+			}
+
+			uint8_t const *begin( ) const noexcept {
+				return m_data;
+			}
+
+			uint8_t *end( ) noexcept {
+				return m_data + m_size;
+			}
+
+			uint8_t const *end( ) const noexcept {
+				return m_data + m_size;
+			}
+
+			uint8_t &operator[]( size_t n ) noexcept {
+				return m_data[n];
+			}
+
+			uint8_t const &operator[]( size_t n ) const noexcept {
+				return m_data[n];
+			}
+
+			buffer_backing_t backing( ) const noexcept {
+				return m_backing;
+			}
+
+			daw::span<uint8_t> span( ) noexcept {
+				return daw::span<uint8_t>( m_data, m_size );
+			}
+
+			daw::span<uint8_t const> span( ) const noexcept {
+				return daw::span<uint8_t const>( m_data, m_size );
+			}
+		};
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,84 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#if defined( __clang__ )
+#if __has_builtin( __builtin_is_constant_evaluated )
+#define DAW_CRYPTO_HAS_IS_CONSTANT_EVALUATED
+#endif
+#elif defined( __GNUC__ ) && __GNUC__ >= 9
+#define DAW_CRYPTO_HAS_IS_CONSTANT_EVALUATED
+#elif defined( _MSC_VER ) && _MSC_VER >= 1925
+#define DAW_CRYPTO_HAS_IS_CONSTANT_EVALUATED
+#endif
+
+// C++20 coroutines, used for awaitable interfaces when the language mode
+// supports them
+#if defined( __cpp_impl_coroutine ) && defined( __has_include )
+#if __has_include( <coroutine> )
+#define DAW_CRYPTO_HAS_COROUTINES
+#endif
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace daw {
+	namespace crypto {
+		namespace impl {
+			/// @brief Overwrite memory in a way the optimizer cannot remove, for
+			/// keys and other secrets going out of use
+			inline void secure_wipe( void *ptr, size_t size ) noexcept {
+				auto volatile *p = static_cast<unsigned char volatile *>( ptr );
+				while( size-- > 0 ) {
+					*p++ = 0;
+				}
+			}
+
+			/// @brief Compare without an early exit so the time taken does not
+			/// depend on where the inputs first differ, for tags and digests
+			template<size_t N>
+			constexpr bool constant_time_equal(
+			  std::array<uint8_t, N> const &lhs,
+			  std::array<uint8_t, N> const &rhs ) noexcept {
+				uint8_t diff = 0;
+				for( size_t n = 0; n < N; ++n ) {
+					diff = static_cast<uint8_t>( diff | ( lhs[n] ^ rhs[n] ) );
+				}
+				return diff == 0;
+			}
+
+			// Selects between the constexpr friendly scalar code and the faster
+			// intrinsic/load-store code that cannot be used in a constant
+			// expression
+			constexpr bool is_constant_evaluated( ) noexcept {
+#if defined( DAW_CRYPTO_HAS_IS_CONSTANT_EVALUATED )
+				return __builtin_is_constant_evaluated( );
+#else
+				return true;
+#endif
+			}
+		} // namespace impl
+	}   // namespace crypto
+} // namespace daw
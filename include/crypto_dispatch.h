@@ -0,0 +1,700 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Picks between the implementations of an operation by message size.  Which
+// one is fastest depends on the machine as well as the size, so the choice
+// comes from timing each of them on this host: a short calibration the first
+// time the process needs it, or a profile cached by an earlier run on the
+// same CPU and build.  Callers can query the choice and override it
+//
+// The profile is a text file, by default $XDG_CACHE_HOME/daw_crypto_profile
+// or ~/.cache/daw_crypto_profile.  DAW_CRYPTO_PROFILE names another file, or
+// when empty turns the cache off.  DAW_CRYPTO_BACKEND sets overrides, e.g.
+// DAW_CRYPTO_BACKEND=sha256_multi_hash=scalar,aes128_ctr=aesni_serial
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <cpuid.h>
+#endif
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <daw/daw_span.h>
+
+#include "aes.h"
+#include "aes_ctr_hmac.h"
+#include "aes_ni.h"
+#include "crypto_buffer.h"
+#include "sha256.h"
+#include "sha256_fixed.h"
+
+namespace daw {
+	namespace crypto {
+		/// @brief Operations with more than one implementation
+		enum class crypto_op_t : uint8_t { sha256_multi_hash, aes128_ctr };
+
+		/// @brief scalar and multi_buffer hash a set of messages one at a time
+		/// or in SIMD lanes.  aes_table is the portable AES, aesni_serial and
+		/// aesni_pipelined run one or eight CTR blocks through the rounds at a
+		/// time
+		enum class crypto_backend_t : uint8_t {
+			scalar,
+			multi_buffer,
+			aes_table,
+			aesni_serial,
+			aesni_pipelined
+		};
+
+		namespace impl {
+			constexpr size_t const crypto_op_count = 2;
+			constexpr size_t const crypto_backend_count = 5;
+
+			/// @brief Sizes are routed by class, 16 bytes times a power of 4.
+			/// Larger sizes use the last class
+			constexpr size_t const dispatch_size_classes = 7;
+
+			constexpr size_t dispatch_class_size( size_t size_class ) noexcept {
+				return size_t{16} << ( 2 * size_class );
+			}
+
+			/// @brief The smallest class at least size bytes
+			constexpr size_t dispatch_size_class( size_t size ) noexcept {
+				size_t result = 0;
+				while( result + 1 < dispatch_size_classes &&
+				       dispatch_class_size( result ) < size ) {
+					++result;
+				}
+				return result;
+			}
+
+			constexpr std::array<char const *, crypto_op_count> const
+			  crypto_op_names = {"sha256_multi_hash", "aes128_ctr"};
+
+			constexpr std::array<char const *, crypto_backend_count> const
+			  crypto_backend_names = {"scalar", "multi_buffer", "aes_table",
+			                          "aesni_serial", "aesni_pipelined"};
+
+			template<typename Enum, size_t N>
+			std::optional<Enum>
+			enum_from_name( std::array<char const *, N> const &names,
+			                std::string const &name ) {
+				for( size_t n = 0; n < N; ++n ) {
+					if( name == names[n] ) {
+						return static_cast<Enum>( n );
+					}
+				}
+				return std::nullopt;
+			}
+		} // namespace impl
+
+		constexpr char const *to_string( crypto_op_t op ) noexcept {
+			return impl::crypto_op_names[static_cast<size_t>( op )];
+		}
+
+		constexpr char const *to_string( crypto_backend_t backend ) noexcept {
+			return impl::crypto_backend_names[static_cast<size_t>( backend )];
+		}
+
+		/// @brief The backends op can use in this build, fastest first when
+		/// nothing has been measured
+		inline std::vector<crypto_backend_t> crypto_backends( crypto_op_t op ) {
+			switch( op ) {
+			case crypto_op_t::sha256_multi_hash:
+				return {crypto_backend_t::multi_buffer, crypto_backend_t::scalar};
+			case crypto_op_t::aes128_ctr:
+#if defined( __AES__ )
+				return {crypto_backend_t::aesni_pipelined,
+				        crypto_backend_t::aesni_serial, crypto_backend_t::aes_table};
+#else
+				return {crypto_backend_t::aes_table};
+#endif
+			}
+			return {};
+		}
+
+		inline bool crypto_backend_available( crypto_op_t op,
+		                                      crypto_backend_t backend ) {
+			auto const backends = crypto_backends( op );
+			return std::find( backends.begin( ), backends.end( ), backend ) !=
+			       backends.end( );
+		}
+
+		/// @brief Identifies the CPU model and the instruction sets the code was
+		/// built for.  A cached profile is only used when this matches
+		inline std::string crypto_host_key( ) {
+			std::string result;
+#if defined( __x86_64__ ) || defined( __i386__ )
+			std::array<unsigned, 12> brand{};
+			unsigned max_leaf = __get_cpuid_max( 0x8000'0000U, nullptr );
+			if( max_leaf >= 0x8000'0004U ) {
+				for( unsigned n = 0; n < 3; ++n ) {
+					__get_cpuid( 0x8000'0002U + n, &brand[n * 4], &brand[n * 4 + 1],
+					             &brand[n * 4 + 2], &brand[n * 4 + 3] );
+				}
+				result.assign( reinterpret_cast<char const *>( brand.data( ) ),
+				               sizeof( brand ) );
+				result.resize( result.find_last_not_of( std::string( "\0 ", 2 ) ) +
+				               1 );
+				result.erase( 0, result.find_first_not_of( ' ' ) );
+			}
+#endif
+			if( result.empty( ) ) {
+				result = "unknown";
+			}
+#if defined( __AES__ )
+			result += " +aes";
+#endif
+#if defined( __AVX2__ )
+			result += " +avx2";
+#endif
+#if defined( __AVX512F__ )
+			result += " +avx512f";
+#endif
+			return result;
+		}
+
+		/// @brief The chosen backend of each op and size class, and how fast it
+		/// ran in nanoseconds per byte, 0 when not measured
+		struct crypto_profile_t {
+			std::string host_key;
+			std::array<std::array<crypto_backend_t, impl::dispatch_size_classes>,
+			           impl::crypto_op_count>
+			  backends{};
+			std::array<std::array<double, impl::dispatch_size_classes>,
+			           impl::crypto_op_count>
+			  ns_per_byte{};
+
+			/// @brief The first available backend of each op for every size
+			static crypto_profile_t defaults( ) {
+				crypto_profile_t result{};
+				result.host_key = crypto_host_key( );
+				for( size_t op = 0; op < impl::crypto_op_count; ++op ) {
+					result.backends[op].fill(
+					  crypto_backends( static_cast<crypto_op_t>( op ) ).front( ) );
+				}
+				return result;
+			}
+		};
+
+		/// @brief A run of sizes, from min_size up to the next crossover, all
+		/// routed to backend
+		struct crypto_crossover_t {
+			size_t min_size;
+			crypto_backend_t backend;
+		};
+
+		inline bool save_crypto_profile( crypto_profile_t const &profile,
+		                                 std::string const &path ) {
+			std::ostringstream out;
+			out << "daw_crypto_profile 1\nhost " << profile.host_key << '\n';
+			for( size_t op = 0; op < impl::crypto_op_count; ++op ) {
+				for( size_t c = 0; c < impl::dispatch_size_classes; ++c ) {
+					out << impl::crypto_op_names[op] << ' '
+					    << impl::dispatch_class_size( c ) << ' '
+					    << to_string( profile.backends[op][c] ) << ' '
+					    << profile.ns_per_byte[op][c] << '\n';
+				}
+			}
+			auto const text = out.str( );
+
+			// Written to a uniquely named file beside the target and renamed so
+			// readers never see half a file and concurrent writers never share
+			// a temporary
+			auto tmp_path = path + ".XXXXXX";
+			int const fd = ::mkstemp( &tmp_path[0] );
+			if( fd < 0 ) {
+				return false;
+			}
+			bool ok = ::fchmod( fd, 0644 ) == 0;
+			size_t pos = 0;
+			while( ok && pos < text.size( ) ) {
+				auto const written =
+				  ::write( fd, text.data( ) + pos, text.size( ) - pos );
+				if( written < 0 && errno == EINTR ) {
+					continue;
+				}
+				ok = written > 0;
+				pos += ok ? static_cast<size_t>( written ) : 0;
+			}
+			ok = ( ::close( fd ) == 0 ) && ok;
+			ok = ok && ::rename( tmp_path.c_str( ), path.c_str( ) ) == 0;
+			if( !ok ) {
+				::unlink( tmp_path.c_str( ) );
+			}
+			return ok;
+		}
+
+		/// @brief Read a profile written by save_crypto_profile.  Empty when the
+		/// file is missing, malformed or names a backend this build lacks
+		inline std::optional<crypto_profile_t>
+		load_crypto_profile( std::string const &path ) {
+			std::ifstream in( path );
+			std::string line;
+			if( !std::getline( in, line ) || line != "daw_crypto_profile 1" ||
+			    !std::getline( in, line ) || line.compare( 0, 5, "host " ) != 0 ) {
+				return std::nullopt;
+			}
+			crypto_profile_t result{};
+			result.host_key = line.substr( 5 );
+			std::array<std::array<bool, impl::dispatch_size_classes>,
+			           impl::crypto_op_count>
+			  seen{};
+			while( std::getline( in, line ) ) {
+				std::istringstream fields( line );
+				std::string op_name;
+				size_t size = 0;
+				std::string backend_name;
+				double rate = 0.0;
+				if( !( fields >> op_name >> size >> backend_name >> rate ) ) {
+					return std::nullopt;
+				}
+				auto const op =
+				  impl::enum_from_name<crypto_op_t>( impl::crypto_op_names, op_name );
+				auto const backend = impl::enum_from_name<crypto_backend_t>(
+				  impl::crypto_backend_names, backend_name );
+				auto const size_class = impl::dispatch_size_class( size );
+				if( !op || !backend ||
+				    impl::dispatch_class_size( size_class ) != size ||
+				    !crypto_backend_available( *op, *backend ) ) {
+					return std::nullopt;
+				}
+				auto const o = static_cast<size_t>( *op );
+				result.backends[o][size_class] = *backend;
+				result.ns_per_byte[o][size_class] = rate;
+				seen[o][size_class] = true;
+			}
+			for( auto const &op_seen : seen ) {
+				if( std::find( op_seen.begin( ), op_seen.end( ), false ) !=
+				    op_seen.end( ) ) {
+					return std::nullopt;
+				}
+			}
+			return result;
+		}
+
+		namespace impl {
+			/// @brief Parse "op=backend,op=backend".  Unknown names and backends
+			/// this build lacks throw std::invalid_argument
+			inline std::vector<std::pair<crypto_op_t, crypto_backend_t>>
+			parse_backend_overrides( std::string const &spec ) {
+				std::vector<std::pair<crypto_op_t, crypto_backend_t>> result;
+				std::istringstream items( spec );
+				std::string item;
+				while( std::getline( items, item, ',' ) ) {
+					if( item.empty( ) ) {
+						continue;
+					}
+					auto const eq = item.find( '=' );
+					auto const op =
+					  eq == std::string::npos
+					    ? std::nullopt
+					    : enum_from_name<crypto_op_t>( crypto_op_names,
+					                                   item.substr( 0, eq ) );
+					auto const backend =
+					  eq == std::string::npos
+					    ? std::nullopt
+					    : enum_from_name<crypto_backend_t>( crypto_backend_names,
+					                                        item.substr( eq + 1 ) );
+					if( !op || !backend || !crypto_backend_available( *op, *backend ) ) {
+						throw std::invalid_argument(
+						  "Unsupported crypto backend override " + item );
+					}
+					result.emplace_back( *op, *backend );
+				}
+				return result;
+			}
+
+			/// @brief Where the profile is cached, empty for nowhere
+			inline std::string default_profile_path( ) {
+				if( auto const *path = std::getenv( "DAW_CRYPTO_PROFILE" ) ) {
+					return path;
+				}
+				auto const *cache = std::getenv( "XDG_CACHE_HOME" );
+				if( cache != nullptr && *cache != '\0' ) {
+					return std::string( cache ) + "/daw_crypto_profile";
+				}
+				if( auto const *home = std::getenv( "HOME" ) ) {
+					return std::string( home ) + "/.cache/daw_crypto_profile";
+				}
+				return {};
+			}
+		} // namespace impl
+
+		/// @brief Hash every message with the given backend
+		/// @param out out[n] receives the digest of messages[n]
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		void sha256_multi_hash( crypto_backend_t backend,
+		                        daw::span<daw::span<U const> const> messages,
+		                        daw::span<sha256_digest_t> out ) noexcept {
+			if( backend == crypto_backend_t::scalar ) {
+				for( size_t n = 0; n < messages.size( ); ++n ) {
+					out[n] = sha2_ctx<256, U>::hash( messages[n] );
+				}
+				return;
+			}
+			sha256_multi_hash( messages, out );
+		}
+
+		namespace aes {
+			/// @brief One shot AES-128-CTR with the given backend
+			inline void aes_ctr_128( crypto_backend_t backend,
+			                         aes128_key_schedule_t const &sched,
+			                         cipher_t const &iv,
+			                         daw::span<uint8_t const> in,
+			                         daw::span<uint8_t> out ) noexcept {
+				auto counter = iv;
+				auto const crypt_block = [&]( size_t pos, auto &&encrypt ) {
+					auto const key_stream = encrypt( counter );
+					impl::ctr_increment( counter, 1 );
+					auto const count = std::min(
+					  in.size( ) - pos, size_t{impl::AES_BLOCK_SIZE::value} );
+					for( size_t n = 0; n < count; ++n ) {
+						out[pos + n] = static_cast<uint8_t>( in[pos + n] ^ key_stream[n] );
+					}
+				};
+				switch( backend ) {
+#if defined( __AES__ )
+				case crypto_backend_t::aesni_serial: {
+					auto sample = crypto::impl::telemetry_start( );
+					auto const keys = impl::load_round_keys( sched );
+					for( size_t pos = 0; pos < in.size( );
+					     pos += impl::AES_BLOCK_SIZE::value ) {
+						crypt_block( pos, [&]( cipher_t block ) {
+							impl::aesni_crypt_block<true>( block, keys );
+							return block;
+						} );
+					}
+					crypto::impl::telemetry_record( telemetry_op_t::aes128_ctr,
+					                                telemetry_backend_t::aesni, 1,
+					                                in.size( ), sample );
+					return;
+				}
+#endif
+				case crypto_backend_t::aes_table: {
+					auto sample = crypto::impl::telemetry_start( );
+					for( size_t pos = 0; pos < in.size( );
+					     pos += impl::AES_BLOCK_SIZE::value ) {
+						crypt_block( pos, [&]( cipher_t const &block ) {
+							return impl::aes_encrypt_128_block( daw::make_span( block ),
+							                                    sched );
+						} );
+					}
+					crypto::impl::telemetry_record( telemetry_op_t::aes128_ctr,
+					                                telemetry_backend_t::scalar, 1,
+					                                in.size( ), sample );
+					return;
+				}
+				default:
+					aes_ctr_128( sched, iv, in, out );
+					return;
+				}
+			}
+		} // namespace aes
+
+		namespace impl {
+			/// @brief Best of a few runs of f, each repeated for at least 200us, in
+			/// nanoseconds per byte
+			template<typename Function>
+			double time_ns_per_byte( Function &&f, size_t bytes ) {
+				using steady_t = std::chrono::steady_clock;
+				f( );
+				auto best = std::numeric_limits<double>::max( );
+				for( size_t trial = 0; trial < 3; ++trial ) {
+					size_t reps = 0;
+					auto const start = steady_t::now( );
+					auto elapsed = steady_t::duration{};
+					do {
+						f( );
+						++reps;
+						elapsed = steady_t::now( ) - start;
+					} while( elapsed < std::chrono::microseconds( 200 ) );
+					auto const ns =
+					  std::chrono::duration<double, std::nano>( elapsed ).count( );
+					best = std::min( best, ns / static_cast<double>( reps * bytes ) );
+				}
+				return best;
+			}
+
+			/// @brief Time every backend of op at each size class and keep the
+			/// fastest.  A backend more than 8 times slower than the best at one
+			/// size is not timed at larger ones, and a lone backend is not timed
+			template<typename Run>
+			void calibrate_op( crypto_profile_t &profile, crypto_op_t op,
+			                   size_t bytes_per_size, Run &&run ) {
+				auto candidates = crypto_backends( op );
+				auto const o = static_cast<size_t>( op );
+				for( size_t c = 0; c < dispatch_size_classes; ++c ) {
+					if( candidates.size( ) == 1 ) {
+						profile.backends[o][c] = candidates.front( );
+						continue;
+					}
+					auto const size = dispatch_class_size( c );
+					std::vector<double> rates;
+					for( auto backend : candidates ) {
+						rates.push_back( time_ns_per_byte(
+						  [&]( ) { run( backend, size ); }, size * bytes_per_size ) );
+					}
+					auto const best = static_cast<size_t>(
+					  std::min_element( rates.begin( ), rates.end( ) ) - rates.begin( ) );
+					profile.backends[o][c] = candidates[best];
+					profile.ns_per_byte[o][c] = rates[best];
+					auto const best_rate = rates[best];
+					for( size_t n = candidates.size( ); n-- > 0; ) {
+						if( rates[n] > best_rate * 8.0 ) {
+							candidates.erase( candidates.begin( ) +
+							                  static_cast<std::ptrdiff_t>( n ) );
+						}
+					}
+				}
+			}
+		} // namespace impl
+
+		/// @brief Time the backends of every op on this host.  Takes some tens
+		/// of milliseconds
+		inline crypto_profile_t calibrate_crypto_profile( ) {
+			auto result = crypto_profile_t::defaults( );
+			constexpr size_t const max_size =
+			  impl::dispatch_class_size( impl::dispatch_size_classes - 1 );
+			constexpr size_t const message_count = impl::sha256_batch_lanes;
+			crypto_buffer input( max_size * message_count );
+			for( size_t n = 0; n < input.size( ); ++n ) {
+				input[n] = static_cast<uint8_t>( n * 167u + 13u );
+			}
+			crypto_buffer output( max_size );
+
+			std::vector<daw::span<uint8_t const>> messages( message_count );
+			std::vector<sha256_digest_t> digests( message_count );
+			impl::calibrate_op(
+			  result, crypto_op_t::sha256_multi_hash, message_count,
+			  [&]( crypto_backend_t backend, size_t size ) {
+				  for( size_t n = 0; n < message_count; ++n ) {
+					  messages[n] =
+					    daw::span<uint8_t const>( input.data( ) + n * max_size, size );
+				  }
+				  sha256_multi_hash(
+				    backend,
+				    daw::span<daw::span<uint8_t const> const>( messages.data( ),
+				                                               messages.size( ) ),
+				    daw::span<sha256_digest_t>( digests.data( ), digests.size( ) ) );
+			  } );
+
+			std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value> key{};
+			auto const sched =
+			  aes::impl::aes128_key_schedule( daw::make_span( key ) );
+			aes::cipher_t const iv{};
+			impl::calibrate_op(
+			  result, crypto_op_t::aes128_ctr, 1,
+			  [&]( crypto_backend_t backend, size_t size ) {
+				  aes::aes_ctr_128( backend, sched, iv,
+				                    daw::span<uint8_t const>( input.data( ), size ),
+				                    daw::span<uint8_t>( output.data( ), size ) );
+			  } );
+			return result;
+		}
+
+		/// @brief Routes each call to a backend by op and size.  The routing
+		/// table is read without locks, so the hot path is a load per call
+		class crypto_dispatch {
+			static constexpr uint8_t const no_override = 0xFF;
+
+			mutable std::mutex m_mutex;
+			crypto_profile_t m_profile;
+			std::array<std::array<std::atomic<uint8_t>, impl::dispatch_size_classes>,
+			           impl::crypto_op_count>
+			  m_routes{};
+			std::array<std::atomic<uint8_t>, impl::crypto_op_count> m_overrides{};
+
+		public:
+			explicit crypto_dispatch( crypto_profile_t const &profile ) {
+				for( auto &o : m_overrides ) {
+					o.store( no_override, std::memory_order_relaxed );
+				}
+				use_profile( profile );
+			}
+
+			/// @brief Load the cached profile if it was made on this host,
+			/// otherwise calibrate and cache the result.  Overrides are taken
+			/// from DAW_CRYPTO_BACKEND
+			static crypto_profile_t host_profile( ) {
+				auto const path = impl::default_profile_path( );
+				if( !path.empty( ) ) {
+					auto cached = load_crypto_profile( path );
+					if( cached && cached->host_key == crypto_host_key( ) ) {
+						return *cached;
+					}
+				}
+				auto result = calibrate_crypto_profile( );
+				if( !path.empty( ) ) {
+					// A read only cache only costs a calibration per process
+					static_cast<void>( save_crypto_profile( result, path ) );
+				}
+				return result;
+			}
+
+			/// @brief The process wide dispatcher, set up on first use
+			static crypto_dispatch &instance( ) {
+				static crypto_dispatch result = [] {
+					crypto_dispatch d( host_profile( ) );
+					if( auto const *spec = std::getenv( "DAW_CRYPTO_BACKEND" ) ) {
+						for( auto const &o : impl::parse_backend_overrides( spec ) ) {
+							d.set_override( o.first, o.second );
+						}
+					}
+					return d;
+				}( );
+				return result;
+			}
+
+			crypto_dispatch( crypto_dispatch &&other ) {
+				for( size_t op = 0; op < impl::crypto_op_count; ++op ) {
+					m_overrides[op].store( other.m_overrides[op].load( ),
+					                       std::memory_order_relaxed );
+				}
+				use_profile( other.profile( ) );
+			}
+
+			crypto_dispatch( crypto_dispatch const & ) = delete;
+			crypto_dispatch &operator=( crypto_dispatch const & ) = delete;
+			crypto_dispatch &operator=( crypto_dispatch && ) = delete;
+			~crypto_dispatch( ) = default;
+
+			/// @brief Replace the routing, e.g. with a fresh calibration
+			void use_profile( crypto_profile_t const &profile ) {
+				std::lock_guard<std::mutex> lock( m_mutex );
+				m_profile = profile;
+				for( size_t op = 0; op < impl::crypto_op_count; ++op ) {
+					for( size_t c = 0; c < impl::dispatch_size_classes; ++c ) {
+						m_routes[op][c].store(
+						  static_cast<uint8_t>( profile.backends[op][c] ),
+						  std::memory_order_relaxed );
+					}
+				}
+			}
+
+			crypto_profile_t profile( ) const {
+				std::lock_guard<std::mutex> lock( m_mutex );
+				return m_profile;
+			}
+
+			/// @brief The backend a call of op on size bytes goes to
+			crypto_backend_t backend_for( crypto_op_t op, size_t size ) const
+			  noexcept {
+				auto const o = static_cast<size_t>( op );
+				auto const forced = m_overrides[o].load( std::memory_order_relaxed );
+				if( forced != no_override ) {
+					return static_cast<crypto_backend_t>( forced );
+				}
+				return static_cast<crypto_backend_t>(
+				  m_routes[o][impl::dispatch_size_class( size )].load(
+				    std::memory_order_relaxed ) );
+			}
+
+			/// @brief The sizes at which the profile's choice for op changes,
+			/// ignoring any override
+			std::vector<crypto_crossover_t> crossovers( crypto_op_t op ) const {
+				auto const current = profile( );
+				auto const &backends = current.backends[static_cast<size_t>( op )];
+				std::vector<crypto_crossover_t> result;
+				for( size_t c = 0; c < backends.size( ); ++c ) {
+					if( result.empty( ) || result.back( ).backend != backends[c] ) {
+						auto const min_size =
+						  c == 0 ? size_t{0} : impl::dispatch_class_size( c - 1 ) + 1;
+						result.push_back( crypto_crossover_t{min_size, backends[c]} );
+					}
+				}
+				return result;
+			}
+
+			/// @brief Send every call of op to backend whatever its size
+			void set_override( crypto_op_t op, crypto_backend_t backend ) {
+				if( !crypto_backend_available( op, backend ) ) {
+					throw std::invalid_argument( std::string( to_string( backend ) ) +
+					                             " cannot run " + to_string( op ) );
+				}
+				m_overrides[static_cast<size_t>( op )].store(
+				  static_cast<uint8_t>( backend ), std::memory_order_relaxed );
+			}
+
+			void clear_override( crypto_op_t op ) noexcept {
+				m_overrides[static_cast<size_t>( op )].store(
+				  no_override, std::memory_order_relaxed );
+			}
+
+			std::optional<crypto_backend_t> override_for( crypto_op_t op ) const
+			  noexcept {
+				auto const forced = m_overrides[static_cast<size_t>( op )].load(
+				  std::memory_order_relaxed );
+				if( forced == no_override ) {
+					return std::nullopt;
+				}
+				return static_cast<crypto_backend_t>( forced );
+			}
+		};
+
+		/// @brief sha256_multi_hash on the backend tuned for the average message
+		/// size
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		void sha256_multi_hash_tuned( daw::span<daw::span<U const> const> messages,
+		                              daw::span<sha256_digest_t> out ) {
+			size_t total = 0;
+			for( auto const &m : messages ) {
+				total += m.size( );
+			}
+			auto const average = messages.empty( ) ? 0 : total / messages.size( );
+			sha256_multi_hash(
+			  crypto_dispatch::instance( ).backend_for(
+			    crypto_op_t::sha256_multi_hash, average ),
+			  messages, out );
+		}
+
+		namespace aes {
+			/// @brief aes_ctr_128 on the backend tuned for in.size( )
+			inline void aes_ctr_128_tuned( aes128_key_schedule_t const &sched,
+			                               cipher_t const &iv,
+			                               daw::span<uint8_t const> in,
+			                               daw::span<uint8_t> out ) {
+				aes_ctr_128( crypto_dispatch::instance( ).backend_for(
+				               crypto_op_t::aes128_ctr, in.size( ) ),
+				             sched, iv, in, out );
+			}
+		} // namespace aes
+	}   // namespace crypto
+} // namespace daw
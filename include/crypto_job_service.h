@@ -0,0 +1,439 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Runs SHA-256 and AES-CBC jobs on worker threads for single threaded event
+// loops.  Submission takes no lock, each worker hashes or encrypts whatever
+// has queued up for it as one multi-buffer batch, and finished jobs are
+// signalled on an eventfd the loop can add to its epoll set
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <daw/daw_span.h>
+
+#include "aes_batch.h"
+#include "crypto_config.h"
+#include "sha256_fixed.h"
+
+#if defined( DAW_CRYPTO_HAS_COROUTINES )
+#include <coroutine>
+#endif
+
+namespace daw {
+	namespace crypto {
+		enum class crypto_job_kind_t : uint8_t { sha256, aes128_cbc_encrypt };
+
+		class crypto_job_service;
+		namespace impl {
+			class job_stack_t;
+		}
+
+		/// @brief Common part of all jobs.  Jobs belong to the caller and must
+		/// stay alive and untouched from submit until poll_completions hands
+		/// them back
+		class crypto_job_t {
+			friend class crypto_job_service;
+			friend class impl::job_stack_t;
+
+			crypto_job_t *m_next = nullptr;
+			crypto_job_kind_t m_kind;
+#if defined( DAW_CRYPTO_HAS_COROUTINES )
+			std::coroutine_handle<> m_continuation{};
+#endif
+
+		protected:
+			explicit constexpr crypto_job_t( crypto_job_kind_t kind ) noexcept
+			  : m_kind( kind ) {}
+
+			// Not virtual, so jobs cannot be destroyed through the base
+			~crypto_job_t( ) = default;
+
+		public:
+			crypto_job_t( crypto_job_t const & ) = delete;
+			crypto_job_t &operator=( crypto_job_t const & ) = delete;
+
+			constexpr crypto_job_kind_t kind( ) const noexcept {
+				return m_kind;
+			}
+		};
+
+		/// @brief Hash input into digest
+		struct sha256_job_t : crypto_job_t {
+			daw::span<uint8_t const> input;
+			sha256_digest_t digest{};
+
+			explicit sha256_job_t( daw::span<uint8_t const> in ) noexcept
+			  : crypto_job_t( crypto_job_kind_t::sha256 )
+			  , input( in ) {}
+		};
+
+		/// @brief CBC encrypt as aes::aes_encrypt_128_cbc_batch would.  The key
+		/// schedule it points to must outlive the job
+		struct aes128_cbc_encrypt_job_t : crypto_job_t {
+			aes::aes128_cbc_job_t cbc;
+
+			explicit aes128_cbc_encrypt_job_t(
+			  aes::aes128_cbc_job_t const &job ) noexcept
+			  : crypto_job_t( crypto_job_kind_t::aes128_cbc_encrypt )
+			  , cbc( job ) {}
+		};
+
+		namespace impl {
+			/// @brief Intrusive lock free stack of jobs.  Any thread may push and
+			/// take_all empties it in one exchange, so there is no pop and no ABA
+			class job_stack_t {
+				std::atomic<crypto_job_t *> m_head{nullptr};
+
+			public:
+				/// @brief Push the chain first..last, already linked newest first.
+				/// Returns true when the stack was empty
+				bool push( crypto_job_t *first, crypto_job_t *last ) noexcept {
+					auto *head = m_head.load( std::memory_order_relaxed );
+					do {
+						last->m_next = head;
+					} while( !m_head.compare_exchange_weak(
+					  head, first, std::memory_order_release,
+					  std::memory_order_relaxed ) );
+					return head == nullptr;
+				}
+
+				/// @brief Take every job, oldest first
+				crypto_job_t *take_all( ) noexcept {
+					auto *newest = m_head.exchange( nullptr, std::memory_order_acquire );
+					crypto_job_t *oldest = nullptr;
+					while( newest != nullptr ) {
+						auto *next = newest->m_next;
+						newest->m_next = oldest;
+						oldest = newest;
+						newest = next;
+					}
+					return oldest;
+				}
+
+				bool empty( ) const noexcept {
+					return m_head.load( std::memory_order_acquire ) == nullptr;
+				}
+			};
+
+			struct job_worker_t {
+				job_stack_t queue;
+				// Only taken to sleep when the queue is empty and to wake the worker
+				std::mutex mutex;
+				std::condition_variable wake;
+				std::thread thread;
+			};
+		} // namespace impl
+
+		/// @brief Worker threads that run crypto jobs off the event loop.  Jobs
+		/// are spread over the workers round robin; a worker takes everything
+		/// queued for it at once, so under load small jobs are hashed
+		/// sha256_batch_lanes at a time and encrypted aes_batch_lanes at a time.
+		/// Finished jobs are collected by poll_completions, normally when
+		/// completion_fd( ) becomes readable
+		class crypto_job_service {
+			std::vector<std::unique_ptr<impl::job_worker_t>> m_workers;
+			impl::job_stack_t m_completed;
+			std::atomic<size_t> m_next_worker{0};
+			std::atomic<bool> m_stop{false};
+			int m_event_fd = -1;
+
+			struct batch_t {
+				std::vector<crypto_job_t *> jobs;
+				std::vector<sha256_job_t *> sha256_jobs;
+				std::vector<daw::span<uint8_t const>> sha256_inputs;
+				std::vector<sha256_digest_t> sha256_digests;
+				std::vector<aes128_cbc_encrypt_job_t *> cbc_jobs;
+				std::vector<aes::aes128_cbc_job_t> cbc;
+
+				void clear( ) noexcept {
+					jobs.clear( );
+					sha256_jobs.clear( );
+					sha256_inputs.clear( );
+					cbc_jobs.clear( );
+					cbc.clear( );
+				}
+			};
+
+			void run_batch( batch_t &batch, crypto_job_t *list ) {
+				batch.clear( );
+				for( auto *job = list; job != nullptr; job = job->m_next ) {
+					batch.jobs.push_back( job );
+					switch( job->m_kind ) {
+					case crypto_job_kind_t::sha256: {
+						auto *sha_job = static_cast<sha256_job_t *>( job );
+						batch.sha256_jobs.push_back( sha_job );
+						batch.sha256_inputs.push_back( sha_job->input );
+						break;
+					}
+					case crypto_job_kind_t::aes128_cbc_encrypt: {
+						auto *cbc_job = static_cast<aes128_cbc_encrypt_job_t *>( job );
+						batch.cbc_jobs.push_back( cbc_job );
+						batch.cbc.push_back( cbc_job->cbc );
+						break;
+					}
+					}
+				}
+				if( !batch.sha256_jobs.empty( ) ) {
+					batch.sha256_digests.resize( batch.sha256_jobs.size( ) );
+					sha256_multi_hash(
+					  daw::span<daw::span<uint8_t const> const>(
+					    batch.sha256_inputs.data( ), batch.sha256_inputs.size( ) ),
+					  daw::span<sha256_digest_t>( batch.sha256_digests.data( ),
+					                              batch.sha256_digests.size( ) ) );
+					for( size_t n = 0; n < batch.sha256_jobs.size( ); ++n ) {
+						batch.sha256_jobs[n]->digest = batch.sha256_digests[n];
+					}
+				}
+				if( !batch.cbc.empty( ) ) {
+					aes::aes_encrypt_128_cbc_batch(
+					  daw::span<aes::aes128_cbc_job_t const>( batch.cbc.data( ),
+					                                          batch.cbc.size( ) ) );
+				}
+				complete( batch.jobs );
+			}
+
+			void complete( std::vector<crypto_job_t *> const &jobs ) noexcept {
+				// Linked newest first so take_all returns them in submission order
+				crypto_job_t *chain = nullptr;
+				for( auto *job : jobs ) {
+					job->m_next = chain;
+					chain = job;
+				}
+				m_completed.push( chain, jobs.front( ) );
+				signal( jobs.size( ) );
+			}
+
+			void signal( uint64_t count ) noexcept {
+				// Only fails if the counter would overflow, which the reader's
+				// next read clears anyway
+				auto const r = ::write( m_event_fd, &count, sizeof( count ) );
+				static_cast<void>( r );
+			}
+
+			/// @brief Put back completed jobs not yet handed out, given oldest
+			/// first, so the next poll_completions returns them
+			void requeue( crypto_job_t *oldest ) noexcept {
+				if( oldest == nullptr ) {
+					return;
+				}
+				auto *const last = oldest;
+				crypto_job_t *newest = nullptr;
+				uint64_t count = 0;
+				while( oldest != nullptr ) {
+					auto *next = oldest->m_next;
+					oldest->m_next = newest;
+					newest = oldest;
+					oldest = next;
+					++count;
+				}
+				m_completed.push( newest, last );
+				signal( count );
+			}
+
+			void run_worker( impl::job_worker_t &worker ) {
+				batch_t batch;
+				while( true ) {
+					if( auto *list = worker.queue.take_all( ) ) {
+						run_batch( batch, list );
+						continue;
+					}
+					std::unique_lock<std::mutex> lock( worker.mutex );
+					worker.wake.wait( lock, [&]( ) {
+						return m_stop.load( std::memory_order_relaxed ) ||
+						       !worker.queue.empty( );
+					} );
+					if( worker.queue.empty( ) ) {
+						// Stopping and nothing is left to do
+						return;
+					}
+				}
+			}
+
+		public:
+			/// @param threads number of workers, 0 for one per hardware thread
+			explicit crypto_job_service( size_t threads = 0 )
+			  : m_event_fd( ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) {
+
+				if( m_event_fd < 0 ) {
+					throw std::system_error( errno, std::generic_category( ),
+					                         "eventfd" );
+				}
+				if( threads == 0 ) {
+					threads = std::max( 1U, std::thread::hardware_concurrency( ) );
+				}
+				try {
+					for( size_t n = 0; n < threads; ++n ) {
+						m_workers.push_back( std::make_unique<impl::job_worker_t>( ) );
+						auto &worker = *m_workers.back( );
+						worker.thread = std::thread( [this, &worker]( ) {
+							run_worker( worker );
+						} );
+					}
+				} catch( ... ) {
+					shutdown( );
+					throw;
+				}
+			}
+
+			crypto_job_service( crypto_job_service const & ) = delete;
+			crypto_job_service &operator=( crypto_job_service const & ) = delete;
+
+			/// @brief Finishes every submitted job, but completions not yet
+			/// polled are not reported
+			~crypto_job_service( ) {
+				shutdown( );
+			}
+
+			/// @brief Readable when poll_completions has jobs to return.  It is
+			/// nonblocking and owned by the service
+			int completion_fd( ) const noexcept {
+				return m_event_fd;
+			}
+
+			size_t worker_count( ) const noexcept {
+				return m_workers.size( );
+			}
+
+			/// @brief Queue a job.  Safe to call from any thread
+			void submit( crypto_job_t &job ) {
+				job.m_next = nullptr;
+				auto const index =
+				  m_next_worker.fetch_add( 1, std::memory_order_relaxed ) %
+				  m_workers.size( );
+				auto &worker = *m_workers[index];
+				if( worker.queue.push( &job, &job ) ) {
+					// The worker may be asleep, it only sleeps on an empty queue
+					std::lock_guard<std::mutex> lock( worker.mutex );
+					worker.wake.notify_one( );
+				}
+			}
+
+			/// @brief Hand back finished jobs in the order each worker finished
+			/// them.  Jobs awaited with async resume their coroutine, all others
+			/// are passed to on_complete.  Call from one thread, normally the
+			/// event loop when completion_fd( ) is readable.  If on_complete
+			/// throws, the jobs after the one it threw for are kept for the next
+			/// call and the exception propagates
+			/// @return number of jobs completed
+			template<typename OnComplete>
+			size_t poll_completions( OnComplete on_complete ) {
+				uint64_t signalled = 0;
+				// Clear the eventfd before taking the jobs so a completion racing
+				// with this call leaves it readable instead of being missed
+				auto const r = ::read( m_event_fd, &signalled, sizeof( signalled ) );
+				static_cast<void>( r );
+				size_t count = 0;
+				auto *rest = m_completed.take_all( );
+				try {
+					while( rest != nullptr ) {
+						// The job may be reused or destroyed by its owner from here on
+						auto *job = rest;
+						rest = job->m_next;
+						job->m_next = nullptr;
+						++count;
+#if defined( DAW_CRYPTO_HAS_COROUTINES )
+						if( auto continuation =
+						      std::exchange( job->m_continuation, {} ) ) {
+							continuation.resume( );
+							continue;
+						}
+#endif
+						on_complete( *job );
+					}
+				} catch( ... ) {
+					requeue( rest );
+					throw;
+				}
+				return count;
+			}
+
+			size_t poll_completions( ) {
+				return poll_completions( []( crypto_job_t & ) {} );
+			}
+
+#if defined( DAW_CRYPTO_HAS_COROUTINES )
+			/// @brief co_await service.async( job ) submits the job and resumes
+			/// the coroutine from poll_completions once it is done
+			class job_awaiter_t {
+				crypto_job_service *m_service;
+				crypto_job_t *m_job;
+
+			public:
+				job_awaiter_t( crypto_job_service &service,
+				               crypto_job_t &job ) noexcept
+				  : m_service( &service )
+				  , m_job( &job ) {}
+
+				constexpr bool await_ready( ) const noexcept {
+					return false;
+				}
+
+				void await_suspend( std::coroutine_handle<> continuation ) {
+					m_job->m_continuation = continuation;
+					m_service->submit( *m_job );
+				}
+
+				constexpr void await_resume( ) const noexcept {}
+			};
+
+			job_awaiter_t async( crypto_job_t &job ) noexcept {
+				return job_awaiter_t( *this, job );
+			}
+#endif
+
+		private:
+			void shutdown( ) noexcept {
+				m_stop.store( true, std::memory_order_relaxed );
+				for( auto &worker : m_workers ) {
+					{
+						std::lock_guard<std::mutex> lock( worker->mutex );
+					}
+					worker->wake.notify_all( );
+				}
+				for( auto &worker : m_workers ) {
+					if( worker->thread.joinable( ) ) {
+						worker->thread.join( );
+					}
+				}
+				m_workers.clear( );
+				if( m_event_fd >= 0 ) {
+					::close( m_event_fd );
+					m_event_fd = -1;
+				}
+			}
+		};
+	} // namespace crypto
+} // namespace daw
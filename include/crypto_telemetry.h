@@ -0,0 +1,437 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Optional usage telemetry for the hashing and cipher entry points: bytes and
+// calls per operation and backend kept in per thread counters, a sampled
+// latency histogram per operation and, where <sys/sdt.h> exists, USDT probes
+// for bpftrace/perf.  It is off unless DAW_CRYPTO_TELEMETRY is defined, and the
+// hooks are then empty constexpr functions that leave no code behind
+
+#include <array>
+#include <cstdint>
+
+#include "crypto_config.h"
+
+#if defined( DAW_CRYPTO_TELEMETRY )
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#if !defined( DAW_CRYPTO_TELEMETRY_NO_SDT ) && defined( __has_include )
+#if __has_include( <sys/sdt.h> )
+#include <sys/sdt.h>
+#define DAW_CRYPTO_HAS_SDT
+#endif
+#endif
+#endif
+
+namespace daw {
+	namespace crypto {
+		enum class telemetry_op_t : uint8_t {
+			sha256,
+			aes128_ecb,
+			aes128_cbc,
+			aes128_ctr,
+			aes128_xts
+		};
+		constexpr size_t const telemetry_op_count = 5;
+
+		/// @brief The code path that did the work: one message at a time in
+		/// portable code, AES-NI, or several messages interleaved in lanes
+		enum class telemetry_backend_t : uint8_t { scalar, aesni, multi_buffer };
+		constexpr size_t const telemetry_backend_count = 3;
+
+		/// @brief Latency buckets, bucket n holds calls that took [2^n, 2^(n+1))
+		/// nanoseconds
+		constexpr size_t const telemetry_latency_buckets = 48;
+
+		constexpr char const *to_string( telemetry_op_t op ) noexcept {
+			switch( op ) {
+			case telemetry_op_t::sha256:
+				return "sha256";
+			case telemetry_op_t::aes128_ecb:
+				return "aes128_ecb";
+			case telemetry_op_t::aes128_cbc:
+				return "aes128_cbc";
+			case telemetry_op_t::aes128_ctr:
+				return "aes128_ctr";
+			case telemetry_op_t::aes128_xts:
+				return "aes128_xts";
+			}
+			return "unknown";
+		}
+
+		constexpr char const *to_string( telemetry_backend_t backend ) noexcept {
+			switch( backend ) {
+			case telemetry_backend_t::scalar:
+				return "scalar";
+			case telemetry_backend_t::aesni:
+				return "aesni";
+			case telemetry_backend_t::multi_buffer:
+				return "multi_buffer";
+			}
+			return "unknown";
+		}
+
+		/// @brief Is telemetry compiled in
+		constexpr bool telemetry_enabled( ) noexcept {
+#if defined( DAW_CRYPTO_TELEMETRY )
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		struct telemetry_counts_t {
+			uint64_t calls = 0;
+			uint64_t bytes = 0;
+		};
+
+		struct telemetry_histogram_t {
+			std::array<uint64_t, telemetry_latency_buckets> buckets{};
+
+			uint64_t count( ) const noexcept {
+				uint64_t result = 0;
+				for( auto b : buckets ) {
+					result += b;
+				}
+				return result;
+			}
+
+			/// @brief Upper bound in nanoseconds of the bucket holding the pct
+			/// quantile, 0 when nothing was sampled
+			uint64_t percentile_ns( double pct ) const noexcept {
+				auto const total = count( );
+				if( total == 0 ) {
+					return 0;
+				}
+				auto const rank = static_cast<uint64_t>(
+				  pct * static_cast<double>( total - 1 ) );
+				uint64_t seen = 0;
+				for( size_t n = 0; n < buckets.size( ); ++n ) {
+					seen += buckets[n];
+					if( seen > rank ) {
+						return uint64_t{2} << n;
+					}
+				}
+				return uint64_t{2} << ( buckets.size( ) - 1 );
+			}
+		};
+
+		/// @brief Totals over every thread at the time of the snapshot
+		struct telemetry_snapshot_t {
+			std::array<std::array<telemetry_counts_t, telemetry_backend_count>,
+			           telemetry_op_count>
+			  counts{};
+			std::array<telemetry_histogram_t, telemetry_op_count> latency{};
+
+			telemetry_counts_t const &
+			get( telemetry_op_t op, telemetry_backend_t backend ) const noexcept {
+				return counts[static_cast<size_t>( op )]
+				             [static_cast<size_t>( backend )];
+			}
+
+			/// @brief Counts of op over all backends
+			telemetry_counts_t total( telemetry_op_t op ) const noexcept {
+				telemetry_counts_t result{};
+				for( auto const &c : counts[static_cast<size_t>( op )] ) {
+					result.calls += c.calls;
+					result.bytes += c.bytes;
+				}
+				return result;
+			}
+
+			telemetry_histogram_t const &
+			latency_of( telemetry_op_t op ) const noexcept {
+				return latency[static_cast<size_t>( op )];
+			}
+
+			/// @brief What happened between earlier and this snapshot
+			telemetry_snapshot_t since( telemetry_snapshot_t const &earlier ) const
+			  noexcept {
+				telemetry_snapshot_t result = *this;
+				for( size_t op = 0; op < telemetry_op_count; ++op ) {
+					for( size_t b = 0; b < telemetry_backend_count; ++b ) {
+						result.counts[op][b].calls -= earlier.counts[op][b].calls;
+						result.counts[op][b].bytes -= earlier.counts[op][b].bytes;
+					}
+					for( size_t n = 0; n < telemetry_latency_buckets; ++n ) {
+						result.latency[op].buckets[n] -=
+						  earlier.latency[op].buckets[n];
+					}
+				}
+				return result;
+			}
+		};
+
+#if defined( DAW_CRYPTO_TELEMETRY )
+		namespace impl {
+			/// @brief One thread's counters.  Only the owning thread writes them,
+			/// so updates are a relaxed load and store rather than a locked add,
+			/// and snapshots read them from other threads
+			struct telemetry_thread_counters_t {
+				struct slot_t {
+					std::atomic<uint64_t> calls{0};
+					std::atomic<uint64_t> bytes{0};
+				};
+				std::array<std::array<slot_t, telemetry_backend_count>,
+				           telemetry_op_count>
+				  slots{};
+				std::array<std::array<std::atomic<uint64_t>, telemetry_latency_buckets>,
+				           telemetry_op_count>
+				  latency{};
+				uint32_t sample_countdown = 1;
+
+				void add_to( telemetry_snapshot_t &snapshot ) const noexcept {
+					for( size_t op = 0; op < telemetry_op_count; ++op ) {
+						for( size_t b = 0; b < telemetry_backend_count; ++b ) {
+							auto &c = snapshot.counts[op][b];
+							c.calls += slots[op][b].calls.load( std::memory_order_relaxed );
+							c.bytes += slots[op][b].bytes.load( std::memory_order_relaxed );
+						}
+						for( size_t n = 0; n < telemetry_latency_buckets; ++n ) {
+							snapshot.latency[op].buckets[n] +=
+							  latency[op][n].load( std::memory_order_relaxed );
+						}
+					}
+				}
+			};
+
+			inline void telemetry_bump( std::atomic<uint64_t> &counter,
+			                            uint64_t n ) noexcept {
+				counter.store( counter.load( std::memory_order_relaxed ) + n,
+				               std::memory_order_relaxed );
+			}
+
+			/// @brief Live threads' counters, and the totals of threads that have
+			/// exited
+			struct telemetry_registry_t {
+				std::mutex mutex{};
+				std::vector<telemetry_thread_counters_t const *> threads{};
+				telemetry_snapshot_t retired{};
+			};
+
+			inline telemetry_registry_t &telemetry_registry( ) {
+				static telemetry_registry_t result{};
+				return result;
+			}
+
+			inline std::atomic<uint32_t> &telemetry_sample_period( ) noexcept {
+				static std::atomic<uint32_t> result{64};
+				return result;
+			}
+
+			inline telemetry_thread_counters_t *&
+			telemetry_current_thread( ) noexcept {
+				static thread_local telemetry_thread_counters_t *result = nullptr;
+				return result;
+			}
+
+			/// @brief Set once the thread's counters are destroyed, so hooks run by
+			/// later thread_local destructors record nothing rather than touching
+			/// or recreating them
+			inline bool &telemetry_thread_retired( ) noexcept {
+				static thread_local bool result = false;
+				return result;
+			}
+
+			/// @brief Registers the thread's counters on construction and folds
+			/// them into the retired totals when the thread exits
+			class telemetry_thread_t {
+				telemetry_thread_counters_t m_counters{};
+
+			public:
+				telemetry_thread_t( ) {
+					auto &registry = telemetry_registry( );
+					std::lock_guard<std::mutex> lock( registry.mutex );
+					registry.threads.push_back( &m_counters );
+				}
+
+				~telemetry_thread_t( ) {
+					auto &registry = telemetry_registry( );
+					std::lock_guard<std::mutex> lock( registry.mutex );
+					m_counters.add_to( registry.retired );
+					auto &threads = registry.threads;
+					for( size_t n = 0; n < threads.size( ); ++n ) {
+						if( threads[n] == &m_counters ) {
+							threads[n] = threads.back( );
+							threads.pop_back( );
+							break;
+						}
+					}
+					telemetry_current_thread( ) = nullptr;
+					telemetry_thread_retired( ) = true;
+				}
+
+				telemetry_thread_t( telemetry_thread_t const & ) = delete;
+				telemetry_thread_t &operator=( telemetry_thread_t const & ) = delete;
+
+				telemetry_thread_counters_t &counters( ) noexcept {
+					return m_counters;
+				}
+			};
+
+			// Out of the hot path, the first hook a thread runs lands here, as do
+			// hooks run after the thread's counters are gone
+			[[gnu::noinline]] inline telemetry_thread_counters_t *
+			telemetry_register_thread( ) {
+				if( telemetry_thread_retired( ) ) {
+					return nullptr;
+				}
+				static thread_local telemetry_thread_t thread{};
+				telemetry_current_thread( ) = &thread.counters( );
+				return &thread.counters( );
+			}
+
+			/// @brief The calling thread's counters, nullptr once they have been
+			/// destroyed at thread exit
+			inline telemetry_thread_counters_t *telemetry_thread( ) noexcept {
+				auto *counters = telemetry_current_thread( );
+				if( counters == nullptr ) {
+					return telemetry_register_thread( );
+				}
+				return counters;
+			}
+
+			inline uint64_t telemetry_now_ns( ) noexcept {
+				return static_cast<uint64_t>(
+				  std::chrono::duration_cast<std::chrono::nanoseconds>(
+				    std::chrono::steady_clock::now( ).time_since_epoch( ) )
+				    .count( ) );
+			}
+
+			inline uint64_t telemetry_start_rt( ) noexcept {
+				auto *const thread = telemetry_thread( );
+				if( thread == nullptr ) {
+					return 0;
+				}
+				auto &counters = *thread;
+				if( --counters.sample_countdown != 0 ) {
+					return 0;
+				}
+				auto const period =
+				  telemetry_sample_period( ).load( std::memory_order_relaxed );
+				if( period == 0 ) {
+					// Look again on the next call
+					counters.sample_countdown = 1;
+					return 0;
+				}
+				counters.sample_countdown = period;
+				return telemetry_now_ns( );
+			}
+
+			inline void telemetry_record_rt( telemetry_op_t op,
+			                                 telemetry_backend_t backend,
+			                                 uint64_t calls, uint64_t bytes,
+			                                 uint64_t start ) noexcept {
+				auto *const thread = telemetry_thread( );
+				if( thread == nullptr ) {
+					return;
+				}
+				auto &counters = *thread;
+				auto &slot = counters.slots[static_cast<size_t>( op )]
+				                           [static_cast<size_t>( backend )];
+				telemetry_bump( slot.calls, calls );
+				telemetry_bump( slot.bytes, bytes );
+#if defined( DAW_CRYPTO_HAS_SDT )
+				DTRACE_PROBE4( daw_crypto, op, static_cast<int>( op ),
+				               static_cast<int>( backend ), calls, bytes );
+#endif
+				if( start == 0 ) {
+					return;
+				}
+				auto const ns = telemetry_now_ns( ) - start;
+				size_t bucket = 0;
+				while( bucket + 1 < telemetry_latency_buckets &&
+				       ( ns >> ( bucket + 1 ) ) != 0 ) {
+					++bucket;
+				}
+				auto &latency = counters.latency[static_cast<size_t>( op )];
+				telemetry_bump( latency[bucket], 1 );
+#if defined( DAW_CRYPTO_HAS_SDT )
+				DTRACE_PROBE3( daw_crypto, latency, static_cast<int>( op ), bytes,
+				               ns );
+#endif
+			}
+		} // namespace impl
+#endif
+
+		namespace impl {
+			/// @brief Start of an operation that may be timed.  Returns the start
+			/// time when this call is sampled for the latency histogram, else 0.
+			/// Keep the result in a non-const variable, a const integer's
+			/// initializer is constant evaluated when it can be and gives 0
+			constexpr uint64_t telemetry_start( ) noexcept {
+#if defined( DAW_CRYPTO_TELEMETRY )
+				if( !is_constant_evaluated( ) ) {
+					return telemetry_start_rt( );
+				}
+#endif
+				return 0;
+			}
+
+			/// @brief Count calls and bytes of op on backend, and the latency since
+			/// start when it is not 0.  Constant evaluation records nothing
+			constexpr void
+			telemetry_record( [[maybe_unused]] telemetry_op_t op,
+			                  [[maybe_unused]] telemetry_backend_t backend,
+			                  [[maybe_unused]] uint64_t calls,
+			                  [[maybe_unused]] uint64_t bytes,
+			                  [[maybe_unused]] uint64_t start = 0 ) noexcept {
+#if defined( DAW_CRYPTO_TELEMETRY )
+				if( !is_constant_evaluated( ) ) {
+					telemetry_record_rt( op, backend, calls, bytes, start );
+				}
+#endif
+			}
+		} // namespace impl
+
+		/// @brief Sum the counters of every thread, live or exited.  All zero
+		/// when telemetry is not compiled in
+		inline telemetry_snapshot_t telemetry_snapshot( ) {
+			telemetry_snapshot_t result{};
+#if defined( DAW_CRYPTO_TELEMETRY )
+			auto &registry = impl::telemetry_registry( );
+			std::lock_guard<std::mutex> lock( registry.mutex );
+			result = registry.retired;
+			for( auto const *counters : registry.threads ) {
+				counters->add_to( result );
+			}
+#endif
+			return result;
+		}
+
+		/// @brief Time one call in period for the latency histograms, 0 stops
+		/// sampling.  A thread picks up a new period when its current countdown
+		/// runs out
+		inline void
+		set_telemetry_sample_period( [[maybe_unused]] uint32_t period ) noexcept {
+#if defined( DAW_CRYPTO_TELEMETRY )
+			impl::telemetry_sample_period( ).store( period,
+			                                        std::memory_order_relaxed );
+#endif
+		}
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,447 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Deterministic random bit generators from SP 800-90A built on this library's
+// AES and SHA-256, and a buffered per thread generator seeded from the OS.
+// CTR_DRBG is used when AES-NI is available, HMAC_DRBG otherwise as the
+// portable AES is far slower than SHA-256
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/random.h>
+
+#include <daw/daw_span.h>
+
+#include "aes_ctr_hmac.h"
+#include "crypto_buffer.h"
+#include "crypto_config.h"
+#include "hmac_sha256.h"
+
+namespace daw {
+	namespace crypto {
+		namespace impl {
+			constexpr std::array<uint8_t, 16> const ctr_drbg_zero_key{};
+
+			template<size_t N>
+			void xor_padded( std::array<uint8_t, N> &out,
+			                 daw::span<uint8_t const> in ) noexcept {
+				auto const count = std::min( in.size( ), N );
+				for( size_t n = 0; n < count; ++n ) {
+					out[n] ^= in[n];
+				}
+			}
+		} // namespace impl
+
+		/// @brief CTR_DRBG with AES-128 and no derivation function (SP 800-90A
+		/// 10.2.1).  Entropy must be full entropy, e.g. from the OS
+		class aes128_ctr_drbg_t {
+		public:
+			static constexpr size_t const seed_size = 32;
+			/// @brief Largest output of one generate request
+			static constexpr size_t const max_request = 65536;
+
+		private:
+			aes::aes128_key_schedule_t m_sched;
+			aes::cipher_t m_v{};
+			uint64_t m_reseed_counter = 1;
+
+			// AES(K, V+1), AES(K, V+2)... is the CTR key stream from V+1
+			void key_stream( uint8_t *out, size_t size ) noexcept {
+				auto counter = m_v;
+				aes::impl::ctr_increment( counter, 1 );
+				std::memset( out, 0, size );
+				aes::aes_ctr_128( m_sched, counter,
+				                  daw::span<uint8_t const>( out, size ),
+				                  daw::span<uint8_t>( out, size ) );
+				aes::impl::ctr_increment(
+				  m_v, ( size + aes::impl::AES_BLOCK_SIZE::value - 1u ) /
+				         aes::impl::AES_BLOCK_SIZE::value );
+			}
+
+			void update( std::array<uint8_t, seed_size> const &provided ) noexcept {
+				std::array<uint8_t, seed_size> temp{};
+				key_stream( temp.data( ), temp.size( ) );
+				for( size_t n = 0; n < temp.size( ); ++n ) {
+					temp[n] ^= provided[n];
+				}
+				m_sched = aes::impl::aes128_key_schedule(
+				  daw::span<uint8_t const>( temp.data( ), 16 ) );
+				std::copy( temp.begin( ) + 16, temp.end( ), m_v.begin( ) );
+				impl::secure_wipe( temp.data( ), temp.size( ) );
+			}
+
+		public:
+			/// @param entropy seed_size bytes
+			/// @param personalization up to seed_size bytes, optional
+			explicit aes128_ctr_drbg_t(
+			  daw::span<uint8_t const> entropy,
+			  daw::span<uint8_t const> personalization = {} )
+			  : m_sched( aes::impl::aes128_key_schedule(
+			      daw::span<uint8_t const>( impl::ctr_drbg_zero_key.data( ),
+			                                impl::ctr_drbg_zero_key.size( ) ) ) ) {
+
+				// Key and V both start as zero
+				if( entropy.size( ) != seed_size ) {
+					throw std::invalid_argument( "CTR_DRBG needs 32 bytes of entropy" );
+				}
+				std::array<uint8_t, seed_size> seed{};
+				impl::xor_padded( seed, entropy );
+				impl::xor_padded( seed, personalization );
+				update( seed );
+				impl::secure_wipe( seed.data( ), seed.size( ) );
+			}
+
+			~aes128_ctr_drbg_t( ) {
+				impl::secure_wipe( m_sched.data( ), m_sched.size( ) );
+				impl::secure_wipe( m_v.data( ), m_v.size( ) );
+			}
+
+			aes128_ctr_drbg_t( aes128_ctr_drbg_t const & ) = delete;
+			aes128_ctr_drbg_t &operator=( aes128_ctr_drbg_t const & ) = delete;
+
+			void reseed( daw::span<uint8_t const> entropy,
+			             daw::span<uint8_t const> additional = {} ) {
+				if( entropy.size( ) != seed_size ) {
+					throw std::invalid_argument( "CTR_DRBG needs 32 bytes of entropy" );
+				}
+				std::array<uint8_t, seed_size> seed{};
+				impl::xor_padded( seed, entropy );
+				impl::xor_padded( seed, additional );
+				update( seed );
+				impl::secure_wipe( seed.data( ), seed.size( ) );
+				m_reseed_counter = 1;
+			}
+
+			/// @brief Fill out, as one request per max_request bytes
+			void generate( daw::span<uint8_t> out,
+			               daw::span<uint8_t const> additional = {} ) noexcept {
+				std::array<uint8_t, seed_size> add{};
+				impl::xor_padded( add, additional );
+				for( size_t pos = 0; pos < out.size( ); pos += max_request ) {
+					if( !additional.empty( ) ) {
+						update( add );
+					}
+					auto const size = std::min( max_request, out.size( ) - pos );
+					key_stream( out.data( ) + pos, size );
+					update( add );
+					++m_reseed_counter;
+				}
+			}
+
+			/// @brief Requests since the last (re)seed, plus one
+			uint64_t reseed_counter( ) const noexcept {
+				return m_reseed_counter;
+			}
+		};
+
+		/// @brief HMAC_DRBG with SHA-256 (SP 800-90A 10.1.2)
+		class hmac_sha256_drbg_t {
+		public:
+			/// @brief 256 bits of entropy and a 128 bit nonce
+			static constexpr size_t const seed_size = 48;
+			static constexpr size_t const max_request = 65536;
+
+		private:
+			std::array<uint8_t, 32> m_k{};
+			std::array<uint8_t, 32> m_v{};
+			uint64_t m_reseed_counter = 1;
+
+			daw::span<uint8_t const> key( ) const noexcept {
+				return daw::span<uint8_t const>( m_k.data( ), m_k.size( ) );
+			}
+
+			// provided is the concatenation of first and second
+			void update( daw::span<uint8_t const> first,
+			             daw::span<uint8_t const> second = {} ) noexcept {
+				bool const empty = first.empty( ) && second.empty( );
+				for( uint8_t round = 0; round < 2; ++round ) {
+					hmac_sha256_ctx mac( key( ) );
+					mac.update( m_v.data( ), m_v.size( ) );
+					mac.update( &round, 1 );
+					mac.update( first );
+					mac.update( second );
+					m_k = mac.final( );
+					hmac_sha256_ctx v_mac( key( ) );
+					v_mac.update( m_v.data( ), m_v.size( ) );
+					m_v = v_mac.final( );
+					if( empty ) {
+						break;
+					}
+				}
+			}
+
+		public:
+			/// @param entropy_and_nonce entropy input followed by the nonce, at
+			/// least 32 bytes
+			/// @param personalization optional
+			explicit hmac_sha256_drbg_t(
+			  daw::span<uint8_t const> entropy_and_nonce,
+			  daw::span<uint8_t const> personalization = {} ) {
+
+				if( entropy_and_nonce.size( ) < 32 ) {
+					throw std::invalid_argument(
+					  "HMAC_DRBG needs at least 32 bytes of entropy" );
+				}
+				m_v.fill( 0x01 );
+				update( entropy_and_nonce, personalization );
+			}
+
+			~hmac_sha256_drbg_t( ) {
+				impl::secure_wipe( m_k.data( ), m_k.size( ) );
+				impl::secure_wipe( m_v.data( ), m_v.size( ) );
+			}
+
+			hmac_sha256_drbg_t( hmac_sha256_drbg_t const & ) = delete;
+			hmac_sha256_drbg_t &operator=( hmac_sha256_drbg_t const & ) = delete;
+
+			void reseed( daw::span<uint8_t const> entropy,
+			             daw::span<uint8_t const> additional = {} ) {
+				if( entropy.size( ) < 32 ) {
+					throw std::invalid_argument(
+					  "HMAC_DRBG needs at least 32 bytes of entropy" );
+				}
+				update( entropy, additional );
+				m_reseed_counter = 1;
+			}
+
+			/// @brief Fill out, as one request per max_request bytes
+			void generate( daw::span<uint8_t> out,
+			               daw::span<uint8_t const> additional = {} ) noexcept {
+				for( size_t pos = 0; pos < out.size( ); pos += max_request ) {
+					if( !additional.empty( ) ) {
+						update( additional );
+					}
+					auto const size = std::min( max_request, out.size( ) - pos );
+					hmac_sha256_ctx mac( key( ) );
+					for( size_t n = 0; n < size; n += m_v.size( ) ) {
+						mac.update( m_v.data( ), m_v.size( ) );
+						m_v = mac.final( );
+						std::copy_n( m_v.begin( ), std::min( m_v.size( ), size - n ),
+						             out.data( ) + pos + n );
+					}
+					update( additional );
+					++m_reseed_counter;
+				}
+			}
+
+			uint64_t reseed_counter( ) const noexcept {
+				return m_reseed_counter;
+			}
+		};
+
+		namespace impl {
+			/// @brief Fill out from the kernel's CSPRNG
+			inline void os_random( daw::span<uint8_t> out ) {
+				size_t pos = 0;
+				while( pos < out.size( ) ) {
+					auto const r = ::getrandom( out.data( ) + pos, out.size( ) - pos, 0 );
+					if( r < 0 ) {
+						if( errno == EINTR ) {
+							continue;
+						}
+						throw std::system_error( errno, std::generic_category( ),
+						                         "getrandom" );
+					}
+					pos += static_cast<size_t>( r );
+				}
+			}
+
+			/// @brief Bumped in every child process right after fork, so
+			/// generators can tell their state is shared with the parent
+			inline std::atomic<uint64_t> &fork_generation( ) noexcept {
+				static std::atomic<uint64_t> generation{0};
+				return generation;
+			}
+
+			inline uint64_t current_fork_generation( ) noexcept {
+				static bool const registered =
+				  ::pthread_atfork( nullptr, nullptr, []( ) {
+					  fork_generation( ).fetch_add( 1, std::memory_order_relaxed );
+				  } ) == 0;
+				static_cast<void>( registered );
+				return fork_generation( ).load( std::memory_order_relaxed );
+			}
+
+			/// @brief Seed material from the OS, wiped when it goes out of scope
+			template<size_t N>
+			class os_seed_t {
+				std::array<uint8_t, N> m_seed{};
+
+			public:
+				os_seed_t( ) {
+					os_random( daw::span<uint8_t>( m_seed.data( ), m_seed.size( ) ) );
+				}
+
+				~os_seed_t( ) {
+					secure_wipe( m_seed.data( ), m_seed.size( ) );
+				}
+
+				os_seed_t( os_seed_t const & ) = delete;
+				os_seed_t &operator=( os_seed_t const & ) = delete;
+
+				daw::span<uint8_t const> span( ) const noexcept {
+					return daw::span<uint8_t const>( m_seed.data( ), m_seed.size( ) );
+				}
+			};
+		} // namespace impl
+
+		/// @brief A DRBG seeded from the OS that hands out its output from a
+		/// buffer, so small requests cost a copy and not a syscall or a DRBG
+		/// request each.  It reseeds from the OS every reseed_interval bytes
+		/// and after a fork, when the child must not repeat the parent's
+		/// output.  It is a UniformRandomBitGenerator.  Not thread safe; use
+		/// thread_csprng( ) for a per thread instance
+		template<typename Drbg, size_t BufferSize = 4096>
+		class basic_csprng_t {
+			Drbg m_drbg;
+			std::array<uint8_t, BufferSize> m_buffer{};
+			size_t m_pos = BufferSize;
+			uint64_t m_since_reseed = 0;
+			uint64_t m_fork_generation = impl::current_fork_generation( );
+
+			void check_reseed( ) {
+				auto const generation = impl::current_fork_generation( );
+				if( generation != m_fork_generation ||
+				    m_since_reseed >= reseed_interval ) {
+					if( generation != m_fork_generation ) {
+						// Buffered bytes were also in the parent's buffer
+						impl::secure_wipe( m_buffer.data( ), m_buffer.size( ) );
+						m_pos = BufferSize;
+						m_fork_generation = generation;
+					}
+					reseed( );
+				}
+			}
+
+		public:
+			using result_type = uint64_t;
+			static constexpr uint64_t const reseed_interval = 1ULL << 24u;
+
+			basic_csprng_t( )
+			  : m_drbg( impl::os_seed_t<Drbg::seed_size>{}.span( ) ) {}
+
+			~basic_csprng_t( ) {
+				impl::secure_wipe( m_buffer.data( ), m_buffer.size( ) );
+			}
+
+			basic_csprng_t( basic_csprng_t const & ) = delete;
+			basic_csprng_t &operator=( basic_csprng_t const & ) = delete;
+
+			/// @brief Mix fresh OS entropy in now
+			void reseed( ) {
+				impl::os_seed_t<Drbg::seed_size> const seed{};
+				m_drbg.reseed( seed.span( ) );
+				m_since_reseed = 0;
+			}
+
+			void fill( daw::span<uint8_t> out ) {
+				check_reseed( );
+				if( out.size( ) >= BufferSize ) {
+					// Large requests skip the buffer
+					m_drbg.generate( out );
+					m_since_reseed += out.size( );
+					return;
+				}
+				size_t pos = 0;
+				while( pos < out.size( ) ) {
+					if( m_pos == BufferSize ) {
+						m_drbg.generate(
+						  daw::span<uint8_t>( m_buffer.data( ), m_buffer.size( ) ) );
+						m_since_reseed += BufferSize;
+						m_pos = 0;
+					}
+					auto const count = std::min( out.size( ) - pos, BufferSize - m_pos );
+					std::memcpy( out.data( ) + pos, m_buffer.data( ) + m_pos, count );
+					// Output is never handed out twice or left behind in memory
+					impl::secure_wipe( m_buffer.data( ) + m_pos, count );
+					m_pos += count;
+					pos += count;
+				}
+			}
+
+			static constexpr result_type min( ) noexcept {
+				return std::numeric_limits<result_type>::min( );
+			}
+
+			static constexpr result_type max( ) noexcept {
+				return std::numeric_limits<result_type>::max( );
+			}
+
+			result_type operator( )( ) {
+				result_type result = 0;
+				fill( daw::span<uint8_t>( reinterpret_cast<uint8_t *>( &result ),
+				                          sizeof( result ) ) );
+				return result;
+			}
+		};
+
+#if defined( __AES__ )
+		using csprng_t = basic_csprng_t<aes128_ctr_drbg_t>;
+#else
+		using csprng_t = basic_csprng_t<hmac_sha256_drbg_t>;
+#endif
+
+		/// @brief The calling thread's generator, created on first use
+		inline csprng_t &thread_csprng( ) {
+			thread_local csprng_t generator{};
+			return generator;
+		}
+
+		/// @brief Fill out with cryptographically secure random bytes
+		inline void random_bytes( daw::span<uint8_t> out ) {
+			thread_csprng( ).fill( out );
+		}
+
+		/// @brief size random bytes in a buffer that is not zero filled first
+		inline crypto_buffer
+		secure_random_buffer( size_t size, buffer_options_t options = {} ) {
+			options.zero = false;
+			crypto_buffer result( size, options );
+			random_bytes( result.span( ) );
+			return result;
+		}
+
+		/// @brief count random values, e.g. benchmark input
+		template<typename T>
+		std::vector<T> secure_random_data( size_t count ) {
+			static_assert( std::is_trivially_copyable_v<T>,
+			               "T must be filled byte by byte" );
+			std::vector<T> result( count );
+			random_bytes( daw::span<uint8_t>(
+			  reinterpret_cast<uint8_t *>( result.data( ) ), count * sizeof( T ) ) );
+			return result;
+		}
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,124 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// HMAC-SHA256 (RFC 2104, FIPS 198-1) on top of sha256_ctx
+
+#include <array>
+#include <cstdint>
+
+#include <daw/daw_span.h>
+
+#include "crypto_config.h"
+#include "sha256.h"
+
+namespace daw {
+	namespace crypto {
+		using hmac_sha256_tag_t = sha256_packed_digest_t;
+
+		/// @brief Streaming HMAC-SHA256.  The inner and outer hashes are keyed
+		/// once up front, so each message costs two compressions more than
+		/// hashing it and reset( ) does not touch the key again
+		class hmac_sha256_ctx {
+			static constexpr size_t const block_size = 64;
+
+			sha256_ctx m_inner_keyed;
+			sha256_ctx m_outer_keyed;
+			sha256_ctx m_inner;
+
+		public:
+			/// @param key any length, keys longer than a block are hashed first
+			explicit constexpr hmac_sha256_ctx(
+			  daw::span<uint8_t const> key ) noexcept
+			  : m_inner_keyed{}
+			  , m_outer_keyed{}
+			  , m_inner{} {
+
+				std::array<uint8_t, block_size> pad{};
+				if( key.size( ) > block_size ) {
+					sha256_ctx key_hash{};
+					key_hash.update( key );
+					key_hash.final_into( daw::span<uint8_t>( pad.data( ), 32 ) );
+				} else {
+					for( size_t n = 0; n < key.size( ); ++n ) {
+						pad[n] = key[n];
+					}
+				}
+				auto const pad_span =
+				  daw::span<uint8_t const>( pad.data( ), pad.size( ) );
+				for( auto &b : pad ) {
+					b ^= 0x36u;
+				}
+				m_inner_keyed.update( pad_span );
+				for( auto &b : pad ) {
+					b ^= 0x36u ^ 0x5Cu;
+				}
+				m_outer_keyed.update( pad_span );
+				m_inner = m_inner_keyed;
+			}
+
+			constexpr void update( daw::span<uint8_t const> message ) noexcept {
+				m_inner.update( message );
+			}
+
+			constexpr void update( uint8_t const *message, size_t len ) noexcept {
+				m_inner.update( message, len );
+			}
+
+			/// @brief Start a new message under the same key
+			constexpr void reset( ) noexcept {
+				m_inner = m_inner_keyed;
+			}
+
+			/// @brief The tag of the message so far.  The context is reset for the
+			/// next message
+			constexpr hmac_sha256_tag_t final( ) noexcept {
+				hmac_sha256_tag_t inner_digest{};
+				m_inner.final_into(
+				  daw::span<uint8_t>( inner_digest.data( ), inner_digest.size( ) ) );
+				auto outer = m_outer_keyed;
+				outer.update( daw::span<uint8_t const>( inner_digest.data( ),
+				                                        inner_digest.size( ) ) );
+				hmac_sha256_tag_t result{};
+				outer.final_into(
+				  daw::span<uint8_t>( result.data( ), result.size( ) ) );
+				reset( );
+				return result;
+			}
+
+			/// @brief Check the message so far against tag in constant time.  The
+			/// context is reset for the next message
+			constexpr bool verify( hmac_sha256_tag_t const &tag ) noexcept {
+				return impl::constant_time_equal( final( ), tag );
+			}
+		};
+
+		constexpr hmac_sha256_tag_t
+		hmac_sha256( daw::span<uint8_t const> key,
+		             daw::span<uint8_t const> message ) noexcept {
+			hmac_sha256_ctx ctx( key );
+			ctx.update( message );
+			return ctx.final( );
+		}
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,456 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Runs the slices of a bulk operation on the NUMA node holding their memory.
+// A buffer spread over two sockets read by unpinned threads pays for remote
+// memory on about half its pages.  Here the node of each slice is looked up
+// with move_pages( ), or get_mempolicy( ) where that is refused, and it is
+// queued for the workers pinned to that node.  A worker only takes slices of
+// another node once its own node has none left, nearest node first.  Linux
+// only
+//
+// DAW_CRYPTO_FAKE_NUMA=<nodes> emulates that many nodes on any machine, the
+// CPUs split between them and the pages owned in turn in 2MB runs, so the
+// scheduling can be exercised without a multi socket host
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace daw {
+	namespace crypto {
+		/// @brief The nodes work can be pinned to, the CPUs of each and the
+		/// order other nodes are stolen from
+		struct numa_topology_t {
+			std::vector<std::vector<int>> node_cpus;
+			std::vector<std::vector<size_t>> steal_order;
+			/// @brief Pages are owned by node ( address / fake_chunk ) % nodes
+			/// rather than asked of the kernel
+			bool emulated = false;
+			size_t fake_chunk = 2 * 1024 * 1024;
+
+			size_t nodes( ) const noexcept {
+				return node_cpus.size( );
+			}
+
+			/// @brief Split the CPUs this thread may run on between nodes.  With
+			/// fewer CPUs than nodes they are shared
+			static numa_topology_t emulate( size_t nodes );
+
+			/// @brief The machine's nodes from sysfs, or DAW_CRYPTO_FAKE_NUMA
+			static numa_topology_t detect( );
+		};
+
+		namespace impl {
+			inline std::vector<int> allowed_cpus( ) {
+				cpu_set_t set;
+				CPU_ZERO( &set );
+				std::vector<int> result;
+				if( sched_getaffinity( 0, sizeof( set ), &set ) == 0 ) {
+					for( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+						if( CPU_ISSET( cpu, &set ) ) {
+							result.push_back( cpu );
+						}
+					}
+				}
+				if( result.empty( ) ) {
+					result.push_back( 0 );
+				}
+				return result;
+			}
+
+			/// @brief Parse a sysfs list such as "0-3,8-11"
+			inline std::vector<int> parse_cpu_list( std::string const &list ) {
+				std::vector<int> result;
+				std::istringstream items( list );
+				std::string item;
+				while( std::getline( items, item, ',' ) ) {
+					auto const dash = item.find( '-' );
+					try {
+						auto const first = std::stoi( item.substr( 0, dash ) );
+						auto const last = dash == std::string::npos
+						                    ? first
+						                    : std::stoi( item.substr( dash + 1 ) );
+						for( int cpu = first; cpu <= last; ++cpu ) {
+							result.push_back( cpu );
+						}
+					} catch( std::exception const & ) {
+						// Whitespace or a malformed item
+					}
+				}
+				return result;
+			}
+
+			inline std::string read_sysfs( std::string const &path ) {
+				std::ifstream in( path );
+				std::string result;
+				std::getline( in, result );
+				return result;
+			}
+
+			/// @brief Other nodes, nearest first
+			inline std::vector<size_t>
+			steal_order( size_t node, std::vector<int> const &distances,
+			             size_t nodes ) {
+				std::vector<size_t> result;
+				for( size_t n = 1; n < nodes; ++n ) {
+					result.push_back( ( node + n ) % nodes );
+				}
+				if( distances.size( ) >= nodes ) {
+					std::stable_sort( result.begin( ), result.end( ),
+					                  [&]( size_t a, size_t b ) {
+						                  return distances[a] < distances[b];
+					                  } );
+				}
+				return result;
+			}
+
+			// From linux/mempolicy.h
+			constexpr int const mpol_f_node = 1;
+			constexpr int const mpol_f_addr = 2;
+
+			/// @brief The node holding each of the pages, -1 where it is not
+			/// known, e.g. a page not yet touched
+			inline std::vector<int> page_nodes( std::vector<void *> pages ) {
+				std::vector<int> result( pages.size( ), -1 );
+				if( pages.empty( ) ) {
+					return result;
+				}
+				// With no target nodes move_pages only reports where pages are
+				if( syscall( SYS_move_pages, 0, pages.size( ), pages.data( ), nullptr,
+				             result.data( ), 0 ) == 0 ) {
+					for( auto &node : result ) {
+						node = std::max( node, -1 );
+					}
+					return result;
+				}
+				for( size_t n = 0; n < pages.size( ); ++n ) {
+					int node = -1;
+					if( syscall( SYS_get_mempolicy, &node, nullptr, 0, pages[n],
+					             mpol_f_node | mpol_f_addr ) == 0 ) {
+						result[n] = node;
+					} else {
+						result[n] = -1;
+					}
+				}
+				return result;
+			}
+		} // namespace impl
+
+		inline numa_topology_t numa_topology_t::emulate( size_t nodes ) {
+			nodes = std::max( nodes, size_t{1} );
+			auto const cpus = impl::allowed_cpus( );
+			numa_topology_t result{};
+			result.emulated = true;
+			result.node_cpus.resize( nodes );
+			for( size_t n = 0; n < std::max( nodes, cpus.size( ) ); ++n ) {
+				result.node_cpus[n % nodes].push_back( cpus[n % cpus.size( )] );
+			}
+			for( auto &node : result.node_cpus ) {
+				std::sort( node.begin( ), node.end( ) );
+				node.erase( std::unique( node.begin( ), node.end( ) ), node.end( ) );
+			}
+			for( size_t n = 0; n < nodes; ++n ) {
+				result.steal_order.push_back( impl::steal_order( n, {}, nodes ) );
+			}
+			return result;
+		}
+
+		inline numa_topology_t numa_topology_t::detect( ) {
+			if( auto const *fake = std::getenv( "DAW_CRYPTO_FAKE_NUMA" ) ) {
+				auto const nodes = std::strtoul( fake, nullptr, 10 );
+				if( nodes > 0 ) {
+					return emulate( nodes );
+				}
+			}
+			auto const allowed = impl::allowed_cpus( );
+			numa_topology_t result{};
+			std::vector<std::vector<int>> distances;
+			std::string const root = "/sys/devices/system/node/node";
+			for( auto node : impl::parse_cpu_list(
+			       impl::read_sysfs( "/sys/devices/system/node/online" ) ) ) {
+				auto const prefix = root + std::to_string( node );
+				std::vector<int> cpus;
+				for( auto cpu :
+				     impl::parse_cpu_list( impl::read_sysfs( prefix + "/cpulist" ) ) ) {
+					if( std::binary_search( allowed.begin( ), allowed.end( ), cpu ) ) {
+						cpus.push_back( cpu );
+					}
+				}
+				// A node whose CPUs are all off limits still owns memory, its
+				// slices go to whichever node is free
+				if( static_cast<size_t>( node ) >= result.node_cpus.size( ) ) {
+					result.node_cpus.resize( static_cast<size_t>( node ) + 1 );
+					distances.resize( static_cast<size_t>( node ) + 1 );
+				}
+				result.node_cpus[static_cast<size_t>( node )] = std::move( cpus );
+				std::istringstream distance( impl::read_sysfs( prefix + "/distance" ) );
+				int d = 0;
+				while( distance >> d ) {
+					distances[static_cast<size_t>( node )].push_back( d );
+				}
+			}
+			if( result.node_cpus.empty( ) ) {
+				result.node_cpus.push_back( allowed );
+				distances.resize( 1 );
+			}
+			for( size_t n = 0; n < result.nodes( ); ++n ) {
+				result.steal_order.push_back(
+				  impl::steal_order( n, distances[n], result.nodes( ) ) );
+			}
+			return result;
+		}
+
+		/// @brief The node of the first page of each slice_size slice of
+		/// [data, data + size ), -1 when not known
+		inline std::vector<int> numa_slice_nodes( numa_topology_t const &topology,
+		                                          void const *data, size_t size,
+		                                          size_t slice_size ) {
+			auto const slices = ( size + slice_size - 1 ) / slice_size;
+			auto const address = reinterpret_cast<uintptr_t>( data );
+			std::vector<int> result;
+			result.reserve( slices );
+			if( topology.emulated ) {
+				for( size_t n = 0; n < slices; ++n ) {
+					result.push_back( static_cast<int>(
+					  ( ( address + n * slice_size ) / topology.fake_chunk ) %
+					  topology.nodes( ) ) );
+				}
+				return result;
+			}
+			if( topology.nodes( ) == 1 ) {
+				return std::vector<int>( slices, 0 );
+			}
+			auto const page_size = static_cast<uintptr_t>( sysconf( _SC_PAGESIZE ) );
+			std::vector<void *> pages;
+			pages.reserve( slices );
+			for( size_t n = 0; n < slices; ++n ) {
+				pages.push_back( reinterpret_cast<void *>(
+				  ( address + n * slice_size ) & ~( page_size - 1 ) ) );
+			}
+			return impl::page_nodes( std::move( pages ) );
+		}
+
+		/// @brief How the slices of a run were spread, for tuning and tests
+		struct numa_run_stats_t {
+			/// @brief Slices run on the node that holds them, or with no known
+			/// node, by the node they were queued for
+			size_t local = 0;
+			/// @brief Slices a worker took from another node's queue
+			size_t stolen = 0;
+			std::vector<size_t> slices_per_node;
+		};
+
+		/// @brief Worker threads pinned per NUMA node, running one bulk
+		/// operation at a time.  Calling run from a worker deadlocks
+		class numa_executor {
+			struct job_t {
+				std::function<void( size_t )> const *slice_fn = nullptr;
+				std::vector<std::vector<size_t>> queues;
+				std::vector<std::atomic<size_t>> cursors;
+				std::atomic<size_t> local{0};
+				std::atomic<size_t> stolen{0};
+
+				explicit job_t( size_t nodes )
+				  : queues( nodes )
+				  , cursors( nodes ) {}
+			};
+
+			numa_topology_t m_topology;
+			std::vector<std::thread> m_workers;
+			std::mutex m_run_mutex;
+			std::mutex m_mutex;
+			std::condition_variable m_start;
+			std::condition_variable m_done;
+			job_t *m_job = nullptr;
+			uint64_t m_generation = 0;
+			size_t m_finished = 0;
+			bool m_stop = false;
+
+			static void pin( std::vector<int> const &cpus ) noexcept {
+				cpu_set_t set;
+				CPU_ZERO( &set );
+				for( auto cpu : cpus ) {
+					CPU_SET( cpu, &set );
+				}
+				// Containers may forbid it, the work still runs unpinned
+				static_cast<void>(
+				  pthread_setaffinity_np( pthread_self( ), sizeof( set ), &set ) );
+			}
+
+			void work( job_t &job, size_t node ) noexcept {
+				auto const drain = [&]( size_t queue, std::atomic<size_t> &count ) {
+					auto const &slices = job.queues[queue];
+					auto &cursor = job.cursors[queue];
+					for( auto n = cursor.fetch_add( 1, std::memory_order_relaxed );
+					     n < slices.size( );
+					     n = cursor.fetch_add( 1, std::memory_order_relaxed ) ) {
+						( *job.slice_fn )( slices[n] );
+						count.fetch_add( 1, std::memory_order_relaxed );
+					}
+				};
+				drain( node, job.local );
+				for( auto other : m_topology.steal_order[node] ) {
+					drain( other, job.stolen );
+				}
+			}
+
+			void worker( size_t node ) {
+				pin( m_topology.node_cpus[node] );
+				uint64_t seen = 0;
+				std::unique_lock<std::mutex> lock( m_mutex );
+				while( true ) {
+					m_start.wait( lock,
+					              [&] { return m_stop || m_generation != seen; } );
+					if( m_stop ) {
+						return;
+					}
+					seen = m_generation;
+					auto *job = m_job;
+					lock.unlock( );
+					work( *job, node );
+					lock.lock( );
+					if( ++m_finished == m_workers.size( ) ) {
+						m_done.notify_one( );
+					}
+				}
+			}
+
+		public:
+			/// @param threads_per_node 0 for one per CPU of the node
+			explicit numa_executor( numa_topology_t topology,
+			                        size_t threads_per_node = 0 )
+			  : m_topology( std::move( topology ) ) {
+				if( m_topology.node_cpus.empty( ) ) {
+					m_topology.node_cpus.resize( 1 );
+				}
+				m_topology.steal_order.resize( m_topology.nodes( ) );
+				for( size_t node = 0; node < m_topology.nodes( ); ++node ) {
+					auto const cpus = m_topology.node_cpus[node].size( );
+					auto const threads = threads_per_node != 0 ? threads_per_node : cpus;
+					// A node with no usable CPUs has no workers, others steal its work
+					for( size_t t = 0; t < ( cpus == 0 ? 0 : threads ); ++t ) {
+						m_workers.emplace_back( [this, node] { worker( node ); } );
+					}
+				}
+				if( m_workers.empty( ) ) {
+					// Nothing could be pinned, run unpinned as node 0
+					m_topology.node_cpus[0] = impl::allowed_cpus( );
+					m_workers.emplace_back( [this] { worker( 0 ); } );
+				}
+			}
+
+			numa_executor( )
+			  : numa_executor( numa_topology_t::detect( ) ) {}
+
+			numa_executor( numa_executor const & ) = delete;
+			numa_executor( numa_executor && ) = delete;
+			numa_executor &operator=( numa_executor const & ) = delete;
+			numa_executor &operator=( numa_executor && ) = delete;
+
+			~numa_executor( ) {
+				{
+					std::lock_guard<std::mutex> lock( m_mutex );
+					m_stop = true;
+				}
+				m_start.notify_all( );
+				for( auto &w : m_workers ) {
+					w.join( );
+				}
+			}
+
+			/// @brief Shared by the bulk functions when not given an executor
+			static numa_executor &shared( ) {
+				static numa_executor result;
+				return result;
+			}
+
+			numa_topology_t const &topology( ) const noexcept {
+				return m_topology;
+			}
+
+			size_t workers( ) const noexcept {
+				return m_workers.size( );
+			}
+
+			/// @brief Call slice_fn( n ) for every n < slice_nodes.size( ), on a
+			/// worker of node slice_nodes[n] when there is one free.  Slices
+			/// with no known node are dealt out in turn.  slice_fn must not throw
+			numa_run_stats_t run( std::vector<int> const &slice_nodes,
+			                      std::function<void( size_t )> const &slice_fn ) {
+				std::lock_guard<std::mutex> run_lock( m_run_mutex );
+				job_t job( m_topology.nodes( ) );
+				job.slice_fn = &slice_fn;
+				size_t next_unknown = 0;
+				for( size_t n = 0; n < slice_nodes.size( ); ++n ) {
+					auto node = slice_nodes[n];
+					if( node < 0 || static_cast<size_t>( node ) >= m_topology.nodes( ) ) {
+						node = static_cast<int>( next_unknown++ % m_topology.nodes( ) );
+					}
+					job.queues[static_cast<size_t>( node )].push_back( n );
+				}
+				numa_run_stats_t result{};
+				for( auto const &q : job.queues ) {
+					result.slices_per_node.push_back( q.size( ) );
+				}
+				{
+					std::unique_lock<std::mutex> lock( m_mutex );
+					m_job = &job;
+					m_finished = 0;
+					++m_generation;
+					m_start.notify_all( );
+					m_done.wait( lock, [&] { return m_finished == m_workers.size( ); } );
+					m_job = nullptr;
+				}
+				result.local = job.local.load( );
+				result.stolen = job.stolen.load( );
+				return result;
+			}
+
+			/// @brief Split [data, data + size) into slice_size slices placed by
+			/// where their memory is and run slice_fn( n ) for each
+			numa_run_stats_t
+			for_each_slice( void const *data, size_t size, size_t slice_size,
+			                std::function<void( size_t )> const &slice_fn ) {
+				return run( numa_slice_nodes( m_topology, data, size, slice_size ),
+				            slice_fn );
+			}
+		};
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,231 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Bulk SHA-256 tree hashing, AES-CTR and XTS over a numa_executor, each
+// slice of the input processed on the node its pages are on
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <daw/daw_span.h>
+
+#include "aes_ctr_hmac.h"
+#include "aes_xts.h"
+#include "numa_executor.h"
+#include "sha256.h"
+#include "sha256_fixed.h"
+
+namespace daw {
+	namespace crypto {
+		namespace impl {
+			/// @brief Bytes in a slice.  Large enough that claiming one is free
+			/// next to processing it, small enough to balance several workers
+			constexpr size_t const numa_slice_size = 1024 * 1024;
+
+			/// @brief Run slices of slice_size bytes of input, inline when there
+			/// is only one
+			template<typename SliceFn>
+			void run_slices( numa_executor &executor, daw::span<uint8_t const> input,
+			                 size_t slice_size, numa_run_stats_t *stats,
+			                 SliceFn slice_fn ) {
+				if( input.size( ) <= slice_size ) {
+					if( !input.empty( ) ) {
+						slice_fn( 0 );
+					}
+					if( stats != nullptr ) {
+						*stats = numa_run_stats_t{};
+					}
+					return;
+				}
+				auto const result = executor.for_each_slice(
+				  input.data( ), input.size( ), slice_size, slice_fn );
+				if( stats != nullptr ) {
+					*stats = result;
+				}
+			}
+
+			/// @brief Prefixes that keep tree hash leaves and inner nodes apart, as
+			/// in RFC 6962
+			constexpr std::array<uint8_t, 1> const tree_leaf_prefix{0x00};
+			constexpr std::array<uint8_t, 1> const tree_node_prefix{0x01};
+		} // namespace impl
+
+		/// @brief Root of a binary Merkle tree over the leaf_size pieces of
+		/// data, the last piece possibly shorter.  As in RFC 6962 a leaf is
+		/// SHA256( 0x00 || piece ) and an inner node is
+		/// SHA256( 0x01 || left || right ), so a leaf can never pass for a node.
+		/// An odd node at the end of a level moves up unchanged, which gives the
+		/// same root as the RFC 6962 split at the largest power of two.  Empty
+		/// data is one empty leaf.  Leaves and nodes are hashed
+		/// sha256_batch_lanes at a time, the leaves in parallel and read in place
+		inline sha256_digest_t
+		sha256_tree_hash( daw::span<uint8_t const> data, size_t leaf_size,
+		                  numa_executor &executor = numa_executor::shared( ),
+		                  numa_run_stats_t *stats = nullptr ) {
+			if( leaf_size == 0 ) {
+				throw std::invalid_argument( "Tree hash leaves must not be empty" );
+			}
+			auto const leaves =
+			  std::max( ( data.size( ) + leaf_size - 1 ) / leaf_size, size_t{1} );
+			// Everything the slices use is allocated up front, workers must not
+			// throw
+			std::vector<daw::span<uint8_t const>> pieces;
+			pieces.reserve( leaves );
+			for( size_t n = 0; n < leaves; ++n ) {
+				auto const offset = std::min( n * leaf_size, data.size( ) );
+				pieces.emplace_back( data.data( ) + offset,
+				                     std::min( leaf_size, data.size( ) - offset ) );
+			}
+			std::vector<sha256_digest_t> level( leaves );
+			auto const leaf_prefix = daw::span<uint8_t const>(
+			  impl::tree_leaf_prefix.data( ), impl::tree_leaf_prefix.size( ) );
+			auto const hash_leaves = [&]( size_t first, size_t last ) noexcept {
+				sha256_multi_hash(
+				  leaf_prefix,
+				  daw::span<daw::span<uint8_t const> const>( pieces.data( ) + first,
+				                                             last - first ),
+				  daw::span<sha256_digest_t>( level.data( ) + first, last - first ) );
+			};
+			auto const leaves_per_slice =
+			  std::max( impl::numa_slice_size / leaf_size, size_t{1} );
+			impl::run_slices( executor, data, leaves_per_slice * leaf_size, stats,
+			                  [&]( size_t slice ) noexcept {
+				                  auto const first = slice * leaves_per_slice;
+				                  hash_leaves(
+				                    first,
+				                    std::min( first + leaves_per_slice, leaves ) );
+			                  } );
+			if( data.empty( ) ) {
+				hash_leaves( 0, 1 );
+			}
+
+			// Each pair of children is stored as one 64 byte message
+			std::vector<std::array<uint8_t, 64>> pairs;
+			std::vector<daw::span<uint8_t const>> messages;
+			auto const node_prefix = daw::span<uint8_t const>(
+			  impl::tree_node_prefix.data( ), impl::tree_node_prefix.size( ) );
+			while( level.size( ) > 1 ) {
+				auto const count = level.size( ) / 2;
+				pairs.resize( count );
+				messages.clear( );
+				for( size_t n = 0; n < count; ++n ) {
+					impl::store_digest_be( level[2 * n], pairs[n].data( ) );
+					impl::store_digest_be( level[( 2 * n ) + 1], pairs[n].data( ) + 32 );
+					messages.emplace_back( pairs[n].data( ), pairs[n].size( ) );
+				}
+				std::vector<sha256_digest_t> next( ( level.size( ) + 1 ) / 2 );
+				sha256_multi_hash(
+				  node_prefix,
+				  daw::span<daw::span<uint8_t const> const>( messages.data( ),
+				                                             messages.size( ) ),
+				  daw::span<sha256_digest_t>( next.data( ), count ) );
+				if( level.size( ) % 2 != 0 ) {
+					next.back( ) = level.back( );
+				}
+				level = std::move( next );
+			}
+			return level[0];
+		}
+
+		namespace aes {
+			/// @brief AES-128-CTR of a large buffer, in 1MB slices each started at
+			/// its own counter.  Slices are placed by where in is
+			inline void aes_ctr_128( aes128_key_schedule_t const &sched,
+			                         cipher_t const &iv,
+			                         daw::span<uint8_t const> in,
+			                         daw::span<uint8_t> out,
+			                         numa_executor &executor,
+			                         numa_run_stats_t *stats = nullptr ) {
+				constexpr size_t const slice_size = crypto::impl::numa_slice_size;
+				static_assert( slice_size % impl::AES_BLOCK_SIZE::value == 0 );
+				crypto::impl::run_slices(
+				  executor, in, slice_size, stats, [&]( size_t slice ) {
+					  auto const offset = slice * slice_size;
+					  auto const size = std::min( slice_size, in.size( ) - offset );
+					  auto counter = iv;
+					  impl::ctr_increment( counter,
+					                       offset / impl::AES_BLOCK_SIZE::value );
+					  aes_ctr_128( sched, counter,
+					               daw::span<uint8_t const>( in.data( ) + offset, size ),
+					               daw::span<uint8_t>( out.data( ) + offset, size ) );
+				  } );
+			}
+
+			namespace impl {
+				template<bool Encrypt>
+				void xts_sectors( aes128_xts_key_t const &key, uint64_t first_sector,
+				                  size_t sector_size, daw::span<uint8_t const> input,
+				                  daw::span<uint8_t> output, numa_executor &executor,
+				                  numa_run_stats_t *stats ) {
+					xts_check_sizes( sector_size, input.size( ), output.size( ) );
+					auto const sectors_per_slice = std::max(
+					  crypto::impl::numa_slice_size / sector_size, size_t{1} );
+					auto const slice_size = sectors_per_slice * sector_size;
+					crypto::impl::run_slices(
+					  executor, input, slice_size, stats, [&]( size_t slice ) {
+						  auto sample = crypto::impl::telemetry_start( );
+						  auto const first = slice * sectors_per_slice;
+						  auto const end =
+						    std::min( ( slice + 1 ) * slice_size, input.size( ) );
+						  for( auto offset = slice * slice_size, sector = first;
+						       offset < end; offset += sector_size, ++sector ) {
+							  xts_sector<Encrypt>(
+							    key, first_sector + sector, input.data( ) + offset,
+							    output.data( ) + offset,
+							    std::min( sector_size, input.size( ) - offset ) );
+						  }
+						  crypto::impl::telemetry_record(
+						    telemetry_op_t::aes128_xts, aes_telemetry_backend, 1,
+						    end - slice * slice_size, sample );
+					  } );
+				}
+			} // namespace impl
+
+			/// @brief aes_xts_encrypt_128_sectors with each slice of sectors run
+			/// on the node its input is on
+			inline void aes_xts_encrypt_128_sectors(
+			  aes128_xts_key_t const &key, uint64_t first_sector,
+			  size_t sector_size, daw::span<uint8_t const> input,
+			  daw::span<uint8_t> output, numa_executor &executor,
+			  numa_run_stats_t *stats = nullptr ) {
+				impl::xts_sectors<true>( key, first_sector, sector_size, input, output,
+				                         executor, stats );
+			}
+
+			/// @brief aes_xts_decrypt_128_sectors with each slice of sectors run
+			/// on the node its input is on
+			inline void aes_xts_decrypt_128_sectors(
+			  aes128_xts_key_t const &key, uint64_t first_sector,
+			  size_t sector_size, daw::span<uint8_t const> input,
+			  daw::span<uint8_t> output, numa_executor &executor,
+			  numa_run_stats_t *stats = nullptr ) {
+				impl::xts_sectors<false>( key, first_sector, sector_size, input,
+				                          output, executor, stats );
+			}
+		} // namespace aes
+	}   // namespace crypto
+} // namespace daw
@@ -23,17 +23,38 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <iomanip>
+#include <iterator>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined( __SSSE3__ )
+#include <immintrin.h>
+#elif defined( _MSC_VER )
+#include <intrin.h>
+#endif
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#include <sys/uio.h>
+#define DAW_CRYPTO_HAS_IOVEC
+#endif
 
-#include <daw/daw_bounded_vector.h>
 #include <daw/daw_random.h>
 #include <daw/daw_span.h>
 #include <daw/daw_string_view.h>
 
+#include "crypto_config.h"
+#include "crypto_telemetry.h"
+
 namespace daw {
 	namespace crypto {
 		namespace impl {
@@ -83,61 +104,80 @@ namespace daw {
 				return SHA2_ROTR<17u>( x ) ^ SHA2_ROTR<19u>( x ) ^ SHA2_SHFR<10u>( x );
 			}
 
-#ifdef LITTLE_ENDIAN
-			constexpr uint32_t to_uint32_be( uint8_t const *ptr ) noexcept {
-				return static_cast<uint32_t>( static_cast<uint8_t>( ptr[0] ) << 24u ) |
-				       static_cast<uint32_t>( static_cast<uint8_t>( ptr[1] ) << 16u ) |
-				       static_cast<uint32_t>( static_cast<uint8_t>( ptr[2] ) << 8u ) |
-				       static_cast<uint32_t>( static_cast<uint8_t>( ptr[3] ) );
+			inline uint32_t byte_swap( uint32_t const value ) noexcept {
+#if defined( __GNUC__ ) || defined( __clang__ )
+				return __builtin_bswap32( value );
+#elif defined( _MSC_VER )
+				return _byteswap_ulong( value );
+#else
+				return ( value >> 24u ) | ( ( value >> 8u ) & 0x0000'FF00U ) |
+				       ( ( value << 8u ) & 0x00FF'0000U ) | ( value << 24u );
+#endif
 			}
 
-			template<typename CharT>
-			constexpr void to_uint64_be( CharT *ptr, uint64_t const value ) noexcept {
-				ptr[0] =
-				  static_cast<CharT>( ( value & 0xFF'00'00'00'00'00'00'00 ) >> 56u );
-				ptr[1] =
-				  static_cast<CharT>( ( value & 0x00'FF'00'00'00'00'00'00 ) >> 48u );
-				ptr[2] =
-				  static_cast<CharT>( ( value & 0x00'00'FF'00'00'00'00'00 ) >> 40u );
-				ptr[3] =
-				  static_cast<CharT>( ( value & 0x00'00'00'FF'00'00'00'00 ) >> 32u );
-				ptr[4] =
-				  static_cast<CharT>( ( value & 0x00'00'00'00'FF'00'00'00 ) >> 24u );
-				ptr[5] =
-				  static_cast<CharT>( ( value & 0x00'00'00'00'00'FF'00'00 ) >> 16u );
-				ptr[6] =
-				  static_cast<CharT>( ( value & 0x00'00'00'00'00'00'FF'00 ) >> 8u );
-				ptr[7] = static_cast<CharT>( ( value & 0x00'00'00'00'00'00'00'FF ) );
-			}
+			inline uint64_t byte_swap( uint64_t const value ) noexcept {
+#if defined( __GNUC__ ) || defined( __clang__ )
+				return __builtin_bswap64( value );
+#elif defined( _MSC_VER )
+				return _byteswap_uint64( value );
 #else
+				return ( static_cast<uint64_t>(
+				           byte_swap( static_cast<uint32_t>( value ) ) )
+				         << 32u ) |
+				       byte_swap( static_cast<uint32_t>( value >> 32u ) );
+#endif
+			}
 
+			/// @brief Read a big endian 32bit value from a possibly unaligned pointer
 			template<typename CharT>
 			constexpr uint32_t to_uint32_be( CharT const *ptr ) noexcept {
-				return static_cast<uint32_t>( static_cast<uint8_t>( ptr[0] ) ) |
-				       static_cast<uint32_t>( static_cast<uint8_t>( ptr[1] ) << 8u ) |
-				       static_cast<uint32_t>( static_cast<uint8_t>( ptr[2] ) << 16u ) |
-				       static_cast<uint32_t>( static_cast<uint8_t>( ptr[3] ) << 24u );
+#if defined( ENDIAN_LITTLE ) || defined( ENDIAN_BIG )
+				if( !is_constant_evaluated( ) ) {
+					uint32_t result = 0;
+					std::memcpy( &result, ptr, sizeof( result ) );
+#if defined( ENDIAN_LITTLE )
+					return byte_swap( result );
+#else
+					return result;
+#endif
+				}
+#endif
+				return ( static_cast<uint32_t>( static_cast<uint8_t>( ptr[0] ) )
+				         << 24u ) |
+				       ( static_cast<uint32_t>( static_cast<uint8_t>( ptr[1] ) )
+				         << 16u ) |
+				       ( static_cast<uint32_t>( static_cast<uint8_t>( ptr[2] ) )
+				         << 8u ) |
+				       static_cast<uint32_t>( static_cast<uint8_t>( ptr[3] ) );
 			}
 
+			/// @brief Write value to ptr[0..8) in big endian order
 			template<typename CharT>
 			constexpr void to_uint64_be( CharT *ptr, uint64_t const value ) noexcept {
-				ptr[0] = static_cast<CharT>( value & 0x00'00'00'00'00'00'00'FF );
-				ptr[1] =
-				  static_cast<CharT>( ( value & 0x00'00'00'00'00'00'FF'00 ) >> 8u );
-				ptr[2] =
-				  static_cast<CharT>( ( value & 0x00'00'00'00'00'FF'00'00 ) >> 16u );
-				ptr[3] =
-				  static_cast<CharT>( ( value & 0x00'00'00'00'FF'00'00'00 ) >> 24u );
-				ptr[4] =
-				  static_cast<CharT>( ( value & 0x00'00'00'FF'00'00'00'00 ) >> 32u );
-				ptr[5] =
-				  static_cast<CharT>( ( value & 0x00'00'FF'00'00'00'00'00 ) >> 40u );
-				ptr[6] =
-				  static_cast<CharT>( ( value & 0x00'FF'00'00'00'00'00'00 ) >> 48u );
-				ptr[7] =
-				  static_cast<CharT>( ( value & 0xFF'00'00'00'00'00'00'00 ) >> 56u );
-			}
+#if defined( ENDIAN_LITTLE ) || defined( ENDIAN_BIG )
+				if( !is_constant_evaluated( ) ) {
+#if defined( ENDIAN_LITTLE )
+					auto const tmp = byte_swap( value );
+#else
+					auto const tmp = value;
 #endif
+					std::memcpy( ptr, &tmp, sizeof( tmp ) );
+					return;
+				}
+#endif
+				for( size_t n = 0; n < sizeof( uint64_t ); ++n ) {
+					ptr[n] = static_cast<CharT>(
+					  ( value >> ( 56u - ( n * 8u ) ) ) & 0xFFu );
+				}
+			}
+
+			template<typename CharT>
+			constexpr void uint32_to_be( CharT *ptr, uint32_t const value ) noexcept {
+				ptr[0] = static_cast<CharT>( ( value >> 24u ) & 0xFFu );
+				ptr[1] = static_cast<CharT>( ( value >> 16u ) & 0xFFu );
+				ptr[2] = static_cast<CharT>( ( value >> 8u ) & 0xFFu );
+				ptr[3] = static_cast<CharT>( value & 0xFFu );
+			}
 
 			template<typename T, size_t DigestSize>
 			struct digest_t {
@@ -231,11 +271,141 @@ namespace daw {
 
 		using sha256_digest_t = impl::digest_t<uint32_t, 8>;
 
+		namespace impl {
+			/// @brief One SHA256 round given K[Round] + W[Round].  Rather than
+			/// shifting a..h down each round the roles rotate through s: in round
+			/// Round variable a is s[( 8 - Round ) % 8], b the next slot, and so on.
+			/// Only d and h are written
+			template<size_t Round, typename word_t>
+			constexpr void sha256_round_kw( std::array<word_t, 8> &s,
+			                                word_t const kw ) noexcept {
+				constexpr size_t a = ( 8 - ( Round % 8 ) ) % 8;
+				constexpr size_t b = ( a + 1 ) % 8;
+				constexpr size_t c = ( a + 2 ) % 8;
+				constexpr size_t d = ( a + 3 ) % 8;
+				constexpr size_t e = ( a + 4 ) % 8;
+				constexpr size_t f = ( a + 5 ) % 8;
+				constexpr size_t g = ( a + 6 ) % 8;
+				constexpr size_t h = ( a + 7 ) % 8;
+
+				word_t const t1 =
+				  s[h] + SHA256_EP1( s[e] ) + SHA256_CH( s[e], s[f], s[g] ) + kw;
+				word_t const t2 = SHA256_EP0( s[a] ) + SHA256_MAJ( s[a], s[b], s[c] );
+				s[d] += t1;
+				s[h] = t1 + t2;
+			}
+
+			/// @brief One SHA256 round.  The message schedule is a 16 word window
+			/// where w[i % 16] is replaced by w[i] once i >= 16
+			template<size_t Round, typename word_t>
+			constexpr void sha256_round( std::array<word_t, 8> &s,
+			                             std::array<word_t, 16> &w ) noexcept {
+				if constexpr( Round >= 16 ) {
+					w[Round % 16] += SHA256_SIG1( w[( Round - 2 ) % 16] ) +
+					                 w[( Round - 7 ) % 16] +
+					                 SHA256_SIG0( w[( Round - 15 ) % 16] );
+				}
+				sha256_round_kw<Round>( s, sha256_k<word_t>[Round] + w[Round % 16] );
+			}
+
+			// 64 rounds is a multiple of 8 so the roles end where they started
+			template<typename word_t, size_t... Rounds>
+			constexpr void sha256_rounds( std::array<word_t, 8> &s,
+			                              std::array<word_t, 16> &w,
+			                              std::index_sequence<Rounds...> ) noexcept {
+				( sha256_round<Rounds>( s, w ), ... );
+			}
+
+			/// @brief Rounds for a block whose K + W values were computed ahead of
+			/// time, e.g. a block holding nothing but padding
+			template<typename word_t, size_t... Rounds>
+			constexpr void
+			sha256_rounds_kw( std::array<word_t, 8> &s,
+			                  std::array<word_t, 64> const &kw,
+			                  std::index_sequence<Rounds...> ) noexcept {
+				( sha256_round_kw<Rounds>( s, kw[Rounds] ), ... );
+			}
+		} // namespace impl
+
+		// Raw 32 byte digest in the standard big endian byte order.  Unlike
+		// sha256_digest_t it carries no alignment padding so it packs densely
+		using sha256_packed_digest_t = std::array<uint8_t, 32>;
+		static_assert( sizeof( sha256_packed_digest_t ) == 32,
+		               "Packed digests must not be padded" );
+
+		namespace impl {
+			/// @brief Compress one block already loaded as 16 host order words.
+			/// State is sha256_digest_t or the unpadded sha256_state_t
+			template<typename State>
+			constexpr void sha256_compress( State &state,
+			                                std::array<uint32_t, 16> w ) noexcept {
+				std::array<uint32_t, 8> working{state[0], state[1], state[2],
+				                                state[3], state[4], state[5],
+				                                state[6], state[7]};
+
+				sha256_rounds( working, w, std::make_index_sequence<64>{} );
+
+				for( size_t i = 0; i < 8; ++i ) {
+					state[i] += working[i];
+				}
+			}
+
+			/// @brief Write the 8 digest words to out in big endian order
+			template<typename Digest, typename CharT>
+			constexpr void store_digest_be( Digest const &digest,
+			                                CharT *out ) noexcept {
+				if( !is_constant_evaluated( ) ) {
+#if defined( __SSSE3__ ) && defined( ENDIAN_LITTLE )
+					auto const mask = _mm_set_epi8( 12, 13, 14, 15, 8, 9, 10, 11, 4, 5,
+					                                6, 7, 0, 1, 2, 3 );
+					auto const lo = _mm_loadu_si128(
+					  reinterpret_cast<__m128i const *>( &digest[0] ) );
+					auto const hi = _mm_loadu_si128(
+					  reinterpret_cast<__m128i const *>( &digest[4] ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i *>( out ),
+					                  _mm_shuffle_epi8( lo, mask ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i *>( out + 16 ),
+					                  _mm_shuffle_epi8( hi, mask ) );
+					return;
+#elif defined( ENDIAN_LITTLE )
+					for( size_t n = 0; n < digest.size( ); ++n ) {
+						auto const tmp = byte_swap( digest[n] );
+						std::memcpy( out + ( n * 4 ), &tmp, sizeof( tmp ) );
+					}
+					return;
+#elif defined( ENDIAN_BIG )
+					std::memcpy( out, &digest[0], 32 );
+					return;
+#endif
+				}
+				for( size_t n = 0; n < digest.size( ); ++n ) {
+					uint32_to_be( out + ( n * 4 ), digest[n] );
+				}
+			}
+		} // namespace impl
+
+		/// @brief Convert the host order digest words to the canonical 32 byte
+		/// big endian digest
+		constexpr sha256_packed_digest_t
+		to_packed_digest( sha256_digest_t const &digest ) noexcept {
+			sha256_packed_digest_t result{};
+			impl::store_digest_be( digest, result.data( ) );
+			return result;
+		}
+
 		namespace impl {
 			template<typename word_t>
 			constexpr sha256_digest_t const sha256_init_state_values{
 			  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
 			  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+			/// @brief Working state without sha256_digest_t's cache line alignment
+			using sha256_state_t = std::array<uint32_t, 8>;
+
+			constexpr sha256_state_t const sha256_init_state_words{
+			  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+			  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
 			constexpr char to_nibble( uint8_t c ) noexcept {
 				if( c < 10 ) {
 					return static_cast<char>( c ) + '0';
@@ -244,6 +414,61 @@ namespace daw {
 			}
 		} // namespace impl
 
+		/// @brief Customization point for iterators over storage made of
+		/// contiguous pieces, such as deques and ropes.  A specialization sets
+		/// is_segmented and provides
+		///   template<typename F>
+		///   static void for_each_segment( Iterator first, Iterator last, F f );
+		/// which calls f( pointer, count ) for each contiguous run in order
+		template<typename Iterator, typename = void>
+		struct segmented_iterator_traits {
+			static constexpr bool const is_segmented = false;
+		};
+
+#if defined( __GLIBCXX__ )
+		// libstdc++ deque iterators expose the block they point into
+		template<typename T, typename Ref, typename Ptr>
+		struct segmented_iterator_traits<std::_Deque_iterator<T, Ref, Ptr>> {
+			static constexpr bool const is_segmented = true;
+			using iterator = std::_Deque_iterator<T, Ref, Ptr>;
+
+			template<typename F>
+			static void for_each_segment( iterator first, iterator last, F f ) {
+				while( first._M_node != last._M_node ) {
+					auto const count = first._M_last - first._M_cur;
+					f( first._M_cur, static_cast<size_t>( count ) );
+					first += count;
+				}
+				f( first._M_cur, static_cast<size_t>( last._M_cur - first._M_cur ) );
+			}
+		};
+#endif
+
+		namespace impl {
+			template<typename T, typename... Ts>
+			constexpr bool const is_one_of_v = ( std::is_same_v<T, Ts> || ... );
+
+			template<typename Iterator, typename Container>
+			constexpr bool const is_iterator_of_v =
+			  is_one_of_v<Iterator, typename Container::iterator,
+			              typename Container::const_iterator>;
+
+			/// @brief Iterators known to point into contiguous storage.  Before
+			/// C++20 this is pointers and the byte vector/string iterators
+			template<typename Iterator>
+			constexpr bool const is_contiguous_iterator_v =
+			  std::is_pointer_v<Iterator> ||
+#if defined( __cpp_lib_concepts )
+			  std::contiguous_iterator<Iterator> ||
+#endif
+			  is_iterator_of_v<Iterator, std::string> ||
+			  is_iterator_of_v<Iterator, std::string_view> ||
+			  is_iterator_of_v<Iterator, std::vector<char>> ||
+			  is_iterator_of_v<Iterator, std::vector<signed char>> ||
+			  is_iterator_of_v<Iterator, std::vector<unsigned char>> ||
+			  is_iterator_of_v<Iterator, std::vector<std::byte>>;
+		} // namespace impl
+
 		template<size_t digest_size, typename>
 		struct sha2_ctx;
 
@@ -256,119 +481,144 @@ namespace daw {
 			  8; // 256/(32bit wordsize) bits
 
 		private:
-			uint64_t m_message_size;
-			daw::bounded_vector_t<byte_t, block_size_bytes> m_message_block;
-			sha256_digest_t m_state;
+			// 104 bytes with no padding, so large numbers of live contexts pack
+			// densely.  The number of bytes in m_block is m_length % 64
+			impl::sha256_state_t m_state;
+			std::array<byte_t, block_size_bytes> m_block;
+			uint64_t m_length;
 
 		public:
 			constexpr sha2_ctx( ) noexcept
-			  : m_message_size{0}
-			  , m_message_block{}
-			  , m_state{impl::sha256_init_state_values<word_t>} {}
+			  : m_state{impl::sha256_init_state_words}
+			  , m_block{}
+			  , m_length{0} {}
 
 		private:
-			constexpr void transform( ) noexcept {
-				/*
-				 * Initialize array of round constants:
-				 * (first 32 bits of the fractional parts of the cube roots of the first
-				 * 64 primes 2..311):
-				 */
-				alignas( 64 ) std::array<word_t, 64> w{0};
-				// Copy message to first 16 words of w array
-				{
-					auto message_view =
-					  daw::span( m_message_block.data( ), m_message_block.size( ) );
-					for( size_t i = 0; i < 16; ++i ) {
-						w[i] = impl::to_uint32_be( message_view.data( ) );
-						message_view.remove_prefix( 4 );
-					}
-				}
+			constexpr size_t block_fill( ) const noexcept {
+				return static_cast<size_t>( m_length % block_size_bytes );
+			}
 
-				for( size_t i = 16; i < 64; ++i ) {
-					word_t const s0 = impl::SHA256_SIG0( w[i - 15] );
-					word_t const s1 = impl::SHA256_SIG1( w[i - 2] );
-					w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+			template<typename State, typename U>
+			static constexpr void compress( State &state, U const *block ) noexcept {
+				std::array<word_t, 16> w{};
+				for( size_t i = 0; i < 16; ++i ) {
+					w[i] = impl::to_uint32_be( block + ( i * 4 ) );
 				}
+				impl::sha256_compress( state, w );
+			}
 
-				alignas( 64 ) std::array<word_t, 10> tmp_state{
-				  m_state[0], m_state[1], m_state[2], m_state[3], m_state[4],
-				  m_state[5], m_state[6], m_state[7], 0,          0};
-
-				for( size_t i = 0; i < 64; ++i ) {
-					tmp_state[8] =
-					  tmp_state[7] + impl::SHA256_EP1( tmp_state[4] ) +
-					  impl::SHA256_CH( tmp_state[4], tmp_state[5], tmp_state[6] ) +
-					  impl::sha256_k<word_t>[i] + w[i];
-					tmp_state[9] =
-					  impl::SHA256_EP0( tmp_state[0] ) +
-					  impl::SHA256_MAJ( tmp_state[0], tmp_state[1], tmp_state[2] );
-					tmp_state[7] = tmp_state[6];
-					tmp_state[6] = tmp_state[5];
-					tmp_state[5] = tmp_state[4];
-					tmp_state[4] = tmp_state[3] + tmp_state[8];
-					tmp_state[3] = tmp_state[2];
-					tmp_state[2] = tmp_state[1];
-					tmp_state[1] = tmp_state[0];
-					tmp_state[0] = tmp_state[8] + tmp_state[9];
+			// Pad the last partial block in a stack buffer and compress the one or
+			// two blocks that result.  tail_size must be less than block_size_bytes
+			template<typename State, typename U>
+			static constexpr void compress_final( State &state, U const *tail,
+			                                      size_t tail_size,
+			                                      uint64_t message_bits ) noexcept {
+				std::array<byte_t, block_size_bytes * 2> blocks{0};
+				for( size_t n = 0; n < tail_size; ++n ) {
+					blocks[n] = static_cast<byte_t>( tail[n] );
 				}
+				blocks[tail_size] = 0b1000'0000;
+				size_t const block_count = tail_size < 56 ? 1 : 2;
+				impl::to_uint64_be( blocks.data( ) +
+				                      ( block_count * block_size_bytes ) -
+				                      sizeof( uint64_t ),
+				                    message_bits );
+				compress( state, blocks.data( ) );
+				if( block_count == 2 ) {
+					compress( state, blocks.data( ) + block_size_bytes );
+				}
+			}
 
-				m_state[0] += tmp_state[0];
-				m_state[1] += tmp_state[1];
-				m_state[2] += tmp_state[2];
-				m_state[3] += tmp_state[3];
-				m_state[4] += tmp_state[4];
-				m_state[5] += tmp_state[5];
-				m_state[6] += tmp_state[6];
-				m_state[7] += tmp_state[7];
-
-				m_message_size += m_message_block.capacity( ) * 8;
-				m_message_block.clear( );
+			template<typename U>
+			constexpr void buffer( size_t pos, U const *data,
+			                       size_t count ) noexcept {
+				if( !impl::is_constant_evaluated( ) ) {
+					if( count > 0 ) {
+						std::memcpy( m_block.data( ) + pos, data, count );
+					}
+					return;
+				}
+				for( size_t n = 0; n < count; ++n ) {
+					m_block[pos + n] = static_cast<byte_t>( data[n] );
+				}
 			}
 
 			template<typename ArrayView>
 			constexpr void update_impl( ArrayView view ) noexcept {
-				size_t push_size = 1;
-				while( view.size( ) > m_message_block.capacity( ) ) {
-					push_size = std::min( view.size( ), m_message_block.available( ) );
-					m_message_block.push_back( view.data( ), push_size );
-					transform( );
+				impl::telemetry_record( telemetry_op_t::sha256,
+				                        telemetry_backend_t::scalar, 0, view.size( ) );
+				auto const fill = block_fill( );
+				m_length += view.size( );
+				if( fill != 0 ) {
+					auto const push_size =
+					  std::min( view.size( ), block_size_bytes - fill );
+					buffer( fill, view.data( ), push_size );
 					view.remove_prefix( push_size );
-				}
-				if( !view.empty( ) ) {
-					push_size = std::min( view.size( ), m_message_block.available( ) );
-					m_message_block.push_back( view.data( ), push_size );
-					if( m_message_block.full( ) ) {
-						transform( );
+					if( fill + push_size < block_size_bytes ) {
+						return;
 					}
-					view.remove_prefix( push_size );
+					compress( m_state, m_block.data( ) );
 				}
+				// Whole blocks are compressed straight from the caller's buffer
+				while( view.size( ) >= block_size_bytes ) {
+					compress( m_state, view.data( ) );
+					view.remove_prefix( block_size_bytes );
+				}
+				buffer( 0, view.data( ), view.size( ) );
 			}
 
+			/// @brief Contiguous ranges use the span path, segmented ones the span
+			/// path per segment and anything else is copied through a staging
+			/// buffer a few blocks at a time.  Byte at a time pushes are only used
+			/// in constant expressions
 			template<typename Iterator>
 			constexpr void update_impl( Iterator first, Iterator last ) noexcept {
-				while( first != last ) {
-					m_message_block.push_back( *first++ );
-					if( m_message_block.full( ) ) {
-						transform( );
+				using value_t =
+				  std::remove_cv_t<typename std::iterator_traits<Iterator>::value_type>;
+				if( !impl::is_constant_evaluated( ) ) {
+					if constexpr( impl::is_contiguous_iterator_v<Iterator> ) {
+						if( first != last ) {
+							update_impl( daw::span<value_t const>(
+							  std::addressof( *first ),
+							  static_cast<size_t>( std::distance( first, last ) ) ) );
+						}
+					} else if constexpr( segmented_iterator_traits<
+					                       Iterator>::is_segmented ) {
+						segmented_iterator_traits<Iterator>::for_each_segment(
+						  first, last, [&]( value_t const *ptr, size_t count ) {
+							  update_impl( daw::span<value_t const>( ptr, count ) );
+						  } );
+					} else {
+						std::array<byte_t, block_size_bytes * 4> staging{};
+						while( first != last ) {
+							size_t count = 0;
+							while( count < staging.size( ) && first != last ) {
+								staging[count++] = static_cast<byte_t>( *first );
+								++first;
+							}
+							update_impl( daw::span<byte_t const>( staging.data( ), count ) );
+						}
 					}
+					return;
 				}
-			}
-
-			constexpr void final_padding( ) noexcept {
-				// Can never be full as we would have processed it in update step
-				m_message_block.push_back( 0b1000'0000 );
-				if( m_message_block.size( ) > 56 ) {
-					while( !m_message_block.full( ) ) {
-						m_message_block.push_back( 0 );
+				while( first != last ) {
+					m_block[block_fill( )] = static_cast<byte_t>( *first );
+					++first;
+					++m_length;
+					if( block_fill( ) == 0 ) {
+						compress( m_state, m_block.data( ) );
 					}
-					transform( );
-				}
-				while( m_message_block.size( ) < 56 ) {
-					m_message_block.push_back( 0 );
 				}
 			}
 
 		public:
+			/// @brief Return the context to its newly constructed state so that it
+			/// can be reused for another message
+			constexpr void reset( ) noexcept {
+				m_state = impl::sha256_init_state_words;
+				m_length = 0;
+			}
+
 			constexpr void update( T const *message, size_t len ) noexcept {
 				auto view = daw::span( message, len );
 				update_impl( view );
@@ -392,22 +642,45 @@ namespace daw {
 				update_impl( first, last );
 			}
 
+			/// @brief Hash the concatenation of fragments, e.g. a header, payload
+			/// pieces and a trailer.  Whole blocks are hashed in place and only a
+			/// block that straddles fragments is copied
+			template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+			constexpr void
+			update( daw::span<daw::span<U const> const> fragments ) noexcept {
+				for( auto const &fragment : fragments ) {
+					update_impl( fragment );
+				}
+			}
+
+#if defined( DAW_CRYPTO_HAS_IOVEC )
+			/// @brief Hash the concatenation of the iovec buffers, as passed to
+			/// writev/readv
+			void update( daw::span<::iovec const> fragments ) noexcept {
+				for( auto const &fragment : fragments ) {
+					update_impl( daw::span<byte_t const>(
+					  static_cast<byte_t const *>( fragment.iov_base ),
+					  fragment.iov_len ) );
+				}
+			}
+
+			void update( ::iovec const *fragments, size_t count ) noexcept {
+				update( daw::span<::iovec const>( fragments, count ) );
+			}
+#endif
+
 			static constexpr sha256_digest_t create_digest( ) noexcept {
 				return sha256_digest_t{};
 			}
 
+			/// @brief Finish the message and store the digest.  Call reset( ) before
+			/// reusing the context
 			constexpr void final( sha256_digest_t &digest ) noexcept {
-				auto const message_size =
-				  m_message_size + ( m_message_block.size( ) * 8 );
-				final_padding( );
-
-				auto size_begin = m_message_block.end( );
-				while( !m_message_block.full( ) ) {
-					m_message_block.push_back( 0 );
-				}
-				impl::to_uint64_be( size_begin, message_size );
-
-				transform( );
+				compress_final( m_state, m_block.data( ), block_fill( ),
+				                m_length * 8 );
+				m_length = 0;
+				impl::telemetry_record( telemetry_op_t::sha256,
+				                        telemetry_backend_t::scalar, 1, 0 );
 
 				for( size_t i = 0; i < digest.size( ); ++i ) {
 					digest[i] = m_state[i];
@@ -419,33 +692,84 @@ namespace daw {
 				final( digest );
 				return digest;
 			}
+
+			/// @brief Finish the message and write the standard 32 byte big endian
+			/// digest to out.  Call reset( ) before reusing the context
+			/// @param out destination, must be at least 32 bytes
+			template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+			constexpr void final_into( daw::span<U> out ) noexcept {
+				compress_final( m_state, m_block.data( ), block_fill( ),
+				                m_length * 8 );
+				m_length = 0;
+				impl::telemetry_record( telemetry_op_t::sha256,
+				                        telemetry_backend_t::scalar, 1, 0 );
+				impl::store_digest_be( m_state, out.data( ) );
+			}
+
+			/// @brief Finish the message and return the canonical byte digest
+			constexpr sha256_packed_digest_t final_packed( ) noexcept {
+				sha256_packed_digest_t result{};
+				final_into( daw::span<uint8_t>( result.data( ), result.size( ) ) );
+				return result;
+			}
+
+			/// @brief Hash a complete message without a streaming context.  Whole
+			/// blocks are read in place and the padded final block(s) are built on
+			/// the stack
+			template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+			static constexpr sha256_digest_t
+			hash( daw::span<U const> message ) noexcept {
+				auto sample = impl::telemetry_start( );
+				auto const size = message.size( );
+				sha256_digest_t state = impl::sha256_init_state_values<word_t>;
+				auto const message_bits = static_cast<uint64_t>( message.size( ) ) * 8;
+				while( message.size( ) >= block_size_bytes ) {
+					compress( state, message.data( ) );
+					message.remove_prefix( block_size_bytes );
+				}
+				compress_final( state, message.data( ), message.size( ),
+				                message_bits );
+				impl::telemetry_record( telemetry_op_t::sha256,
+				                        telemetry_backend_t::scalar, 1, size, sample );
+				return state;
+			}
+
+			static constexpr sha256_digest_t hash( T const *message,
+			                                       size_t len ) noexcept {
+				return hash( daw::span<T const>( message, len ) );
+			}
+
+			/// @brief One shot hash writing the 32 byte big endian digest to out
+			template<typename U, typename V,
+			         typename =
+			           std::enable_if_t<sizeof( U ) == 1 && sizeof( V ) == 1>>
+			static constexpr void hash( daw::span<U const> message,
+			                            daw::span<V> out ) noexcept {
+				impl::store_digest_be( hash( message ), out.data( ) );
+			}
 		}; // sha256_ctx
 
 		using sha256_ctx = sha2_ctx<256, unsigned char>;
+		static_assert( sizeof( sha256_ctx ) == 104,
+		               "sha256_ctx is meant to be state, one block and a count" );
 
 		template<typename CharT, typename Traits,
 		         typename = std::enable_if_t<sizeof( CharT ) == 1>>
 		constexpr sha256_digest_t
 		sha256_bin( daw::basic_string_view<CharT, Traits> sv ) noexcept {
-			sha2_ctx<256, CharT> ctx{};
-			ctx.update( sv.data( ), sv.size( ) );
-			return ctx.final( );
+			return sha2_ctx<256, CharT>::hash( sv.data( ), sv.size( ) );
 		}
 
 		template<typename CharT, typename = std::enable_if_t<sizeof( CharT ) == 1>>
 		constexpr sha256_digest_t sha256_bin( CharT const *str,
 		                                      size_t len ) noexcept {
-			sha2_ctx<256, CharT> ctx{};
-			ctx.update( str, len );
-			return ctx.final( );
+			return sha2_ctx<256, CharT>::hash( str, len );
 		}
 
 		template<typename CharT, size_t N,
 		         typename = std::enable_if_t<sizeof( CharT ) == 1>>
 		constexpr sha256_digest_t sha256_bin( CharT const ( &str )[N] ) noexcept {
-			sha2_ctx<256, CharT> ctx{};
-			ctx.update( str, N - 1 );
-			return ctx.final( );
+			return sha2_ctx<256, CharT>::hash( str, N - 1 );
 		}
 
 		class sha256_hash_string {
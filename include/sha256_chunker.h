@@ -0,0 +1,307 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Content defined chunking with a Gear rolling hash(FastCDC) combined with
+// SHA256 of each chunk.  Bytes are hashed right after the cut point search
+// has read them, while they are still in cache
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <daw/daw_span.h>
+
+#include "sha256.h"
+#include "sha256_fixed.h"
+
+namespace daw {
+	namespace crypto {
+		/// @brief One chunk of the stream
+		struct sha256_chunk_t {
+			uint64_t offset;
+			uint64_t size;
+			sha256_digest_t digest;
+		};
+
+		/// @brief Chunk size limits.  Sizes are in bytes and avg_size must be a
+		/// power of two
+		struct sha256_chunker_sizes_t {
+			size_t min_size = 2 * 1024;
+			size_t avg_size = 8 * 1024;
+			size_t max_size = 64 * 1024;
+		};
+
+		namespace impl {
+			constexpr uint64_t splitmix64( uint64_t &seed ) noexcept {
+				seed += 0x9E37'79B9'7F4A'7C15ULL;
+				uint64_t z = seed;
+				z = ( z ^ ( z >> 30u ) ) * 0xBF58'476D'1CE4'E5B9ULL;
+				z = ( z ^ ( z >> 27u ) ) * 0x94D0'49BB'1331'11EBULL;
+				return z ^ ( z >> 31u );
+			}
+
+			constexpr std::array<uint64_t, 256> make_gear_table( ) noexcept {
+				std::array<uint64_t, 256> result{};
+				uint64_t seed = 0x6461'772D'6364'6300ULL;
+				for( auto &v : result ) {
+					v = splitmix64( seed );
+				}
+				return result;
+			}
+
+			// The table is part of the chunk format, changing it moves every cut
+			// point
+			alignas( 64 ) constexpr std::array<uint64_t, 256> const gear_table =
+			  make_gear_table( );
+
+			constexpr size_t log2( size_t value ) noexcept {
+				size_t result = 0;
+				while( value > 1 ) {
+					value >>= 1u;
+					++result;
+				}
+				return result;
+			}
+
+			/// @brief Gear cut point search with FastCDC normalized chunking.  The
+			/// first min_size bytes of a chunk are skipped, a harder mask is used up
+			/// to avg_size and an easier one after.  The hash shifts left so its top
+			/// bits depend on the last 64 bytes only, and the masks use those bits
+			class gear_cutter_t {
+				sha256_chunker_sizes_t m_sizes;
+				uint64_t m_mask_small;
+				uint64_t m_mask_large;
+				uint64_t m_hash = 0;
+				size_t m_chunk_size = 0;
+
+				static constexpr uint64_t top_bits( size_t bits ) noexcept {
+					return ~static_cast<uint64_t>( 0 ) << ( 64U - bits );
+				}
+
+				// Runs before the masks are computed from avg_size
+				static sha256_chunker_sizes_t
+				validate( sha256_chunker_sizes_t sizes ) {
+					if( sizes.avg_size < 256 ||
+					    ( sizes.avg_size & ( sizes.avg_size - 1 ) ) != 0 ||
+					    sizes.min_size > sizes.avg_size ||
+					    sizes.avg_size > sizes.max_size ) {
+						throw std::invalid_argument(
+						  "Chunk sizes must satisfy min <= avg <= max with avg a power of "
+						  "two of at least 256" );
+					}
+					return sizes;
+				}
+
+			public:
+				explicit gear_cutter_t( sha256_chunker_sizes_t sizes )
+				  : m_sizes( validate( sizes ) )
+				  , m_mask_small( top_bits( log2( m_sizes.avg_size ) + 2 ) )
+				  , m_mask_large( top_bits( log2( m_sizes.avg_size ) - 2 ) ) {}
+
+				constexpr sha256_chunker_sizes_t const &sizes( ) const noexcept {
+					return m_sizes;
+				}
+
+				/// @brief Bytes in the current, not yet cut, chunk
+				constexpr size_t chunk_size( ) const noexcept {
+					return m_chunk_size;
+				}
+
+				/// @brief Scan data for the end of the current chunk
+				/// @return the number of bytes that belong to the current chunk and
+				/// whether the chunk ends there
+				std::pair<size_t, bool> scan( uint8_t const *data,
+				                              size_t size ) noexcept {
+					size_t pos = 0;
+					auto hash = m_hash;
+					auto chunk_size = m_chunk_size;
+					if( chunk_size < m_sizes.min_size ) {
+						auto const skip = std::min( size, m_sizes.min_size - chunk_size );
+						pos += skip;
+						chunk_size += skip;
+					}
+					if( chunk_size < m_sizes.avg_size ) {
+						auto const first = pos;
+						auto const last =
+						  pos + std::min( size - pos, m_sizes.avg_size - chunk_size );
+						while( pos < last ) {
+							hash = ( hash << 1u ) + gear_table[data[pos++]];
+							if( ( hash & m_mask_small ) == 0 ) {
+								return cut( pos );
+							}
+						}
+						chunk_size += last - first;
+					}
+					auto const first = pos;
+					auto const last =
+					  pos + std::min( size - pos, m_sizes.max_size - chunk_size );
+					while( pos < last ) {
+						hash = ( hash << 1u ) + gear_table[data[pos++]];
+						if( ( hash & m_mask_large ) == 0 ) {
+							return cut( pos );
+						}
+					}
+					chunk_size += last - first;
+					if( chunk_size >= m_sizes.max_size ) {
+						return cut( pos );
+					}
+					m_hash = hash;
+					m_chunk_size = chunk_size;
+					return {pos, false};
+				}
+
+			private:
+				std::pair<size_t, bool> cut( size_t pos ) noexcept {
+					m_hash = 0;
+					m_chunk_size = 0;
+					return {pos, true};
+				}
+			};
+		} // namespace impl
+
+		/// @brief Split a stream into content defined chunks and hash each one.
+		/// Chunks are reported in stream order through a callback taking a
+		/// sha256_chunk_t const &.  A chunk that lies wholly inside one update( )
+		/// is queued and hashed with up to sha256_batch_lanes others at once by
+		/// sha256_multi_hash.  A chunk spanning update( ) calls is hashed as it
+		/// arrives with a streaming sha256_ctx
+		class sha256_chunker {
+			impl::gear_cutter_t m_cutter;
+			sha256_ctx m_ctx{};
+			uint64_t m_offset = 0;
+			uint64_t m_chunk_start = 0;
+			std::vector<daw::span<uint8_t const>> m_queue{};
+			std::vector<uint64_t> m_queue_offsets{};
+			std::vector<sha256_digest_t> m_queue_digests{};
+
+			template<typename Callback>
+			void flush( Callback &on_chunk ) {
+				if( m_queue.empty( ) ) {
+					return;
+				}
+				m_queue_digests.resize( m_queue.size( ) );
+				sha256_multi_hash(
+				  daw::span<daw::span<uint8_t const> const>( m_queue.data( ),
+				                                             m_queue.size( ) ),
+				  daw::span<sha256_digest_t>( m_queue_digests.data( ),
+				                              m_queue_digests.size( ) ) );
+				for( size_t n = 0; n < m_queue.size( ); ++n ) {
+					on_chunk( sha256_chunk_t{m_queue_offsets[n], m_queue[n].size( ),
+					                         m_queue_digests[n]} );
+				}
+				m_queue.clear( );
+				m_queue_offsets.clear( );
+			}
+
+		public:
+			explicit sha256_chunker( sha256_chunker_sizes_t sizes = {} )
+			  : m_cutter( sizes ) {
+				m_queue.reserve( impl::sha256_batch_lanes );
+				m_queue_offsets.reserve( impl::sha256_batch_lanes );
+			}
+
+			constexpr sha256_chunker_sizes_t const &sizes( ) const noexcept {
+				return m_cutter.sizes( );
+			}
+
+			/// @brief Bytes consumed so far
+			constexpr uint64_t offset( ) const noexcept {
+				return m_offset;
+			}
+
+			/// @brief Feed the next part of the stream.  Every chunk completed by
+			/// data is reported before update returns
+			template<typename U, typename Callback,
+			         typename = std::enable_if_t<sizeof( U ) == 1>>
+			void update( daw::span<U const> data, Callback &&on_chunk ) {
+				auto view = daw::span<uint8_t const>(
+				  reinterpret_cast<uint8_t const *>( data.data( ) ), data.size( ) );
+				while( !view.empty( ) ) {
+					bool const open_chunk = m_offset != m_chunk_start;
+					auto const result = m_cutter.scan( view.data( ), view.size( ) );
+					auto const segment = view.subset( 0, result.first );
+					m_offset += result.first;
+					view.remove_prefix( result.first );
+					if( !result.second ) {
+						// Chunk continues past this update, hash the bytes now while
+						// they are still in cache
+						m_ctx.update( segment.data( ), segment.size( ) );
+						break;
+					}
+					if( open_chunk ) {
+						// Its start was in an earlier update and is queued nowhere, so it
+						// finishes before anything in the queue
+						m_ctx.update( segment.data( ), segment.size( ) );
+						on_chunk( sha256_chunk_t{m_chunk_start, m_offset - m_chunk_start,
+						                         m_ctx.final( )} );
+						m_ctx.reset( );
+					} else {
+						m_queue.push_back( segment );
+						m_queue_offsets.push_back( m_chunk_start );
+						if( m_queue.size( ) == impl::sha256_batch_lanes ) {
+							flush( on_chunk );
+						}
+					}
+					m_chunk_start = m_offset;
+				}
+				// The queued spans point into data
+				flush( on_chunk );
+			}
+
+			/// @brief End the stream, reporting the last chunk if it is not empty.
+			/// The chunker can then be reused for a new stream
+			template<typename Callback>
+			void final( Callback &&on_chunk ) {
+				if( m_offset != m_chunk_start ) {
+					on_chunk( sha256_chunk_t{m_chunk_start, m_offset - m_chunk_start,
+					                         m_ctx.final( )} );
+				}
+				m_ctx.reset( );
+				m_cutter = impl::gear_cutter_t( m_cutter.sizes( ) );
+				m_offset = 0;
+				m_chunk_start = 0;
+			}
+		};
+
+		/// @brief Chunk and hash a complete buffer
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		std::vector<sha256_chunk_t>
+		sha256_chunks( daw::span<U const> data,
+		               sha256_chunker_sizes_t sizes = {} ) {
+			// The chunker checks sizes before avg_size is divided by
+			sha256_chunker chunker( sizes );
+			std::vector<sha256_chunk_t> result;
+			result.reserve( ( data.size( ) / sizes.avg_size ) + 1 );
+			auto const add = [&result]( sha256_chunk_t const &chunk ) {
+				result.push_back( chunk );
+			};
+			chunker.update( data, add );
+			chunker.final( add );
+			return result;
+		}
+	} // namespace crypto
+} // namespace daw
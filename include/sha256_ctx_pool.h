@@ -0,0 +1,185 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Pooled storage for many long lived hashing contexts, e.g. one per open
+// upload.  Contexts sit back to back in slabs instead of each being its own
+// heap allocation, so they carry no allocator header or rounding and
+// neighbouring contexts share cache lines and pages
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sha256.h"
+
+namespace daw {
+	namespace crypto {
+		namespace impl {
+			/// @brief For pools only ever used from one thread
+			struct null_mutex_t {
+				constexpr void lock( ) noexcept {}
+				constexpr void unlock( ) noexcept {}
+			};
+		} // namespace impl
+
+		/// @brief Ctx slots carved out of slabs of contexts_per_slab.  Slots
+		/// never used yet are handed out in order, released ones go on a free
+		/// list and are reused first.  Slabs are only returned to the system
+		/// when the pool is destroyed, which ends the lifetime of any context
+		/// still out
+		template<typename Ctx, typename Mutex = std::mutex>
+		class basic_ctx_pool {
+			static_assert( std::is_trivially_destructible_v<Ctx>,
+			               "Slots are reused without running destructors" );
+			static_assert( sizeof( Ctx ) >= sizeof( void * ),
+			               "A free slot holds the next free slot" );
+
+			struct slot_t {
+				alignas( Ctx ) unsigned char storage[sizeof( Ctx )];
+			};
+
+			Mutex m_mutex;
+			std::vector<std::unique_ptr<slot_t[]>> m_slabs;
+			slot_t *m_free = nullptr;
+			// The next never used slot is m_slabs[m_fresh_slab][m_fresh_pos]
+			size_t m_fresh_slab = 0;
+			size_t m_fresh_pos = 0;
+			size_t m_contexts_per_slab;
+			size_t m_in_use = 0;
+
+			static slot_t *next_free( slot_t *slot ) noexcept {
+				slot_t *next = nullptr;
+				std::memcpy( &next, slot->storage, sizeof( next ) );
+				return next;
+			}
+
+			void push_free( slot_t *slot ) noexcept {
+				std::memcpy( slot->storage, &m_free, sizeof( m_free ) );
+				m_free = slot;
+			}
+
+			// Slab memory is left uninitialized and only written when a slot is
+			// first handed out, so slots never used cost no pages
+			void grow( ) {
+				std::unique_ptr<slot_t[]> slab( new slot_t[m_contexts_per_slab] );
+				m_slabs.push_back( std::move( slab ) );
+			}
+
+			slot_t *take_slot( ) {
+				if( m_free != nullptr ) {
+					auto *slot = m_free;
+					m_free = next_free( slot );
+					return slot;
+				}
+				if( m_fresh_slab == m_slabs.size( ) ) {
+					grow( );
+				}
+				auto *slot = m_slabs[m_fresh_slab].get( ) + m_fresh_pos;
+				if( ++m_fresh_pos == m_contexts_per_slab ) {
+					++m_fresh_slab;
+					m_fresh_pos = 0;
+				}
+				return slot;
+			}
+
+		public:
+			struct deleter_t {
+				basic_ctx_pool *pool;
+
+				void operator( )( Ctx *ctx ) const noexcept {
+					pool->release( ctx );
+				}
+			};
+			using handle_t = std::unique_ptr<Ctx, deleter_t>;
+
+			explicit basic_ctx_pool( size_t contexts_per_slab = 4096 )
+			  : m_contexts_per_slab( contexts_per_slab > 0 ? contexts_per_slab
+			                                               : 1 ) {}
+
+			basic_ctx_pool( basic_ctx_pool const & ) = delete;
+			basic_ctx_pool &operator=( basic_ctx_pool const & ) = delete;
+
+			/// @brief A newly constructed context
+			Ctx *acquire( ) {
+				slot_t *slot = nullptr;
+				{
+					std::lock_guard<Mutex> lock( m_mutex );
+					slot = take_slot( );
+					++m_in_use;
+				}
+				return new( slot->storage ) Ctx{};
+			}
+
+			/// @brief acquire( ) owned by a handle that releases it
+			handle_t make( ) {
+				return handle_t( acquire( ), deleter_t{this} );
+			}
+
+			void release( Ctx *ctx ) noexcept {
+				if( ctx == nullptr ) {
+					return;
+				}
+				// storage is the only member, so the context is at the slot's address
+				auto *slot = reinterpret_cast<slot_t *>( ctx );
+				std::lock_guard<Mutex> lock( m_mutex );
+				push_free( slot );
+				--m_in_use;
+			}
+
+			/// @brief Make room for count live contexts without growing later
+			void reserve( size_t count ) {
+				std::lock_guard<Mutex> lock( m_mutex );
+				while( m_slabs.size( ) * m_contexts_per_slab < count ) {
+					grow( );
+				}
+			}
+
+			size_t in_use( ) {
+				std::lock_guard<Mutex> lock( m_mutex );
+				return m_in_use;
+			}
+
+			size_t capacity( ) {
+				std::lock_guard<Mutex> lock( m_mutex );
+				return m_slabs.size( ) * m_contexts_per_slab;
+			}
+
+			/// @brief Bytes of slab memory, sizeof( Ctx ) per slot
+			size_t bytes_reserved( ) {
+				return capacity( ) * sizeof( slot_t );
+			}
+		};
+
+		/// @brief Thread safe pool of sha256_ctx
+		using sha256_ctx_pool = basic_ctx_pool<sha256_ctx>;
+		/// @brief Pool for a single thread, without locking
+		using sha256_ctx_local_pool =
+		  basic_ctx_pool<sha256_ctx, impl::null_mutex_t>;
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,594 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Persistent cache of file digests keyed by what stat( ) reports, so that an
+// unchanged file does not have to be read again.  POSIX only
+//
+// The file is a header followed by fixed size records that are only ever
+// appended.  Each record carries a checksum, so a record torn by a crash is
+// skipped and cut off before the next append.  Readers need no locks as they
+// only look at whole records, writers serialize appends with flock( ).
+// Compaction writes the newest record of each file to a new file and renames
+// it over the old one
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sha256.h"
+
+namespace daw {
+	namespace crypto {
+		/// @brief The parts of stat( ) that change when a file's contents may
+		/// have
+		struct file_identity_t {
+			uint64_t device = 0;
+			uint64_t inode = 0;
+			uint64_t size = 0;
+			int64_t mtime_ns = 0;
+			int64_t ctime_ns = 0;
+
+			static file_identity_t from_stat( struct stat const &st ) noexcept {
+#if defined( __APPLE__ )
+				auto const &mtim = st.st_mtimespec;
+				auto const &ctim = st.st_ctimespec;
+#else
+				auto const &mtim = st.st_mtim;
+				auto const &ctim = st.st_ctim;
+#endif
+				file_identity_t result{};
+				result.device = static_cast<uint64_t>( st.st_dev );
+				result.inode = static_cast<uint64_t>( st.st_ino );
+				result.size = static_cast<uint64_t>( st.st_size );
+				result.mtime_ns =
+				  ( static_cast<int64_t>( mtim.tv_sec ) * 1'000'000'000 ) +
+				  static_cast<int64_t>( mtim.tv_nsec );
+				result.ctime_ns =
+				  ( static_cast<int64_t>( ctim.tv_sec ) * 1'000'000'000 ) +
+				  static_cast<int64_t>( ctim.tv_nsec );
+				return result;
+			}
+
+			/// @return true and the identity of an open file
+			static bool from_fd( int fd, file_identity_t &result ) noexcept {
+				struct stat st {};
+				if( ::fstat( fd, &st ) != 0 ) {
+					return false;
+				}
+				result = from_stat( st );
+				return true;
+			}
+
+			/// @return true and the identity of the file at path.  Nothing is
+			/// opened or read
+			static bool from_path( char const *path,
+			                       file_identity_t &result ) noexcept {
+				struct stat st {};
+				if( ::stat( path, &st ) != 0 ) {
+					return false;
+				}
+				result = from_stat( st );
+				return true;
+			}
+
+			constexpr bool operator==( file_identity_t const &rhs ) const noexcept {
+				return device == rhs.device && inode == rhs.inode &&
+				       size == rhs.size && mtime_ns == rhs.mtime_ns &&
+				       ctime_ns == rhs.ctime_ns;
+			}
+
+			constexpr bool operator!=( file_identity_t const &rhs ) const noexcept {
+				return !( *this == rhs );
+			}
+		};
+
+		namespace impl {
+			struct digest_cache_header_t {
+				std::array<char, 8> magic;
+				uint32_t version;
+				uint32_t record_size;
+				uint64_t endian_tag;
+				uint64_t reserved;
+			};
+			static_assert( sizeof( digest_cache_header_t ) == 32,
+			               "Unexpected padding in digest cache header" );
+
+			struct digest_cache_record_t {
+				file_identity_t identity;
+				sha256_packed_digest_t digest;
+				uint64_t check;
+			};
+			static_assert( sizeof( digest_cache_record_t ) == 80,
+			               "Unexpected padding in digest cache record" );
+
+			constexpr std::array<char, 8> const digest_cache_magic = {
+			  'D', 'A', 'W', 'S', 'H', 'A', 'D', 'C'};
+			constexpr uint32_t const digest_cache_version = 1;
+			constexpr uint64_t const digest_cache_endian_tag = 0x0102030405060708ULL;
+
+			inline digest_cache_header_t make_digest_cache_header( ) noexcept {
+				return {digest_cache_magic, digest_cache_version,
+				        static_cast<uint32_t>( sizeof( digest_cache_record_t ) ),
+				        digest_cache_endian_tag, 0};
+			}
+
+			/// @brief Checksum of everything in the record before check.  Only
+			/// meant to catch torn writes and garbage, not tampering
+			inline uint64_t
+			digest_cache_check( digest_cache_record_t const &rec ) noexcept {
+				std::array<uint64_t, 9> words{};
+				std::memcpy( words.data( ), &rec, sizeof( words ) );
+				uint64_t h = 0x6A09'E667'F3BC'C908ULL;
+				for( auto w : words ) {
+					h ^= w;
+					h *= 0x9E37'79B9'7F4A'7C15ULL;
+					h ^= h >> 29u;
+				}
+				// A record of zeros, e.g. from a hole left by a crash, must not pass
+				return h == 0 ? 1 : h;
+			}
+
+			inline bool write_all( int fd, void const *data, size_t size ) noexcept {
+				auto ptr = static_cast<char const *>( data );
+				while( size > 0 ) {
+					auto const count = ::write( fd, ptr, size );
+					if( count < 0 ) {
+						if( errno == EINTR ) {
+							continue;
+						}
+						return false;
+					}
+					ptr += count;
+					size -= static_cast<size_t>( count );
+				}
+				return true;
+			}
+
+			/// @brief Read only shared mapping of a file descriptor
+			class mapped_region_t {
+				uint8_t const *m_ptr = nullptr;
+				size_t m_size = 0;
+
+			public:
+				mapped_region_t( ) noexcept = default;
+
+				mapped_region_t( int fd, size_t size ) noexcept {
+					if( size == 0 ) {
+						return;
+					}
+					auto ptr = ::mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+					if( ptr != MAP_FAILED ) {
+						m_ptr = static_cast<uint8_t const *>( ptr );
+						m_size = size;
+					}
+				}
+
+				mapped_region_t( mapped_region_t const & ) = delete;
+				mapped_region_t &operator=( mapped_region_t const & ) = delete;
+
+				mapped_region_t( mapped_region_t &&other ) noexcept
+				  : m_ptr( std::exchange( other.m_ptr, nullptr ) )
+				  , m_size( std::exchange( other.m_size, 0 ) ) {}
+
+				mapped_region_t &operator=( mapped_region_t &&rhs ) noexcept {
+					if( this != &rhs ) {
+						reset( );
+						m_ptr = std::exchange( rhs.m_ptr, nullptr );
+						m_size = std::exchange( rhs.m_size, 0 );
+					}
+					return *this;
+				}
+
+				~mapped_region_t( ) noexcept {
+					reset( );
+				}
+
+				void reset( ) noexcept {
+					if( m_ptr != nullptr ) {
+						::munmap( const_cast<uint8_t *>( m_ptr ), m_size );
+						m_ptr = nullptr;
+						m_size = 0;
+					}
+				}
+
+				uint8_t const *data( ) const noexcept {
+					return m_ptr;
+				}
+
+				size_t size( ) const noexcept {
+					return m_size;
+				}
+			};
+
+			class flock_guard_t {
+				int m_fd;
+
+			public:
+				explicit flock_guard_t( int fd, int operation ) noexcept
+				  : m_fd( fd ) {
+					while( ::flock( m_fd, operation ) != 0 && errno == EINTR ) {}
+				}
+
+				flock_guard_t( flock_guard_t const & ) = delete;
+				flock_guard_t &operator=( flock_guard_t const & ) = delete;
+
+				~flock_guard_t( ) noexcept {
+					::flock( m_fd, LOCK_UN );
+				}
+			};
+		} // namespace impl
+
+		/// @brief A persistent map from file_identity_t to the file's digest.
+		/// Several processes may use the same cache file at once.  An instance is
+		/// not thread safe
+		class sha256_digest_cache {
+			struct key_t {
+				uint64_t device;
+				uint64_t inode;
+
+				bool operator==( key_t const &rhs ) const noexcept {
+					return device == rhs.device && inode == rhs.inode;
+				}
+			};
+
+			struct key_hash_t {
+				size_t operator( )( key_t const &key ) const noexcept {
+					return static_cast<size_t>(
+					  ( key.inode * 0x9E37'79B9'7F4A'7C15ULL ) ^ key.device );
+				}
+			};
+
+			// Records at or after m_file_records are in m_added, not the mapping
+			using slot_t = uint64_t;
+
+			std::string m_path;
+			int m_fd = -1;
+			bool m_writable = false;
+			impl::mapped_region_t m_map{};
+			size_t m_file_records = 0;
+			std::vector<impl::digest_cache_record_t> m_added{};
+			std::vector<impl::digest_cache_record_t> m_pending{};
+			std::unordered_map<key_t, slot_t, key_hash_t> m_index{};
+
+			static constexpr size_t const pending_limit = 256;
+			static constexpr size_t const header_size =
+			  sizeof( impl::digest_cache_header_t );
+			static constexpr size_t const record_size =
+			  sizeof( impl::digest_cache_record_t );
+
+			impl::digest_cache_record_t record_at( slot_t slot ) const noexcept {
+				if( slot >= m_file_records ) {
+					return m_added[slot - m_file_records];
+				}
+				impl::digest_cache_record_t rec{};
+				std::memcpy( &rec,
+				             m_map.data( ) + header_size + ( slot * record_size ),
+				             sizeof( rec ) );
+				return rec;
+			}
+
+			void close_file( ) noexcept {
+				m_map.reset( );
+				if( m_fd >= 0 ) {
+					::close( m_fd );
+					m_fd = -1;
+				}
+			}
+
+			/// @brief Open the file, creating it with a header when needed
+			bool open_file( ) noexcept {
+				m_fd = ::open( m_path.c_str( ),
+				               O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+				m_writable = m_fd >= 0;
+				if( m_fd < 0 ) {
+					m_fd = ::open( m_path.c_str( ), O_RDONLY | O_CLOEXEC );
+					return m_fd >= 0;
+				}
+				impl::flock_guard_t const lock( m_fd, LOCK_EX );
+				return init_header( );
+			}
+
+			/// @brief Write the header to a new or headerless file.  Call with the
+			/// lock held
+			bool init_header( ) noexcept {
+				struct stat st {};
+				if( ::fstat( m_fd, &st ) != 0 ) {
+					return false;
+				}
+				if( static_cast<size_t>( st.st_size ) >= header_size ) {
+					return true;
+				}
+				if( !m_writable || ::ftruncate( m_fd, 0 ) != 0 ) {
+					return false;
+				}
+				auto const header = impl::make_digest_cache_header( );
+				return impl::write_all( m_fd, &header, sizeof( header ) );
+			}
+
+			/// @brief Map the file and index every valid record.  Later records for
+			/// a file replace earlier ones.  Needs no lock as only whole records
+			/// are read
+			bool load( ) noexcept {
+				m_index.clear( );
+				m_added.clear( );
+				m_file_records = 0;
+				struct stat st {};
+				if( ::fstat( m_fd, &st ) != 0 ||
+				    static_cast<size_t>( st.st_size ) < header_size ) {
+					return false;
+				}
+				m_map =
+				  impl::mapped_region_t( m_fd, static_cast<size_t>( st.st_size ) );
+				if( m_map.data( ) == nullptr ) {
+					return false;
+				}
+				impl::digest_cache_header_t header{};
+				std::memcpy( &header, m_map.data( ), sizeof( header ) );
+				auto const expected = impl::make_digest_cache_header( );
+				if( header.magic != expected.magic ||
+				    header.version != expected.version ||
+				    header.record_size != expected.record_size ||
+				    header.endian_tag != expected.endian_tag ) {
+					m_map.reset( );
+					return false;
+				}
+				m_file_records = ( m_map.size( ) - header_size ) / record_size;
+				m_index.reserve( m_file_records );
+				for( slot_t slot = 0; slot < m_file_records; ++slot ) {
+					auto const rec = record_at( slot );
+					if( rec.check != impl::digest_cache_check( rec ) ) {
+						continue;
+					}
+					m_index[key_t{rec.identity.device, rec.identity.inode}] = slot;
+				}
+				return true;
+			}
+
+			/// @brief After a compaction by another process our descriptor refers
+			/// to the replaced file.  Call with the lock held on m_fd
+			bool is_current_file( ) const noexcept {
+				struct stat by_fd {};
+				struct stat by_path {};
+				return ::fstat( m_fd, &by_fd ) == 0 &&
+				       ::stat( m_path.c_str( ), &by_path ) == 0 &&
+				       by_fd.st_dev == by_path.st_dev && by_fd.st_ino == by_path.st_ino;
+			}
+
+			/// @brief Append records, cutting off a torn record left by a crash
+			/// first so that records stay aligned.  Call with the lock held
+			bool append_locked( impl::digest_cache_record_t const *records,
+			                    size_t count ) noexcept {
+				if( !init_header( ) ) {
+					return false;
+				}
+				struct stat st {};
+				if( ::fstat( m_fd, &st ) != 0 ) {
+					return false;
+				}
+				auto const file_size = static_cast<size_t>( st.st_size );
+				auto const tail = ( file_size - header_size ) % record_size;
+				if( tail != 0 &&
+				    ::ftruncate( m_fd, static_cast<off_t>( file_size - tail ) ) != 0 ) {
+					return false;
+				}
+				return impl::write_all( m_fd, records, count * record_size );
+			}
+
+			/// @brief Reload, write the newest record of each file to tmp_path and
+			/// rename it over the cache.  Call with the lock held
+			bool compact_locked( std::string const &tmp_path ) {
+				m_map.reset( );
+				if( !load( ) ) {
+					return false;
+				}
+				std::vector<slot_t> slots;
+				slots.reserve( m_index.size( ) );
+				for( auto const &entry : m_index ) {
+					slots.push_back( entry.second );
+				}
+				// Keep the order records were written in
+				std::sort( slots.begin( ), slots.end( ) );
+
+				int const out =
+				  ::open( tmp_path.c_str( ), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				          0644 );
+				if( out < 0 ) {
+					return false;
+				}
+				auto const header = impl::make_digest_cache_header( );
+				bool ok = impl::write_all( out, &header, sizeof( header ) );
+				std::vector<impl::digest_cache_record_t> buffer;
+				buffer.reserve( 4096 );
+				for( size_t n = 0; ok && n < slots.size( ); ++n ) {
+					buffer.push_back( record_at( slots[n] ) );
+					if( buffer.size( ) == buffer.capacity( ) || n + 1 == slots.size( ) ) {
+						ok = impl::write_all( out, buffer.data( ),
+						                      buffer.size( ) * record_size );
+						buffer.clear( );
+					}
+				}
+				ok = ok && ::fsync( out ) == 0;
+				ok = ( ::close( out ) == 0 ) && ok;
+				ok = ok && ::rename( tmp_path.c_str( ), m_path.c_str( ) ) == 0;
+				if( !ok ) {
+					::unlink( tmp_path.c_str( ) );
+					return false;
+				}
+				// Make the rename itself durable
+				auto const slash = m_path.rfind( '/' );
+				std::string const dir =
+				  slash == std::string::npos ? "." : m_path.substr( 0, slash + 1 );
+				int const dir_fd = ::open( dir.c_str( ), O_RDONLY | O_CLOEXEC );
+				if( dir_fd >= 0 ) {
+					::fsync( dir_fd );
+					::close( dir_fd );
+				}
+				return true;
+			}
+
+		public:
+			/// @brief Open or create the cache at path.  If the file cannot be
+			/// written the cache is read only and inserts are dropped
+			explicit sha256_digest_cache( std::string path )
+			  : m_path( std::move( path ) ) {
+				if( !open_file( ) || !load( ) ) {
+					close_file( );
+				}
+			}
+
+			sha256_digest_cache( sha256_digest_cache const & ) = delete;
+			sha256_digest_cache &operator=( sha256_digest_cache const & ) = delete;
+
+			~sha256_digest_cache( ) noexcept {
+				flush( );
+				close_file( );
+			}
+
+			/// @brief True when the cache file could be opened and is valid
+			explicit operator bool( ) const noexcept {
+				return m_fd >= 0;
+			}
+
+			bool writable( ) const noexcept {
+				return m_fd >= 0 && m_writable;
+			}
+
+			/// @brief Number of files with a digest
+			size_t size( ) const noexcept {
+				return m_index.size( );
+			}
+
+			/// @brief Number of records loaded or added, including superseded ones
+			size_t record_count( ) const noexcept {
+				return m_file_records + m_added.size( );
+			}
+
+			/// @brief Find the digest of a file.  Only an exact match of the whole
+			/// identity is a hit
+			bool lookup( file_identity_t const &identity,
+			             sha256_digest_t &digest ) const noexcept {
+				auto const it = m_index.find( key_t{identity.device, identity.inode} );
+				if( it == m_index.end( ) ) {
+					return false;
+				}
+				auto const rec = record_at( it->second );
+				if( rec.identity != identity ) {
+					return false;
+				}
+				for( size_t n = 0; n < digest.size( ); ++n ) {
+					digest[n] = impl::to_uint32_be( rec.digest.data( ) + ( n * 4 ) );
+				}
+				return true;
+			}
+
+			/// @brief Record the digest of a file.  Records are buffered and written
+			/// by flush( ), which happens automatically every few hundred inserts
+			void insert( file_identity_t const &identity,
+			             sha256_digest_t const &digest ) {
+				if( !writable( ) ) {
+					return;
+				}
+				impl::digest_cache_record_t rec{};
+				rec.identity = identity;
+				rec.digest = to_packed_digest( digest );
+				rec.check = impl::digest_cache_check( rec );
+				m_index[key_t{identity.device, identity.inode}] =
+				  m_file_records + m_added.size( );
+				m_added.push_back( rec );
+				m_pending.push_back( rec );
+				if( m_pending.size( ) >= pending_limit ) {
+					flush( );
+				}
+			}
+
+			/// @brief Append buffered records to the file
+			/// @return false if they could not be written
+			bool flush( ) noexcept {
+				if( m_pending.empty( ) || !writable( ) ) {
+					m_pending.clear( );
+					return true;
+				}
+				bool result = false;
+				bool replaced = false;
+				{
+					impl::flock_guard_t const lock( m_fd, LOCK_EX );
+					replaced = !is_current_file( );
+					if( !replaced ) {
+						result = append_locked( m_pending.data( ), m_pending.size( ) );
+					}
+				}
+				if( replaced ) {
+					// Another process compacted the cache.  Append to the new file, the
+					// loaded records stay mapped from the old one
+					::close( m_fd );
+					if( open_file( ) && m_writable ) {
+						impl::flock_guard_t const lock( m_fd, LOCK_EX );
+						result = append_locked( m_pending.data( ), m_pending.size( ) );
+					}
+				}
+				m_pending.clear( );
+				return result;
+			}
+
+			/// @brief Rewrite the file with only the newest record of each file,
+			/// including records appended by other processes.  The new file is
+			/// synced and renamed over the old one, so readers see either
+			/// @return false if the cache could not be compacted
+			bool compact( ) {
+				if( !writable( ) ) {
+					return false;
+				}
+				flush( );
+				std::string const tmp_path =
+				  m_path + ".compact." + std::to_string( ::getpid( ) );
+				bool replaced = false;
+				{
+					impl::flock_guard_t const lock( m_fd, LOCK_EX );
+					replaced = !is_current_file( );
+					if( !replaced && !compact_locked( tmp_path ) ) {
+						return false;
+					}
+				}
+				if( replaced ) {
+					close_file( );
+					return open_file( ) && load( ) && compact( );
+				}
+				close_file( );
+				return open_file( ) && load( );
+			}
+		};
+	} // namespace crypto
+} // namespace daw
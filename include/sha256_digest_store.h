@@ -0,0 +1,387 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+#if defined( __AVX2__ ) || defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+#include <daw/daw_memory_mapped_file.h>
+#include <daw/daw_span.h>
+#include <daw/daw_string_view.h>
+
+#include "sha256.h"
+
+namespace daw {
+	namespace crypto {
+		namespace impl {
+			// File layout:
+			//   digest_store_header_t
+			//   uint64_t bucket_index[( 1 << prefix_bits ) + 1]
+			//   sha256_packed_digest_t digests[count] sorted ascending
+			struct digest_store_header_t {
+				std::array<char, 8> magic;
+				uint32_t version;
+				uint32_t prefix_bits;
+				uint64_t count;
+				uint64_t endian_tag;
+			};
+			static_assert( sizeof( digest_store_header_t ) == 32,
+			               "Unexpected padding in digest store header" );
+
+			constexpr std::array<char, 8> const digest_store_magic = {
+			  'D', 'A', 'W', 'S', 'H', 'A', 'D', 'S'};
+			constexpr uint32_t const digest_store_version = 1;
+			constexpr uint64_t const digest_store_endian_tag = 0x0102030405060708ULL;
+
+			inline uint64_t digest_prefix( uint8_t const *digest ) noexcept {
+				return ( static_cast<uint64_t>( digest[0] ) << 56u ) |
+				       ( static_cast<uint64_t>( digest[1] ) << 48u ) |
+				       ( static_cast<uint64_t>( digest[2] ) << 40u ) |
+				       ( static_cast<uint64_t>( digest[3] ) << 32u ) |
+				       ( static_cast<uint64_t>( digest[4] ) << 24u ) |
+				       ( static_cast<uint64_t>( digest[5] ) << 16u ) |
+				       ( static_cast<uint64_t>( digest[6] ) << 8u ) |
+				       static_cast<uint64_t>( digest[7] );
+			}
+
+			inline size_t bucket_of( uint8_t const *digest,
+			                         uint32_t prefix_bits ) noexcept {
+				if( prefix_bits == 0 ) {
+					return 0;
+				}
+				return static_cast<size_t>( digest_prefix( digest ) >>
+				                            ( 64u - prefix_bits ) );
+			}
+
+			// Aim for ~4 digests(128 bytes) per bucket so a probe touches two cache
+			// lines of digests and the index costs ~2 bytes per digest
+			inline uint32_t choose_prefix_bits( size_t count ) noexcept {
+				uint32_t bits = 0;
+				while( bits < 32 && ( count >> ( bits + 2 ) ) > 0 ) {
+					++bits;
+				}
+				return bits;
+			}
+
+			inline void prefetch( void const *ptr ) noexcept {
+#if defined( __GNUC__ ) || defined( __clang__ )
+				__builtin_prefetch( ptr );
+#else
+				static_cast<void>( ptr );
+#endif
+			}
+
+			inline bool digest_equal( uint8_t const *lhs,
+			                          uint8_t const *rhs ) noexcept {
+#if defined( __AVX2__ )
+				auto const a =
+				  _mm256_loadu_si256( reinterpret_cast<__m256i const *>( lhs ) );
+				auto const b =
+				  _mm256_loadu_si256( reinterpret_cast<__m256i const *>( rhs ) );
+				return static_cast<uint32_t>(
+				         _mm256_movemask_epi8( _mm256_cmpeq_epi8( a, b ) ) ) ==
+				       0xFFFF'FFFFU;
+#elif defined( __SSE2__ )
+				auto const a0 =
+				  _mm_loadu_si128( reinterpret_cast<__m128i const *>( lhs ) );
+				auto const a1 =
+				  _mm_loadu_si128( reinterpret_cast<__m128i const *>( lhs + 16 ) );
+				auto const b0 =
+				  _mm_loadu_si128( reinterpret_cast<__m128i const *>( rhs ) );
+				auto const b1 =
+				  _mm_loadu_si128( reinterpret_cast<__m128i const *>( rhs + 16 ) );
+				auto const eq =
+				  _mm_and_si128( _mm_cmpeq_epi8( a0, b0 ), _mm_cmpeq_epi8( a1, b1 ) );
+				return _mm_movemask_epi8( eq ) == 0xFFFF;
+#else
+				return std::memcmp( lhs, rhs, 32 ) == 0;
+#endif
+			}
+		} // namespace impl
+
+		/// @brief Non-owning read only view of a packed digest store.  It can
+		/// refer to a sha256_digest_store or directly to a memory mapped file
+		class sha256_digest_store_view {
+			uint64_t const *m_index = nullptr;
+			uint8_t const *m_digests = nullptr;
+			size_t m_count = 0;
+			uint32_t m_prefix_bits = 0;
+
+			uint8_t const *bucket_begin( size_t bucket ) const noexcept {
+				return m_digests + ( m_index[bucket] * 32 );
+			}
+
+			uint8_t const *bucket_end( size_t bucket ) const noexcept {
+				return m_digests + ( m_index[bucket + 1] * 32 );
+			}
+
+			bool probe( uint8_t const *needle, size_t bucket ) const noexcept {
+				auto const last = bucket_end( bucket );
+				for( auto first = bucket_begin( bucket ); first != last; first += 32 ) {
+					if( impl::digest_equal( first, needle ) ) {
+						return true;
+					}
+				}
+				return false;
+			}
+
+		public:
+			constexpr sha256_digest_store_view( ) noexcept = default;
+
+			constexpr sha256_digest_store_view( uint64_t const *index,
+			                                    uint8_t const *digests, size_t count,
+			                                    uint32_t prefix_bits ) noexcept
+			  : m_index( index )
+			  , m_digests( digests )
+			  , m_count( count )
+			  , m_prefix_bits( prefix_bits ) {}
+
+			constexpr size_t size( ) const noexcept {
+				return m_count;
+			}
+
+			constexpr bool empty( ) const noexcept {
+				return m_count == 0;
+			}
+
+			constexpr uint32_t prefix_bits( ) const noexcept {
+				return m_prefix_bits;
+			}
+
+			bool contains( sha256_packed_digest_t const &digest ) const noexcept {
+				if( empty( ) ) {
+					return false;
+				}
+				return probe( digest.data( ),
+				              impl::bucket_of( digest.data( ), m_prefix_bits ) );
+			}
+
+			bool contains( sha256_digest_t const &digest ) const noexcept {
+				return contains( to_packed_digest( digest ) );
+			}
+
+			/// @brief Look up many digests at once.  The buckets for the whole batch
+			/// are located and prefetched before any are probed so that the cache
+			/// misses overlap instead of serializing
+			/// @param needles digests to look for
+			/// @param results results[n] is set to 1 if needles[n] is present.  Must
+			/// be at least needles.size( ) long
+			/// @return number of needles found
+			size_t contains( daw::span<sha256_packed_digest_t const> needles,
+			                 daw::span<uint8_t> results ) const noexcept {
+				static constexpr size_t const batch_size = 16;
+				std::array<size_t, batch_size> buckets{};
+				size_t found = 0;
+				size_t pos = 0;
+				while( pos < needles.size( ) ) {
+					auto const count = std::min( batch_size, needles.size( ) - pos );
+					for( size_t n = 0; n < count; ++n ) {
+						buckets[n] =
+						  impl::bucket_of( needles[pos + n].data( ), m_prefix_bits );
+						if( !empty( ) ) {
+							impl::prefetch( m_index + buckets[n] );
+						}
+					}
+					if( !empty( ) ) {
+						for( size_t n = 0; n < count; ++n ) {
+							impl::prefetch( bucket_begin( buckets[n] ) );
+						}
+					}
+					for( size_t n = 0; n < count; ++n ) {
+						bool const is_found =
+						  !empty( ) && probe( needles[pos + n].data( ), buckets[n] );
+						results[pos + n] = static_cast<uint8_t>( is_found );
+						found += static_cast<size_t>( is_found );
+					}
+					pos += count;
+				}
+				return found;
+			}
+
+			sha256_packed_digest_t operator[]( size_t pos ) const noexcept {
+				sha256_packed_digest_t result{};
+				std::memcpy( result.data( ), m_digests + ( pos * 32 ), 32 );
+				return result;
+			}
+
+			/// @brief Serialize to the memory mappable on disk format
+			void write( std::ostream &os ) const {
+				impl::digest_store_header_t const header{
+				  impl::digest_store_magic, impl::digest_store_version, m_prefix_bits,
+				  static_cast<uint64_t>( m_count ), impl::digest_store_endian_tag};
+				os.write( reinterpret_cast<char const *>( &header ), sizeof( header ) );
+				os.write( reinterpret_cast<char const *>( m_index ),
+				          static_cast<std::streamsize>(
+				            sizeof( uint64_t ) * ( ( size_t{1} << m_prefix_bits ) + 1 ) ) );
+				os.write( reinterpret_cast<char const *>( m_digests ),
+				          static_cast<std::streamsize>( m_count * 32 ) );
+			}
+		};
+
+		/// @brief Create a view over a serialized store, such as a memory mapped
+		/// file.  An empty view is returned if the data is not a valid store
+		inline sha256_digest_store_view
+		make_digest_store_view( daw::span<uint8_t const> data ) noexcept {
+			impl::digest_store_header_t header{};
+			if( data.size( ) < sizeof( header ) ) {
+				return {};
+			}
+			std::memcpy( &header, data.data( ), sizeof( header ) );
+			if( header.magic != impl::digest_store_magic ||
+			    header.version != impl::digest_store_version ||
+			    header.endian_tag != impl::digest_store_endian_tag ||
+			    header.prefix_bits > 32 ) {
+				return {};
+			}
+			auto const index_size =
+			  sizeof( uint64_t ) * ( ( size_t{1} << header.prefix_bits ) + 1 );
+			if( data.size( ) - sizeof( header ) < index_size ||
+			    ( data.size( ) - sizeof( header ) - index_size ) / 32 <
+			      header.count ) {
+				return {};
+			}
+			auto const index_ptr = data.data( ) + sizeof( header );
+			if( reinterpret_cast<uintptr_t>( index_ptr ) % alignof( uint64_t ) !=
+			    0 ) {
+				return {};
+			}
+			// The buckets must start at 0, never go backwards and end at count,
+			// so every bucket lies inside the digests
+			auto const index = reinterpret_cast<uint64_t const *>( index_ptr );
+			auto const buckets = size_t{1} << header.prefix_bits;
+			if( index[0] != 0 || index[buckets] != header.count ) {
+				return {};
+			}
+			for( size_t n = 0; n < buckets; ++n ) {
+				if( index[n] > index[n + 1] ) {
+					return {};
+				}
+			}
+			return sha256_digest_store_view( index, index_ptr + index_size,
+			                                 static_cast<size_t>( header.count ),
+			                                 header.prefix_bits );
+		}
+
+		/// @brief Immutable set of SHA256 digests stored as a sorted array of raw
+		/// 32 byte values with a bucket index over the leading prefix_bits of
+		/// each digest
+		class sha256_digest_store {
+			std::vector<uint64_t> m_index;
+			std::vector<sha256_packed_digest_t> m_digests;
+			uint32_t m_prefix_bits = 0;
+
+			void build_index( ) {
+				m_index.assign( ( size_t{1} << m_prefix_bits ) + 1, 0 );
+				for( auto const &digest : m_digests ) {
+					++m_index[impl::bucket_of( digest.data( ), m_prefix_bits ) + 1];
+				}
+				for( size_t n = 1; n < m_index.size( ); ++n ) {
+					m_index[n] += m_index[n - 1];
+				}
+			}
+
+		public:
+			sha256_digest_store( )
+			  : sha256_digest_store( std::vector<sha256_packed_digest_t>{} ) {}
+
+			explicit sha256_digest_store(
+			  std::vector<sha256_packed_digest_t> digests )
+			  : m_digests( std::move( digests ) ) {
+
+				std::sort( m_digests.begin( ), m_digests.end( ) );
+				m_digests.erase( std::unique( m_digests.begin( ), m_digests.end( ) ),
+				                 m_digests.end( ) );
+				m_digests.shrink_to_fit( );
+				m_prefix_bits = impl::choose_prefix_bits( m_digests.size( ) );
+				build_index( );
+			}
+
+			template<typename Iterator>
+			sha256_digest_store( Iterator first, Iterator last )
+			  : sha256_digest_store( [&]( ) {
+				  std::vector<sha256_packed_digest_t> result;
+				  while( first != last ) {
+					  result.push_back( to_packed_digest( *first++ ) );
+				  }
+				  return result;
+			  }( ) ) {}
+
+			sha256_digest_store_view view( ) const noexcept {
+				return sha256_digest_store_view(
+				  m_index.data( ),
+				  reinterpret_cast<uint8_t const *>( m_digests.data( ) ),
+				  m_digests.size( ), m_prefix_bits );
+			}
+
+			size_t size( ) const noexcept {
+				return m_digests.size( );
+			}
+
+			bool empty( ) const noexcept {
+				return m_digests.empty( );
+			}
+
+			template<typename Digest>
+			bool contains( Digest const &digest ) const noexcept {
+				return view( ).contains( digest );
+			}
+
+			size_t contains( daw::span<sha256_packed_digest_t const> needles,
+			                 daw::span<uint8_t> results ) const noexcept {
+				return view( ).contains( needles, results );
+			}
+
+			void write( std::ostream &os ) const {
+				view( ).write( os );
+			}
+		};
+		/// @brief A digest store backed by a read only memory mapped file
+		class sha256_digest_store_file {
+			daw::filesystem::memory_mapped_file_t<uint8_t> m_file;
+			sha256_digest_store_view m_view;
+
+		public:
+			explicit sha256_digest_store_file( daw::string_view file_name )
+			  : m_file( file_name )
+			  , m_view( m_file ? make_digest_store_view( daw::span<uint8_t const>(
+			                       m_file.data( ), m_file.size( ) ) )
+			                   : sha256_digest_store_view{} ) {}
+
+			sha256_digest_store_view const &view( ) const noexcept {
+				return m_view;
+			}
+
+			explicit operator bool( ) const noexcept {
+				return static_cast<bool>( m_file );
+			}
+		};
+	} // namespace crypto
+} // namespace daw
@@ -0,0 +1,557 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Fixed length SHA256 for the 32 and 64 byte messages that make up Merkle
+// trees: a digest, a pair of digests and the double hash of either.  The
+// padding needs no buffer and a block that holds only padding uses a message
+// schedule computed at compile time.  The same lanes also hash batches of
+// variable length messages
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include <daw/daw_span.h>
+
+#include "sha256.h"
+
+namespace daw {
+	namespace crypto {
+		namespace impl {
+			/// @brief K + W for the block that follows a message of message_bits
+			/// bits ending exactly on a block boundary
+			constexpr std::array<uint32_t, 64>
+			sha256_padding_kw( uint64_t const message_bits ) noexcept {
+				std::array<uint32_t, 64> w{};
+				w[0] = 0x8000'0000U;
+				w[14] = static_cast<uint32_t>( message_bits >> 32u );
+				w[15] = static_cast<uint32_t>( message_bits );
+				for( size_t i = 16; i < 64; ++i ) {
+					w[i] = SHA256_SIG1( w[i - 2] ) + w[i - 7] + SHA256_SIG0( w[i - 15] ) +
+					       w[i - 16];
+				}
+				for( size_t i = 0; i < 64; ++i ) {
+					w[i] += sha256_k<uint32_t>[i];
+				}
+				return w;
+			}
+
+			template<uint64_t MessageBits>
+			constexpr std::array<uint32_t, 64> const sha256_padding_kw_v =
+			  sha256_padding_kw( MessageBits );
+
+			constexpr void sha256_compress_padding_64( sha256_digest_t &state ) noexcept {
+				std::array<uint32_t, 8> working{state[0], state[1], state[2],
+				                                state[3], state[4], state[5],
+				                                state[6], state[7]};
+				sha256_rounds_kw( working, sha256_padding_kw_v<512>,
+				                  std::make_index_sequence<64>{} );
+				for( size_t i = 0; i < 8; ++i ) {
+					state[i] += working[i];
+				}
+			}
+
+			/// @brief Hash 32 bytes given as 8 big endian words.  The padding words
+			/// are constants the compiler can fold into the unrolled rounds
+			constexpr sha256_digest_t
+			sha256_32_words( std::array<uint32_t, 8> const &words ) noexcept {
+				std::array<uint32_t, 16> w{words[0], words[1], words[2], words[3],
+				                           words[4], words[5], words[6], words[7],
+				                           0x8000'0000U, 0, 0, 0, 0, 0, 0, 256};
+				sha256_digest_t state = sha256_init_state_values<uint32_t>;
+				sha256_compress( state, w );
+				return state;
+			}
+
+			constexpr sha256_digest_t
+			sha256_64_words( std::array<uint32_t, 16> const &words ) noexcept {
+				sha256_digest_t state = sha256_init_state_values<uint32_t>;
+				sha256_compress( state, words );
+				sha256_compress_padding_64( state );
+				return state;
+			}
+
+			template<typename U>
+			constexpr std::array<uint32_t, 8> load_words_32( U const *ptr ) noexcept {
+				std::array<uint32_t, 8> result{};
+				for( size_t n = 0; n < result.size( ); ++n ) {
+					result[n] = to_uint32_be( ptr + ( n * 4 ) );
+				}
+				return result;
+			}
+
+			template<typename U>
+			constexpr std::array<uint32_t, 16> load_words_64( U const *ptr ) noexcept {
+				std::array<uint32_t, 16> result{};
+				for( size_t n = 0; n < result.size( ); ++n ) {
+					result[n] = to_uint32_be( ptr + ( n * 4 ) );
+				}
+				return result;
+			}
+
+			constexpr std::array<uint32_t, 8>
+			digest_words( sha256_digest_t const &digest ) noexcept {
+				return {digest[0], digest[1], digest[2], digest[3],
+				        digest[4], digest[5], digest[6], digest[7]};
+			}
+
+			// Multi lane hashing keeps one word of each of sha256_batch_lanes
+			// independent messages side by side so that every step of a round is a
+			// loop over lanes the compiler turns into vector instructions
+			constexpr size_t const sha256_batch_lanes = 8;
+
+			struct alignas( 32 ) sha256_lane_word_t {
+				std::array<uint32_t, sha256_batch_lanes> v;
+			};
+
+			using sha256_lane_state_t = std::array<sha256_lane_word_t, 8>;
+			using sha256_lane_block_t = std::array<sha256_lane_word_t, 16>;
+
+			template<size_t Round, typename KW>
+			inline void sha256_lane_round_kw( sha256_lane_state_t &s,
+			                                  KW const &kw ) noexcept {
+				constexpr size_t a = ( 8 - ( Round % 8 ) ) % 8;
+				constexpr size_t b = ( a + 1 ) % 8;
+				constexpr size_t c = ( a + 2 ) % 8;
+				constexpr size_t d = ( a + 3 ) % 8;
+				constexpr size_t e = ( a + 4 ) % 8;
+				constexpr size_t f = ( a + 5 ) % 8;
+				constexpr size_t g = ( a + 6 ) % 8;
+				constexpr size_t h = ( a + 7 ) % 8;
+
+				for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+					uint32_t lane_kw = 0;
+					if constexpr( std::is_same_v<KW, uint32_t> ) {
+						lane_kw = kw;
+					} else {
+						lane_kw = kw.v[l];
+					}
+					uint32_t const t1 = s[h].v[l] + SHA256_EP1( s[e].v[l] ) +
+					                    SHA256_CH( s[e].v[l], s[f].v[l], s[g].v[l] ) +
+					                    lane_kw;
+					uint32_t const t2 = SHA256_EP0( s[a].v[l] ) +
+					                    SHA256_MAJ( s[a].v[l], s[b].v[l], s[c].v[l] );
+					s[d].v[l] += t1;
+					s[h].v[l] = t1 + t2;
+				}
+			}
+
+			template<size_t Round>
+			inline void sha256_lane_round( sha256_lane_state_t &s,
+			                               sha256_lane_block_t &w ) noexcept {
+				sha256_lane_word_t kw;
+				for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+					if constexpr( Round >= 16 ) {
+						w[Round % 16].v[l] +=
+						  SHA256_SIG1( w[( Round - 2 ) % 16].v[l] ) +
+						  w[( Round - 7 ) % 16].v[l] +
+						  SHA256_SIG0( w[( Round - 15 ) % 16].v[l] );
+					}
+					kw.v[l] = sha256_k<uint32_t>[Round] + w[Round % 16].v[l];
+				}
+				sha256_lane_round_kw<Round>( s, kw );
+			}
+
+			template<size_t... Rounds>
+			inline void sha256_lane_compress( sha256_lane_state_t &state,
+			                                  sha256_lane_block_t w,
+			                                  std::index_sequence<Rounds...> ) noexcept {
+				auto working = state;
+				( sha256_lane_round<Rounds>( working, w ), ... );
+				for( size_t i = 0; i < 8; ++i ) {
+					for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+						state[i].v[l] += working[i].v[l];
+					}
+				}
+			}
+
+			template<size_t... Rounds>
+			inline void
+			sha256_lane_compress_padding_64( sha256_lane_state_t &state,
+			                                 std::index_sequence<Rounds...> ) noexcept {
+				auto working = state;
+				( sha256_lane_round_kw<Rounds>( working, sha256_padding_kw_v<512>[Rounds] ),
+				  ... );
+				for( size_t i = 0; i < 8; ++i ) {
+					for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+						state[i].v[l] += working[i].v[l];
+					}
+				}
+			}
+
+			inline sha256_lane_state_t sha256_lane_init( ) noexcept {
+				sha256_lane_state_t result;
+				for( size_t i = 0; i < 8; ++i ) {
+					result[i].v.fill( sha256_init_state_values<uint32_t>[i] );
+				}
+				return result;
+			}
+
+			/// @brief Block holding 32 byte messages: words 0..7 are filled in by
+			/// the caller and the rest is the padding for a 256 bit message
+			inline sha256_lane_block_t sha256_lane_block_32( ) noexcept {
+				sha256_lane_block_t result{};
+				result[8].v.fill( 0x8000'0000U );
+				result[15].v.fill( 256 );
+				return result;
+			}
+
+			/// @brief Hash sha256_batch_lanes messages at once.  Messages is the
+			/// number of 32 byte input digests per message, 1 or 2, and Double
+			/// hashes the result a second time as a 32 byte message
+			template<size_t Messages, bool Double>
+			inline void sha256_lanes( sha256_packed_digest_t const *in,
+			                          sha256_packed_digest_t *out ) noexcept {
+				static_assert( Messages == 1 || Messages == 2,
+				               "Only 32 and 64 byte messages are supported" );
+				auto state = sha256_lane_init( );
+				sha256_lane_block_t w = sha256_lane_block_32( );
+				for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+					for( size_t m = 0; m < Messages; ++m ) {
+						auto const *ptr = in[( l * Messages ) + m].data( );
+						for( size_t n = 0; n < 8; ++n ) {
+							w[( m * 8 ) + n].v[l] = to_uint32_be( ptr + ( n * 4 ) );
+						}
+					}
+				}
+				sha256_lane_compress( state, w, std::make_index_sequence<64>{} );
+				if constexpr( Messages == 2 ) {
+					sha256_lane_compress_padding_64( state,
+					                                 std::make_index_sequence<64>{} );
+				}
+				if constexpr( Double ) {
+					// The digest words are already the big endian words of the second
+					// message, no byte round trip is needed
+					w = sha256_lane_block_32( );
+					std::copy( state.cbegin( ), state.cend( ), w.begin( ) );
+					state = sha256_lane_init( );
+					sha256_lane_compress( state, w, std::make_index_sequence<64>{} );
+				}
+				for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+					sha256_digest_t digest{};
+					for( size_t n = 0; n < 8; ++n ) {
+						digest[n] = state[n].v[l];
+					}
+					store_digest_be( digest, out[l].data( ) );
+				}
+			}
+		} // namespace impl
+
+		/// @brief SHA256 of exactly 32 bytes
+		/// @param message must hold at least 32 bytes, only the first 32 are read
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		constexpr sha256_digest_t sha256_32( daw::span<U const> message ) noexcept {
+			auto sample = impl::telemetry_start( );
+			auto const result =
+			  impl::sha256_32_words( impl::load_words_32( message.data( ) ) );
+			impl::telemetry_record( telemetry_op_t::sha256,
+			                        telemetry_backend_t::scalar, 1, 32, sample );
+			return result;
+		}
+
+		/// @brief SHA256 of the canonical 32 byte form of digest
+		constexpr sha256_digest_t sha256_32( sha256_digest_t const &digest ) noexcept {
+			auto sample = impl::telemetry_start( );
+			auto const result = impl::sha256_32_words( impl::digest_words( digest ) );
+			impl::telemetry_record( telemetry_op_t::sha256,
+			                        telemetry_backend_t::scalar, 1, 32, sample );
+			return result;
+		}
+
+		/// @brief SHA256 of exactly 64 bytes.  The second block is all padding
+		/// and uses a precomputed message schedule
+		/// @param message must hold at least 64 bytes, only the first 64 are read
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		constexpr sha256_digest_t sha256_64( daw::span<U const> message ) noexcept {
+			auto sample = impl::telemetry_start( );
+			auto const result =
+			  impl::sha256_64_words( impl::load_words_64( message.data( ) ) );
+			impl::telemetry_record( telemetry_op_t::sha256,
+			                        telemetry_backend_t::scalar, 1, 64, sample );
+			return result;
+		}
+
+		/// @brief Merkle node, the SHA256 of the canonical bytes of left followed
+		/// by those of right
+		constexpr sha256_digest_t sha256_64( sha256_digest_t const &left,
+		                                     sha256_digest_t const &right ) noexcept {
+			auto sample = impl::telemetry_start( );
+			auto const result = impl::sha256_64_words(
+			  {left[0], left[1], left[2], left[3], left[4], left[5], left[6], left[7],
+			   right[0], right[1], right[2], right[3], right[4], right[5], right[6],
+			   right[7]} );
+			impl::telemetry_record( telemetry_op_t::sha256,
+			                        telemetry_backend_t::scalar, 1, 64, sample );
+			return result;
+		}
+
+		/// @brief SHA256( SHA256( message ) ).  The outer hash is always a 32 byte
+		/// message and 32 or 64 byte inputs use the fixed length kernels
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		constexpr sha256_digest_t sha256d( daw::span<U const> message ) noexcept {
+			if( message.size( ) == 32 ) {
+				return sha256_32( sha256_32( message ) );
+			}
+			if( message.size( ) == 64 ) {
+				return sha256_32( sha256_64( message ) );
+			}
+			return sha256_32( sha2_ctx<256, U>::hash( message ) );
+		}
+
+		/// @brief Double hashed Merkle node, SHA256( SHA256( left || right ) )
+		constexpr sha256_digest_t sha256d( sha256_digest_t const &left,
+		                                   sha256_digest_t const &right ) noexcept {
+			return sha256_32( sha256_64( left, right ) );
+		}
+
+		namespace impl {
+			template<size_t Messages, bool Double>
+			void sha256_batch( daw::span<sha256_packed_digest_t const> in,
+			                   daw::span<sha256_packed_digest_t> out ) noexcept {
+				auto sample = telemetry_start( );
+				auto const count = std::min( in.size( ) / Messages, out.size( ) );
+				size_t n = 0;
+				for( ; n + sha256_batch_lanes <= count; n += sha256_batch_lanes ) {
+					sha256_lanes<Messages, Double>( in.data( ) + ( n * Messages ),
+					                                out.data( ) + n );
+				}
+				// Every hash of the lanes counts, the second of a double hash
+				// too, as the scalar tail below does
+				if( n > 0 ) {
+					constexpr uint64_t const hashes = Double ? 2 : 1;
+					constexpr uint64_t const bytes =
+					  ( Messages * 32 ) + ( Double ? 32 : 0 );
+					telemetry_record( telemetry_op_t::sha256,
+					                  telemetry_backend_t::multi_buffer, n * hashes,
+					                  n * bytes, sample );
+				}
+				for( ; n < count; ++n ) {
+					auto const message = daw::span<uint8_t const>(
+					  in[n * Messages].data( ), Messages * 32 );
+					auto digest = Messages == 1 ? sha256_32( message )
+					                            : sha256_64( message );
+					if( Double ) {
+						digest = sha256_32( digest );
+					}
+					store_digest_be( digest, out[n].data( ) );
+				}
+			}
+		} // namespace impl
+
+		/// @brief out[n] = SHA256( in[n] ) for min( in.size( ), out.size( ) )
+		/// digests, sha256_batch_lanes at a time
+		inline void
+		sha256_32_batch( daw::span<sha256_packed_digest_t const> in,
+		                 daw::span<sha256_packed_digest_t> out ) noexcept {
+			impl::sha256_batch<1, false>( in, out );
+		}
+
+		/// @brief One Merkle level, out[n] = SHA256( in[2n] || in[2n + 1] ).  An
+		/// odd trailing input is ignored
+		inline void
+		sha256_64_batch( daw::span<sha256_packed_digest_t const> in,
+		                 daw::span<sha256_packed_digest_t> out ) noexcept {
+			impl::sha256_batch<2, false>( in, out );
+		}
+
+		/// @brief out[n] = SHA256( SHA256( in[n] ) )
+		inline void
+		sha256d_32_batch( daw::span<sha256_packed_digest_t const> in,
+		                  daw::span<sha256_packed_digest_t> out ) noexcept {
+			impl::sha256_batch<1, true>( in, out );
+		}
+
+		/// @brief One double hashed Merkle level,
+		/// out[n] = SHA256( SHA256( in[2n] || in[2n + 1] ) )
+		inline void
+		sha256d_64_batch( daw::span<sha256_packed_digest_t const> in,
+		                  daw::span<sha256_packed_digest_t> out ) noexcept {
+			impl::sha256_batch<2, true>( in, out );
+		}
+
+		namespace impl {
+			/// @brief A message being fed block by block to one lane.  The first
+			/// block is built in tail when the message has a prefix, and the last
+			/// partial block and padding are copied to tail when reached
+			struct sha256_lane_job_t {
+				uint8_t const *data = nullptr;
+				size_t remaining = 0;
+				uint64_t message_bits = 0;
+				size_t index = 0;
+				size_t head = 0;
+				size_t tail_blocks = 0;
+				size_t tail_pos = 0;
+				bool active = false;
+				std::array<uint8_t, 128> tail{};
+
+				/// @param prefix hashed before the message, shorter than a block
+				void start( daw::span<uint8_t const> prefix, uint8_t const *ptr,
+				            size_t size, size_t idx ) noexcept {
+					data = ptr;
+					remaining = size;
+					message_bits = static_cast<uint64_t>( prefix.size( ) + size ) * 8;
+					index = idx;
+					head = prefix.size( );
+					std::copy( prefix.begin( ), prefix.end( ), tail.begin( ) );
+					tail_blocks = 0;
+					tail_pos = 0;
+					active = true;
+				}
+
+				/// @brief The next block to compress and whether it is the last
+				std::pair<uint8_t const *, bool> next_block( ) noexcept {
+					if( head > 0 && head + remaining >= 64 ) {
+						// Only the first block is assembled, the rest of the message is
+						// read in place
+						auto const n = 64 - head;
+						std::copy( data, data + n, tail.begin( ) + head );
+						data += n;
+						remaining -= n;
+						head = 0;
+						return {tail.data( ), false};
+					}
+					if( head == 0 && remaining >= 64 ) {
+						auto const *result = data;
+						data += 64;
+						remaining -= 64;
+						return {result, false};
+					}
+					if( tail_blocks == 0 ) {
+						std::fill( tail.begin( ) + head, tail.end( ), 0 );
+						std::copy( data, data + remaining, tail.begin( ) + head );
+						auto const size = head + remaining;
+						tail[size] = 0b1000'0000;
+						tail_blocks = size < 56 ? 1 : 2;
+						to_uint64_be( tail.data( ) + ( tail_blocks * 64 ) - 8,
+						              message_bits );
+						remaining = 0;
+						head = 0;
+					}
+					auto const *result = tail.data( ) + ( tail_pos * 64 );
+					++tail_pos;
+					return {result, tail_pos == tail_blocks};
+				}
+			};
+		} // namespace impl
+
+		/// @brief Hash independent messages of any length sha256_batch_lanes at a
+		/// time, each preceded by the same prefix.  When a lane finishes its
+		/// message the next waiting message takes its place, so lanes only idle
+		/// once the queue is empty.  The prefix is placed in front of the first
+		/// block of a message, the messages themselves are not copied
+		/// @param prefix bytes hashed before every message, e.g. a domain
+		/// separation tag, shorter than a 64 byte block
+		/// @param messages messages to hash
+		/// @param out out[n] receives the digest of prefix || messages[n], must be
+		/// at least messages.size( ) long
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		void sha256_multi_hash( daw::span<uint8_t const> prefix,
+		                        daw::span<daw::span<U const> const> messages,
+		                        daw::span<sha256_digest_t> out ) noexcept {
+			using impl::sha256_batch_lanes;
+			std::array<impl::sha256_lane_job_t, sha256_batch_lanes> jobs{};
+			size_t next_message = 0;
+			size_t active = 0;
+			auto const init = impl::sha256_lane_init( );
+			auto state = init;
+			auto const start_job = [&]( size_t lane ) {
+				if( next_message >= messages.size( ) ) {
+					jobs[lane].active = false;
+					return;
+				}
+				auto const &message = messages[next_message];
+				jobs[lane].start( prefix,
+				                  reinterpret_cast<uint8_t const *>( message.data( ) ),
+				                  message.size( ), next_message );
+				++next_message;
+				++active;
+				for( size_t i = 0; i < 8; ++i ) {
+					state[i].v[lane] = init[i].v[lane];
+				}
+			};
+			for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+				start_job( l );
+			}
+			if( active == 1 ) {
+				sha2_ctx<256, U> ctx{};
+				ctx.update( prefix.data( ), prefix.size( ) );
+				ctx.update( messages[0] );
+				out[jobs[0].index] = ctx.final( );
+				return;
+			}
+
+			auto sample = impl::telemetry_start( );
+			impl::sha256_lane_block_t w{};
+			std::array<bool, sha256_batch_lanes> finished{};
+			while( active > 0 ) {
+				for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+					finished[l] = false;
+					if( !jobs[l].active ) {
+						continue;
+					}
+					auto const block = jobs[l].next_block( );
+					finished[l] = block.second;
+					for( size_t n = 0; n < 16; ++n ) {
+						w[n].v[l] = impl::to_uint32_be( block.first + ( n * 4 ) );
+					}
+				}
+				impl::sha256_lane_compress( state, w, std::make_index_sequence<64>{} );
+				for( size_t l = 0; l < sha256_batch_lanes; ++l ) {
+					if( !finished[l] ) {
+						continue;
+					}
+					auto &digest = out[jobs[l].index];
+					for( size_t n = 0; n < 8; ++n ) {
+						digest[n] = state[n].v[l];
+					}
+					--active;
+					start_job( l );
+				}
+			}
+			if constexpr( telemetry_enabled( ) ) {
+				size_t bytes = prefix.size( ) * messages.size( );
+				for( auto const &message : messages ) {
+					bytes += message.size( );
+				}
+				impl::telemetry_record( telemetry_op_t::sha256,
+				                        telemetry_backend_t::multi_buffer,
+				                        messages.size( ), bytes, sample );
+			}
+		}
+
+		/// @brief Hash independent messages of any length sha256_batch_lanes at a
+		/// time.  When a lane finishes its message the next waiting message takes
+		/// its place, so lanes only idle once the queue is empty
+		/// @param messages messages to hash
+		/// @param out out[n] receives the digest of messages[n], must be at least
+		/// messages.size( ) long
+		template<typename U, typename = std::enable_if_t<sizeof( U ) == 1>>
+		void sha256_multi_hash( daw::span<daw::span<U const> const> messages,
+		                        daw::span<sha256_digest_t> out ) noexcept {
+			sha256_multi_hash( daw::span<uint8_t const>( ), messages, out );
+		}
+	} // namespace crypto
+} // namespace daw
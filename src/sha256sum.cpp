@@ -20,50 +20,394 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <string>
+
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <daw/daw_memory_mapped_file.h>
 #include <daw/daw_static_array.h>
 #include <daw/daw_string_view.h>
 
 #include "sha256.h"
+#include "sha256_digest_cache.h"
 
 namespace {
-	void do_console( ) noexcept {
+	using stats_clock_t = std::chrono::steady_clock;
+
+	struct fault_counts_t {
+		int64_t minor = 0;
+		int64_t major = 0;
+
+		static fault_counts_t now( ) noexcept {
+			rusage usage{};
+			::getrusage( RUSAGE_SELF, &usage );
+			return {usage.ru_minflt, usage.ru_majflt};
+		}
+	};
+
+	/// @brief What --stats reports for a file and for the whole run
+	struct hash_stats_t {
+		uint64_t bytes = 0;
+		std::chrono::nanoseconds wall{};
+		// Blocked reading or faulting in the file
+		std::chrono::nanoseconds io{};
+		// In sha256_ctx::update/final
+		std::chrono::nanoseconds transform{};
+		int64_t minor_faults = 0;
+		int64_t major_faults = 0;
+		bool cached = false;
+
+		void add( hash_stats_t const &other ) noexcept {
+			bytes += other.bytes;
+			wall += other.wall;
+			io += other.io;
+			transform += other.transform;
+			minor_faults += other.minor_faults;
+			major_faults += other.major_faults;
+		}
+
+		double mb_per_sec( ) const noexcept {
+			auto const secs = std::chrono::duration<double>( wall ).count( );
+			return secs > 0.0 ? static_cast<double>( bytes ) / secs / 1.0e6 : 0.0;
+		}
+	};
+
+	/// @brief Times one file's hashing, faults are counted for the process
+	class stats_scope_t {
+		hash_stats_t &m_stats;
+		stats_clock_t::time_point m_start = stats_clock_t::now( );
+		fault_counts_t m_faults = fault_counts_t::now( );
+
+	public:
+		explicit stats_scope_t( hash_stats_t &stats ) noexcept
+		  : m_stats( stats ) {}
+
+		~stats_scope_t( ) {
+			auto const faults = fault_counts_t::now( );
+			m_stats.wall = stats_clock_t::now( ) - m_start;
+			m_stats.minor_faults = faults.minor - m_faults.minor;
+			m_stats.major_faults = faults.major - m_faults.major;
+		}
+	};
+
+	std::string json_string( daw::string_view str ) {
+		std::string result = "\"";
+		for( auto c : str ) {
+			switch( c ) {
+			case '"':
+				result += "\\\"";
+				break;
+			case '\\':
+				result += "\\\\";
+				break;
+			default:
+				if( static_cast<unsigned char>( c ) < 0x20 ) {
+					char buff[8];
+					std::snprintf( buff, sizeof( buff ), "\\u%04x", c );
+					result += buff;
+				} else {
+					result += c;
+				}
+			}
+		}
+		return result + '"';
+	}
+
+	/// @brief Where --stats and --stats-json send their reports
+	struct stats_output_t {
+		bool human = false;
+		std::unique_ptr<std::ofstream> json{};
+		hash_stats_t total{};
+		size_t files = 0;
+
+		explicit operator bool( ) const noexcept {
+			return human || json;
+		}
+
+		void report( daw::string_view name, hash_stats_t const &stats ) {
+			++files;
+			total.add( stats );
+			write( name, stats, false );
+		}
+
+		void report_total( ) {
+			write( "total", total, true );
+		}
+
+	private:
+		void write( daw::string_view name, hash_stats_t const &stats,
+		            bool is_total ) {
+			using ms = std::chrono::duration<double, std::milli>;
+			if( human ) {
+				std::cerr << name << ": " << stats.bytes << " bytes";
+				if( is_total ) {
+					std::cerr << " in " << files << " files";
+				} else if( stats.cached ) {
+					std::cerr << " (from cache)";
+				}
+				std::cerr << std::fixed << std::setprecision( 3 ) << ", wall "
+				          << ms( stats.wall ).count( ) << " ms, io "
+				          << ms( stats.io ).count( ) << " ms, transform "
+				          << ms( stats.transform ).count( ) << " ms, "
+				          << std::setprecision( 1 ) << stats.mb_per_sec( )
+				          << " MB/s, page faults " << stats.minor_faults
+				          << " minor " << stats.major_faults << " major\n";
+			}
+			if( json ) {
+				*json << "{" << ( is_total ? "\"total\":true,\"files\":" +
+				                               std::to_string( files )
+				                           : "\"file\":" + json_string( name ) )
+				      << ",\"bytes\":" << stats.bytes
+				      << ",\"wall_ns\":" << stats.wall.count( )
+				      << ",\"io_ns\":" << stats.io.count( )
+				      << ",\"transform_ns\":" << stats.transform.count( )
+				      << ",\"mb_per_s\":" << std::fixed << std::setprecision( 3 )
+				      << stats.mb_per_sec( )
+				      << ",\"minor_faults\":" << stats.minor_faults
+				      << ",\"major_faults\":" << stats.major_faults
+				      << ",\"cached\":" << ( stats.cached ? "true" : "false" )
+				      << "}\n";
+			}
+		}
+	};
+
+	/// @brief Hash a mapped file a chunk at a time, faulting each chunk in
+	/// before hashing it so page cache misses count as io, not transform
+	daw::crypto::sha256_digest_t
+	hash_mapped_with_stats( unsigned char const *data, size_t size,
+	                        hash_stats_t &stats ) {
+		constexpr size_t const chunk_size = 1024 * 1024;
+		auto const page_size = static_cast<size_t>( ::sysconf( _SC_PAGESIZE ) );
+		daw::crypto::sha256_ctx ctx{};
+		unsigned char touched = 0;
+		for( size_t pos = 0; pos < size; pos += chunk_size ) {
+			auto const count = std::min( chunk_size, size - pos );
+			auto const io_start = stats_clock_t::now( );
+			for( size_t page = 0; page < count; page += page_size ) {
+				touched ^= static_cast<unsigned char const volatile &>(
+				  data[pos + page] );
+			}
+			auto const transform_start = stats_clock_t::now( );
+			ctx.update( data + pos, count );
+			stats.io += transform_start - io_start;
+			stats.transform += stats_clock_t::now( ) - transform_start;
+		}
+		auto const final_start = stats_clock_t::now( );
+		auto const digest = ctx.final( );
+		stats.transform += stats_clock_t::now( ) - final_start;
+		stats.bytes = size;
+		static_cast<void>( touched );
+		return digest;
+	}
+
+	void do_console( stats_output_t *stats ) noexcept {
 		std::ios_base::sync_with_stdio( false );
 		daw::crypto::sha256_ctx ctx{};
 		daw::static_array_t<unsigned char, 1024> buffer = {0};
 		auto io_ptr = reinterpret_cast<char *>( buffer.data( ) );
 		std::streamsize read_count = 0;
-		while( std::cin.good( ) &&
-		       ( read_count = std::cin.readsome(
-		           io_ptr, static_cast<std::streamsize>( buffer.size( ) ) ) ) >
-		         0 ) {
-			ctx.update( buffer.data( ), static_cast<size_t>( read_count ) );
+		if( stats == nullptr ) {
+			while( std::cin.good( ) &&
+			       ( read_count = std::cin.readsome(
+			           io_ptr, static_cast<std::streamsize>( buffer.size( ) ) ) ) >
+			         0 ) {
+				ctx.update( buffer.data( ), static_cast<size_t>( read_count ) );
+			}
+			std::cout << ctx.final( ).to_hex_string( ) << "  -\n";
+			return;
+		}
+		hash_stats_t file_stats{};
+		{
+			stats_scope_t scope( file_stats );
+			while( true ) {
+				auto const io_start = stats_clock_t::now( );
+				if( !std::cin.good( ) ||
+				    ( read_count = std::cin.readsome(
+				        io_ptr, static_cast<std::streamsize>( buffer.size( ) ) ) ) <=
+				      0 ) {
+					file_stats.io += stats_clock_t::now( ) - io_start;
+					break;
+				}
+				auto const transform_start = stats_clock_t::now( );
+				ctx.update( buffer.data( ), static_cast<size_t>( read_count ) );
+				file_stats.io += transform_start - io_start;
+				file_stats.transform += stats_clock_t::now( ) - transform_start;
+				file_stats.bytes += static_cast<uint64_t>( read_count );
+			}
+			auto const final_start = stats_clock_t::now( );
+			auto const digest = ctx.final( );
+			file_stats.transform += stats_clock_t::now( ) - final_start;
+			std::cout << digest.to_hex_string( ) << "  -\n";
 		}
-		std::cout << ctx.final( ).to_hex_string( ) << "  -\n";
+		stats->report( "-", file_stats );
 	}
 
-	void do_file( daw::string_view file_name ) noexcept {
+	// A file changed this recently may change again without its timestamps
+	// moving, so its digest is not cached
+	constexpr int64_t const racy_window_ns = 2'000'000'000;
+
+	int64_t now_ns( ) noexcept {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		         std::chrono::system_clock::now( ).time_since_epoch( ) )
+		  .count( );
+	}
+
+	bool hash_file( daw::string_view file_name,
+	                daw::crypto::sha256_digest_cache *cache,
+	                hash_stats_t *stats ) noexcept {
+		std::string const path( file_name.data( ), file_name.size( ) );
+		daw::crypto::file_identity_t before{};
+		if( cache != nullptr &&
+		    daw::crypto::file_identity_t::from_path( path.c_str( ), before ) ) {
+			daw::crypto::sha256_digest_t digest{};
+			if( cache->lookup( before, digest ) ) {
+				std::cout << digest.to_hex_string( ) << " " << file_name << '\n';
+				if( stats != nullptr ) {
+					stats->cached = true;
+				}
+				return true;
+			}
+		}
+		auto const open_start = stats_clock_t::now( );
 		daw::filesystem::memory_mapped_file_t<unsigned char> mmf{file_name};
 		if( !mmf ) {
 			std::cerr << "Could not open file '" << file_name << "'\n";
-			exit( EXIT_FAILURE );
+			return false;
 		}
-		daw::crypto::sha256_ctx ctx{};
-		ctx.update( daw::make_array_view( mmf.data( ), mmf.size( ) ) );
-		std::cout << ctx.final( ).to_hex_string( ) << " " << file_name << '\n';
+		daw::crypto::sha256_digest_t digest{};
+		if( stats == nullptr ) {
+			daw::crypto::sha256_ctx ctx{};
+			ctx.update( daw::make_array_view( mmf.data( ), mmf.size( ) ) );
+			digest = ctx.final( );
+		} else {
+			stats->io += stats_clock_t::now( ) - open_start;
+			digest = hash_mapped_with_stats( mmf.data( ), mmf.size( ), *stats );
+		}
+		std::cout << digest.to_hex_string( ) << " " << file_name << '\n';
+
+		daw::crypto::file_identity_t after{};
+		if( cache != nullptr &&
+		    daw::crypto::file_identity_t::from_path( path.c_str( ), after ) &&
+		    after == before && after.size == mmf.size( ) &&
+		    std::max( after.mtime_ns, after.ctime_ns ) <
+		      now_ns( ) - racy_window_ns ) {
+			// The digest is already printed, a cache that cannot grow is skipped
+			try {
+				cache->insert( after, digest );
+			} catch( std::exception const &ex ) {
+				std::cerr << "Could not update the digest cache: " << ex.what( )
+				          << '\n';
+			}
+		}
+		return true;
+	}
+
+	bool do_file( daw::string_view file_name,
+	              daw::crypto::sha256_digest_cache *cache,
+	              stats_output_t *stats ) noexcept {
+		if( stats == nullptr ) {
+			return hash_file( file_name, cache, nullptr );
+		}
+		hash_stats_t file_stats{};
+		bool ok = false;
+		{
+			stats_scope_t const scope( file_stats );
+			ok = hash_file( file_name, cache, &file_stats );
+		}
+		if( ok ) {
+			stats->report( file_name, file_stats );
+		}
+		return ok;
+	}
+
+	[[noreturn]] void usage( char const *prog ) {
+		std::cerr << "Usage: " << prog
+		          << " [--cache file] [--compact-cache] [--stats]"
+		             " [--stats-json file] [file]...\n";
+		exit( EXIT_FAILURE );
 	}
 } // namespace
 
 int main( int argc, char **argv ) {
-	if( argc > 1 ) {
-		do_file( argv[1] );
-	} else {
-		do_console( );
+	std::unique_ptr<daw::crypto::sha256_digest_cache> cache{};
+	bool cache_requested = false;
+	bool compact = false;
+	stats_output_t stats{};
+	int first_file = 1;
+	for( ; first_file < argc; ++first_file ) {
+		daw::string_view const arg = argv[first_file];
+		if( arg == "--cache" && first_file + 1 < argc ) {
+			cache_requested = true;
+			cache = std::make_unique<daw::crypto::sha256_digest_cache>(
+			  argv[++first_file] );
+			if( !*cache ) {
+				std::cerr << "Could not use digest cache '" << argv[first_file]
+				          << "', continuing without it\n";
+				cache.reset( );
+			}
+		} else if( arg == "--compact-cache" ) {
+			compact = true;
+		} else if( arg == "--stats" ) {
+			stats.human = true;
+		} else if( arg == "--stats-json" && first_file + 1 < argc ) {
+			stats.json = std::make_unique<std::ofstream>( argv[++first_file] );
+			if( !*stats.json ) {
+				std::cerr << "Could not open '" << argv[first_file] << "'\n";
+				return EXIT_FAILURE;
+			}
+		} else if( arg == "--" ) {
+			++first_file;
+			break;
+		} else if( arg.size( ) > 1 && arg.front( ) == '-' ) {
+			usage( argv[0] );
+		} else {
+			break;
+		}
+	}
+
+	if( compact && !cache_requested ) {
+		std::cerr << "--compact-cache needs --cache\n";
+		usage( argv[0] );
+	}
+
+	auto *const stats_ptr = stats ? &stats : nullptr;
+	bool ok = true;
+	if( first_file < argc ) {
+		for( int n = first_file; n < argc; ++n ) {
+			ok &= do_file( argv[n], cache.get( ), stats_ptr );
+		}
+	} else if( !compact ) {
+		do_console( stats_ptr );
+	}
+	if( stats && stats.files > 1 ) {
+		stats.report_total( );
+	}
+	if( cache && !cache->flush( ) ) {
+		std::cerr << "Could not update the digest cache\n";
+	}
+	if( compact ) {
+		// A cache that could not be opened cannot be compacted either
+		bool compacted = false;
+		try {
+			compacted = cache && cache->compact( );
+		} catch( std::exception const & ) {
+			compacted = false;
+		}
+		if( !compacted ) {
+			std::cerr << "Could not compact the digest cache\n";
+			ok = false;
+		}
 	}
-	return EXIT_SUCCESS;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,143 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE aes_batch_test
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "aes_batch.h"
+
+using namespace daw::crypto::aes;
+
+namespace {
+	using aes_key_t = std::array<uint8_t, impl::AES128_KEY_SIZE::value>;
+
+	struct batch_t {
+		std::vector<aes128_key_schedule_t> schedules;
+		std::vector<std::vector<uint8_t>> inputs;
+		std::vector<std::vector<uint8_t>> outputs;
+		std::vector<aes128_cbc_job_t> jobs;
+
+		explicit batch_t( size_t count ) {
+			schedules.reserve( count );
+			for( size_t n = 0; n < count; ++n ) {
+				aes_key_t key{};
+				for( size_t k = 0; k < key.size( ); ++k ) {
+					key[k] = static_cast<uint8_t>( n * 31u + k );
+				}
+				schedules.push_back(
+				  impl::aes128_key_schedule( daw::make_span( key ) ) );
+				// Sizes from empty through several blocks, some partial
+				inputs.emplace_back( ( n * 23u ) % 100u );
+				for( size_t k = 0; k < inputs.back( ).size( ); ++k ) {
+					inputs.back( )[k] = static_cast<uint8_t>( n + k * 7u );
+				}
+				outputs.emplace_back( ( inputs.back( ).size( ) + 15u ) & ~15u );
+			}
+			for( size_t n = 0; n < count; ++n ) {
+				cipher_t iv{};
+				iv[0] = static_cast<uint8_t>( n );
+				jobs.push_back( aes128_cbc_job_t{
+				  &schedules[n], iv,
+				  daw::span<uint8_t const>( inputs[n].data( ), inputs[n].size( ) ),
+				  daw::span<uint8_t>( outputs[n].data( ), outputs[n].size( ) )} );
+			}
+		}
+
+		daw::span<aes128_cbc_job_t const> job_span( ) const {
+			return daw::span<aes128_cbc_job_t const>( jobs.data( ), jobs.size( ) );
+		}
+
+		std::vector<std::vector<uint8_t>> expected( ) const {
+			std::vector<std::vector<uint8_t>> result;
+			for( auto const &job : jobs ) {
+				result.emplace_back( job.output.size( ) );
+				auto &out = result.back( );
+				aes_encrypt_128_cbc( job.input, *job.key_sched, job.iv,
+				                     daw::span<uint8_t>( out.data( ), out.size( ) ) );
+			}
+			return result;
+		}
+	};
+} // namespace
+
+BOOST_AUTO_TEST_CASE( aes_cbc_001 ) {
+	// SP 800-38A F.2.1 CBC-AES128.Encrypt
+	aes_key_t const key = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+	                   0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+	cipher_t const iv = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	                     0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+	std::array<uint8_t, 64> const plain = {
+	  0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e,
+	  0x11, 0x73, 0x93, 0x17, 0x2a, 0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03,
+	  0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51, 0x30,
+	  0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19,
+	  0x1a, 0x0a, 0x52, 0xef, 0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b,
+	  0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10};
+	std::array<uint8_t, 64> const expected = {
+	  0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e,
+	  0x9b, 0x12, 0xe9, 0x19, 0x7d, 0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72,
+	  0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2, 0x73,
+	  0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e,
+	  0x22, 0x22, 0x95, 0x16, 0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac,
+	  0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7};
+	auto const sched = impl::aes128_key_schedule( daw::make_span( key ) );
+
+	std::array<uint8_t, 64> cipher{};
+	aes_encrypt_128_cbc( daw::make_span( plain ), sched, iv,
+	                     daw::make_span( cipher ) );
+	BOOST_REQUIRE( cipher == expected );
+
+	cipher = {};
+	aes128_cbc_job_t const job{&sched, iv, daw::make_span( plain ),
+	                           daw::make_span( cipher )};
+	aes_encrypt_128_cbc_batch( daw::span<aes128_cbc_job_t const>( &job, 1 ) );
+	BOOST_REQUIRE( cipher == expected );
+}
+
+BOOST_AUTO_TEST_CASE( aes_cbc_batch_001 ) {
+	// Mixed lengths and keys, more jobs than lanes
+	batch_t batch( 37 );
+	auto const expected = batch.expected( );
+	aes_encrypt_128_cbc_batch( batch.job_span( ) );
+	BOOST_REQUIRE( batch.outputs == expected );
+}
+
+#if defined( __AES__ )
+BOOST_AUTO_TEST_CASE( aes_cbc_batch_002 ) {
+	// Every lane count gives the same result
+	auto const check = []( auto lanes ) {
+		batch_t batch( 29 );
+		auto const expected = batch.expected( );
+		impl::aes_encrypt_128_cbc_lanes<decltype( lanes )::value>(
+		  batch.job_span( ) );
+		BOOST_REQUIRE( batch.outputs == expected );
+	};
+	check( std::integral_constant<size_t, 1>{} );
+	check( std::integral_constant<size_t, 4>{} );
+	check( std::integral_constant<size_t, 8>{} );
+}
+#endif
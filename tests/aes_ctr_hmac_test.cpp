@@ -0,0 +1,228 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE aes_ctr_hmac_test
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "aes_ctr_hmac.h"
+
+using namespace daw::crypto;
+using namespace daw::crypto::aes;
+
+namespace {
+	std::vector<uint8_t> from_hex( std::string const &hex ) {
+		std::vector<uint8_t> result;
+		for( size_t n = 0; n + 1 < hex.size( ); n += 2 ) {
+			result.push_back(
+			  static_cast<uint8_t>( std::stoul( hex.substr( n, 2 ), nullptr, 16 ) ) );
+		}
+		return result;
+	}
+
+	cipher_t block_from_hex( std::string const &hex ) {
+		auto const bytes = from_hex( hex );
+		cipher_t result{};
+		std::copy( bytes.begin( ), bytes.end( ), result.begin( ) );
+		return result;
+	}
+
+	std::vector<uint8_t> pattern( size_t size, uint32_t seed ) {
+		std::vector<uint8_t> result( size );
+		for( auto &b : result ) {
+			seed = seed * 1103515245u + 12345u;
+			b = static_cast<uint8_t>( seed >> 16u );
+		}
+		return result;
+	}
+
+	daw::span<uint8_t const> cspan( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	daw::span<uint8_t> mspan( std::vector<uint8_t> &v ) {
+		return daw::span<uint8_t>( v.data( ), v.size( ) );
+	}
+
+	std::vector<uint8_t> const sp800_key =
+	  from_hex( "2b7e151628aed2a6abf7158809cf4f3c" );
+
+	std::vector<uint8_t> const mac_key = pattern( 32, 99 );
+
+	cipher_t const iv = block_from_hex( "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff" );
+} // namespace
+
+BOOST_AUTO_TEST_CASE( aes_ctr_001 ) {
+	// SP 800-38A F.5.1 CTR-AES128.Encrypt
+	auto const plain = from_hex(
+	  "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+	  "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710" );
+	auto const expected = from_hex(
+	  "874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+	  "5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee" );
+	auto const sched = aes::impl::aes128_key_schedule( cspan( sp800_key ) );
+	std::vector<uint8_t> cipher( plain.size( ) );
+	aes_ctr_128( sched, iv, cspan( plain ), mspan( cipher ) );
+	BOOST_REQUIRE( cipher == expected );
+
+	// Fed in uneven pieces
+	for( size_t step : {1U, 5U, 16U, 17U, 33U} ) {
+		aes128_ctr_t ctr( sched, iv );
+		std::vector<uint8_t> pieces( plain.size( ) );
+		for( size_t pos = 0; pos < plain.size( ); pos += step ) {
+			auto const size = std::min( step, plain.size( ) - pos );
+			ctr.crypt( cspan( plain ).subset( pos, size ),
+			           mspan( pieces ).subset( pos, size ) );
+		}
+		BOOST_REQUIRE( pieces == expected );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( aes_ctr_002 ) {
+	// The counter carries from the low 64 bits into the high 64 bits
+	auto const sched = aes::impl::aes128_key_schedule( cspan( sp800_key ) );
+	std::vector<uint8_t> const zeros( 80 );
+	std::vector<uint8_t> key_stream( zeros.size( ) );
+	aes_ctr_128( sched, block_from_hex( "0001020304050607fffffffffffffffe" ),
+	             cspan( zeros ), mspan( key_stream ) );
+	BOOST_REQUIRE( key_stream ==
+	               from_hex( "eb18472ff22c12c638c5b2e7282d0d20"
+	                         "3d88a68db0f3e3c66e7fd8c1b1cb797a"
+	                         "2a8891d239949bea3ea4f6c17f7ea957"
+	                         "0ad276b9a4cf0b15e9b3a8f57bfabc49"
+	                         "d0529436f20db338316ed93dcef1ca20" ) );
+}
+
+BOOST_AUTO_TEST_CASE( aes_ctr_hmac_001 ) {
+	// The fused pass gives the same cipher text and tag as aes_ctr_128 then
+	// hmac_sha256 over the cipher text, the stored format, including sizes
+	// that are not whole tiles or whole blocks
+	for( size_t size : {0U, 15U, 8192U, 8193U, 100'003U} ) {
+		auto const plain = pattern( size, static_cast<uint32_t>( size ) );
+		std::vector<uint8_t> cipher( size );
+		auto const tag = aes128_ctr_hmac_seal( cspan( sp800_key ),
+		                                       cspan( mac_key ), iv,
+		                                       cspan( plain ), mspan( cipher ) );
+
+		std::vector<uint8_t> expected( size );
+		aes_ctr_128( aes::impl::aes128_key_schedule( cspan( sp800_key ) ), iv,
+		             cspan( plain ), mspan( expected ) );
+		BOOST_REQUIRE( cipher == expected );
+		BOOST_REQUIRE( tag == hmac_sha256( cspan( mac_key ), cspan( expected ) ) );
+
+		std::vector<uint8_t> opened( size );
+		BOOST_REQUIRE( aes128_ctr_hmac_open( cspan( sp800_key ),
+		                                     cspan( mac_key ), iv,
+		                                     cspan( cipher ), tag,
+		                                     mspan( opened ) ) );
+		BOOST_REQUIRE( opened == plain );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( aes_ctr_hmac_002 ) {
+	// Streaming in odd pieces matches one shot, in place
+	auto const plain = pattern( 50'000, 7 );
+	std::vector<uint8_t> one_shot( plain.size( ) );
+	auto const tag =
+	  aes128_ctr_hmac_seal( cspan( sp800_key ), cspan( mac_key ), iv,
+	                        cspan( plain ), mspan( one_shot ) );
+
+	auto data = plain;
+	aes128_ctr_hmac_sha256_ctx enc( cspan( sp800_key ), cspan( mac_key ), iv );
+	for( size_t pos = 0, step = 1; pos < data.size( ); pos += step, step += 97 ) {
+		auto const size = std::min( step, data.size( ) - pos );
+		enc.encrypt_update( cspan( data ).subset( pos, size ),
+		                    mspan( data ).subset( pos, size ) );
+	}
+	BOOST_REQUIRE( data == one_shot );
+	BOOST_REQUIRE( enc.final( ) == tag );
+
+	aes128_ctr_hmac_sha256_ctx dec( cspan( sp800_key ), cspan( mac_key ), iv );
+	for( size_t pos = 0, step = 3; pos < data.size( ); pos += step, step += 51 ) {
+		auto const size = std::min( step, data.size( ) - pos );
+		dec.decrypt_update( cspan( data ).subset( pos, size ),
+		                    mspan( data ).subset( pos, size ) );
+	}
+	BOOST_REQUIRE( dec.verify( tag ) );
+	BOOST_REQUIRE( data == plain );
+}
+
+BOOST_AUTO_TEST_CASE( aes_ctr_hmac_003 ) {
+	// Tampering with the cipher text or the tag is rejected before anything
+	// is decrypted
+	auto const plain = pattern( 1000, 3 );
+	std::vector<uint8_t> cipher( plain.size( ) );
+	auto const tag = aes128_ctr_hmac_seal( cspan( sp800_key ),
+	                                       cspan( mac_key ), iv, cspan( plain ),
+	                                       mspan( cipher ) );
+	auto const rejects = [&]( std::vector<uint8_t> const &c, cipher_t const &v,
+	                          aes128_ctr_hmac_tag_t const &t ) {
+		std::vector<uint8_t> out( c.size( ), 0xEE );
+		auto const ok = aes128_ctr_hmac_open( cspan( sp800_key ),
+		                                      cspan( mac_key ), v, cspan( c ),
+		                                      t, mspan( out ) );
+		return !ok && std::all_of( out.begin( ), out.end( ),
+		                           []( uint8_t b ) { return b == 0xEE; } );
+	};
+	auto bad_cipher = cipher;
+	bad_cipher[500] ^= 0x01u;
+	BOOST_REQUIRE( rejects( bad_cipher, iv, tag ) );
+	auto bad_tag = tag;
+	bad_tag[0] ^= 0x80u;
+	BOOST_REQUIRE( rejects( cipher, iv, bad_tag ) );
+}
+
+BOOST_AUTO_TEST_CASE( aes_ctr_hmac_004 ) {
+	// Binding the IV is opt in: its tag is HMAC( iv || cipher text ) and a
+	// changed IV is then rejected
+	auto const plain = pattern( 1000, 5 );
+	std::vector<uint8_t> cipher( plain.size( ) );
+	auto const covers = ctr_hmac_mac_t::iv_and_cipher_text;
+	auto const tag =
+	  aes128_ctr_hmac_seal( cspan( sp800_key ), cspan( mac_key ), iv,
+	                        cspan( plain ), mspan( cipher ), covers );
+	hmac_sha256_ctx mac( cspan( mac_key ) );
+	mac.update( iv.data( ), iv.size( ) );
+	mac.update( cspan( cipher ) );
+	BOOST_REQUIRE( tag == mac.final( ) );
+	BOOST_REQUIRE( !( tag == hmac_sha256( cspan( mac_key ), cspan( cipher ) ) ) );
+
+	std::vector<uint8_t> out( plain.size( ) );
+	BOOST_REQUIRE( aes128_ctr_hmac_open( cspan( sp800_key ), cspan( mac_key ),
+	                                     iv, cspan( cipher ), tag, mspan( out ),
+	                                     covers ) );
+	BOOST_REQUIRE( out == plain );
+	BOOST_REQUIRE( !aes128_ctr_hmac_open( cspan( sp800_key ), cspan( mac_key ),
+	                                      iv, cspan( cipher ), tag,
+	                                      mspan( out ) ) );
+	auto bad_iv = iv;
+	bad_iv[15] ^= 0x01u;
+	BOOST_REQUIRE( !aes128_ctr_hmac_open( cspan( sp800_key ), cspan( mac_key ),
+	                                      bad_iv, cspan( cipher ), tag,
+	                                      mspan( out ), covers ) );
+}
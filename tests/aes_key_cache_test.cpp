@@ -0,0 +1,148 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE aes_key_cache_test
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "aes_key_cache.h"
+
+using namespace daw::crypto::aes;
+
+namespace {
+	using key_t = std::array<uint8_t, impl::AES128_KEY_SIZE::value>;
+
+	key_t key_for( uint64_t key_id ) {
+		key_t result{};
+		for( size_t n = 0; n < result.size( ); ++n ) {
+			result[n] = static_cast<uint8_t>( ( key_id >> ( ( n % 8 ) * 8 ) ) + n );
+		}
+		return result;
+	}
+
+	aes128_key_schedule_t expected_for( uint64_t key_id ) {
+		auto const key = key_for( key_id );
+		return impl::aes128_key_schedule( daw::make_span( key ) );
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( aes_key_cache_001 ) {
+	// Miss, then hit, with the counters to match
+	key_schedule_cache cache( 64 );
+	aes128_key_schedule_t sched{};
+	BOOST_REQUIRE( !cache.find( 7, sched ) );
+
+	size_t loads = 0;
+	auto const key = key_for( 7 );
+	auto const loader = [&]( ) {
+		++loads;
+		return daw::make_span( key );
+	};
+	BOOST_REQUIRE( cache.get( 7, loader ) == expected_for( 7 ) );
+	BOOST_REQUIRE( cache.get( 7, loader ) == expected_for( 7 ) );
+	BOOST_REQUIRE( cache.find( 7, sched ) );
+	BOOST_REQUIRE( sched == expected_for( 7 ) );
+	BOOST_REQUIRE_EQUAL( loads, 1U );
+
+	auto const stats = cache.stats( );
+	BOOST_REQUIRE_EQUAL( stats.hits, 2U );
+	BOOST_REQUIRE_EQUAL( stats.misses, 2U );
+	BOOST_REQUIRE_EQUAL( stats.evictions, 0U );
+	cache.reset_stats( );
+	BOOST_REQUIRE_EQUAL( cache.stats( ).hits, 0U );
+}
+
+BOOST_AUTO_TEST_CASE( aes_key_cache_002 ) {
+	// More keys than capacity evicts, and every schedule handed out is right
+	key_schedule_cache cache( 16 );
+	BOOST_REQUIRE_GE( cache.capacity( ), 16U );
+	for( uint64_t id = 0; id < 1000; ++id ) {
+		auto const key = key_for( id );
+		BOOST_REQUIRE( cache.get( id, daw::make_span( key ) ) ==
+		               expected_for( id ) );
+	}
+	auto const stats = cache.stats( );
+	BOOST_REQUIRE_EQUAL( stats.misses, 1000U );
+	BOOST_REQUIRE_EQUAL( stats.evictions, 1000U - cache.capacity( ) );
+
+	size_t cached = 0;
+	for( uint64_t id = 0; id < 1000; ++id ) {
+		aes128_key_schedule_t sched{};
+		if( cache.find( id, sched ) ) {
+			BOOST_REQUIRE( sched == expected_for( id ) );
+			++cached;
+		}
+	}
+	BOOST_REQUIRE_EQUAL( cached, cache.capacity( ) );
+}
+
+BOOST_AUTO_TEST_CASE( aes_key_cache_003 ) {
+	// Key rotation and revocation
+	key_schedule_cache cache( 64 );
+	auto const key_a = key_for( 1 );
+	auto const key_b = key_for( 2 );
+	cache.insert( 42, daw::make_span( key_a ) );
+	aes128_key_schedule_t sched{};
+	BOOST_REQUIRE( cache.find( 42, sched ) );
+	BOOST_REQUIRE( sched == expected_for( 1 ) );
+
+	cache.insert( 42, daw::make_span( key_b ) );
+	BOOST_REQUIRE( cache.find( 42, sched ) );
+	BOOST_REQUIRE( sched == expected_for( 2 ) );
+
+	cache.erase( 42 );
+	BOOST_REQUIRE( !cache.find( 42, sched ) );
+	cache.insert( 43, daw::make_span( key_a ) );
+	cache.clear( );
+	BOOST_REQUIRE( !cache.find( 43, sched ) );
+}
+
+BOOST_AUTO_TEST_CASE( aes_key_cache_004 ) {
+	// Readers racing writers that keep evicting must never see a torn or
+	// foreign schedule
+	key_schedule_cache cache( 32 );
+	std::atomic<size_t> bad{0};
+	std::vector<std::thread> threads;
+	for( size_t t = 0; t < 4; ++t ) {
+		threads.emplace_back( [&cache, &bad, t]( ) {
+			for( uint64_t n = 0; n < 20000; ++n ) {
+				auto const id = ( n * 7 + t ) % 200;
+				auto const key = key_for( id );
+				if( cache.get( id, daw::make_span( key ) ) != expected_for( id ) ) {
+					++bad;
+				}
+			}
+		} );
+	}
+	for( auto &th : threads ) {
+		th.join( );
+	}
+	BOOST_REQUIRE_EQUAL( bad.load( ), 0U );
+	auto const stats = cache.stats( );
+	BOOST_REQUIRE_EQUAL( stats.hits + stats.misses, 80000U );
+}
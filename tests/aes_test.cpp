@@ -22,7 +22,11 @@
 
 #define BOOST_TEST_MODULE aes_test
 
+#include <algorithm>
+#include <array>
 #include <iostream>
+#include <type_traits>
+#include <vector>
 
 #include <daw/boost_test.h>
 #include <daw/daw_algorithm.h>
@@ -336,9 +340,10 @@ BOOST_AUTO_TEST_CASE( aes_encrypt_decrypt_001 ) {
 	                                           0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2,
 	                                           0xe0, 0x37, 0x07, 0x34};
 
+	// FIPS-197 appendix B
 	constexpr aes128_state_t const expected_01 = {
-	  0x39, 0x02, 0xdc, 0x19, 0x25, 0xdc, 0x11, 0x6a,
-	  0x84, 0x09, 0x85, 0x0b, 0x1d, 0xfb, 0x97, 0x32};
+	  0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb,
+	  0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32};
 
 	test_enc_dec( key_01, input_01, expected_01 );
 }
@@ -352,9 +357,10 @@ BOOST_AUTO_TEST_CASE( aes_encrypt_decrypt_002 ) {
 	                                           0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11,
 	                                           0x73, 0x93, 0x17, 0x2a};
 
+	// SP 800-38A F.1.1 ECB-AES128 block #1
 	constexpr aes128_state_t const expected_02 = {
-	  0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46,
-	  0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d};
+	  0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60,
+	  0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97};
 
 	test_enc_dec( key_02, input_02, expected_02 );
 }
@@ -374,3 +380,47 @@ BOOST_AUTO_TEST_CASE( aes_encrypt_decrypt_003 ) {
 
 	test_enc_dec( key_03, input_03, expected_03 );
 }
+
+BOOST_AUTO_TEST_CASE( aes_encrypt_fragments_001 ) {
+	// Fragmented input and output must match the contiguous form, including a
+	// zero padded final partial block
+	std::array<uint8_t, 16> const key = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae,
+	                                     0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88,
+	                                     0x09, 0xcf, 0x4f, 0x3c};
+	std::vector<uint8_t> plain( 109 );
+	for( size_t n = 0; n < plain.size( ); ++n ) {
+		plain[n] = static_cast<uint8_t>( n * 13u + 7u );
+	}
+	std::vector<uint8_t> expected( 112 );
+	daw::crypto::aes::aes_encrypt_128(
+	  daw::span<uint8_t const>( plain.data( ), plain.size( ) ),
+	  daw::make_span( key ),
+	  daw::span<uint8_t>( expected.data( ), expected.size( ) ) );
+
+	auto const split = []( auto *ptr, size_t size,
+	                       std::vector<size_t> const &sizes ) {
+		using span_t = daw::span<std::remove_pointer_t<decltype( ptr )>>;
+		std::vector<span_t> result;
+		for( auto sz : sizes ) {
+			sz = std::min( sz, size );
+			result.emplace_back( ptr, sz );
+			ptr += sz;
+			size -= sz;
+		}
+		result.emplace_back( ptr, size );
+		return result;
+	};
+
+	for( auto const &sizes : std::vector<std::vector<size_t>>{
+	       {}, {16, 16, 16}, {3, 0, 5, 40, 1, 1, 1}, {15, 17, 33, 1}} ) {
+		auto const in = split( static_cast<uint8_t const *>( plain.data( ) ),
+		                       plain.size( ), sizes );
+		std::vector<uint8_t> cipher( expected.size( ) );
+		auto const out = split( cipher.data( ), cipher.size( ), {7, 16, 0, 30} );
+		daw::crypto::aes::aes_encrypt_128_fragments(
+		  daw::span<daw::span<uint8_t const> const>( in.data( ), in.size( ) ),
+		  daw::make_span( key ),
+		  daw::span<daw::span<uint8_t> const>( out.data( ), out.size( ) ) );
+		BOOST_REQUIRE( cipher == expected );
+	}
+}
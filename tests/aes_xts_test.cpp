@@ -0,0 +1,207 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE aes_xts_test
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "aes_xts.h"
+
+using namespace daw::crypto::aes;
+
+namespace {
+	std::vector<uint8_t> from_hex( std::string const &hex ) {
+		std::vector<uint8_t> result;
+		for( size_t n = 0; n + 1 < hex.size( ); n += 2 ) {
+			result.push_back(
+			  static_cast<uint8_t>( std::stoul( hex.substr( n, 2 ), nullptr, 16 ) ) );
+		}
+		return result;
+	}
+
+	std::vector<uint8_t> counting( size_t size ) {
+		std::vector<uint8_t> result( size );
+		for( size_t n = 0; n < size; ++n ) {
+			result[n] = static_cast<uint8_t>( n );
+		}
+		return result;
+	}
+
+	daw::span<uint8_t const> cspan( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	daw::span<uint8_t> mspan( std::vector<uint8_t> &v ) {
+		return daw::span<uint8_t>( v.data( ), v.size( ) );
+	}
+
+	// Encrypts the plain text as one sector, checks the cipher text and that
+	// it decrypts back, both out of place and in place
+	void check_vector( std::string const &key_hex, uint64_t sector,
+	                   std::vector<uint8_t> const &plain,
+	                   std::string const &cipher_hex ) {
+		auto const key_bytes = from_hex( key_hex );
+		aes128_xts_key_t const key( cspan( key_bytes ) );
+		auto const expected = from_hex( cipher_hex );
+
+		std::vector<uint8_t> cipher( plain.size( ) );
+		aes_xts_encrypt_128( key, sector, cspan( plain ), mspan( cipher ) );
+		BOOST_REQUIRE( cipher == expected );
+
+		std::vector<uint8_t> decrypted( cipher.size( ) );
+		aes_xts_decrypt_128( key, sector, cspan( cipher ), mspan( decrypted ) );
+		BOOST_REQUIRE( decrypted == plain );
+
+		auto in_place = plain;
+		aes_xts_encrypt_128( key, sector, cspan( in_place ), mspan( in_place ) );
+		BOOST_REQUIRE( in_place == expected );
+		aes_xts_decrypt_128( key, sector, cspan( in_place ), mspan( in_place ) );
+		BOOST_REQUIRE( in_place == plain );
+	}
+
+	std::string const key_1_2 =
+	  "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0bfbebdbcbbbab9b8b7b6b5b4b3b2b1b0";
+} // namespace
+
+// IEEE 1619-2007 Annex B test vectors
+
+BOOST_AUTO_TEST_CASE( aes_xts_001 ) {
+	check_vector( std::string( 64, '0' ), 0, std::vector<uint8_t>( 32 ),
+	              "917cf69ebd68b2ec9b9fe9a3eadda692"
+	              "cd43d2f59598ed858c02c2652fbf922e" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_002 ) {
+	check_vector( "11111111111111111111111111111111"
+	              "22222222222222222222222222222222",
+	              0x33'3333'3333ULL, std::vector<uint8_t>( 32, 0x44 ),
+	              "c454185e6a16936e39334038acef838b"
+	              "fb186fff7480adc4289382ecd6d394f0" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_003 ) {
+	check_vector( "fffefdfcfbfaf9f8f7f6f5f4f3f2f1f0"
+	              "22222222222222222222222222222222",
+	              0x33'3333'3333ULL, std::vector<uint8_t>( 32, 0x44 ),
+	              "af85336b597afc1a900b2eb21ec949d2"
+	              "92df4c047e0b21532186a5971a227a89" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_004 ) {
+	// 512 byte sector, long enough for the 8 block path
+	auto plain = counting( 256 );
+	plain.insert( plain.end( ), plain.begin( ), plain.end( ) );
+	check_vector(
+	  "2718281828459045235360287471352631415926535897932384626433832795", 0,
+	  plain,
+	  "27a7479befa1d476489f308cd4cfa6e2a96e4bbe3208ff25287dd3819616e89c"
+	  "c78cf7f5e543445f8333d8fa7f56000005279fa5d8b5e4ad40e736ddb4d35412"
+	  "328063fd2aab53e5ea1e0a9f332500a5df9487d07a5c92cc512c8866c7e860ce"
+	  "93fdf166a24912b422976146ae20ce846bb7dc9ba94a767aaef20c0d61ad0265"
+	  "5ea92dc4c4e41a8952c651d33174be51a10c421110e6d81588ede82103a252d8"
+	  "a750e8768defffed9122810aaeb99f9172af82b604dc4b8e51bcb08235a6f434"
+	  "1332e4ca60482a4ba1a03b3e65008fc5da76b70bf1690db4eae29c5f1badd03c"
+	  "5ccf2a55d705ddcd86d449511ceb7ec30bf12b1fa35b913f9f747a8afd1b130e"
+	  "94bff94effd01a91735ca1726acd0b197c4e5b03393697e126826fb6bbde8ecc"
+	  "1e08298516e2c9ed03ff3c1b7860f6de76d4cecd94c8119855ef5297ca67e9f3"
+	  "e7ff72b1e99785ca0a7e7720c5b36dc6d72cac9574c8cbbc2f801e23e56fd344"
+	  "b07f22154beba0f08ce8891e643ed995c94d9a69c9f1b5f499027a78572aeebd"
+	  "74d20cc39881c213ee770b1010e4bea718846977ae119f7a023ab58cca0ad752"
+	  "afe656bb3c17256a9f6e9bf19fdd5a38fc82bbe872c5539edb609ef4f79c203e"
+	  "bb140f2e583cb2ad15b4aa5b655016a8449277dbd477ef2c8d6c017db738b18d"
+	  "eb4a427d1923ce3ff262735779a418f20a282df920147beabe421ee5319d0568" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_015 ) {
+	// Vectors 15 to 18 are the ciphertext stealing cases
+	check_vector( key_1_2, 0x12'3456'789aULL, counting( 17 ),
+	              "6c1625db4671522d3d7599601de7ca09ed" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_016 ) {
+	check_vector( key_1_2, 0x12'3456'789aULL, counting( 18 ),
+	              "d069444b7a7e0cab09e24447d24deb1fedbf" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_017 ) {
+	check_vector( key_1_2, 0x12'3456'789aULL, counting( 19 ),
+	              "e5df1351c0544ba1350b3363cd8ef4beedbf9d" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_018 ) {
+	check_vector( key_1_2, 0x12'3456'789aULL, counting( 20 ),
+	              "9d84c813f719aa2c7be3f66171c7c5c2edbf9dac" );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_sectors_001 ) {
+	// Many sectors, a short final one, split over threads, must match sector
+	// at a time and decrypt back
+	auto const key_bytes = counting( 32 );
+	aes128_xts_key_t const key( cspan( key_bytes ) );
+	size_t const sector_size = 4096;
+	auto const plain = counting( sector_size * 700 + 100 );
+
+	std::vector<uint8_t> expected( plain.size( ) );
+	for( size_t offset = 0; offset < plain.size( ); offset += sector_size ) {
+		auto const size = std::min( sector_size, plain.size( ) - offset );
+		aes_xts_encrypt_128(
+		  key, 1000 + offset / sector_size,
+		  daw::span<uint8_t const>( plain.data( ) + offset, size ),
+		  daw::span<uint8_t>( expected.data( ) + offset, size ) );
+	}
+	for( size_t const threads : {1U, 2U, 3U, 0U} ) {
+		std::vector<uint8_t> cipher( plain.size( ) );
+		aes_xts_encrypt_128_sectors( key, 1000, sector_size, cspan( plain ),
+		                             mspan( cipher ), threads );
+		BOOST_REQUIRE( cipher == expected );
+		aes_xts_decrypt_128_sectors( key, 1000, sector_size, cspan( cipher ),
+		                             mspan( cipher ), threads );
+		BOOST_REQUIRE( cipher == plain );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_sectors_002 ) {
+	auto const key_bytes = counting( 32 );
+	auto const short_key = counting( 16 );
+	BOOST_REQUIRE_THROW( aes128_xts_key_t{cspan( short_key )},
+	                     std::invalid_argument );
+	aes128_xts_key_t const key( cspan( key_bytes ) );
+	auto const plain = counting( 15 );
+	std::vector<uint8_t> cipher( plain.size( ) );
+	BOOST_REQUIRE_THROW(
+	  aes_xts_encrypt_128( key, 0, cspan( plain ), mspan( cipher ) ),
+	  std::invalid_argument );
+	// A 530 byte input in 512 byte sectors leaves an 18 byte last sector
+	auto const ok = counting( 530 );
+	std::vector<uint8_t> out( ok.size( ) );
+	aes_xts_encrypt_128_sectors( key, 0, 512, cspan( ok ), mspan( out ) );
+	auto const bad = counting( 520 );
+	BOOST_REQUIRE_THROW(
+	  aes_xts_encrypt_128_sectors( key, 0, 512, cspan( bad ), mspan( out ) ),
+	  std::invalid_argument );
+}
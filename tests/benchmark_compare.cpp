@@ -0,0 +1,341 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Compare crypto_benchmark JSON output against a stored baseline and fail if
+// any case got slower than its tolerance allows
+//
+// benchmark_compare baseline.json current.json [--tolerance fraction]
+//   [--mad-factor n] [--case-tolerance substr=fraction]... [--strict]
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+	struct case_result_t {
+		double ns_median = 0.0;
+		double ns_mad = 0.0;
+	};
+
+	using results_t = std::map<std::string, case_result_t>;
+
+	// Just enough JSON to read the crypto_benchmark output.  Objects in the
+	// top level "benchmarks" array are read as flat name/value maps
+	class json_reader_t {
+		std::string m_data;
+		size_t m_pos = 0;
+
+		[[noreturn]] void fail( std::string const &what ) const {
+			throw std::runtime_error( what + " at offset " +
+			                          std::to_string( m_pos ) );
+		}
+
+		void skip_ws( ) {
+			while( m_pos < m_data.size( ) &&
+			       std::isspace( static_cast<unsigned char>( m_data[m_pos] ) ) ) {
+				++m_pos;
+			}
+		}
+
+		char peek( ) {
+			skip_ws( );
+			if( m_pos >= m_data.size( ) ) {
+				fail( "Unexpected end of JSON" );
+			}
+			return m_data[m_pos];
+		}
+
+		void expect( char c ) {
+			if( peek( ) != c ) {
+				fail( std::string( "Expected '" ) + c + "'" );
+			}
+			++m_pos;
+		}
+
+		std::string parse_string( ) {
+			expect( '"' );
+			std::string result;
+			while( m_pos < m_data.size( ) && m_data[m_pos] != '"' ) {
+				if( m_data[m_pos] == '\\' ) {
+					++m_pos;
+				}
+				result.push_back( m_data[m_pos++] );
+			}
+			expect( '"' );
+			return result;
+		}
+
+		double parse_number( ) {
+			skip_ws( );
+			auto const first = m_pos;
+			while( m_pos < m_data.size( ) &&
+			       ( std::isdigit( static_cast<unsigned char>( m_data[m_pos] ) ) ||
+			         m_data[m_pos] == '-' || m_data[m_pos] == '+' ||
+			         m_data[m_pos] == '.' || m_data[m_pos] == 'e' ||
+			         m_data[m_pos] == 'E' ) ) {
+				++m_pos;
+			}
+			if( first == m_pos ) {
+				fail( "Expected a number" );
+			}
+			return std::stod( m_data.substr( first, m_pos - first ) );
+		}
+
+		// Skip any value that is not needed
+		void skip_value( ) {
+			switch( peek( ) ) {
+			case '"':
+				parse_string( );
+				return;
+			case '{':
+			case '[': {
+				auto const close = m_data[m_pos] == '{' ? '}' : ']';
+				++m_pos;
+				if( peek( ) == close ) {
+					++m_pos;
+					return;
+				}
+				while( true ) {
+					if( close == '}' ) {
+						parse_string( );
+						expect( ':' );
+					}
+					skip_value( );
+					if( peek( ) == ',' ) {
+						++m_pos;
+						continue;
+					}
+					expect( close );
+					return;
+				}
+			}
+			default:
+				while( m_pos < m_data.size( ) && m_data[m_pos] != ',' &&
+				       m_data[m_pos] != '}' && m_data[m_pos] != ']' ) {
+					++m_pos;
+				}
+			}
+		}
+
+		std::pair<std::string, case_result_t> parse_case( ) {
+			std::pair<std::string, case_result_t> result{};
+			expect( '{' );
+			while( peek( ) != '}' ) {
+				auto const key = parse_string( );
+				expect( ':' );
+				if( key == "name" ) {
+					result.first = parse_string( );
+				} else if( key == "ns_median" ) {
+					result.second.ns_median = parse_number( );
+				} else if( key == "ns_mad" ) {
+					result.second.ns_mad = parse_number( );
+				} else {
+					skip_value( );
+				}
+				if( peek( ) == ',' ) {
+					++m_pos;
+				}
+			}
+			expect( '}' );
+			return result;
+		}
+
+	public:
+		explicit json_reader_t( std::string data )
+		  : m_data( std::move( data ) ) {}
+
+		results_t parse( ) {
+			results_t results;
+			expect( '{' );
+			while( peek( ) != '}' ) {
+				auto const key = parse_string( );
+				expect( ':' );
+				if( key != "benchmarks" ) {
+					skip_value( );
+				} else {
+					expect( '[' );
+					while( peek( ) != ']' ) {
+						results.insert( parse_case( ) );
+						if( peek( ) == ',' ) {
+							++m_pos;
+						}
+					}
+					expect( ']' );
+				}
+				if( peek( ) == ',' ) {
+					++m_pos;
+				}
+			}
+			return results;
+		}
+	};
+
+	results_t load( std::string const &file_name ) {
+		std::ifstream in( file_name );
+		if( !in ) {
+			throw std::runtime_error( "Could not open '" + file_name + "'" );
+		}
+		std::stringstream ss;
+		ss << in.rdbuf( );
+		return json_reader_t( ss.str( ) ).parse( );
+	}
+
+	struct options_t {
+		std::string baseline_file;
+		std::string current_file;
+		// Allowed slowdown as a fraction of the baseline median
+		double tolerance = 0.10;
+		// Additional slack in noise standard deviations, estimated from the MAD
+		double mad_factor = 3.0;
+		std::vector<std::pair<std::string, double>> case_tolerances;
+		bool strict = false;
+
+		double tolerance_for( std::string const &name ) const {
+			for( auto const &ct : case_tolerances ) {
+				if( name.find( ct.first ) != std::string::npos ) {
+					return ct.second;
+				}
+			}
+			return tolerance;
+		}
+	};
+
+	[[noreturn]] void usage( char const *prog ) {
+		std::cerr << "Usage: " << prog
+		          << " baseline.json current.json [--tolerance fraction]"
+		             " [--mad-factor n] [--case-tolerance substr=fraction]..."
+		             " [--strict]\n";
+		exit( EXIT_FAILURE );
+	}
+
+	options_t parse_options( int argc, char **argv ) {
+		options_t result{};
+		std::vector<std::string> positional;
+		for( int n = 1; n < argc; ++n ) {
+			std::string const arg = argv[n];
+			if( arg == "--strict" ) {
+				result.strict = true;
+			} else if( arg == "--tolerance" && n + 1 < argc ) {
+				result.tolerance = std::stod( argv[++n] );
+			} else if( arg == "--mad-factor" && n + 1 < argc ) {
+				result.mad_factor = std::stod( argv[++n] );
+			} else if( arg == "--case-tolerance" && n + 1 < argc ) {
+				std::string const value = argv[++n];
+				auto const eq = value.rfind( '=' );
+				if( eq == std::string::npos ) {
+					usage( argv[0] );
+				}
+				result.case_tolerances.emplace_back(
+				  value.substr( 0, eq ), std::stod( value.substr( eq + 1 ) ) );
+			} else if( !arg.empty( ) && arg[0] == '-' ) {
+				usage( argv[0] );
+			} else {
+				positional.push_back( arg );
+			}
+		}
+		if( positional.size( ) != 2 ) {
+			usage( argv[0] );
+		}
+		result.baseline_file = positional[0];
+		result.current_file = positional[1];
+		return result;
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	auto const opts = parse_options( argc, argv );
+	results_t baseline;
+	results_t current;
+	try {
+		baseline = load( opts.baseline_file );
+		current = load( opts.current_file );
+	} catch( std::exception const &ex ) {
+		std::cerr << ex.what( ) << '\n';
+		return EXIT_FAILURE;
+	}
+
+	size_t regressions = 0;
+	size_t missing = 0;
+	std::cout << std::left << std::setw( 44 ) << "case" << std::right
+	          << std::setw( 14 ) << "baseline ns" << std::setw( 14 )
+	          << "current ns" << std::setw( 10 ) << "change" << std::setw( 10 )
+	          << "limit" << "  status\n";
+	for( auto const &base : baseline ) {
+		auto const it = current.find( base.first );
+		if( it == current.end( ) ) {
+			++missing;
+			std::cout << std::left << std::setw( 44 ) << base.first << std::right
+			          << std::setw( 14 ) << std::fixed << std::setprecision( 1 )
+			          << base.second.ns_median << std::setw( 14 ) << "-"
+			          << std::setw( 10 ) << "-" << std::setw( 10 ) << "-"
+			          << "  MISSING\n";
+			continue;
+		}
+		auto const &cur = it->second;
+		// Allow the configured fraction plus the noise seen in either run.
+		// 1.4826 * MAD estimates the standard deviation of normal noise
+		auto const noise =
+		  opts.mad_factor * 1.4826 * std::max( base.second.ns_mad, cur.ns_mad );
+		auto const limit =
+		  base.second.ns_median * ( 1.0 + opts.tolerance_for( base.first ) ) +
+		  noise;
+		auto const change =
+		  base.second.ns_median > 0.0
+		    ? ( cur.ns_median - base.second.ns_median ) / base.second.ns_median
+		    : 0.0;
+		auto const limit_change =
+		  base.second.ns_median > 0.0
+		    ? ( limit - base.second.ns_median ) / base.second.ns_median
+		    : 0.0;
+		bool const is_regression = cur.ns_median > limit;
+		regressions += is_regression ? 1 : 0;
+		std::cout << std::left << std::setw( 44 ) << base.first << std::right
+		          << std::fixed << std::setprecision( 1 ) << std::setw( 14 )
+		          << base.second.ns_median << std::setw( 14 ) << cur.ns_median
+		          << std::showpos << std::setw( 9 ) << ( change * 100.0 ) << '%'
+		          << std::setw( 9 ) << ( limit_change * 100.0 ) << '%'
+		          << std::noshowpos
+		          << ( is_regression ? "  REGRESSED" : "  ok" ) << '\n';
+	}
+	for( auto const &cur : current ) {
+		if( baseline.count( cur.first ) == 0 ) {
+			std::cout << std::left << std::setw( 44 ) << cur.first
+			          << "  new case, not in baseline\n";
+		}
+	}
+	std::cout << regressions << " regression(s), " << missing
+	          << " missing case(s)\n";
+	if( regressions > 0 || ( opts.strict && missing > 0 ) ) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+# Runs crypto_benchmark and compares its results against a stored baseline.
+# Invoked by the benchmark_gate target/test as
+#   cmake -DBENCHMARK=<exe> -DCOMPARE=<exe> -DBASELINE=<json> -DOUTPUT=<json>
+#         "-DBENCHMARK_ARGS=<args>" "-DCOMPARE_ARGS=<args>" -P benchmark_gate.cmake
+
+foreach( var BENCHMARK COMPARE BASELINE OUTPUT )
+	if( NOT DEFINED ${var} )
+		message( FATAL_ERROR "benchmark_gate.cmake: ${var} must be defined" )
+	endif( )
+endforeach( )
+
+if( NOT EXISTS "${BASELINE}" )
+	message( FATAL_ERROR "Benchmark baseline '${BASELINE}' does not exist, build the benchmark_baseline target to create it" )
+endif( )
+
+separate_arguments( BENCHMARK_ARG_LIST UNIX_COMMAND "${BENCHMARK_ARGS}" )
+separate_arguments( COMPARE_ARG_LIST UNIX_COMMAND "${COMPARE_ARGS}" )
+
+execute_process( COMMAND "${BENCHMARK}" ${BENCHMARK_ARG_LIST} --quiet --json "${OUTPUT}"
+                 RESULT_VARIABLE benchmark_result )
+if( NOT benchmark_result EQUAL 0 )
+	message( FATAL_ERROR "crypto_benchmark failed: ${benchmark_result}" )
+endif( )
+
+execute_process( COMMAND "${COMPARE}" "${BASELINE}" "${OUTPUT}" ${COMPARE_ARG_LIST}
+                 RESULT_VARIABLE compare_result )
+if( NOT compare_result EQUAL 0 )
+	message( FATAL_ERROR "Performance regression against '${BASELINE}'" )
+endif( )
@@ -0,0 +1,305 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE chacha20_poly1305_test
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "chacha20_poly1305.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> from_hex( std::string const &hex ) {
+		std::vector<uint8_t> result;
+		for( size_t n = 0; n + 1 < hex.size( ); n += 2 ) {
+			result.push_back(
+			  static_cast<uint8_t>( std::stoul( hex.substr( n, 2 ), nullptr, 16 ) ) );
+		}
+		return result;
+	}
+
+	template<typename Array>
+	Array array_from_hex( std::string const &hex ) {
+		auto const bytes = from_hex( hex );
+		Array result{};
+		std::copy( bytes.begin( ), bytes.end( ), result.begin( ) );
+		return result;
+	}
+
+	std::vector<uint8_t> from_string( std::string const &str ) {
+		return std::vector<uint8_t>( str.begin( ), str.end( ) );
+	}
+
+	std::vector<uint8_t> pattern( size_t size, uint32_t seed ) {
+		std::vector<uint8_t> result( size );
+		for( auto &b : result ) {
+			seed = seed * 1103515245u + 12345u;
+			b = static_cast<uint8_t>( seed >> 16u );
+		}
+		return result;
+	}
+
+	daw::span<uint8_t const> cspan( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	daw::span<uint8_t> mspan( std::vector<uint8_t> &v ) {
+		return daw::span<uint8_t>( v.data( ), v.size( ) );
+	}
+
+	template<size_t N>
+	constexpr std::array<uint8_t, N - 1> bytes_of( char const ( &str )[N] ) {
+		std::array<uint8_t, N - 1> result{};
+		for( size_t n = 0; n + 1 < N; ++n ) {
+			result[n] = static_cast<uint8_t>( str[n] );
+		}
+		return result;
+	}
+
+	template<size_t N>
+	constexpr std::array<uint8_t, N> counting_from( uint8_t first ) {
+		std::array<uint8_t, N> result{};
+		for( size_t n = 0; n < N; ++n ) {
+			result[n] = static_cast<uint8_t>( first + n );
+		}
+		return result;
+	}
+
+	std::string const sunscreen =
+	  "Ladies and Gentlemen of the class of '99: If I could offer you only one "
+	  "tip for the future, sunscreen would be it.";
+
+	// RFC 8439 section 2.8.2
+	constexpr poly1305_tag_t aead_vector_tag( ) {
+		auto const key = counting_from<32>( 0x80 );
+		chacha20_nonce_t const nonce = {0x07, 0x00, 0x00, 0x00, 0x40, 0x41,
+		                                0x42, 0x43, 0x44, 0x45, 0x46, 0x47};
+		std::array<uint8_t, 12> const aad = {0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1,
+		                                     0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7};
+		auto const plain = bytes_of(
+		  "Ladies and Gentlemen of the class of '99: If I could offer you only "
+		  "one tip for the future, sunscreen would be it." );
+		std::array<uint8_t, plain.size( )> cipher{};
+		return chacha20_poly1305_seal(
+		  key, nonce, daw::span<uint8_t const>( aad.data( ), aad.size( ) ),
+		  daw::span<uint8_t const>( plain.data( ), plain.size( ) ),
+		  daw::span<uint8_t>( cipher.data( ), cipher.size( ) ) );
+	}
+
+	// RFC 8439 section 2.5.2
+	constexpr poly1305_tag_t poly1305_vector_tag( ) {
+		poly1305_key_t const key = {
+		  0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52,
+		  0xfe, 0x42, 0xd5, 0x06, 0xa8, 0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d,
+		  0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+		auto const message = bytes_of( "Cryptographic Forum Research Group" );
+		poly1305_ctx ctx( key );
+		ctx.update( daw::span<uint8_t const>( message.data( ), message.size( ) ) );
+		return ctx.final( );
+	}
+
+	static_assert( poly1305_vector_tag( )[0] == 0xa8 &&
+	               poly1305_vector_tag( )[15] == 0xa9 );
+	static_assert( aead_vector_tag( )[0] == 0x1a &&
+	               aead_vector_tag( )[15] == 0x91 );
+} // namespace
+
+BOOST_AUTO_TEST_CASE( chacha20_001 ) {
+	// RFC 8439 2.3.2, the block function as key stream
+	auto const key = counting_from<32>( 0 );
+	auto const nonce =
+	  array_from_hex<chacha20_nonce_t>( "000000090000004a00000000" );
+	std::vector<uint8_t> block( 64 );
+	chacha20_xor( key, nonce, 1, cspan( block ), mspan( block ) );
+	BOOST_REQUIRE( block ==
+	               from_hex( "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c06803"
+	                         "0422aa9ac3d46c4ed2826446079faa0914c2d705d98b02a2"
+	                         "b5129cd1de164eb9cbd083e8a2503c4e" ) );
+}
+
+BOOST_AUTO_TEST_CASE( chacha20_002 ) {
+	// RFC 8439 2.4.2
+	auto const key = counting_from<32>( 0 );
+	auto const nonce =
+	  array_from_hex<chacha20_nonce_t>( "000000000000004a00000000" );
+	auto const plain = from_string( sunscreen );
+	std::vector<uint8_t> cipher( plain.size( ) );
+	chacha20_xor( key, nonce, 1, cspan( plain ), mspan( cipher ) );
+	BOOST_REQUIRE(
+	  cipher ==
+	  from_hex( "6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+	            "f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+	            "07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+	            "5af90bbf74a35be6b40b8eedf2785e42874d" ) );
+}
+
+BOOST_AUTO_TEST_CASE( chacha20_003 ) {
+	// The vector kernels and the odd sized tails against the scalar code
+	auto const key = counting_from<32>( 3 );
+	auto const nonce =
+	  array_from_hex<chacha20_nonce_t>( "0102030405060708090a0b0c" );
+	auto const plain = pattern( 5000, 1 );
+	for( size_t size : {0U, 1U, 63U, 64U, 65U, 191U, 200U, 511U, 512U, 513U,
+	                    1023U, 1024U, 1100U, 2047U, 5000U} ) {
+		std::vector<uint8_t> fast( size );
+		std::vector<uint8_t> slow( size );
+		chacha20_xor( key, nonce, 7,
+		              daw::span<uint8_t const>( plain.data( ), size ),
+		              mspan( fast ) );
+		auto state = impl::chacha20_init( key, nonce, 7 );
+		impl::chacha20_xor_scalar( state, plain.data( ), slow.data( ), size );
+		BOOST_REQUIRE( fast == slow );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( poly1305_001 ) {
+	auto const tag = poly1305_vector_tag( );
+	BOOST_REQUIRE( tag == array_from_hex<poly1305_tag_t>(
+	                        "a8061dc1305136c6c22b8baf0c0127a9" ) );
+}
+
+BOOST_AUTO_TEST_CASE( poly1305_002 ) {
+	// The 4 way vector code against a block at a time, for sizes around the
+	// point where it takes over and with every split of a message
+	auto const key = array_from_hex<poly1305_key_t>(
+	  "85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b" );
+	auto const message = pattern( 4000, 2 );
+	for( size_t size = 0; size < 1200; size += 37 ) {
+		poly1305_ctx ctx( key );
+		ctx.update( daw::span<uint8_t const>( message.data( ), size ) );
+		// 16 bytes per update never reaches the vector code
+		poly1305_ctx expected( key );
+		for( size_t n = 0; n < size; n += 16 ) {
+			expected.update( daw::span<uint8_t const>(
+			  message.data( ) + n, std::min<size_t>( 16, size - n ) ) );
+		}
+		BOOST_REQUIRE( ctx.final( ) == expected.final( ) );
+	}
+	// r close to the limits and h that needs the final reduction
+	std::array<uint8_t, 4096> ones{};
+	ones.fill( 0xff );
+	poly1305_key_t max_key{};
+	max_key.fill( 0xff );
+	poly1305_ctx a( max_key );
+	a.update( daw::span<uint8_t const>( ones.data( ), ones.size( ) ) );
+	poly1305_ctx b( max_key );
+	for( size_t n = 0; n < ones.size( ); n += 16 ) {
+		b.update( daw::span<uint8_t const>( ones.data( ) + n, 16 ) );
+	}
+	BOOST_REQUIRE( a.final( ) == b.final( ) );
+}
+
+BOOST_AUTO_TEST_CASE( chacha20_poly1305_001 ) {
+	// RFC 8439 2.8.2
+	auto const key = counting_from<32>( 0x80 );
+	auto const nonce =
+	  array_from_hex<chacha20_nonce_t>( "070000004041424344454647" );
+	auto const aad = from_hex( "50515253c0c1c2c3c4c5c6c7" );
+	auto const plain = from_string( sunscreen );
+	auto const expected_cipher = from_hex(
+	  "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+	  "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+	  "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+	  "3ff4def08e4b7a9de576d26586cec64b6116" );
+	auto const expected_tag =
+	  array_from_hex<poly1305_tag_t>( "1ae10b594f09e26a7e902ecbd0600691" );
+
+	std::vector<uint8_t> cipher( plain.size( ) );
+	auto const tag =
+	  chacha20_poly1305_seal( key, nonce, cspan( aad ), cspan( plain ),
+	                          mspan( cipher ) );
+	BOOST_REQUIRE( cipher == expected_cipher );
+	BOOST_REQUIRE( tag == expected_tag );
+	BOOST_REQUIRE( aead_vector_tag( ) == expected_tag );
+
+	std::vector<uint8_t> decrypted( cipher.size( ) );
+	BOOST_REQUIRE( chacha20_poly1305_open( key, nonce, cspan( aad ),
+	                                       cspan( cipher ), tag,
+	                                       mspan( decrypted ) ) );
+	BOOST_REQUIRE( decrypted == plain );
+
+	// Any change is rejected and nothing is decrypted
+	auto bad_tag = tag;
+	bad_tag[15] ^= 1u;
+	std::vector<uint8_t> untouched( cipher.size( ), 0xAA );
+	BOOST_REQUIRE( !chacha20_poly1305_open( key, nonce, cspan( aad ),
+	                                        cspan( cipher ), bad_tag,
+	                                        mspan( untouched ) ) );
+	auto bad_cipher = cipher;
+	bad_cipher[40] ^= 0x10u;
+	BOOST_REQUIRE( !chacha20_poly1305_open( key, nonce, cspan( aad ),
+	                                        cspan( bad_cipher ), tag,
+	                                        mspan( untouched ) ) );
+	auto bad_aad = aad;
+	bad_aad[0] ^= 1u;
+	BOOST_REQUIRE( !chacha20_poly1305_open( key, nonce, cspan( bad_aad ),
+	                                        cspan( cipher ), tag,
+	                                        mspan( untouched ) ) );
+	BOOST_REQUIRE( untouched == std::vector<uint8_t>( cipher.size( ), 0xAA ) );
+}
+
+BOOST_AUTO_TEST_CASE( chacha20_poly1305_002 ) {
+	// Streaming in uneven pieces, in place, matches the one shot functions
+	auto const key = counting_from<32>( 9 );
+	auto const nonce =
+	  array_from_hex<chacha20_nonce_t>( "000000000001020304050607" );
+	auto const aad = pattern( 45, 3 );
+	for( size_t size : {0U, 15U, 16U, 100U, 700U, 3000U} ) {
+		auto const plain = pattern( size, static_cast<uint32_t>( size ) );
+		std::vector<uint8_t> expected( size );
+		auto const expected_tag = chacha20_poly1305_seal(
+		  key, nonce, cspan( aad ), cspan( plain ), mspan( expected ) );
+
+		auto text = plain;
+		chacha20_poly1305_ctx enc( key, nonce );
+		enc.update_aad( daw::span<uint8_t const>( aad.data( ), 20 ) );
+		enc.update_aad( daw::span<uint8_t const>( aad.data( ) + 20, 25 ) );
+		size_t pos = 0;
+		for( size_t step = 1; pos < size; step = step * 3 + 1 ) {
+			auto const count = std::min( step, size - pos );
+			enc.encrypt_update(
+			  daw::span<uint8_t const>( text.data( ) + pos, count ),
+			  daw::span<uint8_t>( text.data( ) + pos, count ) );
+			pos += count;
+		}
+		BOOST_REQUIRE( text == expected );
+		BOOST_REQUIRE( enc.final( ) == expected_tag );
+
+		chacha20_poly1305_ctx dec( key, nonce );
+		dec.update_aad( cspan( aad ) );
+		for( pos = 0; pos < size; pos += 77 ) {
+			auto const count = std::min<size_t>( 77, size - pos );
+			dec.decrypt_update(
+			  daw::span<uint8_t const>( text.data( ) + pos, count ),
+			  daw::span<uint8_t>( text.data( ) + pos, count ) );
+		}
+		BOOST_REQUIRE( text == plain );
+		BOOST_REQUIRE( dec.verify( expected_tag ) );
+	}
+}
@@ -0,0 +1,548 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <daw/daw_span.h>
+#include <daw/daw_utility.h>
+
+#include "aes.h"
+#include "aes_batch.h"
+#include "aes_ctr_hmac.h"
+#include "chacha20_poly1305.h"
+#include "crypto_benchmark.h"
+#include "crypto_buffer.h"
+#include "csprng.h"
+#include "sha256.h"
+#include "sha256_chunker.h"
+#include "sha256_fixed.h"
+
+namespace {
+	using daw::crypto_bench::benchmark_suite_t;
+	using daw::crypto_bench::do_not_optimize;
+
+	void sha256_benchmarks( benchmark_suite_t &suite,
+	                        daw::crypto::crypto_buffer const &data ) {
+		size_t previous_size = 0;
+		for( auto const sz : suite.sizes( ) ) {
+			if( !suite.size_fits( sz, previous_size ) ) {
+				break;
+			}
+			suite.run( "sha256_bin/" + std::to_string( sz ), sz, [&]( ) {
+				auto const digest = daw::crypto::sha256_bin( data.data( ), sz );
+				do_not_optimize( digest );
+			} );
+			previous_size = sz;
+		}
+
+		size_t const stream_size =
+		  std::min( data.size( ), static_cast<size_t>( 1024 * 1024 ) );
+		for( size_t const chunk : {1U, 7U, 64U, 1000U, 4096U, 65536U} ) {
+			if( chunk > stream_size ) {
+				break;
+			}
+			suite.run( "sha256_ctx/chunk " + std::to_string( chunk ) + "/" +
+			             std::to_string( stream_size ),
+			           stream_size, [&]( ) {
+				           daw::crypto::sha256_ctx ctx{};
+				           size_t pos = 0;
+				           while( pos < stream_size ) {
+					           auto const len = std::min( chunk, stream_size - pos );
+					           ctx.update( data.data( ) + pos, len );
+					           pos += len;
+				           }
+				           auto const digest = ctx.final( );
+				           do_not_optimize( digest );
+			           } );
+		}
+
+		// update( first, last ) over the containers with their own fast paths
+		// and a list, which goes through the staging buffer
+		std::vector<uint8_t> const vec( data.data( ), data.data( ) + stream_size );
+		std::deque<uint8_t> const deq( vec.begin( ), vec.end( ) );
+		std::list<uint8_t> const lst( vec.begin( ), vec.end( ) );
+		auto const iterator_case = [&]( std::string const &name,
+		                                auto const &container ) {
+			suite.run( "sha256_ctx/iterator " + name + "/" +
+			             std::to_string( stream_size ),
+			           stream_size, [&]( ) {
+				           daw::crypto::sha256_ctx ctx{};
+				           ctx.update( container.begin( ), container.end( ) );
+				           auto const digest = ctx.final( );
+				           do_not_optimize( digest );
+			           } );
+		};
+		iterator_case( "vector", vec );
+		iterator_case( "deque", deq );
+		iterator_case( "list", lst );
+
+		// A packet made of a small header, uneven payload pieces and a trailer,
+		// hashed as fragments or concatenated first
+		std::vector<daw::span<uint8_t const>> fragments;
+		size_t packet_size = 0;
+		for( size_t const len : {14U, 20U, 8U, 700U, 333U, 411U, 4U} ) {
+			fragments.emplace_back( data.data( ) + packet_size, len );
+			packet_size += len;
+		}
+		suite.run( "sha256_ctx/fragments/" + std::to_string( packet_size ),
+		           packet_size, [&]( ) {
+			           daw::crypto::sha256_ctx ctx{};
+			           ctx.update( daw::span<daw::span<uint8_t const> const>(
+			             fragments.data( ), fragments.size( ) ) );
+			           auto const digest = ctx.final( );
+			           do_not_optimize( digest );
+		           } );
+		suite.run( "sha256_ctx/concatenate/" + std::to_string( packet_size ),
+		           packet_size, [&]( ) {
+			           std::vector<uint8_t> joined;
+			           for( auto const &f : fragments ) {
+				           joined.insert( joined.end( ), f.begin( ), f.end( ) );
+			           }
+			           daw::crypto::sha256_ctx ctx{};
+			           ctx.update( joined.data( ), joined.size( ) );
+			           auto const digest = ctx.final( );
+			           do_not_optimize( digest );
+		           } );
+	}
+
+	// Generic one shot hashing against the fixed length kernels and their
+	// multi lane batches, all on the same digests
+	void sha256_fixed_benchmarks( benchmark_suite_t &suite,
+	                              daw::crypto::crypto_buffer const &data ) {
+		using daw::crypto::sha256_packed_digest_t;
+		size_t const batch_size = 1024;
+		std::vector<sha256_packed_digest_t> digests( batch_size );
+		for( size_t n = 0; n < batch_size; ++n ) {
+			digests[n] = daw::crypto::to_packed_digest(
+			  daw::crypto::sha256_bin( data.data( ) + n, 32 ) );
+		}
+		std::vector<sha256_packed_digest_t> out( batch_size );
+		auto const in = daw::span<sha256_packed_digest_t const>(
+		  digests.data( ), digests.size( ) );
+		auto const out_span =
+		  daw::span<sha256_packed_digest_t>( out.data( ), out.size( ) );
+		auto const message32 = daw::span<uint8_t const>( digests[0].data( ), 32 );
+		// The first two digests, copied into one 64 byte message
+		std::array<uint8_t, 64> pair{};
+		std::copy( digests[0].begin( ), digests[0].end( ), pair.begin( ) );
+		std::copy( digests[1].begin( ), digests[1].end( ), pair.begin( ) + 32 );
+		auto const message64 =
+		  daw::span<uint8_t const>( pair.data( ), pair.size( ) );
+
+		suite.run( "sha256_32/generic", 32, [&]( ) {
+			auto const digest =
+			  daw::crypto::sha256_bin( message32.data( ), message32.size( ) );
+			do_not_optimize( digest );
+		} );
+		suite.run( "sha256_32/fixed", 32, [&]( ) {
+			auto const digest = daw::crypto::sha256_32( message32 );
+			do_not_optimize( digest );
+		} );
+		suite.run( "sha256_32/batch " + std::to_string( batch_size ),
+		           32 * batch_size, [&]( ) {
+			           daw::crypto::sha256_32_batch( in, out_span );
+			           do_not_optimize( out.data( ) );
+		           } );
+
+		suite.run( "sha256_64/generic", 64, [&]( ) {
+			auto const digest =
+			  daw::crypto::sha256_bin( message64.data( ), message64.size( ) );
+			do_not_optimize( digest );
+		} );
+		suite.run( "sha256_64/fixed", 64, [&]( ) {
+			auto const digest = daw::crypto::sha256_64( message64 );
+			do_not_optimize( digest );
+		} );
+		suite.run( "sha256_64/batch " + std::to_string( batch_size / 2 ),
+		           32 * batch_size, [&]( ) {
+			           daw::crypto::sha256_64_batch( in, out_span );
+			           do_not_optimize( out.data( ) );
+		           } );
+
+		suite.run( "sha256d_64/generic", 64, [&]( ) {
+			auto const first = daw::crypto::to_packed_digest(
+			  daw::crypto::sha256_bin( message64.data( ), message64.size( ) ) );
+			auto const digest =
+			  daw::crypto::sha256_bin( first.data( ), first.size( ) );
+			do_not_optimize( digest );
+		} );
+		suite.run( "sha256d_64/fixed", 64, [&]( ) {
+			auto const digest = daw::crypto::sha256d( message64 );
+			do_not_optimize( digest );
+		} );
+		suite.run( "sha256d_64/batch " + std::to_string( batch_size / 2 ),
+		           32 * batch_size, [&]( ) {
+			           daw::crypto::sha256d_64_batch( in, out_span );
+			           do_not_optimize( out.data( ) );
+		           } );
+	}
+
+	// Combined chunk and hash against finding all cut points first and then
+	// hashing each chunk, which reads every byte twice
+	void sha256_chunker_benchmarks( benchmark_suite_t &suite,
+	                                daw::crypto::crypto_buffer const &data ) {
+		using daw::crypto::sha256_chunk_t;
+		size_t const size =
+		  std::min( data.size( ), static_cast<size_t>( 16 * 1024 * 1024 ) );
+		auto const input = daw::span<uint8_t const>( data.data( ), size );
+
+		suite.run( "sha256_chunker/two pass/" + std::to_string( size ), size,
+		           [&]( ) {
+			           daw::crypto::impl::gear_cutter_t cutter( {} );
+			           std::vector<std::pair<size_t, size_t>> chunks;
+			           size_t start = 0;
+			           size_t pos = 0;
+			           while( pos < size ) {
+				           auto const r =
+				             cutter.scan( input.data( ) + pos, size - pos );
+				           pos += r.first;
+				           if( r.second || pos == size ) {
+					           chunks.emplace_back( start, pos - start );
+					           start = pos;
+				           }
+			           }
+			           for( auto const &c : chunks ) {
+				           auto const digest = daw::crypto::sha256_bin(
+				             input.data( ) + c.first, c.second );
+				           do_not_optimize( digest );
+			           }
+		           } );
+
+		suite.run( "sha256_chunker/combined/" + std::to_string( size ), size,
+		           [&]( ) {
+			           auto const chunks = daw::crypto::sha256_chunks( input );
+			           do_not_optimize( chunks.data( ) );
+		           } );
+
+		size_t const stream_chunk = 65536;
+		suite.run( "sha256_chunker/streaming " + std::to_string( stream_chunk ) +
+		             "/" + std::to_string( size ),
+		           size, [&]( ) {
+			           daw::crypto::sha256_chunker chunker{};
+			           size_t count = 0;
+			           auto const on_chunk = [&count]( sha256_chunk_t const & ) {
+				           ++count;
+			           };
+			           for( size_t pos = 0; pos < size; pos += stream_chunk ) {
+				           auto const len = std::min( stream_chunk, size - pos );
+				           chunker.update( input.subset( pos, len ), on_chunk );
+			           }
+			           chunker.final( on_chunk );
+			           do_not_optimize( count );
+		           } );
+	}
+
+	// Packets each under their own key.  A CBC chain is serial, so one message
+	// at a time leaves the AES unit waiting on every round unless out of order
+	// execution can overlap the next message
+	void aes_batch_benchmarks( benchmark_suite_t &suite,
+	                           daw::crypto::crypto_buffer const &data ) {
+		namespace aes = daw::crypto::aes;
+		for( auto const &shape : {std::pair<size_t, size_t>{64, 32},
+		                          std::pair<size_t, size_t>{8, 1024}} ) {
+			size_t const packets = shape.first;
+			size_t const packet_size = shape.second;
+			std::vector<aes::aes128_key_schedule_t> schedules;
+			for( size_t n = 0; n < packets; ++n ) {
+				schedules.push_back( aes::impl::aes128_key_schedule(
+				  daw::span<uint8_t const>( data.data( ) + n * 16, 16 ) ) );
+			}
+			std::vector<uint8_t> output( packets * packet_size );
+			std::vector<aes::aes128_cbc_job_t> jobs;
+			for( size_t n = 0; n < packets; ++n ) {
+				jobs.push_back( aes::aes128_cbc_job_t{
+				  &schedules[n], aes::cipher_t{},
+				  daw::span<uint8_t const>( data.data( ) + n * packet_size,
+				                            packet_size ),
+				  daw::span<uint8_t>( output.data( ) + n * packet_size,
+				                      packet_size )} );
+			}
+			auto const job_span =
+			  daw::span<aes::aes128_cbc_job_t const>( jobs.data( ), jobs.size( ) );
+			auto const name = [&]( std::string const &variant ) {
+				return "aes128_cbc_batch/" + variant + "/" + std::to_string( packets ) +
+				       "x" + std::to_string( packet_size );
+			};
+
+			suite.run( name( "portable" ), output.size( ), [&]( ) {
+				for( auto const &job : jobs ) {
+					aes::impl::aes_encrypt_128_cbc_portable( job );
+				}
+				do_not_optimize( output.data( ) );
+			} );
+#if defined( __AES__ )
+			suite.run( name( "aesni 1 lane" ), output.size( ), [&]( ) {
+				aes::impl::aes_encrypt_128_cbc_lanes<1>( job_span );
+				do_not_optimize( output.data( ) );
+			} );
+			suite.run( name( "aesni 4 lanes" ), output.size( ), [&]( ) {
+				aes::impl::aes_encrypt_128_cbc_lanes<4>( job_span );
+				do_not_optimize( output.data( ) );
+			} );
+			suite.run( name( "aesni 8 lanes" ), output.size( ), [&]( ) {
+				aes::impl::aes_encrypt_128_cbc_lanes<8>( job_span );
+				do_not_optimize( output.data( ) );
+			} );
+#endif
+		}
+	}
+
+	// The AEAD for hosts without AES-NI, with the vector kernels and the
+	// scalar code side by side at one size
+	void chacha20_poly1305_benchmarks( benchmark_suite_t &suite,
+	                                   daw::crypto::crypto_buffer const &data ) {
+		daw::crypto::chacha20_key_t key{};
+		std::copy( data.data( ), data.data( ) + key.size( ), key.begin( ) );
+		daw::crypto::chacha20_nonce_t const nonce{};
+		std::vector<uint8_t> output;
+		size_t previous_size = 0;
+		for( auto const sz : suite.sizes( ) ) {
+			if( !suite.size_fits( sz, previous_size ) ) {
+				break;
+			}
+			if( output.size( ) < sz ) {
+				output.resize( sz );
+			}
+			auto const input = daw::span<uint8_t const>( data.data( ), sz );
+			auto const out = daw::span<uint8_t>( output.data( ), sz );
+			suite.run( "chacha20_poly1305/seal/" + std::to_string( sz ), sz, [&]( ) {
+				auto const tag = daw::crypto::chacha20_poly1305_seal(
+				  key, nonce, daw::span<uint8_t const>( ), input, out );
+				do_not_optimize( tag );
+			} );
+			previous_size = sz;
+		}
+
+		size_t const sz = std::min( data.size( ), static_cast<size_t>( 16384 ) );
+		output.resize( std::max( output.size( ), sz ) );
+		suite.run( "chacha20/xor/" + std::to_string( sz ), sz, [&]( ) {
+			daw::crypto::chacha20_xor( key, nonce, 1,
+			                           daw::span<uint8_t const>( data.data( ), sz ),
+			                           daw::span<uint8_t>( output.data( ), sz ) );
+			do_not_optimize( output.data( ) );
+		} );
+		suite.run( "chacha20/xor scalar/" + std::to_string( sz ), sz, [&]( ) {
+			auto state = daw::crypto::impl::chacha20_init( key, nonce, 1 );
+			daw::crypto::impl::chacha20_xor_scalar( state, data.data( ),
+			                                        output.data( ), sz );
+			do_not_optimize( output.data( ) );
+		} );
+		suite.run( "poly1305/" + std::to_string( sz ), sz, [&]( ) {
+			daw::crypto::poly1305_ctx ctx( key );
+			ctx.update( daw::span<uint8_t const>( data.data( ), sz ) );
+			auto const tag = ctx.final( );
+			do_not_optimize( tag );
+		} );
+		suite.run( "poly1305 scalar/" + std::to_string( sz ), sz, [&]( ) {
+			auto state = daw::crypto::impl::poly1305_init( key );
+			daw::crypto::impl::poly1305_blocks_scalar(
+			  state, data.data( ), sz / 16, daw::crypto::impl::poly1305_hibit );
+			auto const tag = daw::crypto::impl::poly1305_finish( state );
+			do_not_optimize( tag );
+		} );
+	}
+
+	// CTR on its own and sealed with HMAC-SHA256, where the hash sets the pace
+	void aes_ctr_hmac_benchmarks( benchmark_suite_t &suite,
+	                              daw::crypto::crypto_buffer const &data ) {
+		namespace aes = daw::crypto::aes;
+		auto const enc_key = daw::span<uint8_t const>(
+		  data.data( ), aes::impl::AES128_KEY_SIZE::value );
+		auto const mac_key = daw::span<uint8_t const>( data.data( ) + 16, 32 );
+		auto const sched = aes::impl::aes128_key_schedule( enc_key );
+		aes::cipher_t const iv{};
+		std::vector<uint8_t> output;
+		size_t previous_size = 0;
+		for( auto const sz : suite.sizes( ) ) {
+			if( !suite.size_fits( sz, previous_size ) ) {
+				break;
+			}
+			if( output.size( ) < sz ) {
+				output.resize( sz );
+			}
+			auto const input = daw::span<uint8_t const>( data.data( ), sz );
+			auto const out = daw::span<uint8_t>( output.data( ), sz );
+			suite.run( "aes128_ctr/" + std::to_string( sz ), sz, [&]( ) {
+				aes::aes_ctr_128( sched, iv, input, out );
+				do_not_optimize( output.data( ) );
+			} );
+			suite.run( "aes128_ctr_hmac/seal/" + std::to_string( sz ), sz, [&]( ) {
+				auto const tag =
+				  aes::aes128_ctr_hmac_seal( enc_key, mac_key, iv, input, out );
+				do_not_optimize( tag );
+			} );
+			previous_size = sz;
+		}
+	}
+
+	void hex_benchmarks( benchmark_suite_t &suite ) {
+		auto const digest = daw::crypto::sha256_bin( "Hello World" );
+		suite.run( "hex/sha256_hash_string", 32, [&]( ) {
+			auto const str = daw::crypto::sha256_hash_string( digest );
+			do_not_optimize( str );
+		} );
+		suite.run( "hex/to_hex_string", 32, [&]( ) {
+			auto const str = digest.to_hex_string( );
+			do_not_optimize( str );
+		} );
+	}
+
+	void aes_benchmarks( benchmark_suite_t &suite,
+	                     daw::crypto::crypto_buffer const &data ) {
+		namespace aes = daw::crypto::aes;
+		std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value> const key = {
+		  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+		  0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+		auto const key_view = daw::make_array_view( key );
+
+		suite.run( "aes128/key_schedule", aes::impl::AES128_KEY_SIZE::value,
+		           [&]( ) {
+			           auto const sched = aes::impl::aes128_key_schedule( key_view );
+			           do_not_optimize( sched );
+		           } );
+
+		auto const block = daw::span<uint8_t const>(
+		  data.data( ), aes::impl::AES_BLOCK_SIZE::value );
+		suite.run( "aes128/encrypt_block", aes::impl::AES_BLOCK_SIZE::value,
+		           [&]( ) {
+			           auto const cipher =
+			             aes::impl::aes_encrypt_128_block( block, key_view );
+			           do_not_optimize( cipher );
+		           } );
+		suite.run( "aes128/decrypt_block", aes::impl::AES_BLOCK_SIZE::value,
+		           [&]( ) {
+			           auto const plain =
+			             aes::impl::aes_decrypt_128_block( block, key_view );
+			           do_not_optimize( plain );
+		           } );
+
+		std::vector<uint8_t> output;
+		size_t previous_size = 0;
+		for( auto const sz : suite.sizes( ) ) {
+			if( !suite.size_fits( sz, previous_size ) ) {
+				break;
+			}
+			if( output.size( ) < sz ) {
+				output.resize( sz );
+			}
+			auto const input = daw::span<uint8_t const>( data.data( ), sz );
+			auto const out = daw::span<uint8_t>( output.data( ), sz );
+			suite.run( "aes128/encrypt/" + std::to_string( sz ), sz, [&]( ) {
+				aes::aes_encrypt_128( input, key_view, out );
+				do_not_optimize( output.data( ) );
+			} );
+			previous_size = sz;
+		}
+
+		previous_size = 0;
+		for( auto const sz : suite.sizes( ) ) {
+			if( !suite.size_fits( sz, previous_size ) ) {
+				break;
+			}
+			auto const input = daw::span<uint8_t const>( data.data( ), sz );
+			suite.run( "aes128/decrypt/" + std::to_string( sz ), sz, [&]( ) {
+				auto in = input;
+				auto pos = output.data( );
+				while( in.size( ) >= aes::impl::AES_BLOCK_SIZE::value ) {
+					auto const plain = aes::impl::aes_decrypt_128_block(
+					  in.subset( 0, aes::impl::AES_BLOCK_SIZE::value ), key_view );
+					std::copy( plain.cbegin( ), plain.cend( ), pos );
+					pos += aes::impl::AES_BLOCK_SIZE::value;
+					in.remove_prefix( aes::impl::AES_BLOCK_SIZE::value );
+				}
+				do_not_optimize( output.data( ) );
+			} );
+			previous_size = sz;
+		}
+	}
+
+	// What the hooks saw over the whole run, when they are compiled in
+	void print_telemetry( std::ostream &os ) {
+		auto const snapshot = daw::crypto::telemetry_snapshot( );
+		os << "\ntelemetry\n";
+		for( size_t op = 0; op < daw::crypto::telemetry_op_count; ++op ) {
+			auto const o = static_cast<daw::crypto::telemetry_op_t>( op );
+			for( size_t b = 0; b < daw::crypto::telemetry_backend_count; ++b ) {
+				auto const backend = static_cast<daw::crypto::telemetry_backend_t>( b );
+				auto const &counts = snapshot.get( o, backend );
+				if( counts.calls == 0 && counts.bytes == 0 ) {
+					continue;
+				}
+				auto const &latency = snapshot.latency_of( o );
+				os << "  " << std::left << std::setw( 12 ) << to_string( o )
+				   << std::setw( 8 ) << to_string( backend ) << std::right
+				   << std::setw( 14 ) << counts.calls << " calls" << std::setw( 16 )
+				   << counts.bytes << " bytes  p50 <" << latency.percentile_ns( 0.5 )
+				   << "ns p99 <" << latency.percentile_ns( 0.99 ) << "ns\n";
+			}
+		}
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	auto const opts = daw::crypto_bench::benchmark_options_t::parse( argc, argv );
+	benchmark_suite_t suite( opts );
+
+	daw::crypto::buffer_options_t data_options{};
+	data_options.huge_pages = daw::crypto::huge_pages_t::transparent;
+	auto const data = daw::crypto::secure_random_buffer(
+	  std::max( opts.max_size, static_cast<size_t>( 1024 * 1024 ) ),
+	  data_options );
+
+	if( !opts.quiet ) {
+		suite.print_header( std::cout );
+	}
+	sha256_benchmarks( suite, data );
+	sha256_fixed_benchmarks( suite, data );
+	sha256_chunker_benchmarks( suite, data );
+	hex_benchmarks( suite );
+	aes_benchmarks( suite, data );
+	aes_batch_benchmarks( suite, data );
+	aes_ctr_hmac_benchmarks( suite, data );
+	chacha20_poly1305_benchmarks( suite, data );
+	if( daw::crypto::telemetry_enabled( ) && !opts.quiet ) {
+		print_telemetry( std::cout );
+	}
+
+	if( opts.json_file == "-" ) {
+		suite.write_json( std::cout );
+	} else if( !opts.json_file.empty( ) ) {
+		std::ofstream out( opts.json_file, std::ios::trunc );
+		if( !out ) {
+			std::cerr << "Could not open '" << opts.json_file << "'\n";
+			return EXIT_FAILURE;
+		}
+		suite.write_json( out );
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,433 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define DAW_CRYPTO_BENCH_HAS_TSC
+#endif
+
+namespace daw {
+	namespace crypto_bench {
+		template<typename T>
+		inline void do_not_optimize( T const &value ) noexcept {
+#if defined( __GNUC__ ) || defined( __clang__ )
+			asm volatile( "" : : "g"( &value ) : "memory" );
+#else
+			static volatile char const *sink;
+			sink = reinterpret_cast<char const volatile *>( &value );
+#endif
+		}
+
+		inline uint64_t read_cycles( ) noexcept {
+#if defined( DAW_CRYPTO_BENCH_HAS_TSC )
+			return static_cast<uint64_t>( __rdtsc( ) );
+#else
+			return 0;
+#endif
+		}
+
+		struct benchmark_options_t {
+			std::string filter;
+			std::string json_file;
+			size_t min_size = 16;
+			size_t max_size = 1024ULL * 1024ULL * 1024ULL;
+			double min_time = 0.25;
+			double max_op_time = 10.0;
+			size_t min_samples = 3;
+			size_t max_samples = 100'000;
+			size_t repetitions = 1;
+			bool quiet = false;
+			bool counters = false;
+
+			/// @brief Parse --name value style options.  Unknown options print usage
+			/// and exit
+			static benchmark_options_t parse( int argc, char **argv ) {
+				benchmark_options_t result{};
+				auto const usage = [&]( ) {
+					std::cerr
+					  << "Usage: " << argv[0]
+					  << " [--filter substr] [--json file|-] [--min-size bytes]"
+					     " [--max-size bytes] [--min-time seconds]"
+					     " [--max-op-time seconds] [--min-samples n]"
+					     " [--repetitions n] [--counters] [--quiet]\n";
+					exit( EXIT_FAILURE );
+				};
+				for( int n = 1; n < argc; ++n ) {
+					std::string const arg = argv[n];
+					if( arg == "--quiet" ) {
+						result.quiet = true;
+						continue;
+					}
+					if( arg == "--counters" ) {
+						result.counters = true;
+						continue;
+					}
+					if( n + 1 >= argc ) {
+						usage( );
+					}
+					std::string const value = argv[++n];
+					if( arg == "--filter" ) {
+						result.filter = value;
+					} else if( arg == "--json" ) {
+						result.json_file = value;
+					} else if( arg == "--min-size" ) {
+						result.min_size = std::stoull( value );
+					} else if( arg == "--max-size" ) {
+						result.max_size = std::stoull( value );
+					} else if( arg == "--min-time" ) {
+						result.min_time = std::stod( value );
+					} else if( arg == "--max-op-time" ) {
+						result.max_op_time = std::stod( value );
+					} else if( arg == "--repetitions" ) {
+						result.repetitions = std::max<size_t>( 1, std::stoull( value ) );
+					} else if( arg == "--min-samples" ) {
+						result.min_samples = std::max<size_t>( 1, std::stoull( value ) );
+					} else {
+						usage( );
+					}
+				}
+				// Sizes grow by multiplying, so 0 would never reach max_size
+				if( result.min_size == 0 || result.min_size > result.max_size ) {
+					std::cerr << "--min-size must be at least 1 and at most --max-size\n";
+					usage( );
+				}
+				return result;
+			}
+		};
+
+		struct benchmark_result_t {
+			std::string name;
+			size_t bytes_per_op = 0;
+			size_t ops = 0;
+			size_t repetitions = 0;
+			double ns_min = 0.0;
+			// Median of the per repetition medians
+			double ns_median = 0.0;
+			// Median absolute deviation of the per repetition medians, or of the
+			// samples when there is a single repetition
+			double ns_mad = 0.0;
+			double ns_p90 = 0.0;
+			double ns_p99 = 0.0;
+			double cycles_per_op = 0.0;
+			// Hardware counts per call, empty unless run with --counters
+			perf_values_t counters{};
+
+			double mb_per_second( ) const noexcept {
+				if( ns_median <= 0.0 ) {
+					return 0.0;
+				}
+				return ( static_cast<double>( bytes_per_op ) * 1.0e9 / ns_median ) /
+				       ( 1024.0 * 1024.0 );
+			}
+
+			/// @brief Core cycles per byte when they were counted, otherwise TSC
+			/// reference cycles per byte
+			double cycles_per_byte( ) const noexcept {
+				if( bytes_per_op == 0 ) {
+					return 0.0;
+				}
+				if( counters.has( perf_event_t::cycles ) ) {
+					return counters.get( perf_event_t::cycles ) /
+					       static_cast<double>( bytes_per_op );
+				}
+				return cycles_per_op / static_cast<double>( bytes_per_op );
+			}
+		};
+
+		namespace impl {
+			// Nearest rank percentile of a sorted sample set
+			inline double percentile( std::vector<double> const &sorted,
+			                          double pct ) noexcept {
+				if( sorted.empty( ) ) {
+					return 0.0;
+				}
+				auto const rank =
+				  static_cast<size_t>( pct * static_cast<double>( sorted.size( ) - 1 ) );
+				return sorted[rank];
+			}
+
+			inline double
+			median_absolute_deviation( std::vector<double> const &sorted ) {
+				auto const median = percentile( sorted, 0.5 );
+				std::vector<double> deviations;
+				deviations.reserve( sorted.size( ) );
+				for( auto v : sorted ) {
+					deviations.push_back( v < median ? median - v : v - median );
+				}
+				std::sort( deviations.begin( ), deviations.end( ) );
+				return percentile( deviations, 0.5 );
+			}
+
+			inline void write_json_string( std::ostream &os,
+			                               std::string const &str ) {
+				os << '"';
+				for( auto c : str ) {
+					if( c == '"' || c == '\\' ) {
+						os << '\\';
+					}
+					os << c;
+				}
+				os << '"';
+			}
+		} // namespace impl
+
+		/// @brief Collects and reports timings for a set of named cases.  Each
+		/// sample times a batch of calls large enough to swamp timer overhead;
+		/// latencies are reported per call
+		class benchmark_suite_t {
+			benchmark_options_t m_opts;
+			std::vector<benchmark_result_t> m_results;
+			double m_last_op_seconds = 0.0;
+			std::unique_ptr<perf_counters_t> m_counters;
+
+			using clock_t = std::chrono::steady_clock;
+
+			bool has_counters( ) const noexcept {
+				return m_counters && m_counters->valid( );
+			}
+
+		public:
+			explicit benchmark_suite_t( benchmark_options_t opts )
+			  : m_opts( std::move( opts ) ) {
+				if( m_opts.counters ) {
+					m_counters = std::make_unique<perf_counters_t>( );
+					report_perf_unavailable( *m_counters );
+				}
+			}
+
+			benchmark_options_t const &options( ) const noexcept {
+				return m_opts;
+			}
+
+			std::vector<benchmark_result_t> const &results( ) const noexcept {
+				return m_results;
+			}
+
+			bool is_selected( std::string const &name ) const {
+				return m_opts.filter.empty( ) ||
+				       name.find( m_opts.filter ) != std::string::npos;
+			}
+
+			/// @brief Sizes from min_size to max_size in steps of 4x
+			std::vector<size_t> sizes( ) const {
+				std::vector<size_t> result;
+				for( size_t sz = m_opts.min_size; sz <= m_opts.max_size; sz *= 4 ) {
+					result.push_back( sz );
+					if( sz > m_opts.max_size / 4 ) {
+						break;
+					}
+				}
+				return result;
+			}
+
+			/// @brief Should a size sweep continue to size given that the previous
+			/// size took m_last_op_seconds per operation
+			bool size_fits( size_t size, size_t previous_size ) const noexcept {
+				if( previous_size == 0 || m_last_op_seconds <= 0.0 ) {
+					return true;
+				}
+				auto const estimate = m_last_op_seconds *
+				                      static_cast<double>( size ) /
+				                      static_cast<double>( previous_size );
+				return estimate <= m_opts.max_op_time;
+			}
+
+			template<typename Function>
+			void run( std::string const &name, size_t bytes_per_op,
+			          Function &&func ) {
+				if( !is_selected( name ) ) {
+					m_last_op_seconds = 0.0;
+					return;
+				}
+				// Size the batch so a sample is at least ~10us
+				auto const first_start = clock_t::now( );
+				func( );
+				auto const first_ns = static_cast<double>(
+				  std::chrono::duration_cast<std::chrono::nanoseconds>(
+				    clock_t::now( ) - first_start )
+				    .count( ) );
+				size_t batch = 1;
+				if( first_ns < 10'000.0 ) {
+					batch =
+					  static_cast<size_t>( 10'000.0 / std::max( first_ns, 1.0 ) ) + 1;
+				}
+
+				std::vector<double> samples;
+				std::vector<double> cycle_samples;
+				std::vector<double> repetition_medians;
+				auto const min_ns = m_opts.min_time * 1.0e9;
+				// The counters span every sample, the clock reads between batches
+				// are small next to a 10us batch
+				if( has_counters( ) ) {
+					m_counters->start( );
+				}
+				for( size_t rep = 0; rep < m_opts.repetitions; ++rep ) {
+					std::vector<double> rep_samples;
+					double total_ns = 0.0;
+					while( rep_samples.size( ) < m_opts.max_samples &&
+					       ( rep_samples.size( ) < m_opts.min_samples ||
+					         total_ns < min_ns ) ) {
+						auto const c0 = read_cycles( );
+						auto const t0 = clock_t::now( );
+						for( size_t n = 0; n < batch; ++n ) {
+							func( );
+						}
+						auto const t1 = clock_t::now( );
+						auto const c1 = read_cycles( );
+						auto const ns = static_cast<double>(
+						  std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 )
+						    .count( ) );
+						total_ns += ns;
+						rep_samples.push_back( ns / static_cast<double>( batch ) );
+						cycle_samples.push_back( static_cast<double>( c1 - c0 ) /
+						                         static_cast<double>( batch ) );
+					}
+					std::sort( rep_samples.begin( ), rep_samples.end( ) );
+					repetition_medians.push_back( impl::percentile( rep_samples, 0.5 ) );
+					samples.insert( samples.end( ), rep_samples.cbegin( ),
+					                rep_samples.cend( ) );
+				}
+				perf_values_t counts{};
+				if( has_counters( ) ) {
+					counts = m_counters->stop( );
+				}
+				std::sort( samples.begin( ), samples.end( ) );
+				std::sort( cycle_samples.begin( ), cycle_samples.end( ) );
+				std::sort( repetition_medians.begin( ), repetition_medians.end( ) );
+
+				benchmark_result_t result{};
+				result.name = name;
+				result.bytes_per_op = bytes_per_op;
+				result.ops = samples.size( ) * batch;
+				result.repetitions = repetition_medians.size( );
+				result.ns_min = samples.front( );
+				result.ns_p90 = impl::percentile( samples, 0.9 );
+				result.ns_p99 = impl::percentile( samples, 0.99 );
+				result.cycles_per_op = impl::percentile( cycle_samples, 0.5 );
+				result.counters = counts.per_op( result.ops );
+				if( repetition_medians.size( ) > 1 ) {
+					result.ns_median = impl::percentile( repetition_medians, 0.5 );
+					result.ns_mad =
+					  impl::median_absolute_deviation( repetition_medians );
+				} else {
+					result.ns_median = impl::percentile( samples, 0.5 );
+					result.ns_mad = impl::median_absolute_deviation( samples );
+				}
+				m_last_op_seconds = result.ns_median / 1.0e9;
+				if( !m_opts.quiet ) {
+					print_result( std::cout, result );
+				}
+				m_results.push_back( std::move( result ) );
+			}
+
+			void print_header( std::ostream &os ) const {
+				os << std::left << std::setw( 44 ) << "case" << std::right
+				   << std::setw( 12 ) << "bytes" << std::setw( 14 ) << "median ns"
+				   << std::setw( 14 ) << "p90 ns" << std::setw( 14 ) << "p99 ns"
+				   << std::setw( 12 ) << "MB/s" << std::setw( 10 ) << "cyc/B";
+				if( has_counters( ) ) {
+					os << std::setw( 8 ) << "IPC" << std::setw( 12 ) << "L1D m/KiB"
+					   << std::setw( 12 ) << "LLC m/KiB" << std::setw( 12 )
+					   << "br m/KiB";
+				}
+				os << '\n';
+			}
+
+			void print_result( std::ostream &os,
+			                   benchmark_result_t const &r ) const {
+				os << std::left << std::setw( 44 ) << r.name << std::right
+				   << std::setw( 12 ) << r.bytes_per_op << std::fixed
+				   << std::setprecision( 1 ) << std::setw( 14 ) << r.ns_median
+				   << std::setw( 14 ) << r.ns_p90 << std::setw( 14 ) << r.ns_p99
+				   << std::setprecision( 2 ) << std::setw( 12 ) << r.mb_per_second( )
+				   << std::setw( 10 ) << r.cycles_per_byte( );
+				if( has_counters( ) ) {
+					auto const column = [&]( int width, bool has, double value ) {
+						os << std::setw( width );
+						if( has ) {
+							os << value;
+						} else {
+							os << "n/a";
+						}
+					};
+					auto const &c = r.counters;
+					column( 8,
+					        c.has( perf_event_t::cycles ) &&
+					          c.has( perf_event_t::instructions ),
+					        c.ipc( ) );
+					for( auto event :
+					     {perf_event_t::l1d_misses, perf_event_t::llc_misses,
+					      perf_event_t::branch_misses} ) {
+						column( 12, c.has( event ), c.per_kib( event, r.bytes_per_op ) );
+					}
+				}
+				os << '\n' << std::defaultfloat;
+			}
+
+			void write_json( std::ostream &os ) const {
+				os << "{\n  \"benchmarks\": [";
+				bool is_first = true;
+				for( auto const &r : m_results ) {
+					os << ( is_first ? "\n" : ",\n" ) << "    {\"name\": ";
+					is_first = false;
+					impl::write_json_string( os, r.name );
+					os << ", \"bytes\": " << r.bytes_per_op << ", \"ops\": " << r.ops
+					   << ", \"repetitions\": " << r.repetitions
+					   << std::setprecision( 17 ) << ", \"ns_min\": " << r.ns_min
+					   << ", \"ns_median\": " << r.ns_median
+					   << ", \"ns_mad\": " << r.ns_mad
+					   << ", \"ns_p90\": " << r.ns_p90 << ", \"ns_p99\": " << r.ns_p99
+					   << ", \"mb_per_s\": " << r.mb_per_second( )
+					   << ", \"cycles_per_byte\": " << r.cycles_per_byte( );
+					for( size_t n = 0; n < perf_event_count; ++n ) {
+						auto const event = static_cast<perf_event_t>( n );
+						if( r.counters.has( event ) ) {
+							os << ", \"" << to_string( event )
+							   << "_per_op\": " << r.counters.get( event );
+						}
+					}
+					if( r.counters.has( perf_event_t::cycles ) &&
+					    r.counters.has( perf_event_t::instructions ) ) {
+						os << ", \"ipc\": " << r.counters.ipc( );
+					}
+					os << "}";
+				}
+				os << "\n  ]\n}\n";
+			}
+		};
+	} // namespace crypto_bench
+} // namespace daw
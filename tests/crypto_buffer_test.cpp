@@ -0,0 +1,127 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE crypto_buffer_test
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include <daw/boost_test.h>
+
+#include "crypto_buffer.h"
+#include "csprng.h"
+
+using namespace daw::crypto;
+
+namespace {
+	bool is_aligned( void const *ptr, size_t alignment ) {
+		return reinterpret_cast<uintptr_t>( ptr ) % alignment == 0;
+	}
+
+	void fill_and_check( crypto_buffer &buffer ) {
+		for( size_t n = 0; n < buffer.size( ); ++n ) {
+			buffer[n] = static_cast<uint8_t>( n * 7U );
+		}
+		for( size_t n = 0; n < buffer.size( ); ++n ) {
+			BOOST_REQUIRE_EQUAL( buffer[n], static_cast<uint8_t>( n * 7U ) );
+		}
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( crypto_buffer_heap_001 ) {
+	crypto_buffer buffer( 1000 );
+	BOOST_REQUIRE_EQUAL( buffer.size( ), 1000U );
+	BOOST_REQUIRE( buffer.backing( ) == buffer_backing_t::heap );
+	BOOST_REQUIRE( is_aligned( buffer.data( ), 64 ) );
+	fill_and_check( buffer );
+
+	buffer_options_t options{};
+	options.alignment = 256;
+	options.zero = true;
+	crypto_buffer zeroed( 5000, options );
+	BOOST_REQUIRE( is_aligned( zeroed.data( ), 256 ) );
+	for( auto b : zeroed ) {
+		BOOST_REQUIRE_EQUAL( b, 0U );
+	}
+
+	crypto_buffer const empty;
+	BOOST_REQUIRE( empty.empty( ) );
+	BOOST_REQUIRE( empty.backing( ) == buffer_backing_t::empty );
+	BOOST_REQUIRE( crypto_buffer( 0 ).empty( ) );
+
+	options.alignment = 48;
+	BOOST_REQUIRE_THROW( crypto_buffer( 100, options ), std::bad_alloc );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_buffer_pages_001 ) {
+	buffer_options_t options{};
+	options.alignment = 64 * 1024;
+	crypto_buffer buffer( 300'000, options );
+	BOOST_REQUIRE( buffer.backing( ) == buffer_backing_t::pages );
+	BOOST_REQUIRE( is_aligned( buffer.data( ), 64 * 1024 ) );
+	// Mapped memory reads as zero
+	BOOST_REQUIRE_EQUAL( buffer[299'999], 0U );
+	fill_and_check( buffer );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_buffer_huge_pages_001 ) {
+	buffer_options_t options{};
+	options.huge_pages = huge_pages_t::transparent;
+	options.populate = true;
+	crypto_buffer thp( 3'000'000, options );
+	BOOST_REQUIRE( thp.backing( ) == buffer_backing_t::transparent_huge_pages );
+	BOOST_REQUIRE( is_aligned( thp.data( ), impl::huge_page_size ) );
+	fill_and_check( thp );
+
+	// Without reserved huge pages this falls back to transparent ones
+	options.huge_pages = huge_pages_t::hugetlb;
+	crypto_buffer huge( 100'000, options );
+	BOOST_REQUIRE( huge.backing( ) == buffer_backing_t::hugetlb ||
+	               huge.backing( ) == buffer_backing_t::transparent_huge_pages );
+	BOOST_REQUIRE( is_aligned( huge.data( ), impl::huge_page_size ) );
+	fill_and_check( huge );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_buffer_move_001 ) {
+	buffer_options_t options{};
+	options.alignment = 4096;
+	crypto_buffer a( 10'000, options );
+	a[0] = 42;
+	auto *const data = a.data( );
+	crypto_buffer b( std::move( a ) );
+	BOOST_REQUIRE( a.empty( ) );
+	BOOST_REQUIRE( b.data( ) == data );
+	BOOST_REQUIRE_EQUAL( b[0], 42U );
+	crypto_buffer c( 100 );
+	c = std::move( b );
+	BOOST_REQUIRE( c.data( ) == data );
+	BOOST_REQUIRE( c.backing( ) == buffer_backing_t::pages );
+}
+
+BOOST_AUTO_TEST_CASE( secure_random_buffer_001 ) {
+	auto const a = secure_random_buffer( 4096 );
+	auto const b = secure_random_buffer( 4096 );
+	BOOST_REQUIRE_EQUAL( a.size( ), 4096U );
+	BOOST_REQUIRE( !std::equal( a.begin( ), a.end( ), b.begin( ) ) );
+}
@@ -0,0 +1,282 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE crypto_dispatch_test
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <daw/boost_test.h>
+
+#include "crypto_dispatch.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> make_input( size_t size ) {
+		std::vector<uint8_t> result( size );
+		for( size_t n = 0; n < size; ++n ) {
+			result[n] = static_cast<uint8_t>( n * 31u + 7u );
+		}
+		return result;
+	}
+
+	crypto_profile_t make_profile( ) {
+		auto result = crypto_profile_t::defaults( );
+		auto &sha = result.backends[0];
+		sha = {crypto_backend_t::scalar,       crypto_backend_t::scalar,
+		       crypto_backend_t::multi_buffer, crypto_backend_t::multi_buffer,
+		       crypto_backend_t::scalar,       crypto_backend_t::scalar,
+		       crypto_backend_t::scalar};
+		return result;
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_size_class_001 ) {
+	BOOST_REQUIRE_EQUAL( impl::dispatch_size_class( 0 ), 0U );
+	BOOST_REQUIRE_EQUAL( impl::dispatch_size_class( 16 ), 0U );
+	BOOST_REQUIRE_EQUAL( impl::dispatch_size_class( 17 ), 1U );
+	BOOST_REQUIRE_EQUAL( impl::dispatch_size_class( 64 ), 1U );
+	BOOST_REQUIRE_EQUAL( impl::dispatch_size_class( 65 ), 2U );
+	BOOST_REQUIRE_EQUAL( impl::dispatch_size_class( 65536 ), 6U );
+	BOOST_REQUIRE_EQUAL( impl::dispatch_size_class( 1U << 30U ), 6U );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_sha256_backends_001 ) {
+	// Every backend gives the reference digests, lengths around the padding
+	// boundaries
+	auto const input = make_input( 2000 );
+	std::vector<daw::span<uint8_t const>> messages;
+	for( size_t size : {0U, 1U, 55U, 56U, 63U, 64U, 65U, 119U, 120U, 1000U,
+	                    2000U} ) {
+		messages.emplace_back( input.data( ), size );
+	}
+	for( auto backend : crypto_backends( crypto_op_t::sha256_multi_hash ) ) {
+		std::vector<sha256_digest_t> digests( messages.size( ) );
+		sha256_multi_hash(
+		  backend,
+		  daw::span<daw::span<uint8_t const> const>( messages.data( ),
+		                                             messages.size( ) ),
+		  daw::span<sha256_digest_t>( digests.data( ), digests.size( ) ) );
+		for( size_t n = 0; n < messages.size( ); ++n ) {
+			BOOST_REQUIRE( sha256_bin( reinterpret_cast<char const *>(
+			                             messages[n].data( ) ),
+			                           messages[n].size( ) ) == digests[n] );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_aes_ctr_backends_001 ) {
+	// Every backend matches aes_ctr_128, including a partial last block and a
+	// counter carry
+	auto const input = make_input( 300 );
+	std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value> key{};
+	for( size_t n = 0; n < key.size( ); ++n ) {
+		key[n] = static_cast<uint8_t>( n );
+	}
+	auto const sched = aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	aes::cipher_t iv{};
+	iv.fill( 0xFF );
+	iv[0] = 0;
+	for( size_t size : {0U, 1U, 15U, 16U, 17U, 128U, 129U, 300U} ) {
+		std::vector<uint8_t> expected( size );
+		aes::aes_ctr_128( sched, iv,
+		                  daw::span<uint8_t const>( input.data( ), size ),
+		                  daw::span<uint8_t>( expected.data( ), size ) );
+		for( auto backend : crypto_backends( crypto_op_t::aes128_ctr ) ) {
+			std::vector<uint8_t> out( size );
+			aes::aes_ctr_128( backend, sched, iv,
+			                  daw::span<uint8_t const>( input.data( ), size ),
+			                  daw::span<uint8_t>( out.data( ), size ) );
+			BOOST_REQUIRE( out == expected );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_routing_001 ) {
+	crypto_dispatch dispatch( make_profile( ) );
+	auto const op = crypto_op_t::sha256_multi_hash;
+	BOOST_REQUIRE( dispatch.backend_for( op, 10 ) == crypto_backend_t::scalar );
+	BOOST_REQUIRE( dispatch.backend_for( op, 64 ) == crypto_backend_t::scalar );
+	BOOST_REQUIRE( dispatch.backend_for( op, 65 ) ==
+	               crypto_backend_t::multi_buffer );
+	BOOST_REQUIRE( dispatch.backend_for( op, 1024 ) ==
+	               crypto_backend_t::multi_buffer );
+	BOOST_REQUIRE( dispatch.backend_for( op, 1025 ) == crypto_backend_t::scalar );
+	BOOST_REQUIRE( dispatch.backend_for( op, 1U << 30U ) ==
+	               crypto_backend_t::scalar );
+
+	auto const crossovers = dispatch.crossovers( op );
+	BOOST_REQUIRE_EQUAL( crossovers.size( ), 3U );
+	BOOST_REQUIRE_EQUAL( crossovers[0].min_size, 0U );
+	BOOST_REQUIRE_EQUAL( crossovers[1].min_size, 65U );
+	BOOST_REQUIRE( crossovers[1].backend == crypto_backend_t::multi_buffer );
+	BOOST_REQUIRE_EQUAL( crossovers[2].min_size, 1025U );
+	BOOST_REQUIRE( crossovers[2].backend == crypto_backend_t::scalar );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_override_001 ) {
+	crypto_dispatch dispatch( make_profile( ) );
+	auto const op = crypto_op_t::sha256_multi_hash;
+	BOOST_REQUIRE( !dispatch.override_for( op ) );
+	dispatch.set_override( op, crypto_backend_t::multi_buffer );
+	BOOST_REQUIRE( dispatch.backend_for( op, 10 ) ==
+	               crypto_backend_t::multi_buffer );
+	BOOST_REQUIRE( dispatch.override_for( op ) ==
+	               crypto_backend_t::multi_buffer );
+	// The profile's crossovers are unchanged by an override
+	BOOST_REQUIRE_EQUAL( dispatch.crossovers( op ).size( ), 3U );
+	dispatch.clear_override( op );
+	BOOST_REQUIRE( dispatch.backend_for( op, 10 ) == crypto_backend_t::scalar );
+
+	BOOST_REQUIRE_THROW(
+	  dispatch.set_override( op, crypto_backend_t::aes_table ),
+	  std::invalid_argument );
+
+	auto const overrides = impl::parse_backend_overrides(
+	  "sha256_multi_hash=scalar,aes128_ctr=aes_table" );
+	BOOST_REQUIRE_EQUAL( overrides.size( ), 2U );
+	BOOST_REQUIRE( overrides[0].first == op );
+	BOOST_REQUIRE( overrides[0].second == crypto_backend_t::scalar );
+	BOOST_REQUIRE( overrides[1].first == crypto_op_t::aes128_ctr );
+	BOOST_REQUIRE( overrides[1].second == crypto_backend_t::aes_table );
+	BOOST_REQUIRE_THROW( impl::parse_backend_overrides( "sha256_multi_hash" ),
+	                     std::invalid_argument );
+	BOOST_REQUIRE_THROW( impl::parse_backend_overrides( "md5=scalar" ),
+	                     std::invalid_argument );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_profile_file_001 ) {
+	auto const path = std::string( "crypto_dispatch_test.profile" );
+	auto profile = make_profile( );
+	profile.ns_per_byte[0][3] = 1.5;
+	BOOST_REQUIRE( save_crypto_profile( profile, path ) );
+	auto const loaded = load_crypto_profile( path );
+	BOOST_REQUIRE( loaded );
+	BOOST_REQUIRE_EQUAL( loaded->host_key, crypto_host_key( ) );
+	BOOST_REQUIRE( loaded->backends == profile.backends );
+	BOOST_REQUIRE_EQUAL( loaded->ns_per_byte[0][3], 1.5 );
+
+	// A file missing a size class is rejected
+	{
+		std::ofstream out( path, std::ios::trunc );
+		out << "daw_crypto_profile 1\nhost x\nsha256_multi_hash 16 scalar 1\n";
+	}
+	BOOST_REQUIRE( !load_crypto_profile( path ) );
+	std::remove( path.c_str( ) );
+	BOOST_REQUIRE( !load_crypto_profile( path ) );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_profile_file_002 ) {
+	// Concurrent writers each use their own temporary, so every save
+	// succeeds, the result is one whole profile and nothing is left behind
+	auto const dir = std::string( "crypto_dispatch_test.dir" );
+	auto const path = dir + "/profile";
+	::mkdir( dir.c_str( ), 0755 );
+	auto const profile = make_profile( );
+	std::array<bool, 4> saved{};
+	std::vector<std::thread> writers;
+	for( auto &ok : saved ) {
+		writers.emplace_back( [&]( ) {
+			ok = true;
+			for( size_t n = 0; n < 50; ++n ) {
+				ok = save_crypto_profile( profile, path ) && ok;
+			}
+		} );
+	}
+	for( auto &t : writers ) {
+		t.join( );
+	}
+	for( bool ok : saved ) {
+		BOOST_REQUIRE( ok );
+	}
+	auto const loaded = load_crypto_profile( path );
+	BOOST_REQUIRE( loaded );
+	BOOST_REQUIRE( loaded->backends == profile.backends );
+
+	size_t files = 0;
+	if( auto d = ::opendir( dir.c_str( ) ) ) {
+		while( auto entry = ::readdir( d ) ) {
+			files += entry->d_name[0] != '.' ? 1U : 0U;
+		}
+		::closedir( d );
+	}
+	BOOST_REQUIRE_EQUAL( files, 1U );
+	std::remove( path.c_str( ) );
+	::rmdir( dir.c_str( ) );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_calibrate_001 ) {
+	auto const profile = calibrate_crypto_profile( );
+	for( size_t op = 0; op < impl::crypto_op_count; ++op ) {
+		auto const backends = crypto_backends( static_cast<crypto_op_t>( op ) );
+		for( size_t c = 0; c < impl::dispatch_size_classes; ++c ) {
+			BOOST_REQUIRE( crypto_backend_available(
+			  static_cast<crypto_op_t>( op ), profile.backends[op][c] ) );
+		}
+		// Only a choice is timed
+		BOOST_REQUIRE( ( profile.ns_per_byte[op][0] > 0.0 ) ==
+		               ( backends.size( ) > 1 ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( crypto_dispatch_tuned_001 ) {
+	// The process wide dispatcher, with the cache kept out of the home
+	// directory
+	setenv( "DAW_CRYPTO_PROFILE", "", 1 );
+	auto const input = make_input( 1000 );
+	std::array<daw::span<uint8_t const>, 3> messages = {
+	  daw::span<uint8_t const>( input.data( ), 10 ),
+	  daw::span<uint8_t const>( input.data( ), 100 ),
+	  daw::span<uint8_t const>( input.data( ), 1000 )};
+	std::array<sha256_digest_t, 3> digests{};
+	sha256_multi_hash_tuned(
+	  daw::span<daw::span<uint8_t const> const>( messages.data( ),
+	                                             messages.size( ) ),
+	  daw::span<sha256_digest_t>( digests.data( ), digests.size( ) ) );
+	for( size_t n = 0; n < messages.size( ); ++n ) {
+		BOOST_REQUIRE(
+		  sha256_bin( reinterpret_cast<char const *>( messages[n].data( ) ),
+		              messages[n].size( ) ) == digests[n] );
+	}
+
+	std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value> key{};
+	auto const sched = aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	aes::cipher_t const iv{};
+	std::vector<uint8_t> expected( input.size( ) );
+	std::vector<uint8_t> out( input.size( ) );
+	aes::aes_ctr_128( sched, iv, daw::make_span( input ),
+	                  daw::make_span( expected ) );
+	aes::aes_ctr_128_tuned( sched, iv, daw::make_span( input ),
+	                        daw::make_span( out ) );
+	BOOST_REQUIRE( out == expected );
+}
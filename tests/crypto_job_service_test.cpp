@@ -0,0 +1,280 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE crypto_job_service_test
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+#include <daw/boost_test.h>
+
+#include "crypto_job_service.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> make_message( size_t size, size_t seed ) {
+		std::vector<uint8_t> result( size );
+		for( size_t n = 0; n < size; ++n ) {
+			result[n] = static_cast<uint8_t>( n * 13u + seed );
+		}
+		return result;
+	}
+
+	daw::span<uint8_t const> as_span( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	// No timeout, a loaded machine can take any time and a hang is left to
+	// the test runner
+	void wait_readable( crypto_job_service &service ) {
+		pollfd pfd{service.completion_fd( ), POLLIN, 0};
+		int r = 0;
+		do {
+			r = ::poll( &pfd, 1, -1 );
+		} while( r < 0 && errno == EINTR );
+		BOOST_REQUIRE( r == 1 );
+	}
+
+	// What an event loop does: wait for the eventfd, then collect
+	template<typename OnComplete>
+	size_t wait_for( crypto_job_service &service, size_t count,
+	                 OnComplete on_complete ) {
+		size_t done = 0;
+		while( done < count ) {
+			wait_readable( service );
+			done += service.poll_completions( on_complete );
+		}
+		return done;
+	}
+
+	// Joins on every exit from a test, a failed check included
+	struct thread_joiner_t {
+		std::vector<std::thread> &threads;
+
+		~thread_joiner_t( ) {
+			for( auto &t : threads ) {
+				if( t.joinable( ) ) {
+					t.join( );
+				}
+			}
+		}
+	};
+} // namespace
+
+// The data the jobs point to is declared before the service in each test.
+// If a check fails the service is destroyed first, and its destructor waits
+// for the workers still using that data
+
+BOOST_AUTO_TEST_CASE( crypto_job_service_001 ) {
+	// Mixed sizes, from empty to several MB, all hashed correctly
+	std::vector<std::vector<uint8_t>> messages;
+	for( size_t n = 0; n < 64; ++n ) {
+		messages.push_back( make_message( ( n * n * 97u ) % 5000u, n ) );
+	}
+	messages.push_back( make_message( 3'000'001, 99 ) );
+	std::vector<std::unique_ptr<sha256_job_t>> jobs;
+	crypto_job_service service( 2 );
+	for( auto const &m : messages ) {
+		jobs.push_back( std::make_unique<sha256_job_t>( as_span( m ) ) );
+		service.submit( *jobs.back( ) );
+	}
+	size_t seen = 0;
+	wait_for( service, jobs.size( ), [&]( crypto_job_t &job ) {
+		BOOST_REQUIRE( job.kind( ) == crypto_job_kind_t::sha256 );
+		++seen;
+	} );
+	BOOST_REQUIRE_EQUAL( seen, jobs.size( ) );
+	for( size_t n = 0; n < jobs.size( ); ++n ) {
+		BOOST_REQUIRE( jobs[n]->digest ==
+		               sha256_bin( messages[n].data( ), messages[n].size( ) ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( crypto_job_service_002 ) {
+	// AES-CBC jobs mixed with hashing
+	using aes_key_t = std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value>;
+	std::vector<aes::aes128_key_schedule_t> schedules;
+	std::vector<std::vector<uint8_t>> inputs;
+	std::vector<std::vector<uint8_t>> outputs;
+	for( size_t n = 0; n < 40; ++n ) {
+		aes_key_t key{};
+		key[0] = static_cast<uint8_t>( n );
+		schedules.push_back(
+		  aes::impl::aes128_key_schedule( daw::make_span( key ) ) );
+		inputs.push_back( make_message( n * 37u, n ) );
+		outputs.emplace_back( ( inputs.back( ).size( ) + 15u ) & ~15u );
+	}
+	std::vector<std::unique_ptr<aes128_cbc_encrypt_job_t>> cbc_jobs;
+	std::vector<std::unique_ptr<sha256_job_t>> sha_jobs;
+	std::vector<crypto_job_t *> jobs;
+	crypto_job_service service( 3 );
+	for( size_t n = 0; n < inputs.size( ); ++n ) {
+		aes::cipher_t iv{};
+		iv[1] = static_cast<uint8_t>( n );
+		cbc_jobs.push_back( std::make_unique<aes128_cbc_encrypt_job_t>(
+		  aes::aes128_cbc_job_t{
+		    &schedules[n], iv, as_span( inputs[n] ),
+		    daw::span<uint8_t>( outputs[n].data( ), outputs[n].size( ) )} ) );
+		jobs.push_back( cbc_jobs.back( ).get( ) );
+		service.submit( *jobs.back( ) );
+		sha_jobs.push_back(
+		  std::make_unique<sha256_job_t>( as_span( inputs[n] ) ) );
+		jobs.push_back( sha_jobs.back( ).get( ) );
+		service.submit( *jobs.back( ) );
+	}
+	wait_for( service, jobs.size( ), []( crypto_job_t & ) {} );
+	for( auto const *job : jobs ) {
+		if( job->kind( ) == crypto_job_kind_t::sha256 ) {
+			auto const &sha_job = static_cast<sha256_job_t const &>( *job );
+			BOOST_REQUIRE(
+			  sha256_bin( sha_job.input.data( ), sha_job.input.size( ) ) ==
+			  sha_job.digest );
+			continue;
+		}
+		auto const &cbc = static_cast<aes128_cbc_encrypt_job_t const &>( *job ).cbc;
+		std::vector<uint8_t> expected( cbc.output.size( ) );
+		aes::aes_encrypt_128_cbc(
+		  cbc.input, *cbc.key_sched, cbc.iv,
+		  daw::span<uint8_t>( expected.data( ), expected.size( ) ) );
+		BOOST_REQUIRE( std::equal( expected.begin( ), expected.end( ),
+		                           cbc.output.begin( ) ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( crypto_job_service_003 ) {
+	// Many submitting threads, every job reported exactly once
+	auto const message = make_message( 100, 1 );
+	auto const expected = sha256_bin( message.data( ), message.size( ) );
+	size_t const per_thread = 2000;
+	std::vector<std::deque<sha256_job_t>> jobs( 4 );
+	for( auto &thread_jobs : jobs ) {
+		for( size_t n = 0; n < per_thread; ++n ) {
+			thread_jobs.emplace_back( as_span( message ) );
+		}
+	}
+	crypto_job_service service( 2 );
+	std::vector<std::thread> threads;
+	thread_joiner_t const joiner{threads};
+	for( auto &thread_jobs : jobs ) {
+		threads.emplace_back( [&]( ) {
+			for( auto &job : thread_jobs ) {
+				service.submit( job );
+			}
+		} );
+	}
+	size_t completed = 0;
+	wait_for( service, 4 * per_thread, [&]( crypto_job_t &job ) {
+		BOOST_REQUIRE( static_cast<sha256_job_t &>( job ).digest == expected );
+		++completed;
+	} );
+	BOOST_REQUIRE_EQUAL( completed, 4 * per_thread );
+	BOOST_REQUIRE_EQUAL( service.poll_completions( ), 0U );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_job_service_005 ) {
+	// A throwing on_complete loses no jobs, the rest come from the next poll
+	auto const message = make_message( 64, 5 );
+	std::vector<std::unique_ptr<sha256_job_t>> jobs;
+	crypto_job_service service( 1 );
+	for( size_t n = 0; n < 50; ++n ) {
+		jobs.push_back( std::make_unique<sha256_job_t>( as_span( message ) ) );
+		service.submit( *jobs.back( ) );
+	}
+	std::set<crypto_job_t const *> seen;
+	size_t throws = 0;
+	auto const on_complete = [&]( crypto_job_t &job ) {
+		BOOST_REQUIRE( seen.insert( &job ).second );
+		if( seen.size( ) % 7 == 1 ) {
+			throw std::runtime_error( "on_complete failed" );
+		}
+	};
+	while( seen.size( ) < jobs.size( ) ) {
+		wait_readable( service );
+		try {
+			service.poll_completions( on_complete );
+		} catch( std::runtime_error const & ) {
+			++throws;
+		}
+	}
+	BOOST_REQUIRE_GE( throws, 1U );
+	BOOST_REQUIRE_EQUAL( service.poll_completions( ), 0U );
+}
+
+#if defined( DAW_CRYPTO_HAS_COROUTINES )
+namespace {
+	struct detached_task_t {
+		struct promise_type {
+			detached_task_t get_return_object( ) noexcept {
+				return {};
+			}
+			std::suspend_never initial_suspend( ) noexcept {
+				return {};
+			}
+			std::suspend_never final_suspend( ) noexcept {
+				return {};
+			}
+			void return_void( ) noexcept {}
+			void unhandled_exception( ) noexcept {
+				std::terminate( );
+			}
+		};
+	};
+
+	// The job lives outside the coroutine frame, as it would in a connection
+	// object; sha256_digest_t is over aligned and some compilers do not honour
+	// that in coroutine frames
+	detached_task_t hash_twice( crypto_job_service &service, sha256_job_t &job,
+	                            sha256_digest_t &result, bool &finished ) {
+		co_await service.async( job );
+		// Reuse the job for a second round
+		co_await service.async( job );
+		result = job.digest;
+		finished = true;
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( crypto_job_service_004 ) {
+	// Coroutines are resumed from poll_completions on the polling thread
+	auto const message = make_message( 12345, 3 );
+	sha256_digest_t result{};
+	bool finished = false;
+	sha256_job_t job( as_span( message ) );
+	crypto_job_service service( 2 );
+	hash_twice( service, job, result, finished );
+	BOOST_REQUIRE( !finished );
+	wait_for( service, 2, []( crypto_job_t & ) {
+		BOOST_FAIL( "awaited jobs resume their coroutine" );
+	} );
+	BOOST_REQUIRE( finished );
+	BOOST_REQUIRE( result == sha256_bin( message.data( ), message.size( ) ) );
+}
+#endif
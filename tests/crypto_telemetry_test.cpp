@@ -0,0 +1,309 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Built twice, with DAW_CRYPTO_TELEMETRY defined and without it
+
+#define BOOST_TEST_MODULE crypto_telemetry_test
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "aes_batch.h"
+#include "aes_ctr_hmac.h"
+#include "aes_xts.h"
+#include "crypto_dispatch.h"
+#include "crypto_telemetry.h"
+#include "sha256.h"
+#include "sha256_fixed.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> counting( size_t size ) {
+		std::vector<uint8_t> result( size );
+		for( size_t n = 0; n < size; ++n ) {
+			result[n] = static_cast<uint8_t>( n );
+		}
+		return result;
+	}
+
+	daw::span<uint8_t const> cspan( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	daw::span<uint8_t> mspan( std::vector<uint8_t> &v ) {
+		return daw::span<uint8_t>( v.data( ), v.size( ) );
+	}
+
+	aes::aes128_key_schedule_t test_schedule( ) {
+		std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value> key{};
+		key[0] = 1;
+		return aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	}
+
+	// Hashing in constant expressions is untouched by the hooks
+	constexpr auto const abc_digest = sha256_bin( "abc", 3 );
+	static_assert( abc_digest[0] == 0xba7816bf, "constexpr sha256 broken" );
+} // namespace
+
+#if defined( DAW_CRYPTO_TELEMETRY )
+BOOST_AUTO_TEST_CASE( crypto_telemetry_sha256_001 ) {
+	BOOST_REQUIRE( telemetry_enabled( ) );
+	auto const data = counting( 1000 );
+	auto const before = telemetry_snapshot( );
+
+	sha256_ctx ctx{};
+	ctx.update( data.data( ), 600 );
+	ctx.update( data.data( ) + 600, 400 );
+	auto const streamed = ctx.final( );
+	BOOST_REQUIRE( sha256_ctx::hash( cspan( data ) ) == streamed );
+
+	auto const delta = telemetry_snapshot( ).since( before );
+	auto const &sha = delta.get( telemetry_op_t::sha256,
+	                             telemetry_backend_t::scalar );
+	BOOST_REQUIRE_EQUAL( sha.calls, 2U );
+	BOOST_REQUIRE_EQUAL( sha.bytes, 2000U );
+	BOOST_REQUIRE_EQUAL( delta.total( telemetry_op_t::aes128_ecb ).calls, 0U );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_telemetry_sha256_fixed_001 ) {
+	// The fixed length kernels count one scalar hash each, the lanes of the
+	// batch and multi message functions count as multi_buffer
+	auto const data = counting( 64 );
+	auto before = telemetry_snapshot( );
+	auto const left = sha256_32( cspan( data ) );
+	auto const right = sha256_64( cspan( data ) );
+	static_cast<void>( sha256_32( left ) );
+	static_cast<void>( sha256_64( left, right ) );
+	auto delta = telemetry_snapshot( ).since( before );
+	auto const &fixed =
+	  delta.get( telemetry_op_t::sha256, telemetry_backend_t::scalar );
+	BOOST_REQUIRE_EQUAL( fixed.calls, 4U );
+	BOOST_REQUIRE_EQUAL( fixed.bytes, 32U + 64U + 32U + 64U );
+
+	std::vector<sha256_packed_digest_t> digests( 20 );
+	before = telemetry_snapshot( );
+	sha256_32_batch( daw::span<sha256_packed_digest_t const>( digests.data( ),
+	                                                          digests.size( ) ),
+	                 daw::span<sha256_packed_digest_t>( digests.data( ),
+	                                                    digests.size( ) ) );
+	delta = telemetry_snapshot( ).since( before );
+	auto const &lanes =
+	  delta.get( telemetry_op_t::sha256, telemetry_backend_t::multi_buffer );
+	BOOST_REQUIRE_EQUAL( lanes.calls, 16U );
+	BOOST_REQUIRE_EQUAL( lanes.bytes, 16U * 32U );
+	auto const &tail =
+	  delta.get( telemetry_op_t::sha256, telemetry_backend_t::scalar );
+	BOOST_REQUIRE_EQUAL( tail.calls, 4U );
+	BOOST_REQUIRE_EQUAL( tail.bytes, 4U * 32U );
+
+	auto const message_data = counting( 1000 );
+	std::vector<daw::span<uint8_t const>> messages;
+	for( size_t n = 0; n < 10; ++n ) {
+		messages.emplace_back( message_data.data( ), n * 100 );
+	}
+	std::vector<sha256_digest_t> out( messages.size( ) );
+	before = telemetry_snapshot( );
+	sha256_multi_hash(
+	  daw::span<daw::span<uint8_t const> const>( messages.data( ),
+	                                             messages.size( ) ),
+	  daw::span<sha256_digest_t>( out.data( ), out.size( ) ) );
+	delta = telemetry_snapshot( ).since( before );
+	auto const &multi =
+	  delta.get( telemetry_op_t::sha256, telemetry_backend_t::multi_buffer );
+	BOOST_REQUIRE_EQUAL( multi.calls, 10U );
+	BOOST_REQUIRE_EQUAL( multi.bytes, 4500U );
+	BOOST_REQUIRE_EQUAL(
+	  delta.get( telemetry_op_t::sha256, telemetry_backend_t::scalar ).calls,
+	  0U );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_telemetry_dispatch_001 ) {
+	// Every AES-CTR route counts its call on the backend that did the work
+	auto const sched = test_schedule( );
+	auto const data = counting( 1000 );
+	std::vector<uint8_t> out( data.size( ) );
+	for( auto backend : crypto_backends( crypto_op_t::aes128_ctr ) ) {
+		auto const before = telemetry_snapshot( );
+		aes::aes_ctr_128( backend, sched, aes::cipher_t{}, cspan( data ),
+		                  mspan( out ) );
+		auto const delta = telemetry_snapshot( ).since( before );
+		auto const expected = backend == crypto_backend_t::aes_table
+		                        ? telemetry_backend_t::scalar
+		                        : backend == crypto_backend_t::aesni_serial
+		                            ? telemetry_backend_t::aesni
+		                            : aes::impl::aes_telemetry_backend;
+		auto const &ctr = delta.get( telemetry_op_t::aes128_ctr, expected );
+		BOOST_REQUIRE_EQUAL( ctr.calls, 1U );
+		BOOST_REQUIRE_EQUAL( ctr.bytes, 1000U );
+		BOOST_REQUIRE_EQUAL( delta.total( telemetry_op_t::aes128_ctr ).calls,
+		                     1U );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( crypto_telemetry_aes_001 ) {
+	auto const sched = test_schedule( );
+	auto const data = counting( 4096 );
+	std::vector<uint8_t> out( data.size( ) );
+	auto const before = telemetry_snapshot( );
+
+	aes::aes_encrypt_128( cspan( data ), sched, mspan( out ) );
+	aes::aes_encrypt_128_cbc( cspan( data ), sched, aes::cipher_t{},
+	                          mspan( out ) );
+	aes::aes_ctr_128( sched, aes::cipher_t{}, cspan( data ), mspan( out ) );
+	std::array<uint8_t, 32> xts_key_bytes{};
+	xts_key_bytes[17] = 1;
+	aes::aes128_xts_key_t const xts_key( daw::make_span( xts_key_bytes ) );
+	aes::aes_xts_encrypt_128_sectors( xts_key, 0, 512, cspan( data ),
+	                                  mspan( out ), 1 );
+
+	auto const delta = telemetry_snapshot( ).since( before );
+	auto const check = []( telemetry_counts_t const &c ) {
+		BOOST_REQUIRE_EQUAL( c.calls, 1U );
+		BOOST_REQUIRE_EQUAL( c.bytes, 4096U );
+	};
+	check( delta.get( telemetry_op_t::aes128_ecb, telemetry_backend_t::scalar ) );
+	check( delta.get( telemetry_op_t::aes128_cbc, telemetry_backend_t::scalar ) );
+	check( delta.get( telemetry_op_t::aes128_ctr,
+	                  aes::impl::aes_telemetry_backend ) );
+	check( delta.get( telemetry_op_t::aes128_xts,
+	                  aes::impl::aes_telemetry_backend ) );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_telemetry_aes_batch_001 ) {
+	auto const sched = test_schedule( );
+	auto const data = counting( 100 );
+	std::vector<std::vector<uint8_t>> outputs( 10, std::vector<uint8_t>( 112 ) );
+	std::vector<aes::aes128_cbc_job_t> jobs;
+	for( auto &out : outputs ) {
+		jobs.push_back( aes::aes128_cbc_job_t{&sched, aes::cipher_t{},
+		                                      cspan( data ), mspan( out )} );
+	}
+	auto const before = telemetry_snapshot( );
+	aes::aes_encrypt_128_cbc_batch(
+	  daw::span<aes::aes128_cbc_job_t const>( jobs.data( ), jobs.size( ) ) );
+	auto const delta = telemetry_snapshot( ).since( before );
+	auto const cbc = delta.total( telemetry_op_t::aes128_cbc );
+	BOOST_REQUIRE_EQUAL( cbc.calls, 10U );
+	BOOST_REQUIRE_EQUAL( cbc.bytes, 1000U );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_telemetry_threads_001 ) {
+	// Counts of threads that have exited are kept
+	auto const data = counting( 64 );
+	auto const before = telemetry_snapshot( );
+	std::vector<std::thread> threads;
+	for( size_t t = 0; t < 4; ++t ) {
+		threads.emplace_back( [&] {
+			for( size_t n = 0; n < 100; ++n ) {
+				sha256_ctx::hash( cspan( data ) );
+			}
+		} );
+	}
+	for( auto &t : threads ) {
+		t.join( );
+	}
+	auto const sha = telemetry_snapshot( ).since( before ).total(
+	  telemetry_op_t::sha256 );
+	BOOST_REQUIRE_EQUAL( sha.calls, 400U );
+	BOOST_REQUIRE_EQUAL( sha.bytes, 400U * 64U );
+}
+
+namespace {
+	// Constructed before the thread's first hook, so destroyed after the
+	// telemetry counters are
+	std::atomic<bool> exit_hook_dropped{false};
+
+	struct hash_on_exit_t {
+		std::vector<uint8_t> data = counting( 64 );
+
+		~hash_on_exit_t( ) {
+			sha256_ctx::hash( cspan( data ) );
+			exit_hook_dropped = impl::telemetry_thread( ) == nullptr;
+		}
+	};
+} // namespace
+
+BOOST_AUTO_TEST_CASE( crypto_telemetry_thread_exit_001 ) {
+	// Hooks run from later thread_local destructors are dropped
+	auto const before = telemetry_snapshot( );
+	std::thread( [] {
+		static thread_local hash_on_exit_t on_exit{};
+		sha256_ctx::hash( cspan( on_exit.data ) );
+	} ).join( );
+	auto const sha = telemetry_snapshot( ).since( before ).total(
+	  telemetry_op_t::sha256 );
+	BOOST_REQUIRE_EQUAL( sha.calls, 1U );
+	BOOST_REQUIRE( exit_hook_dropped );
+}
+
+BOOST_AUTO_TEST_CASE( crypto_telemetry_latency_001 ) {
+	auto const data = counting( 1024 );
+	// Drain the countdown left by earlier tests
+	set_telemetry_sample_period( 1 );
+	for( size_t n = 0; n < 64; ++n ) {
+		sha256_ctx::hash( cspan( data ) );
+	}
+	auto before = telemetry_snapshot( );
+	for( size_t n = 0; n < 50; ++n ) {
+		sha256_ctx::hash( cspan( data ) );
+	}
+	auto const sampled =
+	  telemetry_snapshot( ).since( before ).latency_of( telemetry_op_t::sha256 );
+	BOOST_REQUIRE_EQUAL( sampled.count( ), 50U );
+	BOOST_REQUIRE( sampled.percentile_ns( 0.5 ) > 0U );
+	BOOST_REQUIRE( sampled.percentile_ns( 0.5 ) <= sampled.percentile_ns( 1.0 ) );
+
+	set_telemetry_sample_period( 0 );
+	sha256_ctx::hash( cspan( data ) );
+	before = telemetry_snapshot( );
+	for( size_t n = 0; n < 50; ++n ) {
+		sha256_ctx::hash( cspan( data ) );
+	}
+	auto const none = telemetry_snapshot( ).since( before );
+	BOOST_REQUIRE_EQUAL( none.latency_of( telemetry_op_t::sha256 ).count( ), 0U );
+	BOOST_REQUIRE_EQUAL( none.total( telemetry_op_t::sha256 ).calls, 50U );
+	set_telemetry_sample_period( 64 );
+}
+#else
+BOOST_AUTO_TEST_CASE( crypto_telemetry_disabled_001 ) {
+	static_assert( !telemetry_enabled( ), "DAW_CRYPTO_TELEMETRY is not set" );
+	auto const data = counting( 1000 );
+	auto const sched = test_schedule( );
+	std::vector<uint8_t> out( data.size( ) + 8 );
+	sha256_ctx::hash( cspan( data ) );
+	aes::aes_encrypt_128( cspan( data ), sched, mspan( out ) );
+	aes::aes_ctr_128( sched, aes::cipher_t{}, cspan( data ), mspan( out ) );
+
+	auto const snapshot = telemetry_snapshot( );
+	for( size_t op = 0; op < telemetry_op_count; ++op ) {
+		auto const o = static_cast<telemetry_op_t>( op );
+		BOOST_REQUIRE_EQUAL( snapshot.total( o ).calls, 0U );
+		BOOST_REQUIRE_EQUAL( snapshot.latency_of( o ).count( ), 0U );
+	}
+}
+#endif
@@ -0,0 +1,202 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE csprng_test
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <daw/boost_test.h>
+
+#include "csprng.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> from_hex( std::string const &hex ) {
+		std::vector<uint8_t> result;
+		for( size_t n = 0; n + 1 < hex.size( ); n += 2 ) {
+			result.push_back(
+			  static_cast<uint8_t>( std::stoul( hex.substr( n, 2 ), nullptr, 16 ) ) );
+		}
+		return result;
+	}
+
+	std::vector<uint8_t> counting( size_t size, uint8_t first ) {
+		std::vector<uint8_t> result( size );
+		for( size_t n = 0; n < size; ++n ) {
+			result[n] = static_cast<uint8_t>( first + n );
+		}
+		return result;
+	}
+
+	std::vector<uint8_t> from_string( std::string const &str ) {
+		return std::vector<uint8_t>( str.begin( ), str.end( ) );
+	}
+
+	daw::span<uint8_t const> cspan( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	daw::span<uint8_t> mspan( std::vector<uint8_t> &v ) {
+		return daw::span<uint8_t>( v.data( ), v.size( ) );
+	}
+
+	// The CAVP no reseed procedure: instantiate, generate twice and compare
+	// the second output
+	template<typename Drbg>
+	void check_cavp( std::string const &seed, std::string const &expected ) {
+		Drbg drbg( cspan( from_hex( seed ) ) );
+		auto const want = from_hex( expected );
+		std::vector<uint8_t> out( want.size( ) );
+		drbg.generate( mspan( out ) );
+		drbg.generate( mspan( out ) );
+		BOOST_REQUIRE( out == want );
+		BOOST_REQUIRE_EQUAL( drbg.reseed_counter( ), 3U );
+	}
+
+	// Additional input and reseeding change the output and reseeding restarts
+	// the counter
+	template<typename Drbg>
+	void check_inputs( size_t seed_size ) {
+		auto const seed = counting( seed_size, 0 );
+		Drbg plain( cspan( seed ) );
+		Drbg extra( cspan( seed ) );
+		Drbg personal( cspan( seed ), cspan( from_string( "daw crypto" ) ) );
+		std::vector<uint8_t> a( 37 );
+		std::vector<uint8_t> b( 37 );
+		std::vector<uint8_t> c( 37 );
+		plain.generate( mspan( a ) );
+		extra.generate( mspan( b ), cspan( from_string( "extra" ) ) );
+		personal.generate( mspan( c ) );
+		BOOST_REQUIRE( a != b );
+		BOOST_REQUIRE( a != c );
+		plain.reseed( cspan( counting( 32, 100 ) ),
+		              cspan( from_string( "more" ) ) );
+		BOOST_REQUIRE_EQUAL( plain.reseed_counter( ), 1U );
+		extra.generate( mspan( b ) );
+		plain.generate( mspan( a ) );
+		BOOST_REQUIRE( a != b );
+		BOOST_REQUIRE_EQUAL( plain.reseed_counter( ), 2U );
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( aes128_ctr_drbg_001 ) {
+	// NIST CAVP CTR_DRBG.rsp, [AES-128 no df], no prediction resistance,
+	// no personalization or additional input, COUNT = 0
+	check_cavp<aes128_ctr_drbg_t>(
+	  "ce50f33da5d4c1d3d4004eb35244b7f2cd7f2e5076fbf6780a7ff634b249a5fc",
+	  "6545c0529d372443b392ceb3ae3a99a30f963eaf313280f1d1a1e87f9db373d3"
+	  "61e75d18018266499cccd64d9bbb8de0185f213383080faddec46bae1f784e5a" );
+}
+
+BOOST_AUTO_TEST_CASE( aes128_ctr_drbg_002 ) {
+	check_inputs<aes128_ctr_drbg_t>( aes128_ctr_drbg_t::seed_size );
+}
+
+BOOST_AUTO_TEST_CASE( hmac_sha256_drbg_001 ) {
+	// NIST CAVP HMAC_DRBG.rsp, [SHA-256], no prediction resistance, no
+	// personalization or additional input, COUNT = 0.  The seed is the
+	// EntropyInput followed by the Nonce
+	check_cavp<hmac_sha256_drbg_t>(
+	  "ca851911349384bffe89de1cbdc46e6831e44d34a4fb935ee285dd14b71a7488"
+	  "659ba96c601dc69fc902940805ec0ca8",
+	  "e528e9abf2dece54d47c7e75e5fe302149f817ea9fb4bee6f4199697d04d5b89"
+	  "d54fbb978a15b5c443c9ec21036d2460b6f73ebad0dc2aba6e624abf07745bc1"
+	  "07694bb7547bb0995f70de25d6b29e2d3011bb19d27676c07162c8b5ccde0668"
+	  "961df86803482cb37ed6d5c0bb8d50cf1f50d476aa0458bdaba806f48be9dcb8" );
+}
+
+BOOST_AUTO_TEST_CASE( hmac_sha256_drbg_002 ) {
+	check_inputs<hmac_sha256_drbg_t>( hmac_sha256_drbg_t::seed_size );
+}
+
+BOOST_AUTO_TEST_CASE( csprng_001 ) {
+	// Small and large requests never repeat output
+	std::set<std::vector<uint8_t>> seen;
+	for( size_t size : {1U, 7U, 16U, 4095U, 4096U, 10'000U, 16U, 16U} ) {
+		std::vector<uint8_t> out( std::max<size_t>( size, 16U ) );
+		random_bytes( daw::span<uint8_t>( out.data( ), size ) );
+		BOOST_REQUIRE( seen.insert( out ).second );
+	}
+	auto const values = secure_random_data<uint64_t>( 1000 );
+	BOOST_REQUIRE_EQUAL(
+	  std::set<uint64_t>( values.begin( ), values.end( ) ).size( ), 1000U );
+}
+
+BOOST_AUTO_TEST_CASE( csprng_002 ) {
+	// Each thread has its own generator
+	std::array<std::vector<uint8_t>, 4> outputs;
+	std::vector<std::thread> threads;
+	for( auto &out : outputs ) {
+		threads.emplace_back( [&out]( ) {
+			out = secure_random_data<uint8_t>( 32 );
+		} );
+	}
+	for( auto &t : threads ) {
+		t.join( );
+	}
+	std::set<std::vector<uint8_t>> distinct( outputs.begin( ), outputs.end( ) );
+	BOOST_REQUIRE_EQUAL( distinct.size( ), outputs.size( ) );
+	BOOST_REQUIRE( &thread_csprng( ) == &thread_csprng( ) );
+}
+
+BOOST_AUTO_TEST_CASE( csprng_003 ) {
+	// After a fork parent and child produce different output, even with
+	// bytes already buffered when the fork happened
+	static_cast<void>( secure_random_data<uint8_t>( 1 ) );
+	int fds[2];
+	BOOST_REQUIRE( ::pipe( fds ) == 0 );
+	auto const pid = ::fork( );
+	BOOST_REQUIRE( pid >= 0 );
+	if( pid == 0 ) {
+		auto const child = secure_random_data<uint8_t>( 32 );
+		auto const written = ::write( fds[1], child.data( ), child.size( ) );
+		::_exit( written == 32 ? 0 : 1 );
+	}
+	auto const parent = secure_random_data<uint8_t>( 32 );
+	std::vector<uint8_t> child( 32 );
+	BOOST_REQUIRE( ::read( fds[0], child.data( ), child.size( ) ) == 32 );
+	int status = 0;
+	::waitpid( pid, &status, 0 );
+	::close( fds[0] );
+	::close( fds[1] );
+	BOOST_REQUIRE( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 );
+	BOOST_REQUIRE( parent != child );
+}
+
+BOOST_AUTO_TEST_CASE( csprng_004 ) {
+	// Entropy of the wrong size is rejected
+	std::vector<uint8_t> const short_seed( 16 );
+	BOOST_REQUIRE_THROW( aes128_ctr_drbg_t{cspan( short_seed )},
+	                     std::invalid_argument );
+	BOOST_REQUIRE_THROW( hmac_sha256_drbg_t{cspan( short_seed )},
+	                     std::invalid_argument );
+}
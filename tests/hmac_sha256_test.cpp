@@ -0,0 +1,124 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE hmac_sha256_test
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "hmac_sha256.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> from_hex( std::string const &hex ) {
+		std::vector<uint8_t> result;
+		for( size_t n = 0; n + 1 < hex.size( ); n += 2 ) {
+			result.push_back(
+			  static_cast<uint8_t>( std::stoul( hex.substr( n, 2 ), nullptr, 16 ) ) );
+		}
+		return result;
+	}
+
+	std::vector<uint8_t> from_string( std::string const &str ) {
+		return std::vector<uint8_t>( str.begin( ), str.end( ) );
+	}
+
+	daw::span<uint8_t const> cspan( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	hmac_sha256_tag_t tag_from_hex( std::string const &hex ) {
+		auto const bytes = from_hex( hex );
+		hmac_sha256_tag_t result{};
+		std::copy( bytes.begin( ), bytes.end( ), result.begin( ) );
+		return result;
+	}
+
+	void check( std::vector<uint8_t> const &key,
+	            std::vector<uint8_t> const &message, std::string const &hex ) {
+		auto const expected = tag_from_hex( hex );
+		BOOST_REQUIRE( hmac_sha256( cspan( key ), cspan( message ) ) ==
+		               expected );
+		// The same message fed a byte at a time, twice to cover reset
+		hmac_sha256_ctx ctx( cspan( key ) );
+		for( size_t round = 0; round < 2; ++round ) {
+			for( auto b : message ) {
+				ctx.update( &b, 1 );
+			}
+			BOOST_REQUIRE( ctx.final( ) == expected );
+		}
+		ctx.update( cspan( message ) );
+		BOOST_REQUIRE( ctx.verify( expected ) );
+		auto wrong = expected;
+		wrong[31] ^= 1u;
+		ctx.update( cspan( message ) );
+		BOOST_REQUIRE( !ctx.verify( wrong ) );
+	}
+
+	constexpr hmac_sha256_tag_t constexpr_tag( ) {
+		// RFC 4231 test case 2
+		std::array<uint8_t, 4> const key = {'J', 'e', 'f', 'e'};
+		char const message[] = "what do ya want for nothing?";
+		std::array<uint8_t, sizeof( message ) - 1> bytes{};
+		for( size_t n = 0; n < bytes.size( ); ++n ) {
+			bytes[n] = static_cast<uint8_t>( message[n] );
+		}
+		return hmac_sha256(
+		  daw::span<uint8_t const>( key.data( ), key.size( ) ),
+		  daw::span<uint8_t const>( bytes.data( ), bytes.size( ) ) );
+	}
+	static_assert( constexpr_tag( )[0] == 0x5b && constexpr_tag( )[31] == 0x43 );
+} // namespace
+
+BOOST_AUTO_TEST_CASE( hmac_sha256_001 ) {
+	// RFC 4231 test cases 1 to 4
+	check( std::vector<uint8_t>( 20, 0x0b ), from_string( "Hi There" ),
+	       "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" );
+	check( from_string( "Jefe" ),
+	       from_string( "what do ya want for nothing?" ),
+	       "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" );
+	check( std::vector<uint8_t>( 20, 0xaa ), std::vector<uint8_t>( 50, 0xdd ),
+	       "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe" );
+	check( from_hex( "0102030405060708090a0b0c0d0e0f10111213141516171819" ),
+	       std::vector<uint8_t>( 50, 0xcd ),
+	       "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b" );
+}
+
+BOOST_AUTO_TEST_CASE( hmac_sha256_002 ) {
+	// RFC 4231 test cases 6 and 7, keys longer than a block
+	std::vector<uint8_t> const key( 131, 0xaa );
+	check( key,
+	       from_string(
+	         "Test Using Larger Than Block-Size Key - Hash Key First" ),
+	       "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" );
+	check( key,
+	       from_string( "This is a test using a larger than block-size key and a "
+	                    "larger than block-size data. The key needs to be "
+	                    "hashed before being used by the HMAC algorithm." ),
+	       "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2" );
+}
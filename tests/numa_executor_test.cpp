@@ -0,0 +1,132 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE numa_executor_test
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include <sched.h>
+
+#include <daw/boost_test.h>
+
+#include "numa_executor.h"
+
+using namespace daw::crypto;
+
+BOOST_AUTO_TEST_CASE( numa_cpu_list_001 ) {
+	BOOST_REQUIRE( impl::parse_cpu_list( "0-3,8,10-11" ) ==
+	               ( std::vector<int>{0, 1, 2, 3, 8, 10, 11} ) );
+	BOOST_REQUIRE( impl::parse_cpu_list( "" ).empty( ) );
+	// Nearest first, ties in node order after this one
+	BOOST_REQUIRE( impl::steal_order( 1, {20, 10, 30, 20}, 4 ) ==
+	               ( std::vector<size_t>{3, 0, 2} ) );
+}
+
+BOOST_AUTO_TEST_CASE( numa_topology_001 ) {
+	auto const topology = numa_topology_t::detect( );
+	BOOST_REQUIRE( topology.nodes( ) >= 1 );
+	BOOST_REQUIRE_EQUAL( topology.steal_order.size( ), topology.nodes( ) );
+
+	setenv( "DAW_CRYPTO_FAKE_NUMA", "3", 1 );
+	auto const fake = numa_topology_t::detect( );
+	unsetenv( "DAW_CRYPTO_FAKE_NUMA" );
+	BOOST_REQUIRE( fake.emulated );
+	BOOST_REQUIRE_EQUAL( fake.nodes( ), 3U );
+	for( auto const &cpus : fake.node_cpus ) {
+		BOOST_REQUIRE( !cpus.empty( ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( numa_slice_nodes_001 ) {
+	// Emulated pages belong to nodes in turn in 2MB runs
+	auto const topology = numa_topology_t::emulate( 2 );
+	auto const *base = reinterpret_cast<void const *>( uintptr_t{64} << 20U );
+	auto const nodes =
+	  numa_slice_nodes( topology, base, 8U << 20U, 1U << 20U );
+	BOOST_REQUIRE( nodes == ( std::vector<int>{0, 0, 1, 1, 0, 0, 1, 1} ) );
+
+	// Touched memory on a real machine is on some node
+	std::vector<uint8_t> buffer( 4U << 20U, 1 );
+	auto const detected = numa_topology_t::detect( );
+	for( auto node : numa_slice_nodes( detected, buffer.data( ),
+	                                   buffer.size( ), 1U << 20U ) ) {
+		BOOST_REQUIRE( node >= 0 );
+		BOOST_REQUIRE( static_cast<size_t>( node ) < detected.nodes( ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( numa_executor_001 ) {
+	// Every slice runs once, on a CPU of its node unless it was stolen
+	auto const topology = numa_topology_t::emulate( 2 );
+	numa_executor executor( topology, 2 );
+	BOOST_REQUIRE_EQUAL( executor.workers( ), 4U );
+	std::vector<int> slice_nodes;
+	for( size_t n = 0; n < 1000; ++n ) {
+		slice_nodes.push_back( n % 3 == 0 ? -1 : static_cast<int>( n % 2 ) );
+	}
+	std::vector<std::atomic<int>> runs( slice_nodes.size( ) );
+	std::vector<int> cpus( slice_nodes.size( ), -1 );
+	for( size_t round = 0; round < 3; ++round ) {
+		auto const stats = executor.run( slice_nodes, [&]( size_t n ) {
+			++runs[n];
+			cpus[n] = sched_getcpu( );
+		} );
+		BOOST_REQUIRE_EQUAL( stats.local + stats.stolen, slice_nodes.size( ) );
+		BOOST_REQUIRE_EQUAL( stats.slices_per_node.size( ), 2U );
+		BOOST_REQUIRE_EQUAL(
+		  stats.slices_per_node[0] + stats.slices_per_node[1],
+		  slice_nodes.size( ) );
+		if( stats.stolen == 0 ) {
+			for( size_t n = 0; n < slice_nodes.size( ); ++n ) {
+				if( slice_nodes[n] < 0 ) {
+					continue;
+				}
+				auto const &node_cpus =
+				  topology.node_cpus[static_cast<size_t>( slice_nodes[n] )];
+				BOOST_REQUIRE( std::find( node_cpus.begin( ), node_cpus.end( ),
+				                          cpus[n] ) != node_cpus.end( ) );
+			}
+		}
+	}
+	for( auto const &r : runs ) {
+		BOOST_REQUIRE_EQUAL( r.load( ), 3 );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( numa_executor_steal_001 ) {
+	// A node with no CPUs has no workers, its slices are all stolen
+	numa_topology_t topology{};
+	topology.node_cpus = {impl::allowed_cpus( ), {}};
+	topology.steal_order = {{1}, {0}};
+	topology.emulated = true;
+	numa_executor executor( topology );
+	std::atomic<size_t> count{0};
+	auto const stats = executor.run( {0, 1, 1, 1}, [&]( size_t ) { ++count; } );
+	BOOST_REQUIRE_EQUAL( count.load( ), 4U );
+	BOOST_REQUIRE_EQUAL( stats.local, 1U );
+	BOOST_REQUIRE_EQUAL( stats.stolen, 3U );
+}
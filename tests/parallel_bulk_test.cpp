@@ -0,0 +1,179 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE parallel_bulk_test
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "parallel_bulk.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> make_input( size_t size ) {
+		std::vector<uint8_t> result( size );
+		uint32_t x = 0x1234'5678U;
+		for( auto &b : result ) {
+			x = x * 1664525U + 1013904223U;
+			b = static_cast<uint8_t>( x >> 24U );
+		}
+		return result;
+	}
+
+	// Two emulated nodes, so slices move between queues and workers
+	numa_executor &test_executor( ) {
+		static numa_executor result( numa_topology_t::emulate( 2 ), 2 );
+		return result;
+	}
+
+	// RFC 6962 Merkle tree hash, split at the largest power of two below the
+	// number of leaves
+	sha256_digest_t rfc6962_root( std::vector<uint8_t> const &data,
+	                              size_t leaf_size, size_t first,
+	                              size_t count ) {
+		sha256_ctx ctx;
+		if( count == 1 ) {
+			auto const offset = first * leaf_size;
+			auto const size = std::min( leaf_size, data.size( ) - offset );
+			uint8_t const prefix = 0x00;
+			ctx.update( &prefix, 1 );
+			ctx.update( data.data( ) + offset, size );
+			return ctx.final( );
+		}
+		size_t split = 1;
+		while( split * 2 < count ) {
+			split *= 2;
+		}
+		auto const left = to_packed_digest(
+		  rfc6962_root( data, leaf_size, first, split ) );
+		auto const right = to_packed_digest(
+		  rfc6962_root( data, leaf_size, first + split, count - split ) );
+		uint8_t const prefix = 0x01;
+		ctx.update( &prefix, 1 );
+		ctx.update( left.data( ), left.size( ) );
+		ctx.update( right.data( ), right.size( ) );
+		return ctx.final( );
+	}
+
+	sha256_digest_t tree_reference( std::vector<uint8_t> const &data,
+	                                size_t leaf_size ) {
+		auto const leaves =
+		  std::max( ( data.size( ) + leaf_size - 1 ) / leaf_size, size_t{1} );
+		return rfc6962_root( data, leaf_size, 0, leaves );
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( sha256_tree_hash_001 ) {
+	auto const data = make_input( ( 5U << 20U ) + 12345U );
+	for( size_t leaf_size : {1024U, 4096U, 3U << 20U} ) {
+		numa_run_stats_t stats{};
+		auto const root = sha256_tree_hash( daw::make_span( data ), leaf_size,
+		                                    test_executor( ), &stats );
+		BOOST_REQUIRE( tree_reference( data, leaf_size ) == root );
+		BOOST_REQUIRE( stats.local + stats.stolen > 1 );
+	}
+	// Every leaf count up to 17 matches the RFC 6962 split
+	auto const small = make_input( 100 );
+	for( size_t leaf_size = 6; leaf_size <= 100; ++leaf_size ) {
+		BOOST_REQUIRE( tree_reference( small, leaf_size ) ==
+		               sha256_tree_hash( daw::make_span( small ), leaf_size,
+		                                 test_executor( ) ) );
+	}
+	// Empty data is one empty leaf, SHA256( 0x00 )
+	std::vector<uint8_t> const empty;
+	uint8_t const zero = 0x00;
+	BOOST_REQUIRE( sha256_ctx::hash( &zero, 1 ) ==
+	               sha256_tree_hash( daw::make_span( empty ), 4096,
+	                                 test_executor( ) ) );
+	// The two leaf digests of a tree, hashed as one leaf, do not give its root
+	auto const pair_root = to_packed_digest(
+	  sha256_tree_hash( daw::make_span( small ), 50, test_executor( ) ) );
+	std::vector<uint8_t> leaf_digests;
+	for( size_t offset : {0U, 50U} ) {
+		std::vector<uint8_t> leaf{0x00};
+		leaf.insert( leaf.end( ), small.begin( ) + offset,
+		             small.begin( ) + offset + 50 );
+		auto const digest =
+		  to_packed_digest( sha256_ctx::hash( leaf.data( ), leaf.size( ) ) );
+		leaf_digests.insert( leaf_digests.end( ), digest.begin( ), digest.end( ) );
+	}
+	BOOST_REQUIRE( pair_root !=
+	               to_packed_digest( sha256_tree_hash(
+	                 daw::make_span( leaf_digests ), 64, test_executor( ) ) ) );
+	BOOST_REQUIRE_THROW( sha256_tree_hash( daw::make_span( small ), 0 ),
+	                     std::invalid_argument );
+}
+
+BOOST_AUTO_TEST_CASE( aes_ctr_parallel_001 ) {
+	// The counter carries into the high bytes within the buffer
+	auto const input = make_input( ( 4U << 20U ) + 77U );
+	std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value> key{};
+	for( size_t n = 0; n < key.size( ); ++n ) {
+		key[n] = static_cast<uint8_t>( n * 3U );
+	}
+	auto const sched = aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	aes::cipher_t iv{};
+	iv.fill( 0xFF );
+	iv[0] = 0x10;
+	std::vector<uint8_t> expected( input.size( ) );
+	aes::aes_ctr_128( sched, iv, daw::make_span( input ),
+	                  daw::make_span( expected ) );
+	std::vector<uint8_t> out( input.size( ) );
+	numa_run_stats_t stats{};
+	aes::aes_ctr_128( sched, iv, daw::make_span( input ), daw::make_span( out ),
+	                  test_executor( ), &stats );
+	BOOST_REQUIRE( out == expected );
+	BOOST_REQUIRE_EQUAL( stats.local + stats.stolen, 5U );
+}
+
+BOOST_AUTO_TEST_CASE( aes_xts_parallel_001 ) {
+	std::array<uint8_t, 2 * aes::impl::AES128_KEY_SIZE::value> key{};
+	for( size_t n = 0; n < key.size( ); ++n ) {
+		key[n] = static_cast<uint8_t>( n + 1U );
+	}
+	aes::aes128_xts_key_t const xts_key( daw::make_span( key ) );
+	// A short last sector uses ciphertext stealing
+	auto const input = make_input( ( 3U << 20U ) + 4096U + 20U );
+	std::vector<uint8_t> expected( input.size( ) );
+	aes::aes_xts_encrypt_128_sectors( xts_key, 42, 4096, daw::make_span( input ),
+	                                  daw::make_span( expected ), 1 );
+	std::vector<uint8_t> out( input.size( ) );
+	aes::aes_xts_encrypt_128_sectors( xts_key, 42, 4096, daw::make_span( input ),
+	                                  daw::make_span( out ), test_executor( ) );
+	BOOST_REQUIRE( out == expected );
+
+	std::vector<uint8_t> plain( input.size( ) );
+	aes::aes_xts_decrypt_128_sectors( xts_key, 42, 4096, daw::make_span( out ),
+	                                  daw::make_span( plain ), test_executor( ) );
+	BOOST_REQUIRE( plain == input );
+
+	BOOST_REQUIRE_THROW( aes::aes_xts_encrypt_128_sectors(
+	                       xts_key, 0, 4096, daw::make_span( input ),
+	                       daw::span<uint8_t>( out.data( ), 16 ),
+	                       test_executor( ) ),
+	                     std::invalid_argument );
+}
@@ -0,0 +1,345 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Hardware event counts for benchmark cases, read with perf_event_open.
+// Counters that the kernel or the host does not provide(perf_event_paranoid,
+// containers, VMs without a virtual PMU) are left out and reported as n/a
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#include <daw/daw_benchmark.h>
+
+#if defined( __linux__ )
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define DAW_CRYPTO_BENCH_HAS_PERF
+#endif
+
+namespace daw {
+	namespace crypto_bench {
+		enum class perf_event_t : size_t {
+			cycles,
+			instructions,
+			l1d_misses,
+			llc_misses,
+			branch_misses
+		};
+		constexpr size_t const perf_event_count = 5;
+
+		inline char const *to_string( perf_event_t event ) noexcept {
+			switch( event ) {
+			case perf_event_t::cycles:
+				return "cycles";
+			case perf_event_t::instructions:
+				return "instructions";
+			case perf_event_t::l1d_misses:
+				return "l1d_misses";
+			case perf_event_t::llc_misses:
+				return "llc_misses";
+			case perf_event_t::branch_misses:
+				return "branch_misses";
+			}
+			return "unknown";
+		}
+
+		/// @brief Event counts, each either counted or absent
+		struct perf_values_t {
+			std::array<double, perf_event_count> values{};
+			std::array<bool, perf_event_count> counted{};
+
+			bool has( perf_event_t event ) const noexcept {
+				return counted[static_cast<size_t>( event )];
+			}
+
+			double get( perf_event_t event ) const noexcept {
+				return values[static_cast<size_t>( event )];
+			}
+
+			void set( perf_event_t event, double value ) noexcept {
+				values[static_cast<size_t>( event )] = value;
+				counted[static_cast<size_t>( event )] = true;
+			}
+
+			bool empty( ) const noexcept {
+				for( auto c : counted ) {
+					if( c ) {
+						return false;
+					}
+				}
+				return true;
+			}
+
+			/// @brief Counts per operation when the counters ran for ops calls
+			perf_values_t per_op( size_t ops ) const noexcept {
+				perf_values_t result = *this;
+				if( ops > 0 ) {
+					for( auto &v : result.values ) {
+						v /= static_cast<double>( ops );
+					}
+				}
+				return result;
+			}
+
+			/// @brief Instructions per cycle, 0 when either was not counted
+			double ipc( ) const noexcept {
+				if( !has( perf_event_t::cycles ) ||
+				    !has( perf_event_t::instructions ) ||
+				    get( perf_event_t::cycles ) <= 0.0 ) {
+					return 0.0;
+				}
+				return get( perf_event_t::instructions ) /
+				       get( perf_event_t::cycles );
+			}
+
+			/// @brief Events per KiB processed, for comparing miss rates across
+			/// sizes
+			double per_kib( perf_event_t event, size_t bytes ) const noexcept {
+				if( bytes == 0 ) {
+					return 0.0;
+				}
+				return get( event ) * 1024.0 / static_cast<double>( bytes );
+			}
+		};
+
+		/// @brief A set of hardware counters for the calling thread and the
+		/// threads it starts while counting.  Each event is opened on its own so
+		/// one unsupported event does not disable the rest; the kernel may then
+		/// multiplex them, and the counts are scaled by the time each one ran
+		class perf_counters_t {
+			std::array<int, perf_event_count> m_fds{};
+			std::string m_error;
+
+#if defined( DAW_CRYPTO_BENCH_HAS_PERF )
+			struct read_format_t {
+				uint64_t value;
+				uint64_t time_enabled;
+				uint64_t time_running;
+			};
+
+			static std::pair<uint32_t, uint64_t>
+			event_config( perf_event_t event ) noexcept {
+				switch( event ) {
+				case perf_event_t::cycles:
+					return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+				case perf_event_t::instructions:
+					return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS};
+				case perf_event_t::l1d_misses:
+					return {PERF_TYPE_HW_CACHE,
+					        PERF_COUNT_HW_CACHE_L1D |
+					          ( PERF_COUNT_HW_CACHE_OP_READ << 8u ) |
+					          ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16u )};
+				case perf_event_t::llc_misses:
+					return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+				case perf_event_t::branch_misses:
+					return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES};
+				}
+				return {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES};
+			}
+
+			static int open_event( perf_event_t event ) noexcept {
+				perf_event_attr attr{};
+				attr.size = sizeof( attr );
+				auto const config = event_config( event );
+				attr.type = config.first;
+				attr.config = config.second;
+				attr.disabled = 1;
+				attr.inherit = 1;
+				// User space only, which perf_event_paranoid=2 still allows
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format =
+				  PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				return static_cast<int>(
+				  syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+			}
+
+			static std::string describe_error( int err ) {
+				std::string result = std::strerror( err );
+				if( err == EACCES || err == EPERM ) {
+					result += ", lower /proc/sys/kernel/perf_event_paranoid";
+				} else if( err == ENOENT || err == EOPNOTSUPP ) {
+					result += ", the host exposes no hardware PMU";
+				}
+				return result;
+			}
+#endif
+
+		public:
+			perf_counters_t( ) {
+				m_fds.fill( -1 );
+#if defined( DAW_CRYPTO_BENCH_HAS_PERF )
+				for( size_t n = 0; n < perf_event_count; ++n ) {
+					m_fds[n] = open_event( static_cast<perf_event_t>( n ) );
+					if( m_fds[n] < 0 && m_error.empty( ) ) {
+						m_error = describe_error( errno );
+					}
+				}
+#else
+				m_error = "perf_event_open is not available on this platform";
+#endif
+			}
+
+			~perf_counters_t( ) {
+#if defined( DAW_CRYPTO_BENCH_HAS_PERF )
+				for( auto fd : m_fds ) {
+					if( fd >= 0 ) {
+						close( fd );
+					}
+				}
+#endif
+			}
+
+			perf_counters_t( perf_counters_t const & ) = delete;
+			perf_counters_t &operator=( perf_counters_t const & ) = delete;
+
+			/// @brief Was at least one event opened
+			bool valid( ) const noexcept {
+				for( auto fd : m_fds ) {
+					if( fd >= 0 ) {
+						return true;
+					}
+				}
+				return false;
+			}
+
+			bool is_open( perf_event_t event ) const noexcept {
+				return m_fds[static_cast<size_t>( event )] >= 0;
+			}
+
+			/// @brief Why the first event that failed could not be opened, empty
+			/// when all of them were
+			std::string const &error( ) const noexcept {
+				return m_error;
+			}
+
+			void start( ) noexcept {
+#if defined( DAW_CRYPTO_BENCH_HAS_PERF )
+				for( auto fd : m_fds ) {
+					if( fd >= 0 ) {
+						ioctl( fd, PERF_EVENT_IOC_RESET, 0 );
+						ioctl( fd, PERF_EVENT_IOC_ENABLE, 0 );
+					}
+				}
+#endif
+			}
+
+			/// @brief Stop counting and return the counts since start( ).  An event
+			/// that never got scheduled is left out
+			perf_values_t stop( ) noexcept {
+				perf_values_t result{};
+#if defined( DAW_CRYPTO_BENCH_HAS_PERF )
+				for( auto fd : m_fds ) {
+					if( fd >= 0 ) {
+						ioctl( fd, PERF_EVENT_IOC_DISABLE, 0 );
+					}
+				}
+				for( size_t n = 0; n < perf_event_count; ++n ) {
+					read_format_t rf{};
+					if( m_fds[n] < 0 ||
+					    read( m_fds[n], &rf, sizeof( rf ) ) !=
+					      static_cast<ssize_t>( sizeof( rf ) ) ||
+					    rf.time_running == 0 ) {
+						continue;
+					}
+					auto value = static_cast<double>( rf.value );
+					if( rf.time_running < rf.time_enabled ) {
+						value *= static_cast<double>( rf.time_enabled ) /
+						         static_cast<double>( rf.time_running );
+					}
+					result.set( static_cast<perf_event_t>( n ), value );
+				}
+#endif
+				return result;
+			}
+		};
+
+		/// @brief One line summary of counts for bytes of input: cycles/byte,
+		/// IPC and misses per KiB, n/a for events that were not counted
+		inline void print_perf_values( std::ostream &os,
+		                               perf_values_t const &values,
+		                               size_t bytes ) {
+			auto const field = [&]( char const *label, bool has, double value ) {
+				os << "  " << label << ' ';
+				if( has ) {
+					os << value;
+				} else {
+					os << "n/a";
+				}
+			};
+			auto const per_kib = [&]( char const *label, perf_event_t event ) {
+				field( label, values.has( event ), values.per_kib( event, bytes ) );
+			};
+			os << std::fixed << std::setprecision( 2 );
+			field( "cyc/B", values.has( perf_event_t::cycles ) && bytes > 0,
+			       bytes > 0 ? values.get( perf_event_t::cycles ) /
+			                     static_cast<double>( bytes )
+			                 : 0.0 );
+			field( "IPC",
+			       values.has( perf_event_t::cycles ) &&
+			         values.has( perf_event_t::instructions ),
+			       values.ipc( ) );
+			per_kib( "L1D miss/KiB", perf_event_t::l1d_misses );
+			per_kib( "LLC miss/KiB", perf_event_t::llc_misses );
+			per_kib( "br miss/KiB", perf_event_t::branch_misses );
+			os << '\n' << std::defaultfloat;
+		}
+
+		/// @brief Run daw::show_benchmark with the counters running around it
+		/// and print their summary below its timing.  Without counters this is
+		/// just show_benchmark
+		template<typename Function>
+		void show_counted_benchmark( perf_counters_t &counters, size_t bytes,
+		                             std::string const &title, Function &&func,
+		                             size_t data_prec = 2, size_t time_prec = 2 ) {
+			if( !counters.valid( ) ) {
+				daw::show_benchmark( bytes, title, std::forward<Function>( func ),
+				                     data_prec, time_prec );
+				return;
+			}
+			counters.start( );
+			daw::show_benchmark( bytes, title, std::forward<Function>( func ),
+			                     data_prec, time_prec );
+			auto const values = counters.stop( );
+			print_perf_values( std::cout, values, bytes );
+		}
+
+		/// @brief Note once, on stderr, that no counters could be opened
+		inline void report_perf_unavailable( perf_counters_t const &counters ) {
+			if( !counters.valid( ) ) {
+				std::cerr << "Hardware counters unavailable(" << counters.error( )
+				          << "), reporting time only\n";
+			}
+		}
+	} // namespace crypto_bench
+} // namespace daw
@@ -0,0 +1,143 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE sha256_chunker_test
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <daw/boost_test.h>
+#include <daw/daw_random.h>
+
+#include "sha256_chunker.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<uint8_t> const &test_data( ) {
+		static auto const data = daw::make_random_data<uint8_t>( 1024 * 1024 );
+		return data;
+	}
+
+	daw::span<uint8_t const> as_span( std::vector<uint8_t> const &v ) {
+		return daw::span<uint8_t const>( v.data( ), v.size( ) );
+	}
+
+	bool same_chunks( std::vector<sha256_chunk_t> const &lhs,
+	                  std::vector<sha256_chunk_t> const &rhs ) {
+		if( lhs.size( ) != rhs.size( ) ) {
+			return false;
+		}
+		for( size_t n = 0; n < lhs.size( ); ++n ) {
+			auto digest = lhs[n].digest;
+			if( lhs[n].offset != rhs[n].offset || lhs[n].size != rhs[n].size ||
+			    !( digest == rhs[n].digest ) ) {
+				return false;
+			}
+		}
+		return true;
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( sha256_chunker_001 ) {
+	auto const &data = test_data( );
+	sha256_chunker_sizes_t const sizes{};
+	auto const chunks = sha256_chunks( as_span( data ), sizes );
+
+	BOOST_REQUIRE( chunks.size( ) > 1 );
+	uint64_t offset = 0;
+	for( size_t n = 0; n < chunks.size( ); ++n ) {
+		auto const &chunk = chunks[n];
+		BOOST_REQUIRE_EQUAL( chunk.offset, offset );
+		BOOST_REQUIRE( chunk.size <= sizes.max_size );
+		if( n + 1 < chunks.size( ) ) {
+			BOOST_REQUIRE( chunk.size >= sizes.min_size );
+		}
+		BOOST_REQUIRE( sha256_bin( data.data( ) + chunk.offset, chunk.size ) ==
+		               chunk.digest );
+		offset += chunk.size;
+	}
+	BOOST_REQUIRE_EQUAL( offset, data.size( ) );
+}
+
+// Cut points must not depend on how the stream is split into updates
+BOOST_AUTO_TEST_CASE( sha256_chunker_002 ) {
+	auto const &data = test_data( );
+	auto const expected = sha256_chunks( as_span( data ) );
+	for( size_t const step : {1U, 63U, 4096U, 10'000U, 100'000U} ) {
+		std::vector<sha256_chunk_t> chunks;
+		auto const add = [&chunks]( sha256_chunk_t const &chunk ) {
+			chunks.push_back( chunk );
+		};
+		sha256_chunker chunker{};
+		for( size_t pos = 0; pos < data.size( ); pos += step ) {
+			auto const len = std::min( step, data.size( ) - pos );
+			chunker.update( daw::span<uint8_t const>( data.data( ) + pos, len ),
+			                add );
+		}
+		chunker.final( add );
+		BOOST_REQUIRE( same_chunks( chunks, expected ) );
+	}
+}
+
+// Inserting bytes near the start only changes the chunks around the edit
+BOOST_AUTO_TEST_CASE( sha256_chunker_003 ) {
+	auto const &data = test_data( );
+	auto edited = data;
+	edited.insert( edited.begin( ) + 100, {1, 2, 3, 4, 5} );
+
+	auto const original = sha256_chunks( as_span( data ) );
+	auto const shifted = sha256_chunks( as_span( edited ) );
+
+	size_t matched = 0;
+	for( auto const &chunk : shifted ) {
+		for( auto const &o : original ) {
+			auto digest = chunk.digest;
+			if( digest == o.digest ) {
+				++matched;
+				break;
+			}
+		}
+	}
+	BOOST_REQUIRE( matched + 3 >= original.size( ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_chunker_004 ) {
+	sha256_chunker chunker{};
+	std::vector<sha256_chunk_t> chunks;
+	chunker.final( [&chunks]( sha256_chunk_t const &chunk ) {
+		chunks.push_back( chunk );
+	} );
+	BOOST_REQUIRE( chunks.empty( ) );
+
+	BOOST_REQUIRE_THROW( sha256_chunker( {1024, 3000, 8192} ),
+	                     std::invalid_argument );
+	BOOST_REQUIRE_THROW( sha256_chunker( {16384, 8192, 65536} ),
+	                     std::invalid_argument );
+	BOOST_REQUIRE_THROW( sha256_chunker( {0, 0, 0} ), std::invalid_argument );
+	std::vector<uint8_t> const data( 1024 );
+	BOOST_REQUIRE_THROW(
+	  sha256_chunks( daw::span<uint8_t const>( data.data( ), data.size( ) ),
+	                 {0, 0, 8192} ),
+	  std::invalid_argument );
+}
@@ -0,0 +1,139 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE sha256_ctx_pool_test
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "sha256_ctx_pool.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::string message_for( size_t n ) {
+		return std::string( 37 + ( n * 13 ) % 200,
+		                    static_cast<char>( 'a' + n % 26 ) );
+	}
+
+	daw::span<unsigned char const> bytes( std::string const &str, size_t pos,
+	                                      size_t count ) {
+		return daw::span<unsigned char const>(
+		  reinterpret_cast<unsigned char const *>( str.data( ) ) + pos, count );
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( sha256_ctx_pool_001 ) {
+	// Many contexts fed in turns, as connections would, each matching a one
+	// shot hash
+	sha256_ctx_pool pool( 64 );
+	std::vector<sha256_ctx *> contexts;
+	std::vector<std::string> messages;
+	for( size_t n = 0; n < 300; ++n ) {
+		contexts.push_back( pool.acquire( ) );
+		messages.push_back( message_for( n ) );
+	}
+	BOOST_REQUIRE_EQUAL( pool.in_use( ), 300U );
+	BOOST_REQUIRE_EQUAL( pool.capacity( ), 320U );
+	BOOST_REQUIRE_EQUAL( pool.bytes_reserved( ), 320U * sizeof( sha256_ctx ) );
+
+	for( size_t pos = 0; pos < 240; pos += 7 ) {
+		for( size_t n = 0; n < contexts.size( ); ++n ) {
+			auto const &msg = messages[n];
+			if( pos < msg.size( ) ) {
+				contexts[n]->update(
+				  bytes( msg, pos, std::min<size_t>( 7, msg.size( ) - pos ) ) );
+			}
+		}
+	}
+	for( size_t n = 0; n < contexts.size( ); ++n ) {
+		BOOST_REQUIRE( contexts[n]->final( ) ==
+		               sha256_bin( messages[n].data( ), messages[n].size( ) ) );
+		pool.release( contexts[n] );
+	}
+	BOOST_REQUIRE_EQUAL( pool.in_use( ), 0U );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_ctx_pool_002 ) {
+	// Released slots are reused, come back freshly constructed and the pool
+	// does not grow
+	sha256_ctx_local_pool pool( 16 );
+	pool.reserve( 40 );
+	auto const capacity = pool.capacity( );
+	BOOST_REQUIRE_GE( capacity, 40U );
+	for( size_t round = 0; round < 10; ++round ) {
+		std::vector<sha256_ctx_local_pool::handle_t> handles;
+		for( size_t n = 0; n < 40; ++n ) {
+			handles.push_back( pool.make( ) );
+			BOOST_REQUIRE( handles.back( )->final( ) == sha256_bin( "" ) );
+			handles.back( )->update( bytes( "junk", 0, 4 ) );
+		}
+	}
+	BOOST_REQUIRE_EQUAL( pool.capacity( ), capacity );
+	BOOST_REQUIRE_EQUAL( pool.in_use( ), 0U );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_ctx_pool_003 ) {
+	sha256_ctx_pool pool( 32 );
+	std::atomic<size_t> bad{0};
+	std::vector<std::thread> threads;
+	for( size_t t = 0; t < 4; ++t ) {
+		threads.emplace_back( [&pool, &bad, t]( ) {
+			for( size_t n = 0; n < 2000; ++n ) {
+				auto ctx = pool.make( );
+				auto const msg = message_for( n + t );
+				ctx->update( bytes( msg, 0, msg.size( ) ) );
+				if( !( ctx->final( ) == sha256_bin( msg.data( ), msg.size( ) ) ) ) {
+					++bad;
+				}
+			}
+		} );
+	}
+	for( auto &th : threads ) {
+		th.join( );
+	}
+	BOOST_REQUIRE_EQUAL( bad.load( ), 0U );
+	BOOST_REQUIRE_EQUAL( pool.in_use( ), 0U );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_ctx_pool_004 ) {
+	// Never used slots are handed out in order, so a reserved slab is only
+	// touched as far as it has been used, and released slots are reused first
+	sha256_ctx_local_pool pool( 16 );
+	pool.reserve( 32 );
+	std::vector<sha256_ctx *> contexts;
+	for( size_t n = 0; n < 20; ++n ) {
+		contexts.push_back( pool.acquire( ) );
+	}
+	for( size_t n = 1; n < 16; ++n ) {
+		BOOST_REQUIRE( contexts[n] == contexts[n - 1] + 1 );
+	}
+	pool.release( contexts[5] );
+	BOOST_REQUIRE( pool.acquire( ) == contexts[5] );
+	BOOST_REQUIRE( pool.acquire( ) == contexts[19] + 1 );
+	BOOST_REQUIRE_EQUAL( pool.capacity( ), 32U );
+}
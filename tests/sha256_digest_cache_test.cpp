@@ -0,0 +1,182 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE sha256_digest_cache_test
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <daw/boost_test.h>
+
+#include "sha256_digest_cache.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::string const cache_file = "sha256_digest_cache_test.bin";
+
+	file_identity_t make_identity( uint64_t inode ) {
+		file_identity_t result{};
+		result.device = 42;
+		result.inode = inode;
+		result.size = inode * 100;
+		result.mtime_ns = 1'500'000'000'000'000'000 + static_cast<int64_t>( inode );
+		result.ctime_ns = result.mtime_ns + 1;
+		return result;
+	}
+
+	sha256_digest_t make_digest( uint64_t inode ) {
+		auto const str = std::to_string( inode );
+		return sha256_bin( str.data( ), str.size( ) );
+	}
+
+	struct remove_cache_file {
+		remove_cache_file( ) {
+			std::remove( cache_file.c_str( ) );
+		}
+		~remove_cache_file( ) {
+			std::remove( cache_file.c_str( ) );
+		}
+	};
+} // namespace
+
+BOOST_AUTO_TEST_CASE( sha256_digest_cache_001 ) {
+	remove_cache_file const cleanup{};
+	{
+		sha256_digest_cache cache( cache_file );
+		BOOST_REQUIRE( cache );
+		BOOST_REQUIRE( cache.writable( ) );
+		for( uint64_t n = 1; n <= 1000; ++n ) {
+			cache.insert( make_identity( n ), make_digest( n ) );
+		}
+		sha256_digest_t digest{};
+		BOOST_REQUIRE( cache.lookup( make_identity( 7 ), digest ) );
+		BOOST_REQUIRE( digest == make_digest( 7 ) );
+	}
+	sha256_digest_cache const cache( cache_file );
+	BOOST_REQUIRE_EQUAL( cache.size( ), 1000U );
+	for( uint64_t n = 1; n <= 1000; ++n ) {
+		sha256_digest_t digest{};
+		BOOST_REQUIRE( cache.lookup( make_identity( n ), digest ) );
+		BOOST_REQUIRE( digest == make_digest( n ) );
+	}
+	sha256_digest_t digest{};
+	BOOST_REQUIRE( !cache.lookup( make_identity( 1001 ), digest ) );
+}
+
+// Any change to the identity is a miss, and the newest record wins
+BOOST_AUTO_TEST_CASE( sha256_digest_cache_002 ) {
+	remove_cache_file const cleanup{};
+	auto changed = make_identity( 5 );
+	changed.mtime_ns += 1;
+	{
+		sha256_digest_cache cache( cache_file );
+		cache.insert( make_identity( 5 ), make_digest( 5 ) );
+		sha256_digest_t digest{};
+		BOOST_REQUIRE( !cache.lookup( changed, digest ) );
+		auto other_ctime = make_identity( 5 );
+		other_ctime.ctime_ns += 1;
+		BOOST_REQUIRE( !cache.lookup( other_ctime, digest ) );
+		cache.insert( changed, make_digest( 6 ) );
+	}
+	sha256_digest_cache const cache( cache_file );
+	sha256_digest_t digest{};
+	BOOST_REQUIRE( !cache.lookup( make_identity( 5 ), digest ) );
+	BOOST_REQUIRE( cache.lookup( changed, digest ) );
+	BOOST_REQUIRE( digest == make_digest( 6 ) );
+}
+
+// A torn record from a crash is ignored and later appends stay readable
+BOOST_AUTO_TEST_CASE( sha256_digest_cache_003 ) {
+	remove_cache_file const cleanup{};
+	{
+		sha256_digest_cache cache( cache_file );
+		cache.insert( make_identity( 1 ), make_digest( 1 ) );
+	}
+	{
+		std::ofstream out( cache_file, std::ios::binary | std::ios::app );
+		std::string const garbage( 37, 'x' );
+		out.write( garbage.data( ), static_cast<std::streamsize>( garbage.size( ) ) );
+	}
+	{
+		sha256_digest_cache cache( cache_file );
+		BOOST_REQUIRE( cache );
+		BOOST_REQUIRE_EQUAL( cache.size( ), 1U );
+		cache.insert( make_identity( 2 ), make_digest( 2 ) );
+	}
+	sha256_digest_cache const cache( cache_file );
+	BOOST_REQUIRE_EQUAL( cache.size( ), 2U );
+	sha256_digest_t digest{};
+	BOOST_REQUIRE( cache.lookup( make_identity( 2 ), digest ) );
+	BOOST_REQUIRE( digest == make_digest( 2 ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_cache_004 ) {
+	remove_cache_file const cleanup{};
+	sha256_digest_cache cache( cache_file );
+	for( int pass = 0; pass < 3; ++pass ) {
+		for( uint64_t n = 1; n <= 100; ++n ) {
+			auto id = make_identity( n );
+			id.mtime_ns += pass;
+			cache.insert( id, make_digest( n + static_cast<uint64_t>( pass ) ) );
+		}
+	}
+	{
+		// A second writer appends while the first still has the file open
+		sha256_digest_cache other( cache_file );
+		other.insert( make_identity( 500 ), make_digest( 500 ) );
+	}
+	BOOST_REQUIRE( cache.compact( ) );
+	BOOST_REQUIRE_EQUAL( cache.record_count( ), 101U );
+	BOOST_REQUIRE_EQUAL( cache.size( ), 101U );
+	sha256_digest_t digest{};
+	auto id = make_identity( 10 );
+	id.mtime_ns += 2;
+	BOOST_REQUIRE( cache.lookup( id, digest ) );
+	BOOST_REQUIRE( digest == make_digest( 12 ) );
+	BOOST_REQUIRE( cache.lookup( make_identity( 500 ), digest ) );
+
+	// Appends after a compaction by someone else go to the new file
+	sha256_digest_cache stale( cache_file );
+	BOOST_REQUIRE( cache.compact( ) );
+	stale.insert( make_identity( 600 ), make_digest( 600 ) );
+	BOOST_REQUIRE( stale.flush( ) );
+	sha256_digest_cache const reread( cache_file );
+	BOOST_REQUIRE( reread.lookup( make_identity( 600 ), digest ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_cache_005 ) {
+	remove_cache_file const cleanup{};
+	{
+		std::ofstream out( cache_file, std::ios::binary );
+		out << "not a digest cache, but long enough to have a header";
+	}
+	sha256_digest_cache const cache( cache_file );
+	BOOST_REQUIRE( !cache );
+
+	file_identity_t id{};
+	BOOST_REQUIRE( file_identity_t::from_path( cache_file.c_str( ), id ) );
+	BOOST_REQUIRE( id.size > 0 );
+	BOOST_REQUIRE( id.inode != 0 );
+}
@@ -0,0 +1,195 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE sha256_digest_store_test
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <daw/boost_test.h>
+
+#include "sha256_digest_store.h"
+
+using namespace daw::crypto;
+
+namespace {
+	std::vector<sha256_digest_t> make_digests( size_t first, size_t last ) {
+		std::vector<sha256_digest_t> result;
+		for( ; first < last; ++first ) {
+			auto const str = std::to_string( first );
+			result.push_back( sha256_bin( str.data( ), str.size( ) ) );
+		}
+		return result;
+	}
+
+	// A uniquely named file in the temporary directory, removed when done,
+	// so parallel runs and read only build directories do not matter
+	struct temp_file_t {
+		std::string path;
+
+		temp_file_t( ) {
+			auto const *dir = std::getenv( "TMPDIR" );
+			path = std::string( dir != nullptr && *dir != '\0' ? dir : "/tmp" ) +
+			       "/sha256_digest_store_test.XXXXXX";
+			int const fd = ::mkstemp( &path[0] );
+			BOOST_REQUIRE( fd >= 0 );
+			::close( fd );
+		}
+
+		~temp_file_t( ) {
+			std::remove( path.c_str( ) );
+		}
+
+		temp_file_t( temp_file_t const & ) = delete;
+		temp_file_t &operator=( temp_file_t const & ) = delete;
+	};
+} // namespace
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_packed_001 ) {
+	auto const digest = sha256_bin( "abc" );
+	auto const packed = to_packed_digest( digest );
+	BOOST_REQUIRE_EQUAL( packed[0], 0xba );
+	BOOST_REQUIRE_EQUAL( packed[1], 0x78 );
+	BOOST_REQUIRE_EQUAL( packed[30], 0x15 );
+	BOOST_REQUIRE_EQUAL( packed[31], 0xad );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_empty_001 ) {
+	sha256_digest_store const store{};
+	BOOST_REQUIRE( store.empty( ) );
+	BOOST_REQUIRE( !store.contains( sha256_bin( "abc" ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_contains_001 ) {
+	auto const members = make_digests( 0, 10'000 );
+	auto const others = make_digests( 10'000, 20'000 );
+	sha256_digest_store const store( members.cbegin( ), members.cend( ) );
+
+	BOOST_REQUIRE_EQUAL( store.size( ), members.size( ) );
+	for( auto const &d : members ) {
+		BOOST_REQUIRE( store.contains( d ) );
+	}
+	for( auto const &d : others ) {
+		BOOST_REQUIRE( !store.contains( d ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_duplicates_001 ) {
+	auto digests = make_digests( 0, 100 );
+	auto const extra = make_digests( 0, 100 );
+	digests.insert( digests.end( ), extra.cbegin( ), extra.cend( ) );
+	sha256_digest_store const store( digests.cbegin( ), digests.cend( ) );
+	BOOST_REQUIRE_EQUAL( store.size( ), 100U );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_batch_001 ) {
+	auto const members = make_digests( 0, 5'000 );
+	sha256_digest_store const store( members.cbegin( ), members.cend( ) );
+
+	std::vector<sha256_packed_digest_t> needles;
+	for( auto const &d : make_digests( 4'000, 6'000 ) ) {
+		needles.push_back( to_packed_digest( d ) );
+	}
+	std::vector<uint8_t> results( needles.size( ) );
+	auto const found =
+	  store.contains( daw::span<sha256_packed_digest_t const>( needles.data( ),
+	                                                         needles.size( ) ),
+	                  daw::span<uint8_t>( results.data( ), results.size( ) ) );
+
+	BOOST_REQUIRE_EQUAL( found, 1'000U );
+	for( size_t n = 0; n < needles.size( ); ++n ) {
+		BOOST_REQUIRE_EQUAL( results[n] != 0, store.contains( needles[n] ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_file_001 ) {
+	auto const members = make_digests( 0, 1'000 );
+	sha256_digest_store const store( members.cbegin( ), members.cend( ) );
+	temp_file_t const file;
+	auto const &file_name = file.path;
+	{
+		std::ofstream out( file_name, std::ios::binary | std::ios::trunc );
+		store.write( out );
+	}
+	{
+		sha256_digest_store_file const mapped( file_name );
+		BOOST_REQUIRE( mapped );
+		auto const view = mapped.view( );
+		BOOST_REQUIRE_EQUAL( view.size( ), store.size( ) );
+		BOOST_REQUIRE_EQUAL( view.prefix_bits( ), store.view( ).prefix_bits( ) );
+		for( auto const &d : members ) {
+			BOOST_REQUIRE( view.contains( d ) );
+		}
+		BOOST_REQUIRE( !view.contains( sha256_bin( "not a member" ) ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_file_002 ) {
+	std::vector<uint8_t> const garbage( 256, 0xFF );
+	auto const view = make_digest_store_view(
+	  daw::span<uint8_t const>( garbage.data( ), garbage.size( ) ) );
+	BOOST_REQUIRE( view.empty( ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_digest_store_file_003 ) {
+	// A corrupt bucket index must not let lookups leave the mapping
+	auto const members = make_digests( 0, 100 );
+	sha256_digest_store const store( members.cbegin( ), members.cend( ) );
+	std::ostringstream out;
+	store.write( out );
+	auto const bytes = out.str( );
+	// Keep the index 8 byte aligned as it would be in a mapped file
+	std::vector<uint64_t> words( ( bytes.size( ) + 7 ) / 8 );
+	auto const view_of = [&]( ) {
+		return make_digest_store_view( daw::span<uint8_t const>(
+		  reinterpret_cast<uint8_t const *>( words.data( ) ), bytes.size( ) ) );
+	};
+	auto const reset = [&]( ) {
+		std::memcpy( words.data( ), bytes.data( ), bytes.size( ) );
+	};
+	// The header is 4 words, the index follows
+	size_t const index = 4;
+	auto const buckets = size_t{1} << store.view( ).prefix_bits( );
+	BOOST_REQUIRE( buckets >= 2 );
+
+	reset( );
+	BOOST_REQUIRE_EQUAL( view_of( ).size( ), members.size( ) );
+
+	words[index] = 1;
+	BOOST_REQUIRE( view_of( ).empty( ) );
+
+	reset( );
+	words[index + 1] = 1'000'000;
+	BOOST_REQUIRE( view_of( ).empty( ) );
+
+	reset( );
+	words[index + buckets / 2] = words[index + buckets / 2 + 1] + 1;
+	BOOST_REQUIRE( view_of( ).empty( ) );
+}
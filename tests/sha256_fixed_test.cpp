@@ -0,0 +1,198 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_MODULE sha256_fixed_test
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <daw/boost_test.h>
+
+#include "sha256_fixed.h"
+
+using namespace daw::crypto;
+
+namespace {
+	template<size_t N>
+	constexpr std::array<uint8_t, N> iota_bytes( ) noexcept {
+		std::array<uint8_t, N> result{};
+		for( size_t n = 0; n < N; ++n ) {
+			result[n] = static_cast<uint8_t>( n );
+		}
+		return result;
+	}
+
+	template<size_t N>
+	daw::span<uint8_t const> as_span( std::array<uint8_t, N> const &a ) {
+		return daw::span<uint8_t const>( a.data( ), a.size( ) );
+	}
+
+	std::vector<sha256_packed_digest_t> make_digests( size_t count ) {
+		std::vector<sha256_packed_digest_t> result;
+		for( size_t n = 0; n < count; ++n ) {
+			auto const str = std::to_string( n );
+			result.push_back(
+			  to_packed_digest( sha256_bin( str.data( ), str.size( ) ) ) );
+		}
+		return result;
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( sha256_fixed_32_001 ) {
+	constexpr auto message = iota_bytes<32>( );
+	BOOST_REQUIRE_EQUAL(
+	  sha256_32( as_span( message ) ).to_hex_string( ),
+	  "630dcd2966c4336691125448bbb25b4ff412a49c732db2c8abc1b8581bd710dd" );
+	BOOST_REQUIRE( sha256_32( as_span( message ) ) ==
+	               sha256_bin( message.data( ), message.size( ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_fixed_64_001 ) {
+	constexpr auto message = iota_bytes<64>( );
+	BOOST_REQUIRE_EQUAL(
+	  sha256_64( as_span( message ) ).to_hex_string( ),
+	  "fdeab9acf3710362bd2658cdc9a29e8f9c757fcf9811603a8c447cd1d9151108" );
+
+	auto const left = sha256_bin( "left" );
+	auto const right = sha256_bin( "right" );
+	std::array<uint8_t, 64> both{};
+	auto const pl = to_packed_digest( left );
+	auto const pr = to_packed_digest( right );
+	std::copy( pl.cbegin( ), pl.cend( ), both.begin( ) );
+	std::copy( pr.cbegin( ), pr.cend( ), both.begin( ) + 32 );
+	BOOST_REQUIRE( sha256_64( left, right ) ==
+	               sha256_bin( both.data( ), both.size( ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_fixed_d_001 ) {
+	daw::string_view const hello = "hello";
+	BOOST_REQUIRE_EQUAL(
+	  sha256d( daw::span<char const>( hello.data( ), hello.size( ) ) )
+	    .to_hex_string( ),
+	  "9595c9df90075148eb06860365df33584b75bff782a510c6cd4883a419833d50" );
+	constexpr auto message = iota_bytes<64>( );
+	BOOST_REQUIRE_EQUAL(
+	  sha256d( as_span( message ) ).to_hex_string( ),
+	  "01c9f464780a1b6af4eb400fe2f2896cfb2169f5a65701439e4c2c4e213903ef" );
+	auto const m32 = iota_bytes<32>( );
+	BOOST_REQUIRE( sha256d( as_span( m32 ) ) ==
+	               sha256_32( sha256_bin( m32.data( ), m32.size( ) ) ) );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_fixed_constexpr_001 ) {
+	constexpr auto message = iota_bytes<64>( );
+	constexpr auto digest =
+	  sha256_64( daw::span<uint8_t const>( message.data( ), message.size( ) ) );
+	static_assert( digest[0] == 0xfdeab9ac, "" );
+	static_assert( digest[7] == 0xd9151108, "" );
+	BOOST_REQUIRE( sha256_bin( message.data( ), message.size( ) ) == digest );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_fixed_batch_001 ) {
+	// Neither 74 digests nor 37 pairs fill whole lane groups so the scalar
+	// tail runs too
+	auto const in = make_digests( 74 );
+	std::vector<sha256_packed_digest_t> out32( in.size( ) );
+	std::vector<sha256_packed_digest_t> outd32( in.size( ) );
+	std::vector<sha256_packed_digest_t> out64( in.size( ) / 2 );
+	std::vector<sha256_packed_digest_t> outd64( in.size( ) / 2 );
+	auto const in_span =
+	  daw::span<sha256_packed_digest_t const>( in.data( ), in.size( ) );
+
+	sha256_32_batch( in_span, daw::span<sha256_packed_digest_t>(
+	                            out32.data( ), out32.size( ) ) );
+	sha256d_32_batch( in_span, daw::span<sha256_packed_digest_t>(
+	                             outd32.data( ), outd32.size( ) ) );
+	sha256_64_batch( in_span, daw::span<sha256_packed_digest_t>(
+	                            out64.data( ), out64.size( ) ) );
+	sha256d_64_batch( in_span, daw::span<sha256_packed_digest_t>(
+	                             outd64.data( ), outd64.size( ) ) );
+
+	for( size_t n = 0; n < in.size( ); ++n ) {
+		auto const digest = sha256_bin( in[n].data( ), in[n].size( ) );
+		BOOST_REQUIRE( out32[n] == to_packed_digest( digest ) );
+		BOOST_REQUIRE( outd32[n] == to_packed_digest( sha256_32( digest ) ) );
+	}
+	for( size_t n = 0; n < out64.size( ); ++n ) {
+		auto const digest = sha256_bin( in[2 * n].data( ), 64 );
+		BOOST_REQUIRE( out64[n] == to_packed_digest( digest ) );
+		BOOST_REQUIRE( outd64[n] == to_packed_digest( sha256_32( digest ) ) );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sha256_fixed_multi_001 ) {
+	auto const data = iota_bytes<255>( );
+	std::vector<daw::span<uint8_t const>> messages;
+	// Lengths on both sides of the padding boundaries with more messages than
+	// lanes so finished lanes are refilled
+	for( size_t len : {0U, 1U, 55U, 56U, 63U, 64U, 65U, 119U, 120U, 128U, 200U,
+	                   255U, 3U, 17U, 100U, 250U, 31U, 32U} ) {
+		messages.emplace_back( data.data( ), len );
+	}
+	std::vector<sha256_digest_t> digests( messages.size( ) );
+	sha256_multi_hash(
+	  daw::span<daw::span<uint8_t const> const>( messages.data( ),
+	                                             messages.size( ) ),
+	  daw::span<sha256_digest_t>( digests.data( ), digests.size( ) ) );
+	for( size_t n = 0; n < messages.size( ); ++n ) {
+		BOOST_REQUIRE( sha256_bin( messages[n].data( ), messages[n].size( ) ) ==
+		               digests[n] );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sha256_fixed_multi_002 ) {
+	// A prefix, of one byte and of nearly a block, is hashed in front of every
+	// message, across the padding boundaries of the combined length
+	auto const data = iota_bytes<255>( );
+	std::vector<daw::span<uint8_t const>> messages;
+	for( size_t len : {0U, 1U, 54U, 55U, 56U, 62U, 63U, 64U, 65U, 118U, 119U,
+	                   127U, 128U, 200U, 255U, 3U, 17U, 31U} ) {
+		messages.emplace_back( data.data( ), len );
+	}
+	auto const prefix_bytes = iota_bytes<63>( );
+	for( size_t prefix_size : {1U, 8U, 63U} ) {
+		std::vector<sha256_digest_t> digests( messages.size( ) );
+		sha256_multi_hash(
+		  daw::span<uint8_t const>( prefix_bytes.data( ), prefix_size ),
+		  daw::span<daw::span<uint8_t const> const>( messages.data( ),
+		                                             messages.size( ) ),
+		  daw::span<sha256_digest_t>( digests.data( ), digests.size( ) ) );
+		for( size_t n = 0; n < messages.size( ); ++n ) {
+			sha256_ctx ctx{};
+			ctx.update( prefix_bytes.data( ), prefix_size );
+			ctx.update( messages[n] );
+			BOOST_REQUIRE( ctx.final( ) == digests[n] );
+		}
+	}
+	// One message takes the single message path
+	sha256_digest_t one{};
+	sha256_multi_hash(
+	  daw::span<uint8_t const>( prefix_bytes.data( ), 1 ),
+	  daw::span<daw::span<uint8_t const> const>( messages.data( ) + 4, 1 ),
+	  daw::span<sha256_digest_t>( &one, 1 ) );
+	sha256_ctx ctx{};
+	ctx.update( prefix_bytes.data( ), 1 );
+	ctx.update( messages[4] );
+	BOOST_REQUIRE( ctx.final( ) == one );
+}
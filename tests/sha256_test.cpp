@@ -26,7 +26,13 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <iterator>
+#include <list>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include <daw/boost_test.h>
 
@@ -152,3 +158,240 @@ BOOST_AUTO_TEST_CASE( sha256_012 ) {
 	    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" ) ==
 	  0 );
 }
+
+BOOST_AUTO_TEST_CASE( sha256_013 ) {
+	std::string const msg{
+	  "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno"
+	  "ijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"};
+	auto const expected = sha256_bin( msg.data( ), msg.size( ) );
+	for( size_t chunk = 1; chunk <= 130; ++chunk ) {
+		sha256_ctx ctx{};
+		for( size_t pos = 0; pos < msg.size( ); pos += chunk ) {
+			auto const len = std::min( chunk, msg.size( ) - pos );
+			ctx.update( reinterpret_cast<unsigned char const *>( msg.data( ) + pos ),
+			            len );
+		}
+		BOOST_REQUIRE( ctx.final( ) == expected );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sha256_014 ) {
+	sha256_ctx ctx{};
+	ctx.update( reinterpret_cast<unsigned char const *>( "abc" ), 3 );
+	ctx.final( );
+	ctx.reset( );
+	ctx.update( reinterpret_cast<unsigned char const *>( "Hello World" ), 11 );
+	BOOST_REQUIRE_EQUAL(
+	  ctx.final( ).to_hex_string( ),
+	  "a591a6d40bf420404a011733cfb7b190d62c65bf0bcda32b57b277d9ad9f146e" );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_015 ) {
+	std::array<uint8_t, 32> const expected = {
+	  0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+	  0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+	  0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+
+	std::array<uint8_t, 32> out{};
+	sha256_ctx ctx{};
+	ctx.update( reinterpret_cast<unsigned char const *>( "abc" ), 3 );
+	ctx.final_into( daw::span<uint8_t>( out.data( ), out.size( ) ) );
+	BOOST_REQUIRE( out == expected );
+
+	std::array<uint8_t, 32> one_shot{};
+	sha256_ctx::hash( daw::span<char const>( "abc", 3 ),
+	                  daw::span<uint8_t>( one_shot.data( ), one_shot.size( ) ) );
+	BOOST_REQUIRE( one_shot == expected );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_016 ) {
+	// Lengths around the one and two padding block boundaries
+	std::string msg;
+	for( size_t len = 0; len < 200; ++len ) {
+		sha256_ctx ctx{};
+		ctx.update( reinterpret_cast<unsigned char const *>( msg.data( ) ),
+		            msg.size( ) );
+		BOOST_REQUIRE(
+		  ctx.final( ) ==
+		  sha256_ctx::hash( daw::span<char const>( msg.data( ), msg.size( ) ) ) );
+		msg.push_back( static_cast<char>( 'a' + ( len % 26 ) ) );
+	}
+	BOOST_REQUIRE_EQUAL(
+	  sha256str( msg.data( ), 55 ),
+	  "595615dbe4f0f407ae397d08b4c2cb870cb9b0e11937416f950c5160acf9c005" );
+	BOOST_REQUIRE_EQUAL(
+	  sha256str( msg.data( ), 56 ),
+	  "784f623b787495078e93ff28a25b581df0584055a7e71d8cd90c454716b92f51" );
+	BOOST_REQUIRE_EQUAL(
+	  sha256str( msg.data( ), 64 ),
+	  "2fcd5a0d60e4c941381fcc4e00a4bf8be422c3ddfafb93c809e8d1e2bfffae8e" );
+	BOOST_REQUIRE_EQUAL(
+	  sha256str( msg.data( ), 119 ),
+	  "faef67da856d6fd9c8d12f9ed0a4fefd3cf0ce085ab43e2907418d457e3c354b" );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_017 ) {
+	using namespace daw::crypto_literals;
+	constexpr auto const compile_time = to_packed_digest( "abc"_sha256_digest );
+	std::string const abc = "abc";
+	auto const run_time = to_packed_digest( sha256_bin( abc.data( ), abc.size( ) ) );
+	BOOST_REQUIRE( compile_time == run_time );
+	BOOST_REQUIRE_EQUAL( run_time[0], 0xba );
+	BOOST_REQUIRE_EQUAL( run_time[3], 0xbf );
+	BOOST_REQUIRE_EQUAL( run_time[31], 0xad );
+
+	sha256_ctx ctx{};
+	ctx.update( reinterpret_cast<unsigned char const *>( abc.data( ) ),
+	            abc.size( ) );
+	BOOST_REQUIRE( ctx.final_packed( ) == run_time );
+}
+
+namespace {
+	// Two pieces joined, as a minimal rope
+	struct rope_t {
+		std::string left;
+		std::string right;
+
+		struct iterator {
+			rope_t const *rope;
+			size_t pos;
+
+			using value_type = char;
+			using difference_type = std::ptrdiff_t;
+			using pointer = char const *;
+			using reference = char const &;
+			using iterator_category = std::forward_iterator_tag;
+
+			char const &operator*( ) const {
+				return pos < rope->left.size( ) ? rope->left[pos]
+				                                : rope->right[pos - rope->left.size( )];
+			}
+			iterator &operator++( ) {
+				++pos;
+				return *this;
+			}
+			bool operator==( iterator const &rhs ) const {
+				return pos == rhs.pos;
+			}
+			bool operator!=( iterator const &rhs ) const {
+				return pos != rhs.pos;
+			}
+		};
+
+		iterator begin( ) const {
+			return {this, 0};
+		}
+		iterator end( ) const {
+			return {this, left.size( ) + right.size( )};
+		}
+	};
+
+	size_t rope_segments = 0;
+} // namespace
+
+namespace daw {
+	namespace crypto {
+		template<>
+		struct segmented_iterator_traits<rope_t::iterator> {
+			static constexpr bool const is_segmented = true;
+
+			template<typename F>
+			static void for_each_segment( rope_t::iterator first,
+			                              rope_t::iterator last, F f ) {
+				auto const split = first.rope->left.size( );
+				if( first.pos < split ) {
+					auto const end = last.pos < split ? last.pos : split;
+					f( first.rope->left.data( ) + first.pos, end - first.pos );
+					++rope_segments;
+					first.pos = end;
+				}
+				if( first.pos < last.pos ) {
+					f( first.rope->right.data( ) + ( first.pos - split ),
+					   last.pos - first.pos );
+					++rope_segments;
+				}
+			}
+		};
+	} // namespace crypto
+} // namespace daw
+
+BOOST_AUTO_TEST_CASE( sha256_018 ) {
+	// Every iterator path must give the same digest as the span path
+	std::string msg;
+	for( size_t n = 0; n < 100'000; ++n ) {
+		msg.push_back( static_cast<char>( ( n * 7u ) ^ ( n >> 5u ) ) );
+	}
+	auto const expected =
+	  sha256_ctx::hash( daw::span<char const>( msg.data( ), msg.size( ) ) );
+
+	auto const hash_range = []( auto first, auto last ) {
+		sha256_ctx ctx{};
+		ctx.update( first, last );
+		return ctx.final( );
+	};
+	std::vector<unsigned char> const vec( msg.begin( ), msg.end( ) );
+	std::deque<char> const deq( msg.begin( ), msg.end( ) );
+	std::list<char> const lst( msg.begin( ), msg.end( ) );
+	std::stringstream ss( msg );
+
+	BOOST_REQUIRE( hash_range( msg.begin( ), msg.end( ) ) == expected );
+	BOOST_REQUIRE( hash_range( vec.begin( ), vec.end( ) ) == expected );
+	BOOST_REQUIRE( hash_range( deq.begin( ), deq.end( ) ) == expected );
+	BOOST_REQUIRE( hash_range( lst.begin( ), lst.end( ) ) == expected );
+	BOOST_REQUIRE( hash_range( std::istreambuf_iterator<char>( ss ),
+	                           std::istreambuf_iterator<char>( ) ) == expected );
+
+	// Partial deque ranges start and end inside blocks
+	for( size_t first : {size_t{0}, size_t{1}, size_t{511}, size_t{513}} ) {
+		for( size_t last : {first, first + 1, first + 1000, deq.size( )} ) {
+			auto const part = sha256_ctx::hash(
+			  daw::span<char const>( msg.data( ) + first, last - first ) );
+			BOOST_REQUIRE( hash_range( deq.begin( ) + first, deq.begin( ) + last ) ==
+			               part );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( sha256_019 ) {
+	// User specialized segmented iterator
+	rope_t const rope{std::string( 1000, 'a' ), std::string( 77, 'b' )};
+	std::string const flat = rope.left + rope.right;
+	sha256_ctx ctx{};
+	ctx.update( rope.begin( ), rope.end( ) );
+	BOOST_REQUIRE( ctx.final( ) == sha256_ctx::hash( daw::span<char const>(
+	                                 flat.data( ), flat.size( ) ) ) );
+	BOOST_REQUIRE_EQUAL( rope_segments, 2U );
+}
+
+BOOST_AUTO_TEST_CASE( sha256_020 ) {
+	// Fragments hash as their concatenation, whatever the boundaries
+	std::string msg;
+	for( size_t n = 0; n < 1000; ++n ) {
+		msg.push_back( static_cast<char>( 'A' + ( n % 53 ) ) );
+	}
+	auto const expected =
+	  sha256_ctx::hash( daw::span<char const>( msg.data( ), msg.size( ) ) );
+	for( size_t const step : {1U, 5U, 63U, 64U, 65U, 200U} ) {
+		std::vector<daw::span<char const>> fragments;
+#if defined( DAW_CRYPTO_HAS_IOVEC )
+		std::vector<::iovec> iov;
+#endif
+		for( size_t pos = 0; pos < msg.size( ); pos += step ) {
+			auto const len = std::min( step, msg.size( ) - pos );
+			fragments.emplace_back( msg.data( ) + pos, len );
+			fragments.emplace_back( msg.data( ) + pos, 0 );
+#if defined( DAW_CRYPTO_HAS_IOVEC )
+			iov.push_back( ::iovec{const_cast<char *>( msg.data( ) ) + pos, len} );
+#endif
+		}
+		sha256_ctx ctx{};
+		ctx.update( daw::span<daw::span<char const> const>( fragments.data( ),
+		                                                    fragments.size( ) ) );
+		BOOST_REQUIRE( ctx.final( ) == expected );
+#if defined( DAW_CRYPTO_HAS_IOVEC )
+		ctx.reset( );
+		ctx.update( iov.data( ), iov.size( ) );
+		BOOST_REQUIRE( ctx.final( ) == expected );
+#endif
+	}
+}
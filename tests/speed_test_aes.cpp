@@ -28,14 +28,29 @@
 #include <daw/daw_utility.h>
 
 #include "aes.h"
+#include "aes_ctr_hmac.h"
+#include "aes_xts.h"
+#include "crypto_buffer.h"
+#include "csprng.h"
+#include "perf_counters.h"
 
 int main( int, char ** ) {
 	using namespace daw::size_literals;
-	auto const test_data = daw::make_random_data<uint8_t>( 50_MB );
-	auto data_view = daw::make_array_view( test_data );
-	std::vector<uint8_t> result;
-	result.resize( 1_GB );
-	auto result_view = daw::make_span( result );
+	using daw::crypto_bench::show_counted_benchmark;
+	daw::crypto_bench::perf_counters_t counters;
+	daw::crypto_bench::report_perf_unavailable( counters );
+	daw::crypto::buffer_options_t options{};
+	options.huge_pages = daw::crypto::huge_pages_t::transparent;
+	auto const test_data = daw::crypto::secure_random_buffer( 50_MB, options );
+	auto data_view = test_data.span( );
+	// The first benchmark only writes the first 50MB, the XTS runs use all of
+	// it.  Every page is faulted in and zeroed up front so no run is timed
+	// taking page faults or reading uninitialized bytes
+	auto result_options = options;
+	result_options.populate = true;
+	result_options.zero = true;
+	daw::crypto::crypto_buffer result( 1_GB, result_options );
+	auto result_view = result.span( );
 
 	constexpr daw::static_array_t<
 	  uint8_t, daw::crypto::aes::impl::AES128_KEY_SIZE::value> const key = {
@@ -44,12 +59,59 @@ int main( int, char ** ) {
 
 	auto key_view = daw::make_array_view( key );
 
-	daw::show_benchmark( data_view.size( ), "speed_test_aes_001",
-	                     [&]( ) {
-		                     daw::crypto::aes::aes_encrypt_128( data_view, key_view,
-		                                                        result_view );
-	                     },
-	                     2, 2 );
+	show_counted_benchmark( counters, data_view.size( ), "speed_test_aes_001",
+	                        [&]( ) {
+		                        daw::crypto::aes::aes_encrypt_128(
+		                          data_view, key_view, result_view );
+	                        },
+	                        2, 2 );
+
+	// XTS over the whole result buffer in 4KiB sectors, in place as a disk
+	// encryption layer would
+	daw::static_array_t<uint8_t,
+	                    2 * daw::crypto::aes::impl::AES128_KEY_SIZE::value>
+	  xts_key_bytes{};
+	for( size_t n = 0; n < xts_key_bytes.size( ); ++n ) {
+		xts_key_bytes[n] = static_cast<uint8_t>( n * 13u + 1u );
+	}
+	daw::crypto::aes::aes128_xts_key_t const xts_key(
+	  daw::make_array_view( xts_key_bytes ) );
+	size_t const sector_size = 4096;
+	for( size_t const threads : {1U, 0U} ) {
+		auto const name = threads == 1 ? "speed_test_aes_xts_1_thread"
+		                               : "speed_test_aes_xts_all_threads";
+		show_counted_benchmark( counters, result_view.size( ), name,
+		                        [&]( ) {
+			                        daw::crypto::aes::aes_xts_encrypt_128_sectors(
+			                          xts_key, 0, sector_size, result_view,
+			                          result_view, threads );
+		                        },
+		                        2, 2 );
+	}
+
+	// Encrypt-then-MAC of the whole buffer as CTR followed by a separate
+	// HMAC pass, and as the tiled single pass
+	daw::crypto::aes::cipher_t const ctr_iv{};
+	auto const ctr_sched =
+	  daw::crypto::aes::impl::aes128_key_schedule( key_view );
+	daw::static_array_t<uint8_t, 32> mac_key{};
+	auto mac_key_view = daw::make_array_view( mac_key );
+	daw::crypto::aes::aes128_ctr_hmac_tag_t tag{};
+	show_counted_benchmark(
+	  counters, result_view.size( ), "speed_test_aes_ctr_hmac_two_pass",
+	  [&]( ) {
+		  daw::crypto::aes::aes_ctr_128( ctr_sched, ctr_iv, result_view,
+		                                 result_view );
+		  tag = daw::crypto::hmac_sha256( mac_key_view, result_view );
+	  },
+	  2, 2 );
+	show_counted_benchmark(
+	  counters, result_view.size( ), "speed_test_aes_ctr_hmac_fused",
+	  [&]( ) {
+		  tag = daw::crypto::aes::aes128_ctr_hmac_seal(
+		    key_view, mac_key_view, ctr_iv, result_view, result_view );
+	  },
+	  2, 2 );
 
 	return EXIT_SUCCESS;
 }
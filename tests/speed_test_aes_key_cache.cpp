@@ -0,0 +1,170 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Key schedule lookups from many threads at once.  The shared cache is
+// compared with expanding the key on every use and with a mutex guarded map
+//
+// speed_test_aes_key_cache [lookups per thread] [max threads]
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "aes_key_cache.h"
+
+namespace {
+	namespace aes = daw::crypto::aes;
+	using key_t = std::array<uint8_t, aes::impl::AES128_KEY_SIZE::value>;
+
+	struct key_store_t {
+		std::vector<key_t> keys;
+
+		explicit key_store_t( size_t count )
+		  : keys( count ) {
+			uint64_t seed = 0x1234'5678'9ABC'DEF0ULL;
+			for( auto &key : keys ) {
+				for( auto &b : key ) {
+					seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+					b = static_cast<uint8_t>( seed >> 56u );
+				}
+			}
+		}
+
+		daw::span<uint8_t const> operator[]( uint64_t key_id ) const {
+			return daw::span<uint8_t const>( keys[key_id].data( ),
+			                                 keys[key_id].size( ) );
+		}
+	};
+
+	class locked_map_t {
+		std::mutex m_mutex;
+		std::unordered_map<uint64_t, aes::aes128_key_schedule_t> m_map;
+
+	public:
+		aes::aes128_key_schedule_t get( uint64_t key_id,
+		                                daw::span<uint8_t const> key ) {
+			std::lock_guard<std::mutex> lock( m_mutex );
+			auto it = m_map.find( key_id );
+			if( it == m_map.end( ) ) {
+				it = m_map.emplace( key_id, aes::impl::aes128_key_schedule( key ) )
+				       .first;
+			}
+			return it->second;
+		}
+	};
+
+	template<typename Lookup>
+	double run_threads( size_t threads, size_t lookups, size_t key_count,
+	                    Lookup lookup ) {
+		// Warm up so the steady state is measured, not the first misses
+		for( uint64_t id = 0; id < key_count; ++id ) {
+			lookup( id );
+		}
+		std::atomic<uint64_t> sink{0};
+		std::atomic<size_t> ready{0};
+		std::atomic<bool> go{false};
+		std::vector<std::thread> workers;
+		for( size_t t = 0; t < threads; ++t ) {
+			workers.emplace_back( [&, t]( ) {
+				uint64_t x = 0x9E37'79B9'7F4A'7C15ULL * ( t + 1 );
+				uint64_t local = 0;
+				++ready;
+				while( !go.load( std::memory_order_acquire ) ) {
+					std::this_thread::yield( );
+				}
+				for( size_t n = 0; n < lookups; ++n ) {
+					x ^= x << 13u;
+					x ^= x >> 7u;
+					x ^= x << 17u;
+					auto const sched = lookup( x % key_count );
+					local += sched[sched.size( ) - 1];
+				}
+				sink += local;
+			} );
+		}
+		while( ready.load( ) != threads ) {
+			std::this_thread::yield( );
+		}
+		auto const start = std::chrono::steady_clock::now( );
+		go.store( true, std::memory_order_release );
+		for( auto &w : workers ) {
+			w.join( );
+		}
+		std::chrono::duration<double> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		return static_cast<double>( threads * lookups ) / elapsed.count( );
+	}
+
+	void show( std::string const &name, size_t threads, double ops_per_sec ) {
+		std::cout << std::left << std::setw( 36 ) << name << std::right
+		          << std::setw( 8 ) << threads << std::setw( 14 ) << std::fixed
+		          << std::setprecision( 2 ) << ( ops_per_sec / 1.0e6 ) << '\n';
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	size_t const lookups =
+	  argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 200'000 );
+	size_t const max_threads = argc > 2 ? std::stoul( argv[2] ) : 8U;
+
+	std::cout << std::left << std::setw( 36 ) << "case" << std::right
+	          << std::setw( 8 ) << "threads" << std::setw( 14 ) << "Mlookup/s"
+	          << '\n';
+	// All keys fit, then four times as many keys as the cache holds
+	for( size_t const key_count : {10'000U, 65'536U} ) {
+		key_store_t const keys( key_count );
+		for( size_t threads = 1; threads <= max_threads; threads *= 2 ) {
+			auto const suffix = "/" + std::to_string( key_count ) + " keys";
+			show( "expand every time" + suffix, threads,
+			      run_threads( threads, lookups, key_count, [&]( uint64_t id ) {
+				      return aes::impl::aes128_key_schedule( keys[id] );
+			      } ) );
+
+			locked_map_t map;
+			show( "mutex map" + suffix, threads,
+			      run_threads( threads, lookups, key_count, [&]( uint64_t id ) {
+				      return map.get( id, keys[id] );
+			      } ) );
+
+			aes::key_schedule_cache cache( 16'384 );
+			show( "key_schedule_cache" + suffix, threads,
+			      run_threads( threads, lookups, key_count, [&]( uint64_t id ) {
+				      return cache.get( id, keys[id] );
+			      } ) );
+			auto const stats = cache.stats( );
+			// Includes the warm up
+			std::cout << "  hit ratio " << std::setprecision( 3 )
+			          << stats.hit_ratio( ) << ", " << stats.evictions
+			          << " evictions\n";
+		}
+	}
+	return EXIT_SUCCESS;
+}
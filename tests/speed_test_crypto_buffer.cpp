@@ -0,0 +1,227 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The cost of getting a large output buffer ready and of the passes over it:
+// a zero filled std::vector against crypto_buffer on the heap, on small pages
+// and on huge pages.  Page faults come from getrusage, data TLB misses from
+// perf_event_open when the host allows it
+//
+// speed_test_crypto_buffer [buffer MB]
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "aes_ctr_hmac.h"
+#include "crypto_buffer.h"
+#include "sha256.h"
+
+namespace {
+	namespace crypto = daw::crypto;
+
+	/// @brief User space data TLB load misses of this thread, if the host
+	/// exposes hardware counters
+	class dtlb_miss_counter_t {
+		int m_fd = -1;
+
+	public:
+		dtlb_miss_counter_t( ) {
+			perf_event_attr attr{};
+			attr.size = sizeof( attr );
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_DTLB |
+			              ( PERF_COUNT_HW_CACHE_OP_READ << 8U ) |
+			              ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16U );
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			m_fd = static_cast<int>(
+			  syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+		}
+
+		~dtlb_miss_counter_t( ) {
+			if( m_fd >= 0 ) {
+				close( m_fd );
+			}
+		}
+
+		dtlb_miss_counter_t( dtlb_miss_counter_t const & ) = delete;
+		dtlb_miss_counter_t &operator=( dtlb_miss_counter_t const & ) = delete;
+
+		bool valid( ) const noexcept {
+			return m_fd >= 0;
+		}
+
+		void start( ) noexcept {
+			if( valid( ) ) {
+				ioctl( m_fd, PERF_EVENT_IOC_RESET, 0 );
+				ioctl( m_fd, PERF_EVENT_IOC_ENABLE, 0 );
+			}
+		}
+
+		uint64_t stop( ) noexcept {
+			uint64_t result = 0;
+			if( valid( ) ) {
+				ioctl( m_fd, PERF_EVENT_IOC_DISABLE, 0 );
+				if( read( m_fd, &result, sizeof( result ) ) != sizeof( result ) ) {
+					result = 0;
+				}
+			}
+			return result;
+		}
+	};
+
+	long minor_faults( ) noexcept {
+		rusage usage{};
+		getrusage( RUSAGE_SELF, &usage );
+		return usage.ru_minflt;
+	}
+
+	struct pass_t {
+		double ms = 0.0;
+		long faults = 0;
+		uint64_t dtlb_misses = 0;
+	};
+
+	template<typename Function>
+	pass_t measure( dtlb_miss_counter_t &dtlb, Function &&f ) {
+		auto const faults = minor_faults( );
+		dtlb.start( );
+		auto const start = std::chrono::steady_clock::now( );
+		f( );
+		std::chrono::duration<double, std::milli> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		pass_t result{};
+		result.dtlb_misses = dtlb.stop( );
+		result.ms = elapsed.count( );
+		result.faults = minor_faults( ) - faults;
+		return result;
+	}
+
+	char const *to_string( crypto::buffer_backing_t backing ) {
+		switch( backing ) {
+		case crypto::buffer_backing_t::heap:
+			return "heap";
+		case crypto::buffer_backing_t::pages:
+			return "pages";
+		case crypto::buffer_backing_t::transparent_huge_pages:
+			return "thp";
+		case crypto::buffer_backing_t::hugetlb:
+			return "hugetlb";
+		default:
+			return "empty";
+		}
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	size_t const size =
+	  ( argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 256 ) ) * 1024 *
+	  1024;
+	dtlb_miss_counter_t dtlb;
+	if( !dtlb.valid( ) ) {
+		std::cout << "No data TLB counter on this host\n";
+	}
+
+	// Each encrypt pass writes the whole buffer from a 1MB source, then the
+	// hash pass reads it back
+	size_t const chunk = 1024 * 1024;
+	std::vector<uint8_t> source( chunk, 0x5A );
+	std::array<uint8_t, crypto::aes::impl::AES128_KEY_SIZE::value> key{};
+	auto const sched =
+	  crypto::aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	crypto::aes::cipher_t const iv{};
+	auto const encrypt = [&]( uint8_t *out ) {
+		for( size_t pos = 0; pos < size; pos += chunk ) {
+			auto const len = std::min( chunk, size - pos );
+			crypto::aes::aes_ctr_128(
+			  sched, iv, daw::span<uint8_t const>( source.data( ), len ),
+			  daw::span<uint8_t>( out + pos, len ) );
+		}
+	};
+	volatile uint32_t sink = 0;
+
+	std::cout << std::left << std::setw( 24 ) << "buffer" << std::setw( 9 )
+	          << "backing" << std::right << std::setw( 14 ) << "stage"
+	          << std::setw( 11 ) << "ms" << std::setw( 10 ) << "faults"
+	          << std::setw( 14 ) << "dTLB misses" << '\n';
+	auto const show = [&]( std::string const &name, char const *backing,
+	                       char const *stage, pass_t const &pass ) {
+		std::cout << std::left << std::setw( 24 ) << name << std::setw( 9 )
+		          << backing << std::right << std::setw( 14 ) << stage
+		          << std::setw( 11 ) << std::fixed << std::setprecision( 1 )
+		          << pass.ms << std::setw( 10 ) << pass.faults << std::setw( 14 );
+		if( dtlb.valid( ) ) {
+			std::cout << pass.dtlb_misses;
+		} else {
+			std::cout << "n/a";
+		}
+		std::cout << '\n';
+	};
+	auto const passes = [&]( std::string const &name, char const *backing,
+	                         pass_t const &allocate, uint8_t *data ) {
+		show( name, backing, "allocate", allocate );
+		show( name, backing, "encrypt 1",
+		      measure( dtlb, [&]( ) { encrypt( data ); } ) );
+		show( name, backing, "encrypt 2",
+		      measure( dtlb, [&]( ) { encrypt( data ); } ) );
+		show( name, backing, "sha256", measure( dtlb, [&]( ) {
+			      sink = crypto::sha256_ctx::hash(
+			        daw::span<uint8_t const>( data, size ) )[0];
+		      } ) );
+	};
+
+	{
+		std::vector<uint8_t> buffer;
+		auto const allocate = measure( dtlb, [&]( ) { buffer.resize( size ); } );
+		passes( "std::vector resize", "heap", allocate, buffer.data( ) );
+	}
+	auto const run = [&]( std::string const &name,
+	                      crypto::buffer_options_t const &options ) {
+		crypto::crypto_buffer buffer;
+		auto const allocate = measure(
+		  dtlb, [&]( ) { buffer = crypto::crypto_buffer( size, options ); } );
+		passes( name, to_string( buffer.backing( ) ), allocate, buffer.data( ) );
+	};
+	crypto::buffer_options_t options{};
+	run( "crypto_buffer 64B", options );
+	options.alignment = 4096;
+	run( "crypto_buffer 4KB", options );
+	options.huge_pages = crypto::huge_pages_t::transparent;
+	run( "crypto_buffer thp", options );
+	options.huge_pages = crypto::huge_pages_t::hugetlb;
+	run( "crypto_buffer hugetlb", options );
+	options.populate = true;
+	run( "crypto_buffer populated", options );
+	return EXIT_SUCCESS;
+}
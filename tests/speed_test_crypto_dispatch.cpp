@@ -0,0 +1,142 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Calibrates the backend dispatch, prints the crossovers found, then times
+// each fixed backend and the tuned routing at a range of message sizes
+//
+// speed_test_crypto_dispatch [bytes per size]
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "crypto_dispatch.h"
+
+namespace {
+	namespace crypto = daw::crypto;
+
+	template<typename Function>
+	double mb_per_sec( size_t bytes, Function &&f ) {
+		auto const start = std::chrono::steady_clock::now( );
+		f( );
+		std::chrono::duration<double> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		return static_cast<double>( bytes ) / elapsed.count( ) / 1.0e6;
+	}
+
+	void show( std::string const &name, size_t size, double rate ) {
+		std::cout << std::left << std::setw( 36 ) << name << std::right
+		          << std::setw( 10 ) << size << std::setw( 12 ) << std::fixed
+		          << std::setprecision( 2 ) << rate << '\n';
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	size_t const total =
+	  argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 64 * 1024 * 1024 );
+
+	auto const start = std::chrono::steady_clock::now( );
+	auto const profile = crypto::calibrate_crypto_profile( );
+	std::chrono::duration<double, std::milli> const calibration =
+	  std::chrono::steady_clock::now( ) - start;
+	std::cout << "host: " << profile.host_key << "\ncalibration: "
+	          << std::setprecision( 1 ) << std::fixed << calibration.count( )
+	          << "ms\n";
+	crypto::crypto_dispatch dispatch( profile );
+	for( auto op : {crypto::crypto_op_t::sha256_multi_hash,
+	                crypto::crypto_op_t::aes128_ctr} ) {
+		std::cout << crypto::to_string( op ) << ':';
+		for( auto const &c : dispatch.crossovers( op ) ) {
+			std::cout << ' ' << crypto::to_string( c.backend ) << " from "
+			          << c.min_size << 'B';
+		}
+		std::cout << '\n';
+	}
+	// The process wide dispatcher should not calibrate again or write a cache
+	setenv( "DAW_CRYPTO_PROFILE", "", 1 );
+	crypto::crypto_dispatch::instance( ).use_profile( profile );
+
+	std::cout << std::left << std::setw( 36 ) << "case" << std::right
+	          << std::setw( 10 ) << "size" << std::setw( 12 ) << "MB/s" << '\n';
+	std::vector<uint8_t> input( total );
+	for( size_t n = 0; n < input.size( ); ++n ) {
+		input[n] = static_cast<uint8_t>( n );
+	}
+	std::vector<uint8_t> output( total );
+	std::array<uint8_t, daw::crypto::aes::impl::AES128_KEY_SIZE::value> key{};
+	auto const sched =
+	  crypto::aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	crypto::aes::cipher_t const iv{};
+
+	for( size_t size : {16U, 64U, 256U, 1024U, 4096U, 65536U} ) {
+		auto const count = total / size;
+		std::vector<daw::span<uint8_t const>> messages;
+		for( size_t n = 0; n < count; ++n ) {
+			messages.emplace_back( input.data( ) + n * size, size );
+		}
+		std::vector<crypto::sha256_digest_t> digests( count );
+		auto const message_span = daw::span<daw::span<uint8_t const> const>(
+		  messages.data( ), messages.size( ) );
+		auto const digest_span =
+		  daw::span<crypto::sha256_digest_t>( digests.data( ), digests.size( ) );
+		for( auto backend :
+		     crypto::crypto_backends( crypto::crypto_op_t::sha256_multi_hash ) ) {
+			show( std::string( "sha256 " ) + crypto::to_string( backend ), size,
+			      mb_per_sec( count * size, [&]( ) {
+				      crypto::sha256_multi_hash( backend, message_span, digest_span );
+			      } ) );
+		}
+		show( "sha256 tuned", size, mb_per_sec( count * size, [&]( ) {
+			      crypto::sha256_multi_hash_tuned( message_span, digest_span );
+		      } ) );
+
+		// The table backend is too slow to run over the whole buffer
+		for( auto backend :
+		     crypto::crypto_backends( crypto::crypto_op_t::aes128_ctr ) ) {
+			auto const messages_run =
+			  backend == crypto::crypto_backend_t::aes_table
+			    ? std::max<size_t>( count / 256, 1 )
+			    : count;
+			show( std::string( "aes128_ctr " ) + crypto::to_string( backend ), size,
+			      mb_per_sec( messages_run * size, [&]( ) {
+				      for( size_t n = 0; n < messages_run; ++n ) {
+					      crypto::aes::aes_ctr_128(
+					        backend, sched, iv, messages[n],
+					        daw::span<uint8_t>( output.data( ) + n * size, size ) );
+				      }
+			      } ) );
+		}
+		show( "aes128_ctr tuned", size, mb_per_sec( count * size, [&]( ) {
+			      for( size_t n = 0; n < count; ++n ) {
+				      crypto::aes::aes_ctr_128_tuned(
+				        sched, iv, messages[n],
+				        daw::span<uint8_t>( output.data( ) + n * size, size ) );
+			      }
+		      } ) );
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// An epoll loop hashing small messages through crypto_job_service, against
+// hashing them inline on the loop thread.  The loop keeps a window of jobs
+// in flight and refills it as completions arrive
+//
+// speed_test_crypto_job_service [jobs] [message size] [max threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "crypto_job_service.h"
+
+namespace {
+	using namespace daw::crypto;
+
+	void show( std::string const &name, size_t jobs, size_t size,
+	           double seconds ) {
+		std::cout << std::left << std::setw( 28 ) << name << std::right
+		          << std::setw( 12 ) << std::fixed << std::setprecision( 0 )
+		          << ( static_cast<double>( jobs ) / seconds ) << std::setw( 12 )
+		          << std::setprecision( 1 )
+		          << ( static_cast<double>( jobs * size ) / seconds / 1.0e6 )
+		          << '\n';
+	}
+
+	double inline_hashing( std::vector<uint8_t> const &message, size_t jobs ) {
+		uint32_t sink = 0;
+		auto const start = std::chrono::steady_clock::now( );
+		for( size_t n = 0; n < jobs; ++n ) {
+			sink += sha256_bin( message.data( ), message.size( ) )[0];
+		}
+		std::chrono::duration<double> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		if( sink == 1 ) {
+			std::cout << ' ';
+		}
+		return elapsed.count( );
+	}
+
+	double service_hashing( std::vector<uint8_t> const &message, size_t jobs,
+	                        size_t threads, size_t window ) {
+		crypto_job_service service( threads );
+		int const epoll_fd = ::epoll_create1( EPOLL_CLOEXEC );
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		::epoll_ctl( epoll_fd, EPOLL_CTL_ADD, service.completion_fd( ), &ev );
+
+		std::deque<sha256_job_t> pool;
+		for( size_t n = 0; n < window; ++n ) {
+			pool.emplace_back(
+			  daw::span<uint8_t const>( message.data( ), message.size( ) ) );
+		}
+		auto const start = std::chrono::steady_clock::now( );
+		size_t submitted = 0;
+		size_t completed = 0;
+		for( auto &job : pool ) {
+			if( submitted < jobs ) {
+				service.submit( job );
+				++submitted;
+			}
+		}
+		while( completed < jobs ) {
+			epoll_event ready{};
+			if( ::epoll_wait( epoll_fd, &ready, 1, -1 ) != 1 ) {
+				continue;
+			}
+			completed += service.poll_completions( [&]( crypto_job_t &job ) {
+				if( submitted < jobs ) {
+					service.submit( job );
+					++submitted;
+				}
+			} );
+		}
+		std::chrono::duration<double> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		::close( epoll_fd );
+		return elapsed.count( );
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	size_t const jobs =
+	  argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 1'000'000 );
+	size_t const size = argc > 2 ? std::stoul( argv[2] ) : 256U;
+	size_t const max_threads =
+	  argc > 3 ? std::stoul( argv[3] )
+	           : std::max( 1U, std::thread::hardware_concurrency( ) );
+	std::vector<uint8_t> const message( size, 0x5A );
+
+	std::cout << jobs << " messages of " << size << " bytes\n";
+	std::cout << std::left << std::setw( 28 ) << "case" << std::right
+	          << std::setw( 12 ) << "jobs/s" << std::setw( 12 ) << "MB/s"
+	          << '\n';
+	show( "inline on the loop thread", jobs, size,
+	      inline_hashing( message, jobs ) );
+	for( size_t threads = 1; threads <= max_threads; threads *= 2 ) {
+		show( "service, " + std::to_string( threads ) + " workers", jobs, size,
+		      service_hashing( message, jobs, threads, 1024 ) );
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Cost of the telemetry hooks next to the operations they wrap.  Each row
+// times the same call with the hooks compiled in, then the hook pair on its
+// own, taking the fastest of several runs so both see the same machine state
+//
+// speed_test_crypto_telemetry [calls per run] [runs]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "aes_ctr_hmac.h"
+#include "crypto_telemetry.h"
+#include "sha256.h"
+
+namespace {
+	namespace crypto = daw::crypto;
+
+	template<typename Function>
+	double fastest_ns_per_call( size_t calls, size_t runs, Function f ) {
+		double best = 0.0;
+		for( size_t r = 0; r < runs; ++r ) {
+			auto const start = std::chrono::steady_clock::now( );
+			for( size_t n = 0; n < calls; ++n ) {
+				f( );
+			}
+			std::chrono::duration<double, std::nano> const elapsed =
+			  std::chrono::steady_clock::now( ) - start;
+			auto const ns = elapsed.count( ) / static_cast<double>( calls );
+			best = r == 0 ? ns : std::min( best, ns );
+		}
+		return best;
+	}
+
+	void show( std::string const &name, double op_ns, double hook_ns ) {
+		std::cout << std::left << std::setw( 24 ) << name << std::right
+		          << std::fixed << std::setprecision( 2 ) << std::setw( 12 )
+		          << op_ns << std::setw( 12 ) << hook_ns << std::setw( 10 )
+		          << ( 100.0 * hook_ns / op_ns ) << '\n';
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	if constexpr( !crypto::telemetry_enabled( ) ) {
+		std::cout << "built without DAW_CRYPTO_TELEMETRY, the hooks are empty\n";
+		return EXIT_SUCCESS;
+	}
+	size_t const calls =
+	  argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 200'000 );
+	size_t const runs = argc > 2 ? std::stoul( argv[2] ) : 7U;
+
+	std::vector<uint8_t> data( 4096 );
+	for( size_t n = 0; n < data.size( ); ++n ) {
+		data[n] = static_cast<uint8_t>( n * 7u );
+	}
+	std::vector<uint8_t> out( data.size( ) );
+	std::array<uint8_t, crypto::aes::impl::AES128_KEY_SIZE::value> const key{};
+	auto const sched =
+	  crypto::aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	uint64_t sink = 0;
+
+	// The default sample period, with one latency sample in 64 calls
+	auto const hook_ns = fastest_ns_per_call( calls, runs, [&]( ) {
+		auto sample = crypto::impl::telemetry_start( );
+		crypto::impl::telemetry_record( crypto::telemetry_op_t::sha256,
+		                                crypto::telemetry_backend_t::scalar, 1,
+		                                data.size( ), sample );
+	} );
+
+	std::cout << std::left << std::setw( 24 ) << "case" << std::right
+	          << std::setw( 12 ) << "op ns" << std::setw( 12 ) << "hook ns"
+	          << std::setw( 10 ) << "hook %" << '\n';
+	for( size_t const size : {16U, 64U, 1024U, 4096U} ) {
+		auto const input = daw::span<uint8_t const>( data.data( ), size );
+		show( "sha256 " + std::to_string( size ),
+		      fastest_ns_per_call( calls, runs,
+		                           [&]( ) {
+			                           sink += crypto::sha256_ctx::hash( input )[0];
+		                           } ),
+		      hook_ns );
+		show( "aes128 ctr " + std::to_string( size ),
+		      fastest_ns_per_call(
+		        calls, runs,
+		        [&]( ) {
+			        crypto::aes::aes_ctr_128(
+			          sched, crypto::aes::cipher_t{}, input,
+			          daw::span<uint8_t>( out.data( ), size ) );
+			        sink += out[0];
+		        } ),
+		      hook_ns );
+	}
+	// Printing the checksum keeps the calls from being optimized out
+	std::cout << "sha256 calls counted "
+	          << crypto::telemetry_snapshot( )
+	               .total( crypto::telemetry_op_t::sha256 )
+	               .calls
+	          << ", checksum " << sink << '\n';
+	return EXIT_SUCCESS;
+}
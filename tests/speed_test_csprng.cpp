@@ -0,0 +1,131 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Nonce sized requests from the per thread generator against a getrandom
+// call per nonce, and bulk output, from several threads
+//
+// speed_test_csprng [nonces per thread] [max threads]
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/random.h>
+
+#include "csprng.h"
+
+namespace {
+	template<typename Work>
+	double run_threads( size_t threads, Work work ) {
+		std::atomic<size_t> ready{0};
+		std::atomic<bool> go{false};
+		std::vector<std::thread> workers;
+		for( size_t t = 0; t < threads; ++t ) {
+			workers.emplace_back( [&]( ) {
+				// Creates the thread's generator before timing starts
+				daw::crypto::thread_csprng( );
+				++ready;
+				while( !go.load( std::memory_order_acquire ) ) {
+					std::this_thread::yield( );
+				}
+				work( );
+			} );
+		}
+		while( ready.load( ) != threads ) {
+			std::this_thread::yield( );
+		}
+		auto const start = std::chrono::steady_clock::now( );
+		go.store( true, std::memory_order_release );
+		for( auto &w : workers ) {
+			w.join( );
+		}
+		std::chrono::duration<double> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		return elapsed.count( );
+	}
+
+	void show( std::string const &name, size_t threads, double per_sec,
+	           char const *unit ) {
+		std::cout << std::left << std::setw( 30 ) << name << std::right
+		          << std::setw( 8 ) << threads << std::setw( 14 ) << std::fixed
+		          << std::setprecision( 2 ) << per_sec << ' ' << unit << '\n';
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	size_t const nonces =
+	  argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 2'000'000 );
+	size_t const max_threads =
+	  argc > 2 ? std::stoul( argv[2] )
+	           : std::max( 1U, std::thread::hardware_concurrency( ) );
+
+	std::cout << std::left << std::setw( 30 ) << "case" << std::right
+	          << std::setw( 8 ) << "threads" << std::setw( 14 ) << "rate"
+	          << '\n';
+	for( size_t threads = 1; threads <= max_threads; threads *= 2 ) {
+		auto const csprng_secs = run_threads( threads, [&]( ) {
+			std::array<uint8_t, 16> nonce{};
+			for( size_t n = 0; n < nonces; ++n ) {
+				daw::crypto::random_bytes(
+				  daw::span<uint8_t>( nonce.data( ), nonce.size( ) ) );
+			}
+		} );
+		show( "16 byte nonce, csprng", threads,
+		      static_cast<double>( threads * nonces ) / csprng_secs / 1.0e6,
+		      "M/s" );
+
+		// Far slower, so fewer calls
+		auto const syscalls = std::max<size_t>( nonces / 20, 1 );
+		auto const getrandom_secs = run_threads( threads, [&]( ) {
+			std::array<uint8_t, 16> nonce{};
+			for( size_t n = 0; n < syscalls; ++n ) {
+				if( ::getrandom( nonce.data( ), nonce.size( ), 0 ) < 0 ) {
+					std::abort( );
+				}
+			}
+		} );
+		show( "16 byte nonce, getrandom", threads,
+		      static_cast<double>( threads * syscalls ) / getrandom_secs / 1.0e6,
+		      "M/s" );
+
+		size_t const bulk_size = 256 * 1024 * 1024;
+		auto const bulk_secs = run_threads( threads, [&]( ) {
+			std::vector<uint8_t> out( 1024 * 1024 );
+			for( size_t n = 0; n < bulk_size; n += out.size( ) ) {
+				daw::crypto::random_bytes(
+				  daw::span<uint8_t>( out.data( ), out.size( ) ) );
+			}
+		} );
+		show( "1MB requests, csprng", threads,
+		      static_cast<double>( threads * bulk_size ) / bulk_secs / 1.0e6,
+		      "MB/s" );
+	}
+	return EXIT_SUCCESS;
+}
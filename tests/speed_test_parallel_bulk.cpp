@@ -0,0 +1,133 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Bulk AES-CTR, XTS and SHA-256 tree hashing of one large buffer on a single
+// thread, on unpinned threads where there is such a path, and on the NUMA
+// placed executor.  Set DAW_CRYPTO_FAKE_NUMA=2 to run the executor over
+// emulated nodes
+//
+// speed_test_parallel_bulk [buffer MB]
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "crypto_buffer.h"
+#include "parallel_bulk.h"
+
+namespace {
+	namespace crypto = daw::crypto;
+
+	template<typename Function>
+	double mb_per_sec( size_t bytes, Function &&f ) {
+		f( );
+		auto const start = std::chrono::steady_clock::now( );
+		f( );
+		std::chrono::duration<double> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		return static_cast<double>( bytes ) / elapsed.count( ) / 1.0e6;
+	}
+
+	void show( std::string const &name, double rate,
+	           crypto::numa_run_stats_t const *stats = nullptr ) {
+		std::cout << std::left << std::setw( 32 ) << name << std::right
+		          << std::setw( 12 ) << std::fixed << std::setprecision( 2 )
+		          << rate;
+		if( stats != nullptr ) {
+			std::cout << "  local " << stats->local << " stolen " << stats->stolen;
+		}
+		std::cout << '\n';
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	size_t const size =
+	  ( argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 512 ) ) * 1024 *
+	  1024;
+	auto &executor = crypto::numa_executor::shared( );
+	std::cout << executor.topology( ).nodes( ) << " node(s)"
+	          << ( executor.topology( ).emulated ? " emulated, " : ", " )
+	          << executor.workers( ) << " workers\n";
+	std::cout << std::left << std::setw( 32 ) << "case" << std::right
+	          << std::setw( 12 ) << "MB/s" << '\n';
+
+	crypto::buffer_options_t options{};
+	options.huge_pages = crypto::huge_pages_t::transparent;
+	crypto::crypto_buffer input( size, options );
+	for( size_t n = 0; n < input.size( ); ++n ) {
+		input[n] = static_cast<uint8_t>( n * 7U );
+	}
+	crypto::crypto_buffer output( size, options );
+	crypto::numa_run_stats_t stats{};
+
+	std::array<uint8_t, crypto::aes::impl::AES128_KEY_SIZE::value> key{};
+	auto const sched =
+	  crypto::aes::impl::aes128_key_schedule( daw::make_span( key ) );
+	crypto::aes::cipher_t const iv{};
+	show( "aes128_ctr 1 thread", mb_per_sec( size, [&]( ) {
+		      crypto::aes::aes_ctr_128( sched, iv, input.span( ),
+		                                output.span( ) );
+	      } ) );
+	show( "aes128_ctr numa executor", mb_per_sec( size, [&]( ) {
+		      crypto::aes::aes_ctr_128( sched, iv, input.span( ),
+		                                output.span( ), executor,
+		                                &stats );
+	      } ),
+	      &stats );
+
+	std::array<uint8_t, 2 * crypto::aes::impl::AES128_KEY_SIZE::value>
+	  xts_key_bytes{};
+	crypto::aes::aes128_xts_key_t const xts_key(
+	  daw::make_span( xts_key_bytes ) );
+	show( "aes128_xts 1 thread", mb_per_sec( size, [&]( ) {
+		      crypto::aes::aes_xts_encrypt_128_sectors(
+		        xts_key, 0, 4096, input.span( ),
+		        output.span( ), 1 );
+	      } ) );
+	show( "aes128_xts unpinned threads", mb_per_sec( size, [&]( ) {
+		      crypto::aes::aes_xts_encrypt_128_sectors(
+		        xts_key, 0, 4096, input.span( ),
+		        output.span( ) );
+	      } ) );
+	show( "aes128_xts numa executor", mb_per_sec( size, [&]( ) {
+		      crypto::aes::aes_xts_encrypt_128_sectors(
+		        xts_key, 0, 4096, input.span( ),
+		        output.span( ), executor, &stats );
+	      } ),
+	      &stats );
+
+	crypto::numa_executor single( crypto::numa_topology_t::emulate( 1 ), 1 );
+	show( "sha256_tree_hash 1 thread", mb_per_sec( size, [&]( ) {
+		      static_cast<void>(
+		        crypto::sha256_tree_hash( input.span( ), 4096, single ) );
+	      } ) );
+	show( "sha256_tree_hash numa executor", mb_per_sec( size, [&]( ) {
+		      static_cast<void>( crypto::sha256_tree_hash( input.span( ), 4096,
+		                                                   executor, &stats ) );
+	      } ),
+	      &stats );
+	return EXIT_SUCCESS;
+}
@@ -20,26 +20,94 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <array>
 #include <cstdint>
 #include <cstdlib>
+#include <string>
 
 #include <daw/daw_benchmark.h>
 #include <daw/daw_size_literals.h>
 #include <daw/daw_utility.h>
 
+#include "crypto_buffer.h"
+#include "csprng.h"
+#include "perf_counters.h"
 #include "sha256.h"
 
+namespace {
+	using daw::crypto_bench::perf_counters_t;
+	using daw::crypto_bench::show_counted_benchmark;
+
+	template<size_t MessageSize>
+	void small_message_benchmarks( perf_counters_t &counters ) {
+		size_t const iterations = 1'000'000;
+		auto const test_data =
+		  daw::crypto::secure_random_buffer( MessageSize * iterations );
+		std::array<uint8_t, 32> out{};
+		// Keeps the optimizer from discarding the digests
+		volatile uint8_t sink = 0;
+		auto const out_view = daw::span<uint8_t>( out.data( ), out.size( ) );
+		auto const prefix = "sha256 " + std::to_string( MessageSize ) + "B ";
+
+		show_counted_benchmark(
+		  counters, test_data.size( ), prefix + "new ctx per message",
+		  [&]( ) {
+			  for( size_t n = 0; n < iterations; ++n ) {
+				  daw::crypto::sha256_ctx ctx{};
+				  ctx.update( test_data.data( ) + ( n * MessageSize ), MessageSize );
+				  sink = static_cast<uint8_t>( ctx.final( )[0] );
+			  }
+		  },
+		  2, 2 );
+
+		daw::crypto::sha256_ctx reused_ctx{};
+		show_counted_benchmark(
+		  counters, test_data.size( ), prefix + "reset( )/final_into",
+		  [&]( ) {
+			  for( size_t n = 0; n < iterations; ++n ) {
+				  reused_ctx.reset( );
+				  reused_ctx.update( test_data.data( ) + ( n * MessageSize ),
+				                     MessageSize );
+				  reused_ctx.final_into( out_view );
+				  sink = out[0];
+			  }
+		  },
+		  2, 2 );
+
+		show_counted_benchmark(
+		  counters, test_data.size( ), prefix + "sha256_ctx::hash",
+		  [&]( ) {
+			  for( size_t n = 0; n < iterations; ++n ) {
+				  daw::crypto::sha256_ctx::hash(
+				    daw::span<uint8_t const>( test_data.data( ) + ( n * MessageSize ),
+				                              MessageSize ),
+				    out_view );
+				  sink = out[0];
+			  }
+		  },
+		  2, 2 );
+	}
+} // namespace
+
 int main( int, char ** ) {
 	using namespace daw::size_literals;
-	auto const test_data = daw::make_random_data<uint8_t>( 1_GB, 0, 255 );
+	perf_counters_t counters;
+	daw::crypto_bench::report_perf_unavailable( counters );
+	small_message_benchmarks<16>( counters );
+	small_message_benchmarks<64>( counters );
+	small_message_benchmarks<1024>( counters );
+
+	daw::crypto::buffer_options_t options{};
+	options.huge_pages = daw::crypto::huge_pages_t::transparent;
+	auto const test_data = daw::crypto::secure_random_buffer( 1_GB, options );
 	auto view = daw::span<uint8_t const>( test_data.data( ), test_data.size( ) );
-	daw::show_benchmark( view.size( ), "test001",
-	                     [&view]( ) {
-		                     daw::crypto::sha256_ctx ctx{};
-		                     ctx.update( view );
-		                     ctx.final( );
-	                     },
-	                     2, 2 );
+	show_counted_benchmark( counters, view.size( ), "test001",
+	                        [&view]( ) {
+		                        daw::crypto::sha256_ctx ctx{};
+		                        ctx.update( view );
+		                        ctx.final( );
+	                        },
+	                        2, 2 );
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,192 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2017-2018 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and / or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Memory per live sha256_ctx and update cost when there are many of them,
+// as with one context per open connection.  Contexts allocated one at a time
+// on the heap, next to other per connection allocations, are compared with
+// the same contexts in a sha256_ctx_pool and with the 192 byte, cache line
+// aligned footprint sha256_ctx had before it was packed
+//
+// speed_test_sha256_ctx_memory [max contexts] [updates]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sha256_ctx_pool.h"
+
+namespace {
+	using daw::crypto::sha256_ctx;
+
+	// Same work as sha256_ctx with the size and alignment of the old layout
+	struct alignas( 64 ) legacy_sized_ctx_t {
+		sha256_ctx ctx;
+		unsigned char padding[192 - sizeof( sha256_ctx )];
+	};
+	static_assert( sizeof( legacy_sized_ctx_t ) == 192 );
+
+	/// @brief Resident set size in bytes, 0 when unknown
+	size_t resident_bytes( ) {
+		std::ifstream statm( "/proc/self/statm" );
+		size_t pages = 0;
+		size_t resident = 0;
+		if( !( statm >> pages >> resident ) ) {
+			return 0;
+		}
+		return resident * 4096;
+	}
+
+	template<typename Alloc>
+	double bytes_per_context( size_t count, Alloc alloc ) {
+		auto const before = resident_bytes( );
+		auto const holder = alloc( count );
+		auto const after = resident_bytes( );
+		if( before == 0 || after < before ) {
+			return 0.0;
+		}
+		return static_cast<double>( after - before ) / static_cast<double>( count );
+	}
+
+	// Each connection also owns other allocations, which is what scatters
+	// individually allocated contexts through the heap
+	struct connection_noise_t {
+		uint32_t seed = 7;
+		std::vector<std::unique_ptr<char[]>> blocks;
+
+		void add( ) {
+			seed = seed * 1103515245u + 12345u;
+			auto const size = 200 + ( seed >> 16u ) % 1800;
+			blocks.emplace_back( new char[size] );
+			blocks.back( )[0] = 0;
+		}
+	};
+
+	/// @brief ns per 64 byte update to a random context
+	template<typename GetCtx>
+	double update_ns( size_t count, size_t updates, GetCtx get_ctx ) {
+		std::array<unsigned char, 64> packet{};
+		uint64_t x = 0x9E37'79B9'7F4A'7C15ULL;
+		auto const start = std::chrono::steady_clock::now( );
+		for( size_t n = 0; n < updates; ++n ) {
+			x ^= x << 13u;
+			x ^= x >> 7u;
+			x ^= x << 17u;
+			packet[0] = static_cast<unsigned char>( n );
+			get_ctx( x % count ).update(
+			  daw::span<unsigned char const>( packet.data( ), packet.size( ) ) );
+		}
+		std::chrono::duration<double, std::nano> const elapsed =
+		  std::chrono::steady_clock::now( ) - start;
+		return elapsed.count( ) / static_cast<double>( updates );
+	}
+
+	void show( std::string const &name, size_t count, double bytes, double ns ) {
+		std::cout << std::left << std::setw( 24 ) << name << std::right
+		          << std::setw( 10 ) << count << std::setw( 14 ) << std::fixed
+		          << std::setprecision( 1 ) << bytes << std::setw( 12 ) << ns
+		          << '\n';
+	}
+} // namespace
+
+int main( int argc, char **argv ) {
+	size_t const max_contexts =
+	  argc > 1 ? std::stoul( argv[1] ) : static_cast<size_t>( 1'000'000 );
+	size_t const updates =
+	  argc > 2 ? std::stoul( argv[2] ) : static_cast<size_t>( 2'000'000 );
+
+	std::cout << "sizeof( sha256_ctx ) " << sizeof( sha256_ctx )
+	          << ", alignof " << alignof( sha256_ctx ) << "\n\n";
+	std::cout << std::left << std::setw( 24 ) << "layout" << std::right
+	          << std::setw( 10 ) << "contexts" << std::setw( 14 ) << "bytes/ctx"
+	          << std::setw( 12 ) << "ns/update" << '\n';
+	for( size_t count = 1024; count <= max_contexts; count *= 8 ) {
+		// Memory, measured before the noise allocations so it is contexts only
+		auto const heap_bytes = bytes_per_context( count, []( size_t c ) {
+			std::vector<std::unique_ptr<sha256_ctx>> v;
+			for( size_t n = 0; n < c; ++n ) {
+				v.emplace_back( new sha256_ctx{} );
+			}
+			return v;
+		} );
+		auto const legacy_bytes = bytes_per_context( count, []( size_t c ) {
+			std::vector<std::unique_ptr<legacy_sized_ctx_t>> v;
+			for( size_t n = 0; n < c; ++n ) {
+				v.emplace_back( new legacy_sized_ctx_t{} );
+			}
+			return v;
+		} );
+		auto const pool_bytes = bytes_per_context( count, []( size_t c ) {
+			auto pool = std::make_unique<daw::crypto::sha256_ctx_local_pool>( );
+			for( size_t n = 0; n < c; ++n ) {
+				pool->acquire( );
+			}
+			return pool;
+		} );
+
+		{
+			std::vector<std::unique_ptr<legacy_sized_ctx_t>> contexts;
+			connection_noise_t noise;
+			for( size_t n = 0; n < count; ++n ) {
+				contexts.emplace_back( new legacy_sized_ctx_t{} );
+				noise.add( );
+			}
+			show( "legacy 192B, heap", count, legacy_bytes,
+			      update_ns( count, updates, [&]( size_t n ) -> sha256_ctx & {
+				      return contexts[n]->ctx;
+			      } ) );
+		}
+		{
+			std::vector<std::unique_ptr<sha256_ctx>> contexts;
+			connection_noise_t noise;
+			for( size_t n = 0; n < count; ++n ) {
+				contexts.emplace_back( new sha256_ctx{} );
+				noise.add( );
+			}
+			show( "packed, heap", count, heap_bytes,
+			      update_ns( count, updates, [&]( size_t n ) -> sha256_ctx & {
+				      return *contexts[n];
+			      } ) );
+		}
+		{
+			daw::crypto::sha256_ctx_local_pool pool;
+			std::vector<sha256_ctx *> contexts;
+			connection_noise_t noise;
+			for( size_t n = 0; n < count; ++n ) {
+				contexts.push_back( pool.acquire( ) );
+				noise.add( );
+			}
+			show( "packed, pool", count, pool_bytes,
+			      update_ns( count, updates, [&]( size_t n ) -> sha256_ctx & {
+				      return *contexts[n];
+			      } ) );
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,34 @@
+# Runs crypto_benchmark built without and with DAW_CRYPTO_TELEMETRY and fails
+# when the instrumented build is slower by more than the compare tolerance.
+# Invoked by the telemetry_overhead target as
+#   cmake -DBENCHMARK=<exe> -DTELEMETRY_BENCHMARK=<exe> -DCOMPARE=<exe>
+#         -DOUTPUT_DIR=<dir> "-DBENCHMARK_ARGS=<args>" "-DCOMPARE_ARGS=<args>"
+#         -P telemetry_overhead.cmake
+
+foreach( var BENCHMARK TELEMETRY_BENCHMARK COMPARE OUTPUT_DIR )
+	if( NOT DEFINED ${var} )
+		message( FATAL_ERROR "telemetry_overhead.cmake: ${var} must be defined" )
+	endif( )
+endforeach( )
+
+separate_arguments( BENCHMARK_ARG_LIST UNIX_COMMAND "${BENCHMARK_ARGS}" )
+separate_arguments( COMPARE_ARG_LIST UNIX_COMMAND "${COMPARE_ARGS}" )
+
+function( run_benchmark exe json )
+	execute_process( COMMAND "${exe}" ${BENCHMARK_ARG_LIST} --quiet --json "${json}"
+	                 RESULT_VARIABLE benchmark_result )
+	if( NOT benchmark_result EQUAL 0 )
+		message( FATAL_ERROR "${exe} failed: ${benchmark_result}" )
+	endif( )
+endfunction( )
+
+set( plain_json "${OUTPUT_DIR}/telemetry_off.json" )
+set( telemetry_json "${OUTPUT_DIR}/telemetry_on.json" )
+run_benchmark( "${BENCHMARK}" "${plain_json}" )
+run_benchmark( "${TELEMETRY_BENCHMARK}" "${telemetry_json}" )
+
+execute_process( COMMAND "${COMPARE}" "${plain_json}" "${telemetry_json}" ${COMPARE_ARG_LIST}
+                 RESULT_VARIABLE compare_result )
+if( NOT compare_result EQUAL 0 )
+	message( FATAL_ERROR "Telemetry overhead exceeds the tolerance" )
+endif( )